@@ -41,12 +41,14 @@ check_include_file(signal.h HAVE_SIGNAL_H)
 check_include_file(stdint.h HAVE_STDINT_H)
 check_include_file(unistd.h HAVE_UNISTD_H)
 check_include_file(pthread.h HAVE_PTHREAD_H)
+check_include_file(sys/eventfd.h HAVE_SYS_EVENTFD_H)
 check_include_file(sys/ioctl.h HAVE_SYS_IOCTL_H)
 check_include_file(sys/param.h HAVE_SYS_PARAM_H)
 check_include_file(sys/resource.h HAVE_SYS_RESOURCE_H)
 check_include_file(sys/socket.h HAVE_SYS_SOCKET_H)
 check_include_file(sys/stat.h HAVE_SYS_STAT_H)
 check_include_file(sys/time.h HAVE_SYS_TIME_H)
+check_include_file(sys/uio.h HAVE_SYS_UIO_H)
 check_include_file(sys/un.h HAVE_SYS_UN_H)
 check_include_file(poll.h HAVE_POLL_H)
 check_include_file(sys/poll.h HAVE_SYS_POLL_H)
@@ -66,6 +68,16 @@ check_cxx_source_compiles(
   "
   HAVE_AF_UNIX_H)
 
+# TUringServer needs provided buffer rings and multishot accept and receive,
+# which older linux/io_uring.h headers (before Linux 6.0) do not have
+check_cxx_source_compiles(
+  "
+  #include <linux/io_uring.h>
+  int main(){struct io_uring_buf_reg reg; struct io_uring_buf buf; (void)reg; (void)buf;
+    return IORING_REGISTER_PBUF_RING + IORING_ACCEPT_MULTISHOT + IORING_RECV_MULTISHOT;}
+  "
+  HAVE_LINUX_IO_URING_H)
+
 
 check_function_exists(gethostbyname HAVE_GETHOSTBYNAME)
 check_function_exists(gethostbyname_r HAVE_GETHOSTBYNAME_R)
@@ -82,6 +94,11 @@ check_cxx_source_compiles(
   STRERROR_R_CHAR_P)
 
 
+# compression libraries for the THeaderTransport transforms
+set(HAVE_ZSTD ${WITH_ZSTD})
+set(HAVE_LZ4 ${WITH_LZ4})
+set(HAVE_SNAPPY ${WITH_SNAPPY})
+
 set(PACKAGE ${PACKAGE_NAME})
 set(PACKAGE_STRING "${PACKAGE_NAME} ${PACKAGE_VERSION}")
 set(VERSION ${thrift_VERSION})
@@ -67,6 +67,16 @@ if(WITH_CPP)
     find_package(ZLIB QUIET)
     CMAKE_DEPENDENT_OPTION(WITH_ZLIB "Build with ZLIB support" ON
                            "ZLIB_FOUND" OFF)
+    # the THeaderTransport compression transforms live in the ZLIB library
+    find_package(Zstd QUIET)
+    CMAKE_DEPENDENT_OPTION(WITH_ZSTD "Build with zstd support" ON
+                           "WITH_ZLIB;Zstd_FOUND" OFF)
+    find_package(LZ4 QUIET)
+    CMAKE_DEPENDENT_OPTION(WITH_LZ4 "Build with lz4 support" ON
+                           "WITH_ZLIB;LZ4_FOUND" OFF)
+    find_package(Snappy QUIET)
+    CMAKE_DEPENDENT_OPTION(WITH_SNAPPY "Build with snappy support" ON
+                           "WITH_ZLIB;Snappy_FOUND" OFF)
     find_package(Libevent QUIET)
     CMAKE_DEPENDENT_OPTION(WITH_LIBEVENT "Build with libevent support" ON
                            "Libevent_FOUND" OFF)
@@ -185,6 +195,9 @@ if (BUILD_CPP)
     message(STATUS "    Build with libevent support:              ${WITH_LIBEVENT}")
     message(STATUS "    Build with Qt5 support:                   ${WITH_QT5}")
     message(STATUS "    Build with ZLIB support:                  ${WITH_ZLIB}")
+    message(STATUS "    Build with zstd support:                  ${WITH_ZSTD}")
+    message(STATUS "    Build with lz4 support:                   ${WITH_LZ4}")
+    message(STATUS "    Build with snappy support:                ${WITH_SNAPPY}")
 endif ()
 message(STATUS)
 message(STATUS "  Build C (GLib) library:                     ${BUILD_C_GLIB}")
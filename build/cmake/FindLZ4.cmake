@@ -0,0 +1,46 @@
+#
+# Licensed to the Apache Software Foundation (ASF) under one
+# or more contributor license agreements. See the NOTICE file
+# distributed with this work for additional information
+# regarding copyright ownership. The ASF licenses this file
+# to you under the Apache License, Version 2.0 (the
+# "License"); you may not use this file except in compliance
+# with the License. You may obtain a copy of the License at
+#
+#   http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing,
+# software distributed under the License is distributed on an
+# "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+# KIND, either express or implied. See the License for the
+# specific language governing permissions and limitations
+# under the License.
+#
+
+# find lz4 (https://lz4.github.io/lz4/), used by the THeaderTransport
+# compression transforms
+
+# Usage:
+# Provide LZ4_ROOT if you need it
+# Result: LZ4_INCLUDE_DIRS, where to find lz4.h
+# Result: LZ4_LIBRARIES, the lz4 library
+# Result: LZ4_FOUND, If false, lz4 was not found
+
+find_path(LZ4_INCLUDE_DIRS lz4.h HINTS ${LZ4_ROOT} PATH_SUFFIXES include)
+find_library(LZ4_LIBRARIES NAMES lz4 HINTS ${LZ4_ROOT} PATH_SUFFIXES lib)
+if (LZ4_INCLUDE_DIRS AND LZ4_LIBRARIES)
+  set(LZ4_FOUND TRUE)
+else ()
+  set(LZ4_FOUND FALSE)
+  if (LZ4_FIND_REQUIRED)
+    message(FATAL_ERROR "Could NOT find lz4")
+  endif ()
+  if (NOT LZ4_FIND_QUIETLY)
+    message(STATUS "lz4 NOT found")
+  endif ()
+endif ()
+
+mark_as_advanced(
+  LZ4_INCLUDE_DIRS
+  LZ4_LIBRARIES
+)
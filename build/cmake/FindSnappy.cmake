@@ -0,0 +1,46 @@
+#
+# Licensed to the Apache Software Foundation (ASF) under one
+# or more contributor license agreements. See the NOTICE file
+# distributed with this work for additional information
+# regarding copyright ownership. The ASF licenses this file
+# to you under the Apache License, Version 2.0 (the
+# "License"); you may not use this file except in compliance
+# with the License. You may obtain a copy of the License at
+#
+#   http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing,
+# software distributed under the License is distributed on an
+# "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+# KIND, either express or implied. See the License for the
+# specific language governing permissions and limitations
+# under the License.
+#
+
+# find snappy (https://google.github.io/snappy/), used by the THeaderTransport
+# compression transforms
+
+# Usage:
+# Provide SNAPPY_ROOT if you need it
+# Result: SNAPPY_INCLUDE_DIRS, where to find snappy-c.h
+# Result: SNAPPY_LIBRARIES, the snappy library
+# Result: Snappy_FOUND, If false, snappy was not found
+
+find_path(SNAPPY_INCLUDE_DIRS snappy-c.h HINTS ${SNAPPY_ROOT} PATH_SUFFIXES include)
+find_library(SNAPPY_LIBRARIES NAMES snappy HINTS ${SNAPPY_ROOT} PATH_SUFFIXES lib)
+if (SNAPPY_INCLUDE_DIRS AND SNAPPY_LIBRARIES)
+  set(Snappy_FOUND TRUE)
+else ()
+  set(Snappy_FOUND FALSE)
+  if (Snappy_FIND_REQUIRED)
+    message(FATAL_ERROR "Could NOT find snappy")
+  endif ()
+  if (NOT Snappy_FIND_QUIETLY)
+    message(STATUS "snappy NOT found")
+  endif ()
+endif ()
+
+mark_as_advanced(
+  SNAPPY_INCLUDE_DIRS
+  SNAPPY_LIBRARIES
+)
@@ -0,0 +1,46 @@
+#
+# Licensed to the Apache Software Foundation (ASF) under one
+# or more contributor license agreements. See the NOTICE file
+# distributed with this work for additional information
+# regarding copyright ownership. The ASF licenses this file
+# to you under the Apache License, Version 2.0 (the
+# "License"); you may not use this file except in compliance
+# with the License. You may obtain a copy of the License at
+#
+#   http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing,
+# software distributed under the License is distributed on an
+# "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+# KIND, either express or implied. See the License for the
+# specific language governing permissions and limitations
+# under the License.
+#
+
+# find zstd (https://facebook.github.io/zstd/), used by the THeaderTransport
+# compression transforms
+
+# Usage:
+# Provide ZSTD_ROOT if you need it
+# Result: ZSTD_INCLUDE_DIRS, where to find zstd.h
+# Result: ZSTD_LIBRARIES, the zstd library
+# Result: Zstd_FOUND, If false, zstd was not found
+
+find_path(ZSTD_INCLUDE_DIRS zstd.h HINTS ${ZSTD_ROOT} PATH_SUFFIXES include)
+find_library(ZSTD_LIBRARIES NAMES zstd HINTS ${ZSTD_ROOT} PATH_SUFFIXES lib)
+if (ZSTD_INCLUDE_DIRS AND ZSTD_LIBRARIES)
+  set(Zstd_FOUND TRUE)
+else ()
+  set(Zstd_FOUND FALSE)
+  if (Zstd_FIND_REQUIRED)
+    message(FATAL_ERROR "Could NOT find zstd")
+  endif ()
+  if (NOT Zstd_FIND_QUIETLY)
+    message(STATUS "zstd NOT found")
+  endif ()
+endif ()
+
+mark_as_advanced(
+  ZSTD_INCLUDE_DIRS
+  ZSTD_LIBRARIES
+)
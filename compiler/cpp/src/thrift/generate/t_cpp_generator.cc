@@ -27,6 +27,7 @@
 #include <iomanip>
 #include <iostream>
 #include <limits>
+#include <set>
 #include <sstream>
 #include <string>
 #include <vector>
@@ -66,6 +67,9 @@ public:
     gen_moveable_ = false;
     gen_no_ostream_operators_ = false;
     gen_no_skeleton_ = false;
+    gen_arena_ = false;
+    gen_zero_copy_binary_ = false;
+    gen_lazy_ = false;
     has_members_ = false;
 
     for( iter = parsed_options.begin(); iter != parsed_options.end(); ++iter) {
@@ -88,6 +92,12 @@ public:
         gen_no_ostream_operators_ = true;
       } else if ( iter->first.compare("no_skeleton") == 0) {
         gen_no_skeleton_ = true;
+      } else if ( iter->first.compare("arena") == 0) {
+        gen_arena_ = true;
+      } else if ( iter->first.compare("zero_copy_binary") == 0) {
+        gen_zero_copy_binary_ = true;
+      } else if ( iter->first.compare("lazy") == 0) {
+        gen_lazy_ = true;
       } else {
         throw "unknown option cpp:" + iter->first;
       }
@@ -120,6 +130,7 @@ public:
   void generate_struct(t_struct* tstruct) override { generate_cpp_struct(tstruct, false); }
   void generate_xception(t_struct* txception) override { generate_cpp_struct(txception, true); }
   void generate_cpp_struct(t_struct* tstruct, bool is_exception);
+  void generate_lazy_field_accessors(std::ostream& out, t_struct* tstruct, t_field* tfield);
 
   void generate_service(t_service* tservice) override;
 
@@ -276,6 +287,65 @@ public:
                && (((t_base_type*)ttype)->get_base() == t_base_type::TYPE_STRING));
   }
 
+  /**
+   * Returns the suffix ("I32", "I64" or "Double") of the bulk read/write*Array()
+   * protocol methods able to transfer all elements of the list in one call, or
+   * an empty string if the elements have to be transferred one at a time.
+   * Only plain std::vector storage of unannotated base types qualifies.
+   */
+  std::string list_array_suffix(t_list* tlist) {
+    if (tlist->has_cpp_name()) {
+      return "";
+    }
+    t_type* etype = get_true_type(tlist->get_elem_type());
+    if (!etype->is_base_type()) {
+      return "";
+    }
+    t_base_type::t_base tbase = ((t_base_type*)etype)->get_base();
+    if (type_name(etype) != base_type_name(tbase)) {
+      return "";  // cpp.type annotation
+    }
+    switch (tbase) {
+    case t_base_type::TYPE_I32:
+      return "I32";
+    case t_base_type::TYPE_I64:
+      return "I64";
+    case t_base_type::TYPE_DOUBLE:
+      return "Double";
+    default:
+      return "";
+    }
+  }
+
+  /**
+   * True if ttype is a binary type represented as a TSlice.
+   */
+  bool is_binary_slice(t_type* ttype) {
+    if (!gen_zero_copy_binary_ || !ttype->is_binary()) {
+      return false;
+    }
+    return ttype->annotations_.find("cpp.type") == ttype->annotations_.end();
+  }
+
+  /**
+   * True if tfield of tstruct is kept encoded until it is first accessed.
+   */
+  bool is_lazy_field(t_struct* tstruct, t_field* tfield) {
+    if (lazy_structs_.count(tstruct) == 0 || is_reference(tfield)) {
+      return false;
+    }
+    t_type* type = get_true_type(tfield->get_type());
+    return type->is_struct() || type->is_container()
+           || (type->is_string() && !is_binary_slice(type));
+  }
+
+  /**
+   * Returns the allocator type used for containers of elem in arena mode.
+   */
+  std::string arena_allocator_name(const std::string& elem) {
+    return "::apache::thrift::TArenaAllocator<" + elem + " > ";
+  }
+
   void set_use_include_prefix(bool use_include_prefix) { use_include_prefix_ = use_include_prefix; }
 
   /**
@@ -342,6 +412,27 @@ private:
    */
   bool gen_moveable_;
 
+  /**
+   * True if containers should allocate from the current TArena.
+   */
+  bool gen_arena_;
+
+  /**
+   * True if binary fields should be TSlices sharing the receive buffer.
+   */
+  bool gen_zero_copy_binary_;
+
+  /**
+   * True if struct, container and string fields of user structs should be
+   * decoded on first access rather than when the struct is read.
+   */
+  bool gen_lazy_;
+
+  /**
+   * The structs generated with lazy fields.
+   */
+  std::set<t_struct*> lazy_structs_;
+
   /**
    * True if we should generate ostream definitions
    */
@@ -450,6 +541,12 @@ void t_cpp_generator::init_generator() {
            << "#include <thrift/protocol/TProtocol.h>" << '\n'
            << "#include <thrift/transport/TTransport.h>" << '\n'
            << '\n';
+  if (gen_arena_) {
+    f_types_ << "#include <thrift/TArena.h>" << '\n' << '\n';
+  }
+  if (gen_lazy_) {
+    f_types_ << "#include <thrift/protocol/TEncodedValue.h>" << '\n' << '\n';
+  }
   // Include C++xx compatibility header
   f_types_ << "#include <functional>" << '\n';
   f_types_ << "#include <memory>" << '\n';
@@ -914,6 +1011,9 @@ void t_cpp_generator::generate_forward_declaration(t_struct* tstruct) {
  * @param tstruct The struct definition
  */
 void t_cpp_generator::generate_cpp_struct(t_struct* tstruct, bool is_exception) {
+  if (gen_lazy_ && !is_exception) {
+    lazy_structs_.insert(tstruct);
+  }
   generate_struct_declaration(f_types_, tstruct, is_exception, false, true, true, true, true);
   generate_struct_definition(f_types_impl_, f_types_impl_, tstruct, true, true, false);
 
@@ -944,6 +1044,50 @@ void t_cpp_generator::generate_cpp_struct(t_struct* tstruct, bool is_exception)
   has_members_ = true;
 }
 
+/**
+ * Generates the accessors of a lazy field, which decode the field the first
+ * time it is used. Reading the field keeps its encoded bytes for write(),
+ * mutable_<field>() marks it modified and drops them.
+ */
+void t_cpp_generator::generate_lazy_field_accessors(std::ostream& out,
+                                                    t_struct* tstruct,
+                                                    t_field* tfield) {
+  string name = tfield->get_name();
+  string type = type_name(tfield->get_type());
+
+  out << '\n' << indent() << "const " << type << "& " << tstruct->get_name() << "::get_" << name
+      << "() const {" << '\n';
+  indent_up();
+  out << indent() << "if (__encoded_" << name << ".isPending()) {" << '\n' << indent()
+      << "  __decode_" << name << "();" << '\n' << indent() << "}" << '\n' << indent() << "return "
+      << name << ";" << '\n';
+  indent_down();
+  out << indent() << "}" << '\n';
+
+  out << '\n' << indent() << type << "& " << tstruct->get_name() << "::mutable_" << name << "() {"
+      << '\n';
+  indent_up();
+  out << indent() << "if (__encoded_" << name << ".isPending()) {" << '\n' << indent()
+      << "  __decode_" << name << "();" << '\n' << indent() << "}" << '\n' << indent()
+      << "__encoded_" << name << ".clear();" << '\n' << indent() << "return " << name << ";"
+      << '\n';
+  indent_down();
+  out << indent() << "}" << '\n';
+
+  out << '\n' << indent() << "void " << tstruct->get_name() << "::__decode_" << name
+      << "() const {" << '\n';
+  indent_up();
+  out << indent() << "std::shared_ptr< ::apache::thrift::protocol::TProtocol> decoder = __encoded_"
+      << name << ".getDecoder();" << '\n' << indent()
+      << "::apache::thrift::protocol::TProtocol* iprot = decoder.get();" << '\n' << indent()
+      << "uint32_t xfer = 0;" << '\n';
+  generate_deserialize_field(out, tfield, "this->");
+  out << indent() << "(void)xfer;" << '\n' << indent() << "__encoded_" << name
+      << ".setDecoded();" << '\n';
+  indent_down();
+  out << indent() << "}" << '\n';
+}
+
 void t_cpp_generator::generate_equality_operator(std::ostream& out, t_struct* tstruct) {
   // Get members
   vector<t_field*>::const_iterator m_iter;
@@ -954,16 +1098,21 @@ void t_cpp_generator::generate_equality_operator(std::ostream& out, t_struct* ts
       << (members.size() > 0 ? "rhs" : "/* rhs */") << ") const" << '\n';
   scope_up(out);
   for (m_iter = members.begin(); m_iter != members.end(); ++m_iter) {
+    // lazy fields are compared decoded
+    string value = (*m_iter)->get_name();
+    if (is_lazy_field(tstruct, *m_iter)) {
+      value = "get_" + value + "()";
+    }
     // Most existing Thrift code does not use isset or optional/required,
     // so we treat "default" fields as required.
     if ((*m_iter)->get_req() != t_field::T_OPTIONAL) {
-      out << indent() << "if (!(" << (*m_iter)->get_name() << " == rhs."
-          << (*m_iter)->get_name() << "))" << '\n' << indent() << "  return false;" << '\n';
+      out << indent() << "if (!(" << value << " == rhs."
+          << value << "))" << '\n' << indent() << "  return false;" << '\n';
     } else {
       out << indent() << "if (__isset." << (*m_iter)->get_name() << " != rhs.__isset."
           << (*m_iter)->get_name() << ")" << '\n' << indent() << "  return false;" << '\n'
           << indent() << "else if (__isset." << (*m_iter)->get_name() << " && !("
-          << (*m_iter)->get_name() << " == rhs." << (*m_iter)->get_name() << "))" << '\n'
+          << value << " == rhs." << value << "))" << '\n'
           << indent() << "  return false;" << '\n';
     }
   }
@@ -1107,27 +1256,58 @@ void t_cpp_generator::generate_constructor_helper(ostream& out,
   out << tmp_name << ") ";
   if(is_move || is_struct_storage_not_throwing(tstruct))
     out << "noexcept ";
-  if (is_exception)
-    out << ": TException() ";
-  out << "{" << '\n';
-  indent_up();
 
   const vector<t_field*>& members = tstruct->get_members();
+  vector<t_field*>::const_iterator f_iter;
+
+  // In arena mode containers are copy constructed rather than assigned, so
+  // that the copy gets its own allocator instead of the current arena.
+  std::set<t_field*> initialized;
+  if (gen_arena_ && !is_move) {
+    for (f_iter = members.begin(); f_iter != members.end(); ++f_iter) {
+      if (!is_reference(*f_iter) && get_true_type((*f_iter)->get_type())->is_container()) {
+        initialized.insert(*f_iter);
+      }
+    }
+  }
+
+  const char* separator = ": ";
+  if (is_exception) {
+    out << separator << "TException()";
+    separator = ", ";
+  }
+  for (f_iter = members.begin(); f_iter != members.end(); ++f_iter) {
+    if (initialized.count(*f_iter) != 0) {
+      out << separator << (*f_iter)->get_name() << "(" << tmp_name << "."
+          << (*f_iter)->get_name() << ")";
+      separator = ", ";
+    }
+  }
+  if (is_exception || !initialized.empty())
+    out << " ";
+  out << "{" << '\n';
+  indent_up();
 
   // eliminate compiler unused warning
   if (members.empty())
     indent(out) << "(void) " << tmp_name << ";" << '\n';
 
-  vector<t_field*>::const_iterator f_iter;
   bool has_nonrequired_fields = false;
   for (f_iter = members.begin(); f_iter != members.end(); ++f_iter) {
     if ((*f_iter)->get_req() != t_field::T_REQUIRED)
       has_nonrequired_fields = true;
-    indent(out) << (*f_iter)->get_name() << " = "
-                << maybeMove(
-                    tmp_name + "." + (*f_iter)->get_name(),
-                    is_move && is_complex_type((*f_iter)->get_type()))
-                << ";" << '\n';
+    if (initialized.count(*f_iter) == 0) {
+      indent(out) << (*f_iter)->get_name() << " = "
+                  << maybeMove(
+                      tmp_name + "." + (*f_iter)->get_name(),
+                      is_move && is_complex_type((*f_iter)->get_type()))
+                  << ";" << '\n';
+    }
+    if (is_lazy_field(tstruct, *f_iter)) {
+      indent(out) << "__encoded_" << (*f_iter)->get_name() << " = "
+                  << maybeMove(tmp_name + ".__encoded_" + (*f_iter)->get_name(), is_move) << ";"
+                  << '\n';
+    }
   }
 
   if (has_nonrequired_fields) {
@@ -1178,6 +1358,11 @@ void t_cpp_generator::generate_assignment_helper(ostream& out, t_struct* tstruct
                     tmp_name + "." + (*f_iter)->get_name(),
                     is_move && is_complex_type((*f_iter)->get_type()))
                 << ";" << '\n';
+    if (is_lazy_field(tstruct, *f_iter)) {
+      indent(out) << "__encoded_" << (*f_iter)->get_name() << " = "
+                  << maybeMove(tmp_name + ".__encoded_" + (*f_iter)->get_name(), is_move) << ";"
+                  << '\n';
+    }
   }
   if (has_nonrequired_fields) {
     indent(out) << "__isset = " << maybeMove(tmp_name + ".__isset", false) << ";" << '\n';
@@ -1299,20 +1484,47 @@ void t_cpp_generator::generate_struct_declaration(ostream& out,
     out << '\n' << indent() << "virtual ~" << tstruct->get_name() << "() noexcept;" << '\n';
   }
 
-  // Declare all fields
+  // Declare all fields. Lazy fields are decoded by const getters, and are
+  // private so that they cannot be changed without dropping their bytes.
+  bool in_private = false;
   for (m_iter = members.begin(); m_iter != members.end(); ++m_iter) {
+    bool lazy = is_lazy_field(tstruct, *m_iter);
+    if (lazy != in_private) {
+      indent_down();
+      indent(out) << (lazy ? " private:" : " public:") << '\n';
+      indent_up();
+      in_private = lazy;
+    }
     generate_java_doc(out, *m_iter);
-    indent(out) << declare_field(*m_iter,
+    indent(out) << (lazy ? "mutable " : "") << declare_field(*m_iter,
                                  false,
                                  (pointers && !(*m_iter)->get_type()->is_xception()),
                                  !read) << '\n';
   }
+  if (in_private) {
+    indent_down();
+    indent(out) << " public:" << '\n';
+    indent_up();
+  }
 
   // Add the __isset data member if we need it, using the definition from above
   if (has_nonrequired_fields && (!pointers || read)) {
     out << '\n' << indent() << "_" << tstruct->get_name() << "__isset __isset;" << '\n';
   }
 
+  // The bytes lazy fields were read from, empty once a field is modified
+  bool has_lazy_fields = false;
+  for (m_iter = members.begin(); m_iter != members.end(); ++m_iter) {
+    if (is_lazy_field(tstruct, *m_iter)) {
+      if (!has_lazy_fields) {
+        out << '\n';
+        has_lazy_fields = true;
+      }
+      indent(out) << "mutable ::apache::thrift::protocol::TEncodedValue __encoded_"
+                  << (*m_iter)->get_name() << ";" << '\n';
+    }
+  }
+
   // Create a setter function for each field
   for (m_iter = members.begin(); m_iter != members.end(); ++m_iter) {
     if (pointers) {
@@ -1328,6 +1540,27 @@ void t_cpp_generator::generate_struct_declaration(ostream& out,
       out << " val);" << '\n';
     }
   }
+
+  // Accessors that decode lazy fields on first use, the only way to get at
+  // the private fields. Modifying them drops the bytes they were read from.
+  if (has_lazy_fields) {
+    out << '\n' << indent() << "// get_<field>() decodes the field on first use, so unlike other"
+        << '\n' << indent() << "// const members it modifies the struct: threads sharing a struct"
+        << '\n' << indent() << "// must synchronize calls to it, or decode every field first.";
+  }
+  for (m_iter = members.begin(); m_iter != members.end(); ++m_iter) {
+    if (!is_lazy_field(tstruct, *m_iter)) {
+      continue;
+    }
+    string type = type_name((*m_iter)->get_type());
+    out << '\n' << indent() << "const " << type << "& get_" << (*m_iter)->get_name() << "() const;"
+        << '\n' << indent() << type << "& mutable_" << (*m_iter)->get_name() << "();" << '\n'
+        << indent() << "void __decode_" << (*m_iter)->get_name() << "() const;" << '\n';
+  }
+  if (has_lazy_fields && swap) {
+    out << '\n' << indent() << "friend void swap(" << tstruct->get_name() << "&, "
+        << tstruct->get_name() << "&);" << '\n';
+  }
   out << '\n';
 
   if (!pointers) {
@@ -1451,6 +1684,9 @@ void t_cpp_generator::generate_struct_definition(ostream& out,
       }
       indent_up();
       out << indent() << "this->" << (*m_iter)->get_name() << " = val;" << '\n';
+      if (is_lazy_field(tstruct, *m_iter)) {
+        out << indent() << "this->__encoded_" << (*m_iter)->get_name() << ".clear();" << '\n';
+      }
       indent_down();
 
       // assume all fields are required except optional fields.
@@ -1462,6 +1698,11 @@ void t_cpp_generator::generate_struct_definition(ostream& out,
       out << indent() << "}" << '\n';
     }
   }
+  for (m_iter = members.begin(); m_iter != members.end(); ++m_iter) {
+    if (is_lazy_field(tstruct, *m_iter)) {
+      generate_lazy_field_accessors(out, tstruct, *m_iter);
+    }
+  }
   if (is_user_struct) {
     generate_struct_ostream_operator(out, tstruct);
   }
@@ -1548,6 +1789,17 @@ void t_cpp_generator::generate_struct_reader(ostream& out, t_struct* tstruct, bo
 
       if (pointers && !(*f_iter)->get_type()->is_xception()) {
         generate_deserialize_field(out, *f_iter, "(*(this->", "))");
+      } else if (is_lazy_field(tstruct, *f_iter)) {
+        // keep the value encoded if the protocol can capture it
+        string encoded = tmp("_encoded");
+        out << indent() << "uint32_t " << encoded << " = this->__encoded_"
+            << (*f_iter)->get_name() << ".read(iprot, ftype);" << '\n' << indent() << "if ("
+            << encoded << ") {" << '\n' << indent() << "  xfer += " << encoded << ";" << '\n'
+            << indent() << "} else {" << '\n';
+        indent_up();
+        generate_deserialize_field(out, *f_iter, "this->");
+        indent_down();
+        out << indent() << "}" << '\n';
       } else {
         generate_deserialize_field(out, *f_iter, "this->");
       }
@@ -1633,6 +1885,16 @@ void t_cpp_generator::generate_struct_writer(ostream& out, t_struct* tstruct, bo
     // Write field contents
     if (pointers && !(*f_iter)->get_type()->is_xception()) {
       generate_serialize_field(out, *f_iter, "(*(this->", "))");
+    } else if (is_lazy_field(tstruct, *f_iter)) {
+      // a field that was not modified is written as it was read
+      out << indent() << "if (this->__encoded_" << (*f_iter)->get_name() << ".canWrite(oprot)) {"
+          << '\n' << indent() << "  xfer += this->__encoded_" << (*f_iter)->get_name()
+          << ".write(oprot);" << '\n' << indent() << "} else {" << '\n';
+      indent_up();
+      out << indent() << "this->get_" << (*f_iter)->get_name() << "();" << '\n';
+      generate_serialize_field(out, *f_iter, "this->");
+      indent_down();
+      out << indent() << "}" << '\n';
     } else {
       generate_serialize_field(out, *f_iter, "this->");
     }
@@ -1757,6 +2019,15 @@ void t_cpp_generator::generate_struct_swap(ostream& out, t_struct* tstruct) {
       out << indent() << "swap(a." << tfield->get_name() << ", b." << tfield->get_name() << ");"
           << '\n';
     }
+    if (is_lazy_field(tstruct, tfield)) {
+      if (tstruct->get_name() == "a" || tstruct->get_name() == "b") {
+        out << indent() << "swap(a1.__encoded_" << tfield->get_name() << ", a2.__encoded_"
+            << tfield->get_name() << ");" << '\n';
+      } else {
+        out << indent() << "swap(a.__encoded_" << tfield->get_name() << ", b.__encoded_"
+            << tfield->get_name() << ");" << '\n';
+      }
+    }
   }
 
   if (has_nonrequired_fields) {
@@ -1880,6 +2151,11 @@ void t_cpp_generator::generate_struct_print_method(std::ostream& out, t_struct*
   indent_up();
 
   out << indent() << "using ::apache::thrift::to_string;" << '\n';
+  for (auto tfield : tstruct->get_members()) {
+    if (is_lazy_field(tstruct, tfield)) {
+      out << indent() << "get_" << tfield->get_name() << "();" << '\n';
+    }
+  }
   out << indent() << "out << \"" << tstruct->get_name() << "(\";" << '\n';
   struct_ostream_operator_generator::generate_fields(out, tstruct->get_members(), indent());
   out << indent() << "out << \")\";" << '\n';
@@ -3583,7 +3859,19 @@ void t_cpp_generator::generate_process_function(t_service* tservice,
         << "this->eventHandler_.get(), ctx, " << service_func_name << ");" << '\n' << '\n'
         << indent() << "if (this->eventHandler_.get() != nullptr) {" << '\n' << indent()
         << "  this->eventHandler_->preRead(ctx, " << service_func_name << ");" << '\n' << indent()
-        << "}" << '\n' << '\n' << indent() << argsname << " args;" << '\n' << indent()
+        << "}" << '\n' << '\n';
+
+    // Arguments are read into the thread's arena, which is reset once they
+    // have been destroyed at the end of the call
+    if (gen_arena_) {
+      out << indent() << "// Containers read into args live in the thread's arena until this"
+          << '\n' << indent() << "// call returns. Handlers must copy, not move or swap, them into"
+          << '\n' << indent() << "// state that outlives the call."
+          << '\n' << indent() << "::apache::thrift::TArenaScope arenaScope("
+          << "::apache::thrift::TArena::threadArena());" << '\n';
+    }
+
+    out << indent() << argsname << " args;" << '\n' << indent()
         << "args.read(iprot);" << '\n' << indent() << "iprot->readMessageEnd();" << '\n' << indent()
         << "uint32_t bytes = iprot->getTransport()->readEnd();" << '\n' << '\n' << indent()
         << "if (this->eventHandler_.get() != nullptr) {" << '\n' << indent()
@@ -4047,7 +4335,9 @@ void t_cpp_generator::generate_deserialize_field(ostream& out,
       out << "readUUID(" << name << ");";
       break;
     case t_base_type::TYPE_STRING:
-      if (type->is_binary()) {
+      if (is_binary_slice(type)) {
+        out << "readBinarySlice(" << name << ");";
+      } else if (type->is_binary()) {
         out << "readBinary(" << name << ");";
       } else {
         out << "readString(" << name << ");";
@@ -4128,7 +4418,13 @@ void t_cpp_generator::generate_deserialize_container(ostream& out, t_type* ttype
   t_container* tcontainer = (t_container*)ttype;
   bool use_push = tcontainer->has_cpp_name();
 
-  indent(out) << prefix << ".clear();" << '\n' << indent() << "uint32_t " << size << ";" << '\n';
+  // In arena mode the container is bound to the arena of the reading thread
+  if (gen_arena_ && !use_push) {
+    indent(out) << "::apache::thrift::clearForCurrentArena(" << prefix << ");" << '\n';
+  } else {
+    indent(out) << prefix << ".clear();" << '\n';
+  }
+  indent(out) << "uint32_t " << size << ";" << '\n';
 
   // Declare variables, read header
   if (ttype->is_map()) {
@@ -4144,6 +4440,15 @@ void t_cpp_generator::generate_deserialize_container(ostream& out, t_type* ttype
     if (!use_push) {
       indent(out) << prefix << ".resize(" << size << ");" << '\n';
     }
+
+    string suffix = list_array_suffix((t_list*)ttype);
+    if (!suffix.empty()) {
+      indent(out) << "xfer += iprot->read" << suffix << "Array(" << prefix << ".data(), " << size
+                  << ");" << '\n';
+      indent(out) << "xfer += iprot->readListEnd();" << '\n';
+      scope_down(out);
+      return;
+    }
   }
 
   // For loop iterates over elements
@@ -4258,7 +4563,9 @@ void t_cpp_generator::generate_serialize_field(ostream& out,
         out << "writeUUID(" << name << ");";
         break;
       case t_base_type::TYPE_STRING:
-        if (type->is_binary()) {
+        if (is_binary_slice(type)) {
+          out << "writeBinarySlice(" << name << ");";
+        } else if (type->is_binary()) {
           out << "writeBinary(" << name << ");";
         } else {
           out << "writeString(" << name << ");";
@@ -4335,6 +4642,15 @@ void t_cpp_generator::generate_serialize_container(ostream& out, t_type* ttype,
     indent(out) << "xfer += oprot->writeListBegin("
                 << type_to_enum(((t_list*)ttype)->get_elem_type()) << ", "
                 << "static_cast<uint32_t>(" << prefix << ".size()));" << '\n';
+
+    string suffix = list_array_suffix((t_list*)ttype);
+    if (!suffix.empty()) {
+      indent(out) << "xfer += oprot->write" << suffix << "Array(" << prefix << ".data(), "
+                  << "static_cast<uint32_t>(" << prefix << ".size()));" << '\n';
+      indent(out) << "xfer += oprot->writeListEnd();" << '\n';
+      scope_down(out);
+      return;
+    }
   }
 
   string iter = tmp("_iter");
@@ -4479,6 +4795,8 @@ string t_cpp_generator::type_name(t_type* ttype, bool in_typedef, bool arg) {
     std::map<string, std::vector<string>>::iterator it = ttype->annotations_.find("cpp.type");
     if (it != ttype->annotations_.end() && !it->second.empty()) {
       bname = it->second.back();
+    } else if (is_binary_slice(ttype)) {
+      bname = "::apache::thrift::TSlice";
     }
 
     if (!arg) {
@@ -4501,14 +4819,30 @@ string t_cpp_generator::type_name(t_type* ttype, bool in_typedef, bool arg) {
       cname = tcontainer->get_cpp_name();
     } else if (ttype->is_map()) {
       t_map* tmap = (t_map*)ttype;
-      cname = "std::map<" + type_name(tmap->get_key_type(), in_typedef) + ", "
-              + type_name(tmap->get_val_type(), in_typedef) + "> ";
+      string kname = type_name(tmap->get_key_type(), in_typedef);
+      string vname = type_name(tmap->get_val_type(), in_typedef);
+      cname = "std::map<" + kname + ", " + vname;
+      if (gen_arena_) {
+        cname += ", std::less<" + kname + " >, "
+                 + arena_allocator_name("std::pair<const " + kname + ", " + vname + " >");
+      }
+      cname += "> ";
     } else if (ttype->is_set()) {
       t_set* tset = (t_set*)ttype;
-      cname = "std::set<" + type_name(tset->get_elem_type(), in_typedef) + "> ";
+      string ename = type_name(tset->get_elem_type(), in_typedef);
+      cname = "std::set<" + ename;
+      if (gen_arena_) {
+        cname += ", std::less<" + ename + " >, " + arena_allocator_name(ename);
+      }
+      cname += "> ";
     } else if (ttype->is_list()) {
       t_list* tlist = (t_list*)ttype;
-      cname = "std::vector<" + type_name(tlist->get_elem_type(), in_typedef) + "> ";
+      string ename = type_name(tlist->get_elem_type(), in_typedef);
+      cname = "std::vector<" + ename;
+      if (gen_arena_) {
+        cname += ", " + arena_allocator_name(ename);
+      }
+      cname += "> ";
     }
 
     if (arg) {
@@ -4857,4 +5191,16 @@ THRIFT_REGISTER_GENERATOR(
     "    moveable_types:  Generate move constructors and assignment operators.\n"
     "    no_ostream_operators:\n"
     "                     Omit generation of ostream definitions.\n"
-    "    no_skeleton:     Omits generation of skeleton.\n")
+    "    no_skeleton:     Omits generation of skeleton.\n"
+    "    arena:           Deserialize container fields into the thread's current TArena.\n"
+    "                     Processors allocate from a per-thread arena that is reset when\n"
+    "                     each call returns, so handlers must copy, not move or swap,\n"
+    "                     argument containers into state that outlives the call.\n"
+    "    zero_copy_binary:\n"
+    "                     Represent binary fields as TSlices sharing the receive buffer.\n"
+    "    lazy:            Keep struct, container and string fields of structs encoded until\n"
+    "                     first accessed through get_<field>() or mutable_<field>(), and\n"
+    "                     write fields not changed through mutable_<field>() or __set_<field>()\n"
+    "                     as they were read. These fields are private, the accessors are the\n"
+    "                     only way to them. get_<field>() decodes into the struct, so\n"
+    "                     concurrent reads of one struct need external synchronization.\n")
@@ -45,7 +45,9 @@ public:
     PROTOCOL_ERROR = 7,
     INVALID_TRANSFORM = 8,
     INVALID_PROTOCOL = 9,
-    UNSUPPORTED_CLIENT_TYPE = 10
+    UNSUPPORTED_CLIENT_TYPE = 10,
+    LOADSHEDDING = 11,
+    TIMEOUT = 12
   };
 
   TApplicationException() : TException(), type_(UNKNOWN) {}
@@ -92,6 +94,10 @@ public:
         return "TApplicationException: Invalid protocol";
       case UNSUPPORTED_CLIENT_TYPE:
         return "TApplicationException: Unsupported client type";
+      case LOADSHEDDING:
+        return "TApplicationException: Request shed by an overloaded server";
+      case TIMEOUT:
+        return "TApplicationException: Request timed out before it was processed";
       default:
         return "TApplicationException: (Invalid exception type)";
       };
@@ -0,0 +1,112 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/TArena.h>
+
+#include <algorithm>
+#include <cstdlib>
+
+namespace apache {
+namespace thrift {
+
+namespace {
+thread_local TArena* currentArena = nullptr;
+}
+
+TArena::TArena(size_t initialBlockSize, size_t maxBlockSize)
+  : head_(nullptr),
+    cur_(nullptr),
+    end_(nullptr),
+    used_(0),
+    nextBlockSize_((std::max)(initialBlockSize, sizeof(Block) + alignof(std::max_align_t))),
+    maxBlockSize_((std::max)(maxBlockSize, nextBlockSize_)),
+    scopes_(0) {
+}
+
+TArena::~TArena() {
+  while (head_ != nullptr) {
+    Block* next = head_->next;
+    std::free(head_);
+    head_ = next;
+  }
+}
+
+void* TArena::allocateSlow(size_t size, size_t align) {
+  // room for the header and worst case alignment padding
+  const size_t overhead = sizeof(Block) + align;
+  if (size > SIZE_MAX - overhead) {
+    throw std::bad_alloc();
+  }
+  size_t blockSize = nextBlockSize_;
+  if (size + overhead > blockSize) {
+    // oversized requests get a dedicated block and leave the growth alone
+    blockSize = size + overhead;
+  } else {
+    nextBlockSize_ = (std::min)(nextBlockSize_ * 2, maxBlockSize_);
+  }
+
+  auto* block = static_cast<Block*>(std::malloc(blockSize));
+  if (block == nullptr) {
+    throw std::bad_alloc();
+  }
+  block->next = head_;
+  block->size = blockSize;
+  head_ = block;
+  cur_ = reinterpret_cast<char*>(block + 1);
+  end_ = reinterpret_cast<char*>(block) + blockSize;
+  return allocate(size, align);
+}
+
+void TArena::reset() {
+  // keep the newest block unless it was an oversized one
+  Block* keep = nullptr;
+  if (head_ != nullptr && head_->size <= maxBlockSize_) {
+    keep = head_;
+    head_ = head_->next;
+  }
+  while (head_ != nullptr) {
+    Block* next = head_->next;
+    std::free(head_);
+    head_ = next;
+  }
+  head_ = keep;
+  if (keep != nullptr) {
+    keep->next = nullptr;
+    cur_ = reinterpret_cast<char*>(keep + 1);
+    end_ = reinterpret_cast<char*>(keep) + keep->size;
+  } else {
+    cur_ = end_ = nullptr;
+  }
+  used_ = 0;
+}
+
+TArena* TArena::current() {
+  return currentArena;
+}
+
+void TArena::setCurrent(TArena* arena) {
+  currentArena = arena;
+}
+
+TArena& TArena::threadArena() {
+  static thread_local TArena arena;
+  return arena;
+}
+}
+} // apache::thrift
@@ -0,0 +1,207 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_TARENA_H_
+#define _THRIFT_TARENA_H_ 1
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+
+#include <thrift/TNonCopyable.h>
+
+namespace apache {
+namespace thrift {
+
+/**
+ * A bump-pointer memory arena. Allocations are carved out of large blocks
+ * and are never freed individually; reset() releases everything at once.
+ *
+ * Blocks grow geometrically up to maxBlockSize. reset() keeps the most
+ * recent regular block around for reuse, so an arena that is reset after
+ * each message settles on a single block and stops calling malloc.
+ *
+ * An arena is not thread safe; use one per thread.
+ */
+class TArena : apache::thrift::TNonCopyable {
+public:
+  static const size_t DEFAULT_BLOCK_SIZE = 16 * 1024;
+  static const size_t DEFAULT_MAX_BLOCK_SIZE = 1024 * 1024;
+
+  explicit TArena(size_t initialBlockSize = DEFAULT_BLOCK_SIZE,
+                  size_t maxBlockSize = DEFAULT_MAX_BLOCK_SIZE);
+  ~TArena();
+
+  /**
+   * Returns size bytes aligned to align, which must be a power of two.
+   */
+  void* allocate(size_t size, size_t align = alignof(std::max_align_t)) {
+    const auto p = (reinterpret_cast<uintptr_t>(cur_) + align - 1) & ~(uintptr_t)(align - 1);
+    if (cur_ == nullptr || p > reinterpret_cast<uintptr_t>(end_)
+        || size > reinterpret_cast<uintptr_t>(end_) - p) {
+      return allocateSlow(size, align);
+    }
+    cur_ = reinterpret_cast<char*>(p + size);
+    used_ += size;
+    return reinterpret_cast<void*>(p);
+  }
+
+  /**
+   * Releases every allocation made from this arena. Anything still pointing
+   * into it is left dangling.
+   */
+  void reset();
+
+  /**
+   * Number of bytes handed out since the last reset.
+   */
+  size_t used() const { return used_; }
+
+  /**
+   * The arena installed on the calling thread by the innermost TArenaScope,
+   * or nullptr.
+   */
+  static TArena* current();
+
+  /**
+   * An arena owned by the calling thread, created on first use.
+   */
+  static TArena& threadArena();
+
+private:
+  struct Block {
+    Block* next;
+    size_t size;
+  };
+
+  void* allocateSlow(size_t size, size_t align);
+  static void setCurrent(TArena* arena);
+
+  Block* head_;
+  char* cur_;
+  char* end_;
+  size_t used_;
+  size_t nextBlockSize_;
+  size_t maxBlockSize_;
+  unsigned scopes_;
+
+  friend class TArenaScope;
+};
+
+/**
+ * Installs an arena as TArena::current() for the calling thread for the
+ * lifetime of the scope. Scopes nest; the outermost scope for a given arena
+ * resets it on exit, so objects allocated from it must be destroyed first.
+ */
+class TArenaScope : apache::thrift::TNonCopyable {
+public:
+  explicit TArenaScope(TArena& arena) : arena_(arena), previous_(TArena::current()) {
+    ++arena_.scopes_;
+    TArena::setCurrent(&arena_);
+  }
+
+  ~TArenaScope() {
+    TArena::setCurrent(previous_);
+    if (--arena_.scopes_ == 0) {
+      arena_.reset();
+    }
+  }
+
+private:
+  TArena& arena_;
+  TArena* previous_;
+};
+
+/**
+ * Standard allocator drawing from a TArena, or from the global heap if it
+ * has none. Default constructed allocators use the heap, so containers only
+ * allocate from an arena once they are bound to it explicitly, as generated
+ * code does with clearForCurrentArena() before deserializing into them.
+ *
+ * Copies of a container are always made on the heap, so it is safe to copy
+ * arena backed data that must outlive the scope. Moving it out is not.
+ */
+template <typename T>
+class TArenaAllocator {
+public:
+  typedef T value_type;
+  typedef std::false_type propagate_on_container_copy_assignment;
+  typedef std::true_type propagate_on_container_move_assignment;
+  typedef std::true_type propagate_on_container_swap;
+
+  template <typename U>
+  struct rebind {
+    typedef TArenaAllocator<U> other;
+  };
+
+  TArenaAllocator() noexcept : arena_(nullptr) {}
+  explicit TArenaAllocator(TArena* arena) noexcept : arena_(arena) {}
+  template <typename U>
+  TArenaAllocator(const TArenaAllocator<U>& other) noexcept : arena_(other.arena()) {}
+
+  T* allocate(size_t n) {
+    if (arena_ != nullptr) {
+      return static_cast<T*>(arena_->allocate(n * sizeof(T), alignof(T)));
+    }
+    return static_cast<T*>(::operator new(n * sizeof(T)));
+  }
+
+  void deallocate(T* p, size_t) noexcept {
+    if (arena_ == nullptr) {
+      ::operator delete(p);
+    }
+  }
+
+  TArenaAllocator select_on_container_copy_construction() const {
+    return TArenaAllocator(nullptr);
+  }
+
+  TArena* arena() const { return arena_; }
+
+private:
+  TArena* arena_;
+};
+
+template <typename T, typename U>
+bool operator==(const TArenaAllocator<T>& a, const TArenaAllocator<U>& b) {
+  return a.arena() == b.arena();
+}
+
+template <typename T, typename U>
+bool operator!=(const TArenaAllocator<T>& a, const TArenaAllocator<U>& b) {
+  return a.arena() != b.arena();
+}
+
+/**
+ * Empties a container using TArenaAllocator and binds it to TArena::current(),
+ * so that what is inserted next comes from the calling thread's arena.
+ */
+template <typename Container>
+void clearForCurrentArena(Container& container) {
+  if (container.get_allocator().arena() == TArena::current()) {
+    container.clear();
+  } else {
+    container = Container(typename Container::allocator_type(TArena::current()));
+  }
+}
+}
+} // apache::thrift
+
+#endif // #ifndef _THRIFT_TARENA_H_
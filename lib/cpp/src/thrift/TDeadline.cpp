@@ -0,0 +1,46 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/TDeadline.h>
+
+namespace apache {
+namespace thrift {
+
+namespace {
+thread_local TDeadline::Clock::time_point currentDeadline = TDeadline::Clock::time_point::max();
+}
+
+const char* const TDeadline::HEADER = "client_timeout";
+
+TDeadline::Clock::time_point TDeadline::current() {
+  return currentDeadline;
+}
+
+void TDeadline::setCurrent(Clock::time_point deadline) {
+  currentDeadline = deadline;
+}
+
+std::chrono::milliseconds TDeadline::remaining() {
+  if (!isSet()) {
+    return std::chrono::milliseconds::max();
+  }
+  return std::chrono::duration_cast<std::chrono::milliseconds>(currentDeadline - Clock::now());
+}
+}
+} // apache::thrift
@@ -0,0 +1,113 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_TDEADLINE_H_
+#define _THRIFT_TDEADLINE_H_ 1
+
+#include <chrono>
+
+#include <thrift/TNonCopyable.h>
+
+namespace apache {
+namespace thrift {
+
+/**
+ * The deadline of the request handled on the calling thread.
+ *
+ * Clients send how long they still wait for a response in the
+ * client_timeout header of THeader requests. Servers drop requests that
+ * waited longer than that before a worker got to them, and install the
+ * deadline of the others with a TDeadlineScope while their handler runs.
+ * Handlers can check it, and the THeader requests they send on to other
+ * services carry the time that is left, so that those drop work nobody
+ * waits for as well.
+ *
+ * Clients that are not handlers set a deadline the same way, with a
+ * TDeadlineScope around their calls.
+ */
+class TDeadline {
+public:
+  typedef std::chrono::steady_clock Clock;
+
+  /// THeader header with the milliseconds the caller still waits
+  static const char* const HEADER;
+
+  /**
+   * The deadline installed on the calling thread by the innermost
+   * TDeadlineScope, or Clock::time_point::max() if there is none.
+   */
+  static Clock::time_point current();
+
+  /// Whether the calling thread has a deadline
+  static bool isSet() { return current() != Clock::time_point::max(); }
+
+  /**
+   * Time left until the deadline, negative once it passed, and
+   * milliseconds::max() if there is none.
+   */
+  static std::chrono::milliseconds remaining();
+
+  /// Whether the deadline of the calling thread has passed
+  static bool expired() { return isSet() && Clock::now() >= current(); }
+
+private:
+  static void setCurrent(Clock::time_point deadline);
+
+  friend class TDeadlineScope;
+};
+
+/**
+ * Installs a deadline on the calling thread for the lifetime of the scope.
+ * Scopes nest, and an inner scope never extends the deadline of the outer
+ * one.
+ */
+class TDeadlineScope : apache::thrift::TNonCopyable {
+public:
+  explicit TDeadlineScope(TDeadline::Clock::time_point deadline)
+    : previous_(TDeadline::current()) {
+    TDeadline::setCurrent(deadline < previous_ ? deadline : previous_);
+  }
+
+  explicit TDeadlineScope(std::chrono::milliseconds timeout)
+    : TDeadlineScope(TDeadline::Clock::now() + timeout) {}
+
+  ~TDeadlineScope() { TDeadline::setCurrent(previous_); }
+
+private:
+  TDeadline::Clock::time_point previous_;
+};
+
+/**
+ * Implemented by transports whose requests can carry the time their caller
+ * still waits for them, so that servers can find it before processing.
+ */
+class TDeadlineCarrier {
+public:
+  virtual ~TDeadlineCarrier() = default;
+
+  /**
+   * Reads the next request far enough to find its timeout, without
+   * consuming it. Returns false if it carries none, or a malformed one.
+   */
+  virtual bool readRequestTimeout(std::chrono::milliseconds& timeout) = 0;
+};
+}
+} // apache::thrift
+
+#endif // #ifndef _THRIFT_TDEADLINE_H_
@@ -0,0 +1,111 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_TSLICE_H_
+#define _THRIFT_TSLICE_H_ 1
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <utility>
+
+namespace apache {
+namespace thrift {
+
+/**
+ * An immutable run of bytes with shared ownership of its storage.
+ *
+ * A slice read by a transport that keeps whole frames in memory (such as
+ * TFramedTransport) points straight into the frame and keeps it alive, so
+ * binary fields can be deserialized and forwarded without copying them.
+ * Slices built from a std::string own a copy of it.
+ */
+class TSlice {
+public:
+  TSlice() : size_(0) {}
+
+  TSlice(const char* str) : TSlice(std::string(str)) {}
+
+  TSlice(const std::string& str) : TSlice(std::string(str)) {}
+
+  TSlice(std::string&& str) : size_(str.size()) {
+    if (size_ > 0) {
+      auto owner = std::make_shared<std::string>(std::move(str));
+      data_ = std::shared_ptr<const uint8_t>(owner,
+                                             reinterpret_cast<const uint8_t*>(owner->data()));
+    }
+  }
+
+  /**
+   * Refers to size bytes at data. data may be an aliasing pointer that
+   * shares ownership of a larger buffer.
+   */
+  TSlice(std::shared_ptr<const uint8_t> data, size_t size) : data_(std::move(data)), size_(size) {}
+
+  const uint8_t* data() const { return data_.get(); }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  const uint8_t* begin() const { return data_.get(); }
+  const uint8_t* end() const { return data_.get() + size_; }
+
+  /**
+   * Returns len bytes starting at offset, sharing this slice's storage.
+   */
+  TSlice sub(size_t offset, size_t len) const {
+    return TSlice(std::shared_ptr<const uint8_t>(data_, data_.get() + offset), len);
+  }
+
+  /**
+   * Copies the bytes into a std::string.
+   */
+  std::string str() const {
+    return size_ == 0 ? std::string()
+                      : std::string(reinterpret_cast<const char*>(data_.get()), size_);
+  }
+
+  bool operator==(const TSlice& rhs) const {
+    return size_ == rhs.size_ && (size_ == 0 || std::memcmp(data(), rhs.data(), size_) == 0);
+  }
+
+  bool operator!=(const TSlice& rhs) const { return !(*this == rhs); }
+
+  bool operator<(const TSlice& rhs) const {
+    const int cmp = (std::min)(size_, rhs.size_) == 0
+                        ? 0
+                        : std::memcmp(data(), rhs.data(), (std::min)(size_, rhs.size_));
+    return cmp < 0 || (cmp == 0 && size_ < rhs.size_);
+  }
+
+private:
+  std::shared_ptr<const uint8_t> data_;
+  size_t size_;
+};
+
+inline std::ostream& operator<<(std::ostream& out, const TSlice& slice) {
+  return out.write(reinterpret_cast<const char*>(slice.data()),
+                   static_cast<std::streamsize>(slice.size()));
+}
+}
+} // apache::thrift
+
+#endif // #ifndef _THRIFT_TSLICE_H_
@@ -71,14 +71,14 @@ inline std::string to_string(const long double& t) {
   return o.str();
 }
 
-template <typename K, typename V>
-std::string to_string(const std::map<K, V>& m);
+template <typename K, typename V, typename C, typename A>
+std::string to_string(const std::map<K, V, C, A>& m);
 
-template <typename T>
-std::string to_string(const std::set<T>& s);
+template <typename T, typename C, typename A>
+std::string to_string(const std::set<T, C, A>& s);
 
-template <typename T>
-std::string to_string(const std::vector<T>& t);
+template <typename T, typename A>
+std::string to_string(const std::vector<T, A>& t);
 
 template <typename K, typename V>
 std::string to_string(const typename std::pair<K, V>& v) {
@@ -98,22 +98,22 @@ std::string to_string(const T& beg, const T& end) {
   return o.str();
 }
 
-template <typename T>
-std::string to_string(const std::vector<T>& t) {
+template <typename T, typename A>
+std::string to_string(const std::vector<T, A>& t) {
   std::ostringstream o;
   o << "[" << to_string(t.begin(), t.end()) << "]";
   return o.str();
 }
 
-template <typename K, typename V>
-std::string to_string(const std::map<K, V>& m) {
+template <typename K, typename V, typename C, typename A>
+std::string to_string(const std::map<K, V, C, A>& m) {
   std::ostringstream o;
   o << "{" << to_string(m.begin(), m.end()) << "}";
   return o.str();
 }
 
-template <typename T>
-std::string to_string(const std::set<T>& s) {
+template <typename T, typename C, typename A>
+std::string to_string(const std::set<T, C, A>& s) {
   std::ostringstream o;
   o << "{" << to_string(s.begin(), s.end()) << "}";
   return o.str();
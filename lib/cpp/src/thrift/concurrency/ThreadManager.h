@@ -200,6 +200,16 @@ public:
   static std::shared_ptr<ThreadManager> newSimpleThreadManager(size_t count = 4,
                                                                  size_t pendingTaskCountMax = 0);
 
+  /**
+   * Creates a thread manager with the same contract as newSimpleThreadManager
+   * that keeps a separate task queue per worker thread, with idle workers
+   * stealing from the others. Use it when many threads add short tasks and
+   * the single queue lock of the simple thread manager becomes a bottleneck.
+   * Tasks run in roughly, but not strictly, the order they were added.
+   */
+  static std::shared_ptr<ThreadManager> newWorkStealingThreadManager(size_t count = 4,
+                                                                       size_t pendingTaskCountMax = 0);
+
   class Task;
 
   class Worker;
@@ -24,6 +24,7 @@
 #include <iostream>
 #include <memory>
 #include <set>
+#include <vector>
 
 namespace apache {
 namespace thrift {
@@ -60,6 +61,7 @@ public:
 private:
   shared_ptr<Runnable> runnable_;
   friend class TimerManager::Dispatcher;
+  friend class TimingWheelTimerManager;
   STATE state_;
 };
 
@@ -316,6 +318,409 @@ void TimerManager::remove(Timer handle) {
 TimerManager::STATE TimerManager::state() const {
   return state_;
 }
+
+/**
+ * A timer in the wheel. While it is linked into a slot it owns itself through
+ * self_, so that the wheel does not need a container of shared pointers.
+ */
+class TimingWheelTimerManager::Task : public TimerManager::Task {
+
+public:
+  Task(shared_ptr<Runnable> runnable, uint64_t tick)
+    : TimerManager::Task(runnable), tick_(tick), prev_(nullptr), next_(nullptr), head_(nullptr) {}
+
+  uint64_t tick_;
+  Task* prev_;
+  Task* next_;
+  Task** head_;
+  shared_ptr<Task> self_;
+};
+
+class TimingWheelTimerManager::Dispatcher : public Runnable {
+
+public:
+  Dispatcher(TimingWheelTimerManager* manager) : manager_(manager) {}
+
+  ~Dispatcher() override = default;
+
+  /**
+   * Dispatcher entry point
+   *
+   * As long as dispatcher thread is running, advance the wheel to the
+   * current tick and execute whatever fell due.
+   */
+  void run() override {
+    {
+      Synchronized s(manager_->monitor_);
+      if (manager_->state_ == TimerManager::STARTING) {
+        manager_->state_ = TimerManager::STARTED;
+        manager_->monitor_.notifyAll();
+      }
+    }
+
+    std::vector<shared_ptr<TimingWheelTimerManager::Task> > expiredTasks;
+    do {
+      {
+        Synchronized s(manager_->monitor_);
+        while (manager_->state_ == TimerManager::STARTED) {
+          manager_->advance(manager_->tickOf(std::chrono::steady_clock::now(), false), expiredTasks);
+          if (!expiredTasks.empty()) {
+            break;
+          }
+
+          // Let add() know which tick we sleep until, so it only wakes us
+          // for a timer that falls due before that.
+          manager_->wakeTick_ = manager_->nextTick();
+          if (manager_->wakeTick_ == UINT64_MAX) {
+            manager_->monitor_.waitForever();
+          } else {
+            manager_->monitor_.waitForTime(
+                manager_->epoch_
+                + manager_->tick_ * static_cast<std::chrono::steady_clock::rep>(manager_->wakeTick_));
+          }
+          manager_->wakeTick_ = 0;
+        }
+
+        for (const auto& expiredTask : expiredTasks) {
+          if (expiredTask->state_ == TimerManager::Task::WAITING) {
+            expiredTask->state_ = TimerManager::Task::EXECUTING;
+          }
+        }
+      }
+
+      for (const auto& expiredTask : expiredTasks) {
+        expiredTask->run();
+      }
+      expiredTasks.clear();
+
+    } while (manager_->state_ == TimerManager::STARTED);
+
+    {
+      Synchronized s(manager_->monitor_);
+      if (manager_->state_ == TimerManager::STOPPING) {
+        manager_->state_ = TimerManager::STOPPED;
+        manager_->monitor_.notifyAll();
+      }
+    }
+  }
+
+private:
+  TimingWheelTimerManager* manager_;
+  friend class TimingWheelTimerManager;
+};
+
+#if defined(_MSC_VER)
+#pragma warning(push)
+#pragma warning(disable : 4355) // 'this' used in base member initializer list
+#endif
+
+TimingWheelTimerManager::TimingWheelTimerManager(const std::chrono::milliseconds& tick)
+  : tick_(tick.count() > 0 ? tick : std::chrono::milliseconds(1)),
+    epoch_(std::chrono::steady_clock::now()),
+    currentTick_(0),
+    wakeTick_(0),
+    taskCount_(0),
+    due_(nullptr),
+    state_(TimerManager::UNINITIALIZED),
+    dispatcher_(std::make_shared<Dispatcher>(this)) {
+  for (auto& level : wheel_) {
+    for (auto& slot : level) {
+      slot = nullptr;
+    }
+  }
+}
+
+#if defined(_MSC_VER)
+#pragma warning(pop)
+#endif
+
+TimingWheelTimerManager::~TimingWheelTimerManager() {
+  if (state_ != STOPPED) {
+    try {
+      stop();
+    } catch (...) {
+      // We're really hosed.
+    }
+  }
+  clear();
+}
+
+void TimingWheelTimerManager::start() {
+  bool doStart = false;
+  {
+    Synchronized s(monitor_);
+    if (!threadFactory_) {
+      throw InvalidArgumentException();
+    }
+    if (state_ == TimerManager::UNINITIALIZED) {
+      state_ = TimerManager::STARTING;
+      doStart = true;
+    }
+  }
+
+  if (doStart) {
+    dispatcherThread_ = threadFactory_->newThread(dispatcher_);
+    dispatcherThread_->start();
+  }
+
+  {
+    Synchronized s(monitor_);
+    while (state_ == TimerManager::STARTING) {
+      monitor_.wait();
+    }
+    assert(state_ != TimerManager::STARTING);
+  }
+}
+
+void TimingWheelTimerManager::stop() {
+  bool doStop = false;
+  {
+    Synchronized s(monitor_);
+    if (state_ == TimerManager::UNINITIALIZED) {
+      state_ = TimerManager::STOPPED;
+    } else if (state_ != STOPPING && state_ != STOPPED) {
+      doStop = true;
+      state_ = STOPPING;
+      monitor_.notifyAll();
+    }
+    while (state_ != STOPPED) {
+      monitor_.wait();
+    }
+  }
+
+  if (doStop) {
+    // Clean up any outstanding tasks
+    clear();
+
+    // Remove dispatcher's reference to us.
+    dispatcher_->manager_ = nullptr;
+  }
+}
+
+shared_ptr<const ThreadFactory> TimingWheelTimerManager::threadFactory() const {
+  Synchronized s(monitor_);
+  return threadFactory_;
+}
+
+void TimingWheelTimerManager::threadFactory(shared_ptr<const ThreadFactory> value) {
+  Synchronized s(monitor_);
+  threadFactory_ = value;
+}
+
+size_t TimingWheelTimerManager::taskCount() const {
+  return taskCount_;
+}
+
+TimerManager::Timer TimingWheelTimerManager::add(shared_ptr<Runnable> task,
+                                                 const std::chrono::milliseconds& timeout) {
+  return add(task, std::chrono::steady_clock::now() + timeout);
+}
+
+TimerManager::Timer TimingWheelTimerManager::add(
+    shared_ptr<Runnable> task,
+    const std::chrono::time_point<std::chrono::steady_clock>& abstime) {
+  auto now = std::chrono::steady_clock::now();
+
+  if (abstime < now) {
+    throw InvalidArgumentException();
+  }
+  auto timer = std::make_shared<Task>(task, tickOf(abstime, true));
+
+  Synchronized s(monitor_);
+  if (state_ != TimerManager::STARTED) {
+    throw IllegalStateException();
+  }
+
+  timer->self_ = timer;
+  insert(timer.get());
+  taskCount_++;
+
+  // The dispatcher only needs a kick if it is asleep and this timer falls due
+  // before it would wake up anyway.
+  if (timer->tick_ < wakeTick_) {
+    monitor_.notify();
+  }
+
+  return timer;
+}
+
+void TimingWheelTimerManager::remove(shared_ptr<Runnable> task) {
+  Synchronized s(monitor_);
+  if (state_ != TimerManager::STARTED) {
+    throw IllegalStateException();
+  }
+
+  std::vector<Task*> found;
+  auto match = [&](Task* head) {
+    for (; head != nullptr; head = head->next_) {
+      if (*head == task) {
+        found.push_back(head);
+      }
+    }
+  };
+  match(due_);
+  for (auto& level : wheel_) {
+    for (auto slot : level) {
+      match(slot);
+    }
+  }
+
+  if (found.empty()) {
+    throw NoSuchTaskException();
+  }
+  for (auto timer : found) {
+    unlink(timer);
+    taskCount_--;
+  }
+}
+
+void TimingWheelTimerManager::remove(Timer handle) {
+  Synchronized s(monitor_);
+  if (state_ != TimerManager::STARTED) {
+    throw IllegalStateException();
+  }
+
+  shared_ptr<TimingWheelTimerManager::Task> task
+      = std::static_pointer_cast<TimingWheelTimerManager::Task>(handle.lock());
+  if (!task) {
+    throw NoSuchTaskException();
+  }
+
+  if (task->head_ == nullptr) {
+    // Task is being executed
+    throw UncancellableTaskException();
+  }
+
+  unlink(task.get());
+  taskCount_--;
+}
+
+TimerManager::STATE TimingWheelTimerManager::state() const {
+  return state_;
+}
+
+uint64_t TimingWheelTimerManager::tickOf(
+    const std::chrono::time_point<std::chrono::steady_clock>& time,
+    bool roundUp) const {
+  const auto elapsed = (time - epoch_).count();
+  const auto tick = tick_.count();
+  if (elapsed <= 0) {
+    return 0;
+  }
+  return static_cast<uint64_t>(roundUp ? (elapsed + tick - 1) / tick : elapsed / tick);
+}
+
+void TimingWheelTimerManager::insert(Task* task) {
+  Task** head;
+  if (task->tick_ <= currentTick_) {
+    head = &due_;
+  } else {
+    // the finest wheel whose span covers the distance to the due tick; the
+    // coarsest one also holds anything further out and re-files it on each
+    // turn until it gets close enough
+    const uint64_t delta = task->tick_ - currentTick_;
+    unsigned level = 0;
+    while (level < LEVELS - 1 && (delta >> (SLOT_BITS * (level + 1))) != 0) {
+      level++;
+    }
+    const uint64_t maxDelta = (uint64_t(1) << (SLOT_BITS * LEVELS)) - 1;
+    const uint64_t tick = delta > maxDelta ? currentTick_ + maxDelta : task->tick_;
+    head = &wheel_[level][(tick >> (SLOT_BITS * level)) & (SLOTS - 1)];
+  }
+
+  task->head_ = head;
+  task->prev_ = nullptr;
+  task->next_ = *head;
+  if (*head != nullptr) {
+    (*head)->prev_ = task;
+  }
+  *head = task;
+}
+
+void TimingWheelTimerManager::unlink(Task* task) {
+  if (task->prev_ != nullptr) {
+    task->prev_->next_ = task->next_;
+  } else {
+    *task->head_ = task->next_;
+  }
+  if (task->next_ != nullptr) {
+    task->next_->prev_ = task->prev_;
+  }
+  task->prev_ = task->next_ = nullptr;
+  task->head_ = nullptr;
+  task->self_.reset();
+}
+
+void TimingWheelTimerManager::collect(Task*& head, std::vector<shared_ptr<Task> >& expired) {
+  Task* task = head;
+  head = nullptr;
+  while (task != nullptr) {
+    Task* next = task->next_;
+    task->prev_ = task->next_ = nullptr;
+    task->head_ = nullptr;
+    expired.push_back(std::move(task->self_));
+    taskCount_--;
+    task = next;
+  }
+}
+
+void TimingWheelTimerManager::advance(uint64_t nowTick, std::vector<shared_ptr<Task> >& expired) {
+  collect(due_, expired);
+
+  while (currentTick_ < nowTick) {
+    if (taskCount_ == 0) {
+      currentTick_ = nowTick;
+      break;
+    }
+
+    const uint64_t tick = ++currentTick_;
+
+    // At the start of a turn of a wheel, the slot of the next coarser wheel
+    // that covers the turn is spread over the finer wheels, starting at the
+    // coarsest one so that each cascade can feed the next.
+    for (unsigned level = LEVELS - 1; level > 0; level--) {
+      if ((tick & ((uint64_t(1) << (SLOT_BITS * level)) - 1)) == 0) {
+        Task*& slot = wheel_[level][(tick >> (SLOT_BITS * level)) & (SLOTS - 1)];
+        Task* task = slot;
+        slot = nullptr;
+        while (task != nullptr) {
+          Task* next = task->next_;
+          insert(task);
+          task = next;
+        }
+      }
+    }
+
+    collect(wheel_[0][tick & (SLOTS - 1)], expired);
+    collect(due_, expired);
+  }
+}
+
+uint64_t TimingWheelTimerManager::nextTick() const {
+  if (due_ != nullptr) {
+    return currentTick_;
+  }
+  if (taskCount_ == 0) {
+    return UINT64_MAX;
+  }
+  const uint64_t turnEnd = (currentTick_ | (SLOTS - 1)) + 1;
+  for (uint64_t tick = currentTick_ + 1; tick < turnEnd; tick++) {
+    if (wheel_[0][tick & (SLOTS - 1)] != nullptr) {
+      return tick;
+    }
+  }
+  return turnEnd;
+}
+
+void TimingWheelTimerManager::clear() {
+  std::vector<shared_ptr<Task> > orphans;
+  collect(due_, orphans);
+  for (auto& level : wheel_) {
+    for (auto& slot : level) {
+      collect(slot, orphans);
+    }
+  }
+}
 }
 }
 } // apache::thrift::concurrency
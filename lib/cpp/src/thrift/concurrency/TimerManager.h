@@ -23,8 +23,10 @@
 #include <thrift/concurrency/Monitor.h>
 #include <thrift/concurrency/ThreadFactory.h>
 
-#include <memory>
+#include <chrono>
 #include <map>
+#include <memory>
+#include <vector>
 
 namespace apache {
 namespace thrift {
@@ -130,6 +132,96 @@ private:
   using task_iterator = decltype(taskMap_)::iterator;
   typedef std::pair<task_iterator, task_iterator> task_range;
 };
+
+/**
+ * A TimerManager that keeps its timers in a hierarchical timing wheel rather
+ * than an ordered map.
+ *
+ * Due times are rounded up to a whole number of ticks and each timer is
+ * hashed into one of LEVELS wheels of SLOTS slots according to how far away
+ * it falls due, so adding and removing a timer is O(1) and allocates nothing
+ * but the timer itself. The dispatcher wakes only for ticks that have timers,
+ * moves timers down from the coarser wheels as their turn comes up, and runs
+ * everything that falls due in a tick as one batch. This suits large numbers
+ * of outstanding timers, such as a deadline per in-flight request, that are
+ * mostly cancelled before they fire.
+ */
+class TimingWheelTimerManager : public TimerManager {
+
+public:
+  static const unsigned LEVELS = 4;
+  static const unsigned SLOT_BITS = 8;
+  static const unsigned SLOTS = 1U << SLOT_BITS;
+
+  /**
+   * @param tick Granularity of the wheel. Timers never fire early, but may
+   *             fire up to one tick late.
+   */
+  explicit TimingWheelTimerManager(const std::chrono::milliseconds& tick = std::chrono::milliseconds(1));
+
+  ~TimingWheelTimerManager() override;
+
+  std::shared_ptr<const ThreadFactory> threadFactory() const override;
+
+  void threadFactory(std::shared_ptr<const ThreadFactory> value) override;
+
+  void start() override;
+
+  void stop() override;
+
+  size_t taskCount() const override;
+
+  using TimerManager::add;
+
+  Timer add(std::shared_ptr<Runnable> task, const std::chrono::milliseconds& timeout) override;
+
+  Timer add(std::shared_ptr<Runnable> task,
+            const std::chrono::time_point<std::chrono::steady_clock>& abstime) override;
+
+  void remove(std::shared_ptr<Runnable> task) override;
+
+  void remove(Timer timer) override;
+
+  STATE state() const override;
+
+private:
+  class Task;
+  class Dispatcher;
+  friend class Dispatcher;
+
+  uint64_t tickOf(const std::chrono::time_point<std::chrono::steady_clock>& time, bool roundUp) const;
+
+  void insert(Task* task);
+  void unlink(Task* task);
+
+  /**
+   * Advances the wheel to nowTick, moving every timer that falls due on the
+   * way into expired.
+   */
+  void advance(uint64_t nowTick, std::vector<std::shared_ptr<Task> >& expired);
+  void collect(Task*& head, std::vector<std::shared_ptr<Task> >& expired);
+
+  /**
+   * The next tick at which advance() has work to do: a slot with timers in
+   * it or a turn of the finest wheel that cascades timers down.
+   */
+  uint64_t nextTick() const;
+
+  void clear();
+
+  std::shared_ptr<const ThreadFactory> threadFactory_;
+  const std::chrono::steady_clock::duration tick_;
+  const std::chrono::time_point<std::chrono::steady_clock> epoch_;
+  uint64_t currentTick_;
+  uint64_t wakeTick_;
+  size_t taskCount_;
+  Task* wheel_[LEVELS][SLOTS];
+  Task* due_;
+  Monitor monitor_;
+  STATE state_;
+  std::shared_ptr<Dispatcher> dispatcher_;
+  std::shared_ptr<Thread> dispatcherThread_;
+};
 }
 }
 } // apache::thrift::concurrency
@@ -0,0 +1,674 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/thrift-config.h>
+
+#include <thrift/concurrency/ThreadManager.h>
+#include <thrift/concurrency/Exception.h>
+#include <thrift/concurrency/Monitor.h>
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <set>
+#include <thread>
+#include <vector>
+
+namespace apache {
+namespace thrift {
+namespace concurrency {
+
+using std::shared_ptr;
+
+namespace {
+
+/**
+ * The manager and queue of the worker running on the calling thread, so that
+ * tasks added from a worker go to its own queue and so that a worker is never
+ * put to sleep waiting for room in the queues it is supposed to drain.
+ */
+struct WorkerContext {
+  const void* manager;
+  size_t queue;
+};
+
+thread_local WorkerContext currentWorker = {nullptr, 0};
+
+}
+
+/**
+ * A ThreadManager that gives every worker its own task queue.
+ *
+ * Tasks added by a worker go to the back of that worker's queue; tasks added
+ * by any other thread are spread round robin over all queues. A worker takes
+ * tasks from the front of its own queue and, once that is empty, steals from
+ * the front of the others. Each queue has its own lock, so producers and
+ * consumers only contend when they hit the same queue, and the counters that
+ * decide whether anyone needs waking are atomics that are read without taking
+ * the manager lock. The manager lock and its monitors are only used to park
+ * idle workers, to block add() when pendingTaskCountMax is reached, and to
+ * start and stop workers.
+ *
+ * Tasks are run in roughly, but not strictly, the order they were added.
+ */
+class WorkStealingThreadManager : public ThreadManager {
+
+public:
+  WorkStealingThreadManager(size_t workerCount, size_t pendingTaskCountMax)
+    : initialWorkerCount_(workerCount),
+      pendingTaskCountMax_(pendingTaskCountMax),
+      pending_(0),
+      busyCount_(0),
+      idleCount_(0),
+      expiredCount_(0),
+      maxWaiters_(0),
+      workerCount_(0),
+      workerMaxCount_(0),
+      state_(ThreadManager::UNINITIALIZED),
+      nextQueue_(0),
+      monitor_(&mutex_),
+      maxMonitor_(&mutex_),
+      workerMonitor_(&mutex_) {
+    const size_t queueCount = workerCount > 0 ? workerCount : 1;
+    for (size_t ix = 0; ix < queueCount; ix++) {
+      queues_.emplace_back(new Queue());
+    }
+  }
+
+  ~WorkStealingThreadManager() override { stop(); }
+
+  void start() override;
+  void stop() override;
+
+  ThreadManager::STATE state() const override { return state_; }
+
+  shared_ptr<ThreadFactory> threadFactory() const override {
+    Guard g(mutex_);
+    return threadFactory_;
+  }
+
+  void threadFactory(shared_ptr<ThreadFactory> value) override {
+    Guard g(mutex_);
+    if (threadFactory_ && threadFactory_->isDetached() != value->isDetached()) {
+      throw InvalidArgumentException();
+    }
+    threadFactory_ = value;
+  }
+
+  void addWorker(size_t value) override;
+
+  void removeWorker(size_t value) override;
+
+  size_t idleWorkerCount() const override { return idleCount_; }
+
+  size_t workerCount() const override { return workerCount_; }
+
+  size_t pendingTaskCount() const override { return pending_; }
+
+  size_t totalTaskCount() const override { return pending_ + busyCount_; }
+
+  size_t pendingTaskCountMax() const override { return pendingTaskCountMax_; }
+
+  size_t expiredTaskCount() const override { return expiredCount_; }
+
+  void add(shared_ptr<Runnable> value, int64_t timeout, int64_t expiration) override;
+
+  void remove(shared_ptr<Runnable> task) override;
+
+  shared_ptr<Runnable> removeNextPending() override;
+
+  void removeExpiredTasks() override { removeExpired(false); }
+
+  void setExpireCallback(ExpireCallback expireCallback) override;
+
+private:
+  class Worker;
+
+  struct Task {
+    Task() : expires(false) {}
+
+    Task(shared_ptr<Runnable> value, int64_t expiration)
+      : runnable(std::move(value)),
+        enqueueTime(std::chrono::steady_clock::now()),
+        expires(expiration != 0) {
+      if (expires) {
+        expireTime = enqueueTime + std::chrono::milliseconds(expiration);
+      }
+    }
+
+    bool expiredAt(std::chrono::steady_clock::time_point now) const {
+      return expires && expireTime < now;
+    }
+
+    shared_ptr<Runnable> runnable;
+    std::chrono::steady_clock::time_point enqueueTime;
+    std::chrono::steady_clock::time_point expireTime;
+    bool expires;
+  };
+
+  struct Queue {
+    Queue() : size(0) {}
+
+    Mutex mutex;
+    std::deque<Task> tasks;
+    // lets workers skip empty queues without taking their lock
+    std::atomic<size_t> size;
+    // keep neighbouring queues off each other's cache lines
+    char padding[64];
+  };
+
+  /**
+   * Claims a pending task slot, failing if pendingTaskCountMax is reached.
+   */
+  bool reserve();
+
+  /**
+   * Gives back a pending task slot and wakes a thread blocked in add().
+   */
+  void release();
+
+  void push(Task&& task);
+
+  /**
+   * Takes the next task, looking at the queue home first and then stealing
+   * from the others.
+   */
+  bool take(size_t home, Task& task);
+
+  void run(Task& task);
+
+  void expire(const shared_ptr<Runnable>& runnable);
+
+  /**
+   * Remove one or more expired tasks.
+   * \param[in]  justOne  if true, try to remove just one task and return
+   */
+  void removeExpired(bool justOne);
+
+  void lockQueues();
+  void unlockQueues();
+
+  bool isActive() const {
+    return (workerCount_ <= workerMaxCount_)
+           || (state_ == ThreadManager::JOINING && pending_ != 0);
+  }
+
+  bool canSleep() const { return currentWorker.manager != this; }
+
+  /**
+   * Lowers the maximum worker count and blocks until enough worker threads complete
+   * to get to the new maximum worker limit.  The caller is responsible for acquiring
+   * a lock on the class mutex_.
+   */
+  void removeWorkersUnderLock(size_t value);
+
+  const size_t initialWorkerCount_;
+  const size_t pendingTaskCountMax_;
+
+  std::vector<std::unique_ptr<Queue> > queues_;
+
+  // pending_ and idleCount_ (and maxWaiters_ with pending_) are each written
+  // by one side and read by the other before sleeping, so they must stay
+  // sequentially consistent
+  std::atomic<size_t> pending_;
+  std::atomic<size_t> busyCount_;
+  std::atomic<size_t> idleCount_;
+  std::atomic<size_t> expiredCount_;
+  std::atomic<size_t> maxWaiters_;
+
+  // only changed under mutex_, read without it by running workers
+  std::atomic<size_t> workerCount_;
+  std::atomic<size_t> workerMaxCount_;
+  std::atomic<ThreadManager::STATE> state_;
+
+  size_t nextQueue_;
+  ExpireCallback expireCallback_;
+  shared_ptr<ThreadFactory> threadFactory_;
+
+  Mutex mutex_;
+  Monitor monitor_;
+  Monitor maxMonitor_;
+  Monitor workerMonitor_;       // used to synchronize changes in worker count
+
+  std::set<shared_ptr<Thread> > workers_;
+  std::set<shared_ptr<Thread> > deadWorkers_;
+};
+
+class WorkStealingThreadManager::Worker : public Runnable {
+
+public:
+  Worker(WorkStealingThreadManager* manager) : manager_(manager) {}
+
+  ~Worker() override = default;
+
+  /**
+   * Worker entry point
+   *
+   * Waits on the manager monitor only while there are no pending tasks at
+   * all. Otherwise tasks are taken and run without touching the manager
+   * lock, going back to it only when every queue is empty or when the
+   * worker count has been lowered.
+   */
+  void run() override {
+    WorkStealingThreadManager* manager = manager_;
+    Guard g(manager->mutex_);
+
+    bool active = manager->workerCount_ < manager->workerMaxCount_;
+    if (active) {
+      if (++manager->workerCount_ == manager->workerMaxCount_) {
+        manager->workerMonitor_.notify();
+      }
+    }
+
+    const size_t home = manager->nextQueue_++ % manager->queues_.size();
+    currentWorker.manager = manager;
+    currentWorker.queue = home;
+
+    while (active) {
+      while ((active = manager->isActive())) {
+        // Count ourselves idle before looking at pending_, so that a
+        // concurrent add() either sees an idle worker to notify or we see
+        // its task.
+        manager->idleCount_++;
+        if (manager->pending_ != 0) {
+          manager->idleCount_--;
+          break;
+        }
+        manager->monitor_.wait();
+        manager->idleCount_--;
+      }
+
+      if (active) {
+        // Release the lock so we can run tasks without blocking the thread manager
+        manager->mutex_.unlock();
+
+        Task task;
+        while (manager->take(home, task)) {
+          manager->run(task);
+          task = Task();
+          if (!manager->isActive()) {
+            break;
+          }
+        }
+
+        // Re-acquire the lock to decide whether to wait or exit
+        manager->mutex_.lock();
+      }
+    }
+
+    currentWorker.manager = nullptr;
+
+    /**
+     * Final accounting for the worker thread that is done working
+     */
+    manager->deadWorkers_.insert(this->thread());
+    if (--manager->workerCount_ == manager->workerMaxCount_) {
+      manager->workerMonitor_.notify();
+    }
+  }
+
+private:
+  WorkStealingThreadManager* manager_;
+};
+
+void WorkStealingThreadManager::addWorker(size_t value) {
+  std::set<shared_ptr<Thread> > newThreads;
+  for (size_t ix = 0; ix < value; ix++) {
+    newThreads.insert(threadFactory_->newThread(std::make_shared<Worker>(this)));
+  }
+
+  Guard g(mutex_);
+  workerMaxCount_ += value;
+  workers_.insert(newThreads.begin(), newThreads.end());
+
+  for (const auto& newThread : newThreads) {
+    newThread->start();
+  }
+
+  while (workerCount_ != workerMaxCount_) {
+    workerMonitor_.wait();
+  }
+}
+
+void WorkStealingThreadManager::start() {
+  {
+    Guard g(mutex_);
+    if (state_ != ThreadManager::UNINITIALIZED) {
+      return;
+    }
+    if (!threadFactory_) {
+      throw InvalidArgumentException();
+    }
+    state_ = ThreadManager::STARTED;
+  }
+
+  addWorker(initialWorkerCount_);
+}
+
+void WorkStealingThreadManager::stop() {
+  Guard g(mutex_);
+  bool doStop = false;
+
+  if (state_ != ThreadManager::STOPPING && state_ != ThreadManager::JOINING
+      && state_ != ThreadManager::STOPPED) {
+    doStop = true;
+    state_ = ThreadManager::JOINING;
+  }
+
+  if (doStop) {
+    removeWorkersUnderLock(workerCount_);
+  }
+
+  state_ = ThreadManager::STOPPED;
+}
+
+void WorkStealingThreadManager::removeWorker(size_t value) {
+  Guard g(mutex_);
+  removeWorkersUnderLock(value);
+}
+
+void WorkStealingThreadManager::removeWorkersUnderLock(size_t value) {
+  if (value > workerMaxCount_) {
+    throw InvalidArgumentException();
+  }
+
+  workerMaxCount_ -= value;
+
+  if (idleCount_ > value) {
+    // There are more idle workers than we need to remove,
+    // so notify enough of them so they can terminate.
+    for (size_t ix = 0; ix < value; ix++) {
+      monitor_.notify();
+    }
+  } else {
+    // There are as many or less idle workers than we need to remove,
+    // so just notify them all so they can terminate.
+    monitor_.notifyAll();
+  }
+
+  while (workerCount_ != workerMaxCount_) {
+    workerMonitor_.wait();
+  }
+
+  for (const auto& deadWorker : deadWorkers_) {
+
+    // when used with a joinable thread factory, we join the threads as we remove them
+    if (!threadFactory_->isDetached()) {
+      deadWorker->join();
+    }
+
+    workers_.erase(deadWorker);
+  }
+
+  deadWorkers_.clear();
+}
+
+bool WorkStealingThreadManager::reserve() {
+  size_t pending = pending_.load();
+  do {
+    if (pendingTaskCountMax_ > 0 && pending >= pendingTaskCountMax_) {
+      return false;
+    }
+  } while (!pending_.compare_exchange_weak(pending, pending + 1));
+  return true;
+}
+
+void WorkStealingThreadManager::release() {
+  pending_--;
+  if (maxWaiters_ > 0) {
+    Guard g(mutex_);
+    maxMonitor_.notify();
+  }
+}
+
+void WorkStealingThreadManager::push(Task&& task) {
+  size_t index;
+  if (currentWorker.manager == this) {
+    index = currentWorker.queue;
+  } else {
+    static thread_local size_t cursor = std::hash<std::thread::id>()(std::this_thread::get_id());
+    index = cursor++ % queues_.size();
+  }
+
+  Queue& queue = *queues_[index];
+  {
+    Guard g(queue.mutex);
+    queue.tasks.push_back(std::move(task));
+    queue.size = queue.tasks.size();
+  }
+
+  // If idle thread is available notify it, otherwise all worker threads are
+  // running and will get around to this task in time.
+  if (idleCount_ > 0) {
+    Guard g(mutex_);
+    monitor_.notify();
+  }
+}
+
+bool WorkStealingThreadManager::take(size_t home, Task& task) {
+  const size_t count = queues_.size();
+  for (size_t ix = 0; ix < count; ix++) {
+    Queue& queue = *queues_[(home + ix) % count];
+    if (queue.size == 0) {
+      continue;
+    }
+    {
+      Guard g(queue.mutex);
+      if (queue.tasks.empty()) {
+        continue;
+      }
+      task = std::move(queue.tasks.front());
+      queue.tasks.pop_front();
+      queue.size = queue.tasks.size();
+    }
+    // count the task as running before it stops being pending so that
+    // totalTaskCount() never dips while it moves between the two
+    busyCount_++;
+    release();
+    return true;
+  }
+  return false;
+}
+
+void WorkStealingThreadManager::run(Task& task) {
+  if (task.expiredAt(std::chrono::steady_clock::now())) {
+    expire(task.runnable);
+  } else {
+    try {
+      task.runnable->run();
+    } catch (const std::exception& e) {
+      GlobalOutput.printf("[ERROR] task->run() raised an exception: %s", e.what());
+    } catch (...) {
+      GlobalOutput.printf("[ERROR] task->run() raised an unknown exception");
+    }
+  }
+  busyCount_--;
+}
+
+void WorkStealingThreadManager::expire(const shared_ptr<Runnable>& runnable) {
+  ExpireCallback expireCallback;
+  {
+    Guard g(mutex_);
+    expireCallback = expireCallback_;
+  }
+  if (expireCallback) {
+    expireCallback(runnable);
+  }
+  ++expiredCount_;
+}
+
+void WorkStealingThreadManager::add(shared_ptr<Runnable> value,
+                                    int64_t timeout,
+                                    int64_t expiration) {
+  if (state_ != ThreadManager::STARTED) {
+    throw IllegalStateException(
+        "WorkStealingThreadManager::add ThreadManager "
+        "not started");
+  }
+
+  if (!reserve()) {
+    // if we're at a limit, remove an expired task to see if the limit clears
+    removeExpired(true);
+
+    if (!reserve()) {
+      if (!canSleep() || timeout < 0) {
+        throw TooManyPendingTasksException();
+      }
+
+      Guard g(mutex_, timeout);
+      if (!g) {
+        throw TimedOutException();
+      }
+
+      // Registering as a waiter before retrying pairs with release(), which
+      // frees the slot before checking for waiters.
+      maxWaiters_++;
+      try {
+        while (!reserve()) {
+          maxMonitor_.wait(timeout);
+        }
+      } catch (...) {
+        maxWaiters_--;
+        throw;
+      }
+      maxWaiters_--;
+    }
+  }
+
+  push(Task(std::move(value), expiration));
+}
+
+void WorkStealingThreadManager::remove(shared_ptr<Runnable> task) {
+  if (state_ != ThreadManager::STARTED) {
+    throw IllegalStateException(
+        "WorkStealingThreadManager::remove ThreadManager not "
+        "started");
+  }
+
+  for (auto& queue : queues_) {
+    bool found = false;
+    {
+      Guard g(queue->mutex);
+      for (auto it = queue->tasks.begin(); it != queue->tasks.end(); ++it) {
+        if (it->runnable == task) {
+          queue->tasks.erase(it);
+          queue->size = queue->tasks.size();
+          found = true;
+          break;
+        }
+      }
+    }
+    if (found) {
+      release();
+      return;
+    }
+  }
+}
+
+shared_ptr<Runnable> WorkStealingThreadManager::removeNextPending() {
+  if (state_ != ThreadManager::STARTED) {
+    throw IllegalStateException(
+        "WorkStealingThreadManager::removeNextPending "
+        "ThreadManager not started");
+  }
+
+  shared_ptr<Runnable> next;
+  lockQueues();
+  Queue* oldest = nullptr;
+  for (auto& queue : queues_) {
+    if (!queue->tasks.empty()
+        && (oldest == nullptr
+            || queue->tasks.front().enqueueTime < oldest->tasks.front().enqueueTime)) {
+      oldest = queue.get();
+    }
+  }
+  if (oldest != nullptr) {
+    next = std::move(oldest->tasks.front().runnable);
+    oldest->tasks.pop_front();
+    oldest->size = oldest->tasks.size();
+  }
+  unlockQueues();
+
+  if (next) {
+    release();
+  }
+  return next;
+}
+
+void WorkStealingThreadManager::removeExpired(bool justOne) {
+  if (pending_ == 0) {
+    return;
+  }
+  auto now = std::chrono::steady_clock::now();
+
+  std::vector<shared_ptr<Runnable> > expired;
+  lockQueues();
+  for (auto& queue : queues_) {
+    for (auto it = queue->tasks.begin(); it != queue->tasks.end();) {
+      if (it->expiredAt(now)) {
+        expired.push_back(std::move(it->runnable));
+        it = queue->tasks.erase(it);
+        if (justOne) {
+          break;
+        }
+      } else {
+        ++it;
+      }
+    }
+    queue->size = queue->tasks.size();
+    if (justOne && !expired.empty()) {
+      break;
+    }
+  }
+  unlockQueues();
+
+  // the callbacks run without any queue locked so that they may add tasks
+  for (const auto& runnable : expired) {
+    release();
+    expire(runnable);
+  }
+}
+
+void WorkStealingThreadManager::lockQueues() {
+  // always in the same order; workers never hold more than one queue lock
+  for (auto& queue : queues_) {
+    queue->mutex.lock();
+  }
+}
+
+void WorkStealingThreadManager::unlockQueues() {
+  for (auto it = queues_.rbegin(); it != queues_.rend(); ++it) {
+    (*it)->mutex.unlock();
+  }
+}
+
+void WorkStealingThreadManager::setExpireCallback(ExpireCallback expireCallback) {
+  Guard g(mutex_);
+  expireCallback_ = expireCallback;
+}
+
+shared_ptr<ThreadManager> ThreadManager::newWorkStealingThreadManager(size_t count,
+                                                                      size_t pendingTaskCountMax) {
+  return shared_ptr<ThreadManager>(new WorkStealingThreadManager(count, pendingTaskCountMax));
+}
+}
+}
+} // apache::thrift::concurrency
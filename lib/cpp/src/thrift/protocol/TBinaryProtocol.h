@@ -121,6 +121,19 @@ public:
 
   inline uint32_t writeUUID(const std::string& str);
 
+  inline uint32_t writeI32Array(const int32_t* array, const uint32_t size);
+
+  inline uint32_t writeI64Array(const int64_t* array, const uint32_t size);
+
+  inline uint32_t writeDoubleArray(const double* array, const uint32_t size);
+
+  inline uint32_t writeBinarySlice(const TSlice& slice);
+
+  uint32_t writeEncoded(const TSlice& encoded) {
+    this->trans_->writeSlice(encoded);
+    return static_cast<uint32_t>(encoded.size());
+  }
+
   /**
    * Reading functions
    */
@@ -170,6 +183,28 @@ public:
 
   inline uint32_t readUUID(std::string& str);
 
+  inline uint32_t readI32Array(int32_t* array, const uint32_t size);
+
+  inline uint32_t readI64Array(int64_t* array, const uint32_t size);
+
+  inline uint32_t readDoubleArray(double* array, const uint32_t size);
+
+  inline uint32_t readBinarySlice(TSlice& slice);
+
+  /**
+   * Skips without recursion. Strings and containers of fixed width values
+   * are passed over in one step.
+   */
+  uint32_t skip(TType type);
+
+  /**
+   * Captures a value when the transport can lend all of it, as a framed
+   * or memory transport can.
+   */
+  uint32_t readEncoded(TType type, TSlice& encoded);
+
+  TEncodedFormat getEncodedFormat() const override;
+
   int getMinSerializedSize(TType type) override;
 
   void checkReadBytesAvailable(TSet& set) override
@@ -192,6 +227,60 @@ protected:
   template <typename StrType>
   uint32_t readStringBody(StrType& str, int32_t sz);
 
+  // Fixed-width array helpers shared by the read/write*Array() methods
+  template <typename Wire_, typename Elem_, typename Convert_>
+  uint32_t writeArray(const Elem_* array, uint32_t size, Convert_ toWire);
+
+  template <typename Wire_, typename Elem_, typename Convert_>
+  uint32_t readArray(Elem_* array, uint32_t size, Convert_ fromWire);
+
+  // Byte sources for skipValue(): the transport, which skip() consumes, or
+  // a window borrowed from it, which readEncoded() measures values in
+  class TransportInput {
+  public:
+    explicit TransportInput(Transport_* trans) : trans_(trans) {}
+    int8_t readByte() {
+      uint8_t b[1];
+      trans_->readAll(b, 1);
+      return *(int8_t*)b;
+    }
+    int32_t readI32() {
+      union bytes {
+        uint8_t b[4];
+        int32_t all;
+      } theBytes;
+      trans_->readAll(theBytes.b, 4);
+      return (int32_t)ByteOrder_::fromWire32(theBytes.all);
+    }
+    void skip(uint32_t len) { skipBytes(*trans_, len); }
+
+  private:
+    Transport_* trans_;
+  };
+
+  class WindowInput : public TBorrowedWindow {
+  public:
+    WindowInput(const uint8_t* buf, uint32_t len) : TBorrowedWindow(buf, len) {}
+    int32_t readI32() {
+      union bytes {
+        uint8_t b[4];
+        int32_t all;
+      } theBytes;
+      const uint8_t* p = take(4);
+      std::copy(p, p + 4, theBytes.b);
+      return (int32_t)ByteOrder_::fromWire32(theBytes.all);
+    }
+  };
+
+  template <class Input_>
+  uint32_t skipValue(Input_& in, TType type);
+
+  // Wire size of a value of type, or 0 if it is not fixed
+  static uint32_t fixedWidth(TType type);
+  // Wire size of size values of width bytes
+  static uint32_t runLength(uint32_t size, uint32_t width);
+  static uint32_t checkSize(int32_t size, int32_t limit);
+
   Transport_* trans_;
 
   int32_t string_limit_;
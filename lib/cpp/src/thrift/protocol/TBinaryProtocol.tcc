@@ -24,7 +24,10 @@
 #include <thrift/protocol/TUuidUtils.hpp>
 #include <thrift/transport/TTransportException.h>
 
+#include <algorithm>
+#include <cstring>
 #include <limits>
+#include <type_traits>
 
 namespace apache {
 namespace thrift {
@@ -194,6 +197,18 @@ uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::writeBinary(const std::string
   return TBinaryProtocolT<Transport_, ByteOrder_>::writeString(str);
 }
 
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::writeBinarySlice(const TSlice& slice) {
+  if (slice.size() > static_cast<size_t>((std::numeric_limits<int32_t>::max)()))
+    throw TProtocolException(TProtocolException::SIZE_LIMIT);
+  auto size = static_cast<uint32_t>(slice.size());
+  uint32_t result = writeI32((int32_t)size);
+  if (size > 0) {
+    this->trans_->writeSlice(slice);
+  }
+  return result + size;
+}
+
 template <class Transport_, class ByteOrder_>
 uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::writeUUID(const std::string& str) {
   std::string out;
@@ -208,6 +223,62 @@ uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::writeUUID(const std::string&
   return 16;
 }
 
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::writeI32Array(const int32_t* array,
+                                                                 const uint32_t size) {
+  return writeArray<uint32_t>(array, size, [](int32_t v) {
+    return (uint32_t)ByteOrder_::toWire32((uint32_t)v);
+  });
+}
+
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::writeI64Array(const int64_t* array,
+                                                                 const uint32_t size) {
+  return writeArray<uint64_t>(array, size, [](int64_t v) {
+    return (uint64_t)ByteOrder_::toWire64((uint64_t)v);
+  });
+}
+
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::writeDoubleArray(const double* array,
+                                                                    const uint32_t size) {
+  static_assert(sizeof(double) == sizeof(uint64_t), "sizeof(double) == sizeof(uint64_t)");
+  static_assert(std::numeric_limits<double>::is_iec559, "std::numeric_limits<double>::is_iec559");
+
+  return writeArray<uint64_t>(array, size, [](double v) {
+    return (uint64_t)ByteOrder_::toWire64(bitwise_cast<uint64_t>(v));
+  });
+}
+
+/**
+ * Converts the elements to wire order in fixed-size chunks on the stack, so
+ * the transport sees a few large writes instead of one write per element.
+ */
+template <class Transport_, class ByteOrder_>
+template <typename Wire_, typename Elem_, typename Convert_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::writeArray(const Elem_* array,
+                                                              uint32_t size,
+                                                              Convert_ toWire) {
+  static_assert(sizeof(Wire_) == sizeof(Elem_), "sizeof(Wire_) == sizeof(Elem_)");
+
+  if (size > static_cast<uint32_t>((std::numeric_limits<int32_t>::max)()) / sizeof(Wire_)) {
+    throw TProtocolException(TProtocolException::SIZE_LIMIT);
+  }
+
+  Wire_ chunk[1024 / sizeof(Wire_)];
+  const uint32_t chunkElems = sizeof(chunk) / sizeof(Wire_);
+  for (uint32_t done = 0; done < size;) {
+    const uint32_t n = (std::min)(chunkElems, size - done);
+    for (uint32_t i = 0; i < n; ++i) {
+      chunk[i] = toWire(array[done + i]);
+    }
+    this->trans_->write(reinterpret_cast<const uint8_t*>(chunk),
+                        static_cast<uint32_t>(n * sizeof(Wire_)));
+    done += n;
+  }
+  return static_cast<uint32_t>(size * sizeof(Wire_));
+}
+
 /**
  * Reading functions
  */
@@ -443,6 +514,20 @@ uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::readBinary(std::string& str)
   return TBinaryProtocolT<Transport_, ByteOrder_>::readString(str);
 }
 
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::readBinarySlice(TSlice& slice) {
+  int32_t size;
+  uint32_t result = readI32(size);
+  if (size < 0) {
+    throw TProtocolException(TProtocolException::NEGATIVE_SIZE);
+  }
+  if (this->string_limit_ > 0 && size > this->string_limit_) {
+    throw TProtocolException(TProtocolException::SIZE_LIMIT);
+  }
+  slice = this->trans_->readSlice(static_cast<uint32_t>(size));
+  return result + (uint32_t)size;
+}
+
 template <class Transport_, class ByteOrder_>
 uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::readUUID(std::string& str) {
   std::string in;
@@ -451,6 +536,74 @@ uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::readUUID(std::string& str) {
   return 16;
 }
 
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::readI32Array(int32_t* array,
+                                                                const uint32_t size) {
+  return readArray<uint32_t>(array, size, [](uint32_t w) {
+    return (int32_t)ByteOrder_::fromWire32(w);
+  });
+}
+
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::readI64Array(int64_t* array,
+                                                                const uint32_t size) {
+  return readArray<uint64_t>(array, size, [](uint64_t w) {
+    return (int64_t)ByteOrder_::fromWire64(w);
+  });
+}
+
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::readDoubleArray(double* array,
+                                                                   const uint32_t size) {
+  static_assert(sizeof(double) == sizeof(uint64_t), "sizeof(double) == sizeof(uint64_t)");
+  static_assert(std::numeric_limits<double>::is_iec559, "std::numeric_limits<double>::is_iec559");
+
+  return readArray<uint64_t>(array, size, [](uint64_t w) {
+    return bitwise_cast<double>((uint64_t)ByteOrder_::fromWire64(w));
+  });
+}
+
+/**
+ * When the transport can lend the whole run, the byte swap is fused with the
+ * copy out of its buffer.  Otherwise the run is read straight into the
+ * destination and swapped in place.
+ */
+template <class Transport_, class ByteOrder_>
+template <typename Wire_, typename Elem_, typename Convert_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::readArray(Elem_* array,
+                                                             uint32_t size,
+                                                             Convert_ fromWire) {
+  static_assert(sizeof(Wire_) == sizeof(Elem_), "sizeof(Wire_) == sizeof(Elem_)");
+
+  if (size == 0) {
+    return 0;
+  }
+  if (size > static_cast<uint32_t>((std::numeric_limits<int32_t>::max)()) / sizeof(Wire_)) {
+    throw TProtocolException(TProtocolException::SIZE_LIMIT);
+  }
+  const auto len = static_cast<uint32_t>(size * sizeof(Wire_));
+
+  uint32_t got = len;
+  const uint8_t* borrow_buf = this->trans_->borrow(nullptr, &got);
+  if (borrow_buf) {
+    for (uint32_t i = 0; i < size; ++i) {
+      Wire_ w;
+      std::memcpy(&w, borrow_buf + i * sizeof(Wire_), sizeof(Wire_));
+      array[i] = fromWire(w);
+    }
+    this->trans_->consume(len);
+    return len;
+  }
+
+  this->trans_->readAll(reinterpret_cast<uint8_t*>(array), len);
+  for (uint32_t i = 0; i < size; ++i) {
+    Wire_ w;
+    std::memcpy(&w, &array[i], sizeof(Wire_));
+    array[i] = fromWire(w);
+  }
+  return len;
+}
+
 template <class Transport_, class ByteOrder_>
 template <typename StrType>
 uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::readStringBody(StrType& str, int32_t size) {
@@ -484,6 +637,166 @@ uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::readStringBody(StrType& str,
   return (uint32_t)size;
 }
 
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::skip(TType type) {
+  TransportInput in(this->trans_);
+  return skipValue(in, type);
+}
+
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::readEncoded(TType type, TSlice& encoded) {
+  uint32_t avail = 1;
+  const uint8_t* window = this->trans_->borrow(nullptr, &avail);
+  if (window == nullptr) {
+    return 0;
+  }
+
+  uint32_t size;
+  try {
+    WindowInput in(window, avail);
+    size = skipValue(in, type);
+  } catch (const transport::TTransportException&) {
+    // the value does not end inside the window
+    return 0;
+  }
+  encoded = this->trans_->readSlice(size);
+  return size;
+}
+
+template <class Transport_, class ByteOrder_>
+TEncodedFormat TBinaryProtocolT<Transport_, ByteOrder_>::getEncodedFormat() const {
+  return std::is_same<ByteOrder_, TNetworkLittleEndian>::value ? T_ENCODED_BINARY_LE
+                                                               : T_ENCODED_BINARY;
+}
+
+/**
+ * Passes over one value without recursion. Strings and containers of fixed
+ * width values are passed over in one step.
+ */
+template <class Transport_, class ByteOrder_>
+template <class Input_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::skipValue(Input_& in, TType type) {
+  uint32_t result = 0;
+  TSkipStack stack(*this);
+
+  while (true) {
+    uint32_t width = fixedWidth(type);
+    if (width) {
+      in.skip(width);
+      result += width;
+    } else {
+      switch (type) {
+      case T_STRING: {
+        uint32_t size = checkSize(in.readI32(), this->string_limit_);
+        in.skip(size);
+        result += 4 + size;
+        break;
+      }
+      case T_STRUCT:
+        stack.push(T_STRUCT, T_STOP, T_STOP, 0);
+        break;
+      case T_MAP: {
+        auto keyType = static_cast<TType>(in.readByte());
+        auto valType = static_cast<TType>(in.readByte());
+        uint32_t size = checkSize(in.readI32(), this->container_limit_);
+        result += 6;
+        uint32_t keyWidth = fixedWidth(keyType);
+        uint32_t valWidth = fixedWidth(valType);
+        if (keyWidth && valWidth) {
+          uint32_t len = runLength(size, keyWidth + valWidth);
+          in.skip(len);
+          result += len;
+        } else if (size > 0) {
+          stack.push(T_MAP, keyType, valType, 2 * size);
+        }
+        break;
+      }
+      case T_SET:
+      case T_LIST: {
+        auto elemType = static_cast<TType>(in.readByte());
+        uint32_t size = checkSize(in.readI32(), this->container_limit_);
+        result += 5;
+        uint32_t elemWidth = fixedWidth(elemType);
+        if (elemWidth) {
+          uint32_t len = runLength(size, elemWidth);
+          in.skip(len);
+          result += len;
+        } else if (size > 0) {
+          stack.push(type, elemType, T_STOP, size);
+        }
+        break;
+      }
+      default:
+        throw TProtocolException(TProtocolException::INVALID_DATA, "invalid TType");
+      }
+    }
+
+    // Find the next value, closing the structs and containers that are done
+    while (true) {
+      if (stack.empty()) {
+        return result;
+      }
+      TSkipFrame& frame = stack.top();
+      if (frame.type == T_STRUCT) {
+        int8_t fieldType = in.readByte();
+        result += 1;
+        if (fieldType != T_STOP) {
+          // the field id
+          in.skip(2);
+          result += 2;
+          type = static_cast<TType>(fieldType);
+          break;
+        }
+      } else if (frame.left > 0) {
+        type = (frame.type == T_MAP && frame.left % 2 == 1) ? frame.valType : frame.elemType;
+        --frame.left;
+        break;
+      }
+      stack.pop();
+    }
+  }
+}
+
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::fixedWidth(TType type) {
+  switch (type) {
+  case T_BOOL:
+  case T_BYTE:
+    return 1;
+  case T_I16:
+    return 2;
+  case T_I32:
+    return 4;
+  case T_I64:
+  case T_DOUBLE:
+    return 8;
+  case T_UUID:
+    return 16;
+  default:
+    return 0;
+  }
+}
+
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::runLength(uint32_t size, uint32_t width) {
+  uint64_t len = static_cast<uint64_t>(size) * width;
+  if (len > static_cast<uint64_t>((std::numeric_limits<int32_t>::max)())) {
+    throw TProtocolException(TProtocolException::SIZE_LIMIT);
+  }
+  return static_cast<uint32_t>(len);
+}
+
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::checkSize(int32_t size, int32_t limit) {
+  if (size < 0) {
+    throw TProtocolException(TProtocolException::NEGATIVE_SIZE);
+  }
+  if (limit > 0 && size > limit) {
+    throw TProtocolException(TProtocolException::SIZE_LIMIT);
+  }
+  return static_cast<uint32_t>(size);
+}
+
 // Return the minimum number of bytes a type will consume on the wire
 template <class Transport_, class ByteOrder_>
 int TBinaryProtocolT<Transport_, ByteOrder_>::getMinSerializedSize(TType type)
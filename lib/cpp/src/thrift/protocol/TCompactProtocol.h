@@ -140,6 +140,19 @@ public:
 
   uint32_t writeBinary(const std::string& str);
 
+  uint32_t writeI32Array(const int32_t* array, const uint32_t size);
+
+  uint32_t writeI64Array(const int64_t* array, const uint32_t size);
+
+  uint32_t writeBinarySlice(const TSlice& slice);
+
+  uint32_t writeEncoded(const TSlice& encoded) {
+    trans_->writeSlice(encoded);
+    return static_cast<uint32_t>(encoded.size());
+  }
+
+  TEncodedFormat getEncodedFormat() const override { return T_ENCODED_COMPACT; }
+
   int getMinSerializedSize(TType type) override;
 
   void checkReadBytesAvailable(TSet& set) override
@@ -213,6 +226,25 @@ public:
 
   uint32_t readBinary(std::string& str);
 
+  uint32_t readI32Array(int32_t* array, const uint32_t size);
+
+  uint32_t readI64Array(int64_t* array, const uint32_t size);
+
+  uint32_t readBinarySlice(TSlice& slice);
+
+  /**
+   * Skips without recursion. Strings and containers of fixed width values
+   * are passed over in one step, runs of varints are skipped by finding
+   * their ends rather than decoding them.
+   */
+  uint32_t skip(TType type);
+
+  /**
+   * Captures a value when the transport can lend all of it, as a framed
+   * or memory transport can.
+   */
+  uint32_t readEncoded(TType type, TSlice& encoded);
+
   /*
    *These methods are here for the struct to call, but don't have any wire
    * encoding.
@@ -226,6 +258,19 @@ public:
 protected:
   uint32_t readVarint32(int32_t& i32);
   uint32_t readVarint64(int64_t& i64);
+  template <typename Int_, typename Convert_>
+  uint32_t readVarintArray(Int_* array, uint32_t size, Convert_ fromZigzag);
+  uint32_t skipVarints(uint32_t count);
+  // Byte sources for skipValue(): the transport, which skip() consumes, or
+  // a window borrowed from it, which readEncoded() measures values in
+  class TransportInput;
+  class WindowInput;
+  template <class Input_>
+  uint32_t skipValue(Input_& in, TType type);
+  static uint32_t runLength(uint32_t size, uint32_t width);
+  // Wire size of a container element of type, or 0 if it is not fixed
+  static uint32_t fixedWidth(TType type);
+  static bool isVarint(TType type);
   int32_t zigzagToI32(uint32_t n);
   int64_t zigzagToI64(uint64_t n);
   TType getTType(int8_t type);
@@ -21,9 +21,31 @@
 
 #include <limits>
 #include <cstdlib>
+#include <cstring>
 
 #include "thrift/config.h"
 
+/*
+ * Varint decoding packs the 7-bit groups of a varint with PEXT when the
+ * target is known to have BMI2 (e.g. -mbmi2 or -march=haswell), and with a
+ * portable mask-and-shift sequence otherwise.  Define
+ * THRIFT_COMPACT_USE_PEXT to 0 or 1 to override the choice.
+ */
+#ifndef THRIFT_COMPACT_USE_PEXT
+#if defined(__BMI2__) && (defined(__x86_64__) || defined(_M_X64))
+#define THRIFT_COMPACT_USE_PEXT 1
+#else
+#define THRIFT_COMPACT_USE_PEXT 0
+#endif
+#endif
+
+#if THRIFT_COMPACT_USE_PEXT
+#include <immintrin.h>
+#endif
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
 /*
  * TCompactProtocol::i*ToZigzag depend on the fact that the right shift
  * operator on a signed integer is an arithmetic (sign-extending) shift.
@@ -83,6 +105,85 @@ const int8_t TTypeToCType[16] = {
   CT_LIST, // T_LIST
 };
 
+/**
+ * Longest possible varint: 64 bits / (7 bits/byte) = 10 bytes.
+ */
+const uint32_t VARINT_MAX_BYTES = 10;
+
+inline uint32_t countTrailingZeros64(uint64_t x) {
+#if defined(__GNUC__)
+  return static_cast<uint32_t>(__builtin_ctzll(x));
+#elif defined(_MSC_VER) && defined(_M_X64)
+  unsigned long index;
+  _BitScanForward64(&index, x);
+  return static_cast<uint32_t>(index);
+#else
+  uint32_t n = 0;
+  while (!(x & 1)) {
+    x >>= 1;
+    ++n;
+  }
+  return n;
+#endif
+}
+
+/**
+ * Decode one varint from a buffer with at least VARINT_MAX_BYTES readable
+ * bytes, returning the number of bytes it occupies.
+ *
+ * The first eight bytes are loaded as a single little endian word.  The
+ * first byte without a continuation bit gives the length, and the 7-bit
+ * groups of that many bytes are packed without a per-byte loop.  Only
+ * values of more than 56 bits fall back to decoding byte by byte.
+ */
+inline uint32_t decodeVarint64(const uint8_t* buf, uint64_t& value) {
+  uint64_t word;
+  std::memcpy(&word, buf, sizeof(word));
+  word = THRIFT_letohll(word);
+
+  const uint64_t stops = ~word & 0x8080808080808080ULL;
+  if (stops != 0) {
+    const uint32_t len = (countTrailingZeros64(stops) >> 3) + 1;
+    if (len < 8) {
+      word &= (1ULL << (len * 8)) - 1;
+    }
+#if THRIFT_COMPACT_USE_PEXT
+    value = _pext_u64(word, 0x7f7f7f7f7f7f7f7fULL);
+#else
+    word &= 0x7f7f7f7f7f7f7f7fULL;
+    word = ((word & 0x7f007f007f007f00ULL) >> 1) | (word & 0x007f007f007f007fULL);
+    word = ((word & 0x3fff00003fff0000ULL) >> 2) | (word & 0x00003fff00003fffULL);
+    word = ((word & 0x0fffffff00000000ULL) >> 4) | (word & 0x000000000fffffffULL);
+    value = word;
+#endif
+    return len;
+  }
+
+  uint64_t val = 0;
+  for (uint32_t i = 0; i < VARINT_MAX_BYTES; ++i) {
+    val |= (uint64_t)(buf[i] & 0x7f) << (7 * i);
+    if (!(buf[i] & 0x80)) {
+      value = val;
+      return i + 1;
+    }
+  }
+  throw TProtocolException(TProtocolException::INVALID_DATA, "Variable-length int over 10 bytes.");
+}
+
+/**
+ * Encode n as a varint into buf, which must have room for VARINT_MAX_BYTES,
+ * returning the number of bytes written.
+ */
+inline uint32_t encodeVarint64(uint64_t n, uint8_t* buf) {
+  uint32_t wsize = 0;
+  while (n & ~0x7FULL) {
+    buf[wsize++] = (uint8_t)((n & 0x7F) | 0x80);
+    n >>= 7;
+  }
+  buf[wsize++] = (uint8_t)n;
+  return wsize;
+}
+
 }} // end detail::compact namespace
 
 
@@ -286,6 +387,21 @@ uint32_t TCompactProtocolT<Transport_>::writeBinary(const std::string& str) {
   return wsize;
 }
 
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::writeBinarySlice(const TSlice& slice) {
+  if(slice.size() > (std::numeric_limits<uint32_t>::max)())
+    throw TProtocolException(TProtocolException::SIZE_LIMIT);
+  auto ssize = static_cast<uint32_t>(slice.size());
+  uint32_t wsize = writeVarint32(ssize);
+  if(ssize > (std::numeric_limits<uint32_t>::max)() - wsize)
+    throw TProtocolException(TProtocolException::SIZE_LIMIT);
+  wsize += ssize;
+  if (ssize > 0) {
+    trans_->writeSlice(slice);
+  }
+  return wsize;
+}
+
 //
 // Internal Writing methods
 //
@@ -345,18 +461,8 @@ uint32_t TCompactProtocolT<Transport_>::writeCollectionBegin(const TType elemTyp
  */
 template <class Transport_>
 uint32_t TCompactProtocolT<Transport_>::writeVarint32(uint32_t n) {
-  uint8_t buf[5];
-  uint32_t wsize = 0;
-
-  while (true) {
-    if ((n & ~0x7F) == 0) {
-      buf[wsize++] = (int8_t)n;
-      break;
-    } else {
-      buf[wsize++] = (int8_t)((n & 0x7F) | 0x80);
-      n >>= 7;
-    }
-  }
+  uint8_t buf[detail::compact::VARINT_MAX_BYTES];
+  uint32_t wsize = detail::compact::encodeVarint64(n, buf);
   trans_->write(buf, wsize);
   return wsize;
 }
@@ -366,20 +472,48 @@ uint32_t TCompactProtocolT<Transport_>::writeVarint32(uint32_t n) {
  */
 template <class Transport_>
 uint32_t TCompactProtocolT<Transport_>::writeVarint64(uint64_t n) {
-  uint8_t buf[10];
+  uint8_t buf[detail::compact::VARINT_MAX_BYTES];
+  uint32_t wsize = detail::compact::encodeVarint64(n, buf);
+  trans_->write(buf, wsize);
+  return wsize;
+}
+
+/**
+ * Write a run of list elements, encoding them into a stack buffer so the
+ * transport sees one write per chunk instead of one per element.
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::writeI32Array(const int32_t* array, const uint32_t size) {
+  uint8_t buf[1024];
   uint32_t wsize = 0;
+  uint32_t used = 0;
+  for (uint32_t i = 0; i < size; ++i) {
+    if (used > sizeof(buf) - detail::compact::VARINT_MAX_BYTES) {
+      trans_->write(buf, used);
+      wsize += used;
+      used = 0;
+    }
+    used += detail::compact::encodeVarint64(i32ToZigzag(array[i]), buf + used);
+  }
+  trans_->write(buf, used);
+  return wsize + used;
+}
 
-  while (true) {
-    if ((n & ~0x7FL) == 0) {
-      buf[wsize++] = (int8_t)n;
-      break;
-    } else {
-      buf[wsize++] = (int8_t)((n & 0x7F) | 0x80);
-      n >>= 7;
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::writeI64Array(const int64_t* array, const uint32_t size) {
+  uint8_t buf[1024];
+  uint32_t wsize = 0;
+  uint32_t used = 0;
+  for (uint32_t i = 0; i < size; ++i) {
+    if (used > sizeof(buf) - detail::compact::VARINT_MAX_BYTES) {
+      trans_->write(buf, used);
+      wsize += used;
+      used = 0;
     }
+    used += detail::compact::encodeVarint64(i64ToZigzag(array[i]), buf + used);
   }
-  trans_->write(buf, wsize);
-  return wsize;
+  trans_->write(buf, used);
+  return wsize + used;
 }
 
 /**
@@ -718,6 +852,26 @@ uint32_t TCompactProtocolT<Transport_>::readBinary(std::string& str) {
   return rsize + (uint32_t)size;
 }
 
+/**
+ * Read a byte[] from the wire into a slice of the transport's buffer.
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::readBinarySlice(TSlice& slice) {
+  int32_t rsize = 0;
+  int32_t size;
+
+  rsize += readVarint32(size);
+  if (size < 0) {
+    throw TProtocolException(TProtocolException::NEGATIVE_SIZE);
+  }
+  if (string_limit_ > 0 && size > string_limit_) {
+    throw TProtocolException(TProtocolException::SIZE_LIMIT);
+  }
+  trans_->checkReadBytesAvailable(rsize + (uint32_t)size);
+  slice = trans_->readSlice(static_cast<uint32_t>(size));
+  return rsize + (uint32_t)size;
+}
+
 /**
  * Read an i32 from the wire as a varint. The MSB of each byte is set
  * if there is another byte to follow. This can read up to 5 bytes.
@@ -739,27 +893,16 @@ uint32_t TCompactProtocolT<Transport_>::readVarint64(int64_t& i64) {
   uint32_t rsize = 0;
   uint64_t val = 0;
   int shift = 0;
-  uint8_t buf[10];  // 64 bits / (7 bits/byte) = 10 bytes.
+  uint8_t buf[detail::compact::VARINT_MAX_BYTES];
   uint32_t buf_size = sizeof(buf);
   const uint8_t* borrowed = trans_->borrow(buf, &buf_size);
 
   // Fast path.
   if (borrowed != nullptr) {
-    while (true) {
-      uint8_t byte = borrowed[rsize];
-      rsize++;
-      val |= (uint64_t)(byte & 0x7f) << shift;
-      shift += 7;
-      if (!(byte & 0x80)) {
-        i64 = val;
-        trans_->consume(rsize);
-        return rsize;
-      }
-      // Have to check for invalid data so we don't crash.
-      if (UNLIKELY(rsize == sizeof(buf))) {
-        throw TProtocolException(TProtocolException::INVALID_DATA, "Variable-length int over 10 bytes.");
-      }
-    }
+    rsize = detail::compact::decodeVarint64(borrowed, val);
+    i64 = val;
+    trans_->consume(rsize);
+    return rsize;
   }
 
   // Slow path.
@@ -781,6 +924,340 @@ uint32_t TCompactProtocolT<Transport_>::readVarint64(int64_t& i64) {
   }
 }
 
+/**
+ * Read a run of zigzag varints.  Whenever the transport can lend a window,
+ * every element that is guaranteed to fit in it is decoded straight out of
+ * the window and the whole stretch is consumed at once; elements near the
+ * end of the window take the per-element path.
+ */
+template <class Transport_>
+template <typename Int_, typename Convert_>
+uint32_t TCompactProtocolT<Transport_>::readVarintArray(Int_* array,
+                                                        uint32_t size,
+                                                        Convert_ fromZigzag) {
+  uint32_t rsize = 0;
+  uint32_t i = 0;
+  while (i < size) {
+    uint32_t avail = detail::compact::VARINT_MAX_BYTES;
+    const uint8_t* borrowed = trans_->borrow(nullptr, &avail);
+    if (borrowed == nullptr) {
+      int64_t value;
+      rsize += readVarint64(value);
+      array[i++] = fromZigzag(static_cast<uint64_t>(value));
+      continue;
+    }
+
+    uint32_t used = 0;
+    while (i < size && avail - used >= detail::compact::VARINT_MAX_BYTES) {
+      uint64_t value;
+      used += detail::compact::decodeVarint64(borrowed + used, value);
+      array[i++] = fromZigzag(value);
+    }
+    trans_->consume(used);
+    rsize += used;
+  }
+  return rsize;
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::readI32Array(int32_t* array, const uint32_t size) {
+  return readVarintArray(array, size, [this](uint64_t n) {
+    return zigzagToI32(static_cast<uint32_t>(n));
+  });
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::readI64Array(int64_t* array, const uint32_t size) {
+  return readVarintArray(array, size, [this](uint64_t n) { return zigzagToI64(n); });
+}
+
+template <class Transport_>
+class TCompactProtocolT<Transport_>::TransportInput {
+public:
+  explicit TransportInput(TCompactProtocolT* prot) : prot_(prot) {}
+  int8_t readByte() {
+    int8_t byte;
+    prot_->readByte(byte);
+    return byte;
+  }
+  uint32_t readVarint32(int32_t& i32) { return prot_->readVarint32(i32); }
+  uint32_t skipVarints(uint32_t count) { return prot_->skipVarints(count); }
+  void skip(uint32_t len) { skipBytes(*prot_->trans_, len); }
+
+private:
+  TCompactProtocolT* prot_;
+};
+
+template <class Transport_>
+class TCompactProtocolT<Transport_>::WindowInput : public TBorrowedWindow {
+public:
+  WindowInput(const uint8_t* buf, uint32_t len) : TBorrowedWindow(buf, len) {}
+
+  uint32_t readVarint32(int32_t& i32) {
+    const uint8_t* start = pos_;
+    uint32_t rsize = skipVarints(1);
+    uint64_t val = 0;
+    for (uint32_t i = 0; i < rsize; ++i) {
+      val |= (uint64_t)(start[i] & 0x7f) << (7 * i);
+    }
+    i32 = (int32_t)val;
+    return rsize;
+  }
+
+  uint32_t skipVarints(uint32_t count) {
+    const uint8_t* start = pos_;
+    const uint8_t* last = pos_;
+    while (count > 0) {
+      if (pos_ == end_) {
+        throw transport::TTransportException(transport::TTransportException::END_OF_FILE);
+      }
+      if (!(*pos_++ & 0x80)) {
+        last = pos_;
+        --count;
+      } else if (UNLIKELY(static_cast<uint32_t>(pos_ - last) >= detail::compact::VARINT_MAX_BYTES)) {
+        throw TProtocolException(TProtocolException::INVALID_DATA, "Variable-length int over 10 bytes.");
+      }
+    }
+    return static_cast<uint32_t>(pos_ - start);
+  }
+};
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::skip(TType type) {
+  // the value of a bool field came with its header
+  if (type == T_BOOL && boolValue_.hasBoolValue) {
+    boolValue_.hasBoolValue = false;
+    return 0;
+  }
+
+  TransportInput in(this);
+  return skipValue(in, type);
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::readEncoded(TType type, TSlice& encoded) {
+  // the value of a bool field came with its header and has no bytes of its own
+  if (type == T_BOOL && boolValue_.hasBoolValue) {
+    return 0;
+  }
+
+  uint32_t avail = 1;
+  const uint8_t* window = trans_->borrow(nullptr, &avail);
+  if (window == nullptr) {
+    return 0;
+  }
+
+  uint32_t size;
+  try {
+    WindowInput in(window, avail);
+    size = skipValue(in, type);
+  } catch (const transport::TTransportException&) {
+    // the value does not end inside the window
+    return 0;
+  }
+  encoded = trans_->readSlice(size);
+  return size;
+}
+
+/**
+ * Passes over one value without recursion. Strings and containers of fixed
+ * width values are passed over in one step, runs of varints are passed over
+ * by finding their ends rather than decoding them.
+ */
+template <class Transport_>
+template <class Input_>
+uint32_t TCompactProtocolT<Transport_>::skipValue(Input_& in, TType type) {
+  uint32_t result = 0;
+  TSkipStack stack(*this);
+
+  while (true) {
+    switch (type) {
+    case T_BOOL:
+    case T_BYTE:
+      in.skip(1);
+      result += 1;
+      break;
+    case T_DOUBLE:
+      in.skip(8);
+      result += 8;
+      break;
+    case T_I16:
+    case T_I32:
+    case T_I64:
+      result += in.skipVarints(1);
+      break;
+    case T_STRING: {
+      int32_t size;
+      result += in.readVarint32(size);
+      if (size < 0) {
+        throw TProtocolException(TProtocolException::NEGATIVE_SIZE);
+      }
+      if (string_limit_ > 0 && size > string_limit_) {
+        throw TProtocolException(TProtocolException::SIZE_LIMIT);
+      }
+      in.skip(static_cast<uint32_t>(size));
+      result += static_cast<uint32_t>(size);
+      break;
+    }
+    case T_STRUCT:
+      stack.push(T_STRUCT, T_STOP, T_STOP, 0);
+      break;
+    case T_MAP: {
+      int32_t size;
+      result += in.readVarint32(size);
+      if (size < 0) {
+        throw TProtocolException(TProtocolException::NEGATIVE_SIZE);
+      } else if (container_limit_ && size > container_limit_) {
+        throw TProtocolException(TProtocolException::SIZE_LIMIT);
+      }
+      if (size == 0) {
+        break;
+      }
+      auto kvType = static_cast<uint8_t>(in.readByte());
+      result += 1;
+      TType keyType = getTType(static_cast<int8_t>(kvType >> 4));
+      TType valType = getTType(static_cast<int8_t>(kvType & 0xf));
+      uint32_t keyWidth = fixedWidth(keyType);
+      uint32_t valWidth = fixedWidth(valType);
+      if (keyWidth && valWidth) {
+        uint32_t len = runLength(static_cast<uint32_t>(size), keyWidth + valWidth);
+        in.skip(len);
+        result += len;
+      } else if (isVarint(keyType) && isVarint(valType)) {
+        result += in.skipVarints(2 * static_cast<uint32_t>(size));
+      } else {
+        stack.push(T_MAP, keyType, valType, 2 * static_cast<uint32_t>(size));
+      }
+      break;
+    }
+    case T_SET:
+    case T_LIST: {
+      auto sizeAndType = static_cast<uint8_t>(in.readByte());
+      result += 1;
+      int32_t size = (sizeAndType >> 4) & 0x0f;
+      if (size == 15) {
+        result += in.readVarint32(size);
+      }
+      if (size < 0) {
+        throw TProtocolException(TProtocolException::NEGATIVE_SIZE);
+      } else if (container_limit_ && size > container_limit_) {
+        throw TProtocolException(TProtocolException::SIZE_LIMIT);
+      }
+      if (size == 0) {
+        break;
+      }
+      TType elemType = getTType(static_cast<int8_t>(sizeAndType & 0x0f));
+      uint32_t elemWidth = fixedWidth(elemType);
+      if (elemWidth) {
+        uint32_t len = runLength(static_cast<uint32_t>(size), elemWidth);
+        in.skip(len);
+        result += len;
+      } else if (isVarint(elemType)) {
+        result += in.skipVarints(static_cast<uint32_t>(size));
+      } else {
+        stack.push(type, elemType, T_STOP, static_cast<uint32_t>(size));
+      }
+      break;
+    }
+    default:
+      throw TProtocolException(TProtocolException::INVALID_DATA, "invalid TType");
+    }
+
+    // Find the next value, closing the structs and containers that are done
+    while (true) {
+      if (stack.empty()) {
+        return result;
+      }
+      TSkipFrame& frame = stack.top();
+      if (frame.type == T_STRUCT) {
+        int8_t byte = in.readByte();
+        result += 1;
+        int8_t fieldType = (byte & 0x0f);
+        if (fieldType == T_STOP) {
+          stack.pop();
+          continue;
+        }
+        // field ids do not matter here, only whether one follows
+        if ((byte & 0xf0) == 0) {
+          result += in.skipVarints(1);
+        }
+        if (fieldType == detail::compact::CT_BOOLEAN_TRUE
+            || fieldType == detail::compact::CT_BOOLEAN_FALSE) {
+          continue;
+        }
+        type = getTType(fieldType);
+        break;
+      } else if (frame.left > 0) {
+        type = (frame.type == T_MAP && frame.left % 2 == 1) ? frame.valType : frame.elemType;
+        --frame.left;
+        break;
+      }
+      stack.pop();
+    }
+  }
+}
+
+/**
+ * Skip count varints.  Whenever the transport can lend a window, the ends of
+ * the varints in it are counted without decoding them and the whole stretch
+ * is consumed at once.
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::skipVarints(uint32_t count) {
+  uint32_t rsize = 0;
+  while (count > 0) {
+    uint32_t avail = detail::compact::VARINT_MAX_BYTES;
+    const uint8_t* borrowed = trans_->borrow(nullptr, &avail);
+    if (borrowed == nullptr) {
+      int64_t value;
+      rsize += readVarint64(value);
+      --count;
+      continue;
+    }
+
+    // used ends with the last complete varint in the window
+    uint32_t used = 0;
+    for (uint32_t pos = 0; count > 0 && pos < avail;) {
+      if (!(borrowed[pos++] & 0x80)) {
+        used = pos;
+        --count;
+      } else if (UNLIKELY(pos - used >= detail::compact::VARINT_MAX_BYTES)) {
+        throw TProtocolException(TProtocolException::INVALID_DATA, "Variable-length int over 10 bytes.");
+      }
+    }
+    trans_->consume(used);
+    rsize += used;
+  }
+  return rsize;
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::runLength(uint32_t size, uint32_t width) {
+  uint64_t len = static_cast<uint64_t>(size) * width;
+  if (len > static_cast<uint64_t>((std::numeric_limits<int32_t>::max)())) {
+    throw TProtocolException(TProtocolException::SIZE_LIMIT);
+  }
+  return static_cast<uint32_t>(len);
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::fixedWidth(TType type) {
+  switch (type) {
+    case T_BOOL:
+    case T_BYTE:
+      return 1;
+    case T_DOUBLE:
+      return 8;
+    default:
+      return 0;
+  }
+}
+
+template <class Transport_>
+bool TCompactProtocolT<Transport_>::isVarint(TType type) {
+  return type == T_I16 || type == T_I32 || type == T_I64;
+}
+
 /**
  * Convert from zigzag int to int.
  */
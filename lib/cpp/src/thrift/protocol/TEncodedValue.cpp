@@ -0,0 +1,70 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/protocol/TEncodedValue.h>
+
+#include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/protocol/TCompactProtocol.h>
+#include <thrift/transport/TBufferTransports.h>
+
+using apache::thrift::transport::TMemoryBuffer;
+
+namespace apache {
+namespace thrift {
+namespace protocol {
+
+namespace {
+
+// Reads a captured value and keeps it alive; slices read from it share it
+class TEncodedBuffer : public TMemoryBuffer {
+public:
+  explicit TEncodedBuffer(const TSlice& bytes)
+    : TMemoryBuffer(const_cast<uint8_t*>(bytes.data()), static_cast<uint32_t>(bytes.size())),
+      bytes_(bytes) {}
+
+  TSlice readSlice(uint32_t len) override {
+    if (len > 0 && static_cast<ptrdiff_t>(len) <= rBound_ - rBase_) {
+      TSlice result = bytes_.sub(static_cast<size_t>(rBase_ - bytes_.data()), len);
+      consume(len);
+      return result;
+    }
+    return TMemoryBuffer::readSlice(len);
+  }
+
+private:
+  TSlice bytes_;
+};
+}
+
+std::shared_ptr<TProtocol> TEncodedValue::getDecoder() const {
+  std::shared_ptr<TMemoryBuffer> buffer(new TEncodedBuffer(bytes_));
+  switch (format_) {
+  case T_ENCODED_BINARY:
+    return std::make_shared<TBinaryProtocolT<TMemoryBuffer> >(buffer);
+  case T_ENCODED_BINARY_LE:
+    return std::make_shared<TBinaryProtocolT<TMemoryBuffer, TNetworkLittleEndian> >(buffer);
+  case T_ENCODED_COMPACT:
+    return std::make_shared<TCompactProtocolT<TMemoryBuffer> >(buffer);
+  default:
+    throw TProtocolException(TProtocolException::INVALID_DATA, "no encoded value to decode");
+  }
+}
+}
+}
+} // apache::thrift::protocol
@@ -0,0 +1,112 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_PROTOCOL_TENCODEDVALUE_H_
+#define _THRIFT_PROTOCOL_TENCODEDVALUE_H_ 1
+
+#include <thrift/protocol/TProtocol.h>
+#include <thrift/TSlice.h>
+
+#include <memory>
+#include <utility>
+
+namespace apache {
+namespace thrift {
+namespace protocol {
+
+/**
+ * The wire bytes of a field as it was read, as kept by structs generated
+ * with the cpp:lazy option. The bytes usually share the frame buffer they
+ * were read from, so capturing a field costs no copy and writing it back
+ * out with the same protocol costs no encoding.
+ *
+ * The bytes stay valid after the field was decoded, until the field is
+ * modified and clear() is called.
+ */
+class TEncodedValue {
+public:
+  TEncodedValue() : format_(T_ENCODED_NONE), decoded_(false) {}
+
+  bool empty() const { return format_ == T_ENCODED_NONE; }
+  TEncodedFormat getFormat() const { return format_; }
+  const TSlice& getBytes() const { return bytes_; }
+
+  // Whether the value still has to be decoded from the bytes
+  bool isPending() const { return !empty() && !decoded_; }
+  void setDecoded() { decoded_ = true; }
+
+  // Drops the bytes once the decoded value was modified
+  void clear() {
+    bytes_ = TSlice();
+    format_ = T_ENCODED_NONE;
+    decoded_ = false;
+  }
+
+  /**
+   * Captures the next value, of type, from iprot. Returns the bytes read, or
+   * 0 and leaves this empty if iprot cannot capture it, in which case the
+   * value must be decoded as usual.
+   */
+  uint32_t read(TProtocol* iprot, TType type) {
+    clear();
+    TEncodedFormat format = iprot->getEncodedFormat();
+    if (format == T_ENCODED_NONE) {
+      return 0;
+    }
+    uint32_t result = iprot->readEncoded(type, bytes_);
+    if (result > 0) {
+      format_ = format;
+    }
+    return result;
+  }
+
+  // Whether write() can send the value to oprot as it is
+  bool canWrite(TProtocol* oprot) const {
+    return !empty() && oprot->getEncodedFormat() == format_;
+  }
+
+  uint32_t write(TProtocol* oprot) const { return oprot->writeEncoded(bytes_); }
+
+  /**
+   * Returns a protocol reading the captured value. Slices read through it,
+   * such as the captured fields of a nested lazy struct, share the bytes
+   * held here.
+   */
+  std::shared_ptr<TProtocol> getDecoder() const;
+
+  void swap(TEncodedValue& other) {
+    std::swap(bytes_, other.bytes_);
+    std::swap(format_, other.format_);
+    std::swap(decoded_, other.decoded_);
+  }
+
+private:
+  TSlice bytes_;
+  TEncodedFormat format_;
+  bool decoded_;
+};
+
+inline void swap(TEncodedValue& a, TEncodedValue& b) {
+  a.swap(b);
+}
+}
+}
+} // apache::thrift::protocol
+
+#endif // #ifndef _THRIFT_PROTOCOL_TENCODEDVALUE_H_
@@ -23,10 +23,13 @@
 #include <thrift/protocol/TCompactProtocol.h>
 #include <thrift/protocol/TBinaryProtocol.h>
 #include <thrift/TApplicationException.h>
+#include <thrift/TDeadline.h>
 
+#include <algorithm>
 #include <limits>
 
 #include <memory>
+#include <string>
 
 namespace apache {
 namespace thrift {
@@ -59,6 +62,14 @@ uint32_t THeaderProtocol::writeMessageBegin(const std::string& name,
                                             const int32_t seqId) {
   resetProtocol(); // Reset in case we changed protocols
   trans_->setSequenceNumber(seqId);
+
+  // Calls made under a deadline tell the server how long they still wait,
+  // unless the caller set the header itself
+  if ((messageType == T_CALL || messageType == T_ONEWAY) && TDeadline::isSet()
+      && trans_->getWriteHeaders().count(TDeadline::HEADER) == 0) {
+    int64_t remaining = std::max<int64_t>(0, TDeadline::remaining().count());
+    trans_->setHeader(TDeadline::HEADER, std::to_string(remaining));
+  }
   return proto_->writeMessageBegin(name, messageType, seqId);
 }
 
@@ -146,6 +157,26 @@ uint32_t THeaderProtocol::writeBinary(const std::string& str) {
   return proto_->writeBinary(str);
 }
 
+uint32_t THeaderProtocol::writeI32Array(const int32_t* array, const uint32_t size) {
+  return proto_->writeI32Array(array, size);
+}
+
+uint32_t THeaderProtocol::writeI64Array(const int64_t* array, const uint32_t size) {
+  return proto_->writeI64Array(array, size);
+}
+
+uint32_t THeaderProtocol::writeDoubleArray(const double* array, const uint32_t size) {
+  return proto_->writeDoubleArray(array, size);
+}
+
+uint32_t THeaderProtocol::writeBinarySlice(const TSlice& slice) {
+  return proto_->writeBinarySlice(slice);
+}
+
+uint32_t THeaderProtocol::writeEncoded(const TSlice& encoded) {
+  return proto_->writeEncoded(encoded);
+}
+
 /**
  * Reading functions
  */
@@ -246,6 +277,30 @@ uint32_t THeaderProtocol::readString(std::string& str) {
 uint32_t THeaderProtocol::readBinary(std::string& binary) {
   return proto_->readBinary(binary);
 }
+
+uint32_t THeaderProtocol::readI32Array(int32_t* array, const uint32_t size) {
+  return proto_->readI32Array(array, size);
+}
+
+uint32_t THeaderProtocol::readI64Array(int64_t* array, const uint32_t size) {
+  return proto_->readI64Array(array, size);
+}
+
+uint32_t THeaderProtocol::readDoubleArray(double* array, const uint32_t size) {
+  return proto_->readDoubleArray(array, size);
+}
+
+uint32_t THeaderProtocol::readBinarySlice(TSlice& slice) {
+  return proto_->readBinarySlice(slice);
+}
+
+uint32_t THeaderProtocol::readEncoded(TType type, TSlice& encoded) {
+  return proto_->readEncoded(type, encoded);
+}
+
+uint32_t THeaderProtocol::skip(TType type) {
+  return proto_->skip(type);
+}
 }
 }
 } // apache::thrift::protocol
@@ -135,6 +135,16 @@ public:
 
   uint32_t writeBinary(const std::string& str);
 
+  uint32_t writeI32Array(const int32_t* array, const uint32_t size);
+
+  uint32_t writeI64Array(const int64_t* array, const uint32_t size);
+
+  uint32_t writeDoubleArray(const double* array, const uint32_t size);
+
+  uint32_t writeBinarySlice(const TSlice& slice);
+
+  uint32_t writeEncoded(const TSlice& encoded);
+
   /**
    * Reading functions
    */
@@ -181,6 +191,21 @@ public:
 
   uint32_t readBinary(std::string& binary);
 
+  uint32_t readI32Array(int32_t* array, const uint32_t size);
+
+  uint32_t readI64Array(int64_t* array, const uint32_t size);
+
+  uint32_t readDoubleArray(double* array, const uint32_t size);
+
+  uint32_t readBinarySlice(TSlice& slice);
+
+  uint32_t readEncoded(TType type, TSlice& encoded);
+
+  uint32_t skip(TType type);
+
+  // the format of the protocol the current message uses
+  TEncodedFormat getEncodedFormat() const override { return proto_->getEncodedFormat(); }
+
 protected:
   std::shared_ptr<THeaderTransport> trans_;
 
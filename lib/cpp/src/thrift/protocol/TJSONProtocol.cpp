@@ -27,6 +27,11 @@
 #include <locale>
 #include <sstream>
 #include <stdexcept>
+#include <type_traits>
+#if defined(__SSE2__) && defined(__GNUC__)
+#include <emmintrin.h>
+#define THRIFT_JSON_SSE2 1
+#endif
 
 #include <thrift/protocol/TBase64Utils.h>
 #include <thrift/transport/TTransportException.h>
@@ -301,124 +306,181 @@ static bool isLowSurrogate(uint16_t val) {
   return val >= 0xDC00 && val <= 0xDFFF;
 }
 
-/**
- * Class to serve as base JSON context and as base class for other context
- * implementations
- */
-class TJSONContext {
-
-public:
-  TJSONContext() = default;
-
-  virtual ~TJSONContext() = default;
-
-  /**
-   * Write context data to the transport. Default is to do nothing.
-   */
-  virtual uint32_t write(TTransport& trans) {
-    (void)trans;
-    return 0;
-  };
-
-  /**
-   * Read context data from the transport. Default is to do nothing.
-   */
-  virtual uint32_t read(TJSONProtocol::LookaheadReader& reader) {
-    (void)reader;
-    return 0;
-  };
-
-  /**
-   * Return true if numbers need to be escaped as strings in this context.
-   * Default behavior is to return false.
-   */
-  virtual bool escapeNum() { return false; }
-};
-
-// Context class for object member key-value pairs
-class JSONPairContext : public TJSONContext {
-
-public:
-  JSONPairContext() : first_(true), colon_(true) {}
-
-  uint32_t write(TTransport& trans) override {
-    if (first_) {
-      first_ = false;
-      colon_ = true;
-      return 0;
-    } else {
-      trans.write(colon_ ? &kJSONPairSeparator : &kJSONElemSeparator, 1);
-      colon_ = !colon_;
-      return 1;
+// Return the length of the leading run of buf that a JSON string holds as
+// is: up to the first quote or backslash.
+static uint32_t unescapedLength(const uint8_t* buf, uint32_t len) {
+  uint32_t i = 0;
+#ifdef THRIFT_JSON_SSE2
+  const __m128i quote = _mm_set1_epi8(static_cast<char>(kJSONStringDelimiter));
+  const __m128i backslash = _mm_set1_epi8(static_cast<char>(kJSONBackslash));
+  for (; i + 16 <= len; i += 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + i));
+    int mask = _mm_movemask_epi8(
+        _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)));
+    if (mask != 0) {
+      return i + static_cast<uint32_t>(__builtin_ctz(mask));
     }
   }
-
-  uint32_t read(TJSONProtocol::LookaheadReader& reader) override {
-    if (first_) {
-      first_ = false;
-      colon_ = true;
-      return 0;
-    } else {
-      uint8_t ch = (colon_ ? kJSONPairSeparator : kJSONElemSeparator);
-      colon_ = !colon_;
-      return readSyntaxChar(reader, ch);
+#endif
+  for (; i < len; i++) {
+    if (buf[i] == kJSONStringDelimiter || buf[i] == kJSONBackslash) {
+      break;
     }
   }
+  return i;
+}
+
+// Return the length of the leading run of buf that can be written into a
+// JSON string without escaping: anything but control characters, quotes
+// and backslashes.
+static uint32_t plainLength(const uint8_t* buf, uint32_t len) {
+  uint32_t i = 0;
+#ifdef THRIFT_JSON_SSE2
+  const __m128i quote = _mm_set1_epi8(static_cast<char>(kJSONStringDelimiter));
+  const __m128i backslash = _mm_set1_epi8(static_cast<char>(kJSONBackslash));
+  const __m128i control = _mm_set1_epi8(0x1F);
+  for (; i + 16 <= len; i += 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + i));
+    __m128i special = _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash));
+    // unsigned chunk <= 0x1F
+    special = _mm_or_si128(special, _mm_cmpeq_epi8(_mm_min_epu8(chunk, control), chunk));
+    int mask = _mm_movemask_epi8(special);
+    if (mask != 0) {
+      return i + static_cast<uint32_t>(__builtin_ctz(mask));
+    }
+  }
+#endif
+  for (; i < len; i++) {
+    uint8_t ch = buf[i];
+    if (ch < 0x20 || ch == kJSONStringDelimiter || ch == kJSONBackslash) {
+      break;
+    }
+  }
+  return i;
+}
+
+// Write the decimal digits of num to the end of the buffer that ends at end,
+// returning the number of characters written.
+static uint32_t formatDecimal(uint64_t num, bool negative, uint8_t* end) {
+  uint8_t* p = end;
+  do {
+    *--p = static_cast<uint8_t>('0' + num % 10);
+    num /= 10;
+  } while (num != 0);
+  if (negative) {
+    *--p = '-';
+  }
+  return static_cast<uint32_t>(end - p);
+}
 
-  // Numbers must be turned into strings if they are the key part of a pair
-  bool escapeNum() override { return colon_; }
-
-private:
-  bool first_;
-  bool colon_;
-};
-
-// Context class for lists
-class JSONListContext : public TJSONContext {
+static uint32_t formatInteger(int64_t num, uint8_t* end) {
+  uint64_t magnitude = num < 0 ? 0 - static_cast<uint64_t>(num) : static_cast<uint64_t>(num);
+  return formatDecimal(magnitude, num < 0, end);
+}
 
-public:
-  JSONListContext() : first_(true) {}
+static uint32_t formatInteger(uint64_t num, uint8_t* end) {
+  return formatDecimal(num, false, end);
+}
 
-  uint32_t write(TTransport& trans) override {
-    if (first_) {
-      first_ = false;
-      return 0;
-    } else {
-      trans.write(&kJSONElemSeparator, 1);
-      return 1;
+// Parse [begin, end) as a decimal integer that must fit NumberType.
+// Return false if it does not.
+template <typename NumberType>
+static bool parseInteger(const char* begin, const char* end, NumberType& num) {
+  bool negative = false;
+  if (begin != end && (*begin == '-' || *begin == '+')) {
+    negative = *begin == '-';
+    ++begin;
+  }
+  if (begin == end) {
+    return false;
+  }
+  uint64_t value = 0;
+  for (; begin != end; ++begin) {
+    if (*begin < '0' || *begin > '9') {
+      return false;
     }
+    auto digit = static_cast<uint64_t>(*begin - '0');
+    if (value > ((std::numeric_limits<uint64_t>::max)() - digit) / 10) {
+      return false;
+    }
+    value = value * 10 + digit;
   }
-
-  uint32_t read(TJSONProtocol::LookaheadReader& reader) override {
-    if (first_) {
-      first_ = false;
-      return 0;
-    } else {
-      return readSyntaxChar(reader, kJSONElemSeparator);
+  if (!negative) {
+    if (value > static_cast<uint64_t>((std::numeric_limits<NumberType>::max)())) {
+      return false;
+    }
+    num = static_cast<NumberType>(value);
+  } else if (!std::numeric_limits<NumberType>::is_signed) {
+    if (value != 0) {
+      return false;
     }
+    num = static_cast<NumberType>(0);
+  } else {
+    // magnitude of the minimum, computed without overflowing
+    uint64_t limit
+        = static_cast<uint64_t>(-(static_cast<int64_t>((std::numeric_limits<NumberType>::min)()) + 1))
+          + 1;
+    if (value > limit) {
+      return false;
+    }
+    num = static_cast<NumberType>(0 - value);
   }
-
-private:
-  bool first_;
-};
+  return true;
+}
 
 TJSONProtocol::TJSONProtocol(std::shared_ptr<TTransport> ptrans)
   : TVirtualProtocol<TJSONProtocol>(ptrans),
     trans_(ptrans.get()),
-    context_(new TJSONContext()),
     reader_(*ptrans) {
+  contexts_.reserve(16);
+  contexts_.emplace_back(JSONContext::BASE);
 }
 
 TJSONProtocol::~TJSONProtocol() = default;
 
-void TJSONProtocol::pushContext(std::shared_ptr<TJSONContext> c) {
-  contexts_.push(context_);
-  context_ = c;
+void TJSONProtocol::pushContext(JSONContext::Type type) {
+  contexts_.emplace_back(type);
 }
 
 void TJSONProtocol::popContext() {
-  context_ = contexts_.top();
-  contexts_.pop();
+  contexts_.pop_back();
+}
+
+uint32_t TJSONProtocol::writeContext() {
+  JSONContext& c = contexts_.back();
+  if (c.type == JSONContext::BASE) {
+    return 0;
+  }
+  if (c.first) {
+    c.first = false;
+    c.colon = true;
+    return 0;
+  }
+  if (c.type == JSONContext::PAIR) {
+    trans_->write(c.colon ? &kJSONPairSeparator : &kJSONElemSeparator, 1);
+    c.colon = !c.colon;
+  } else {
+    trans_->write(&kJSONElemSeparator, 1);
+  }
+  return 1;
+}
+
+uint32_t TJSONProtocol::readContext() {
+  JSONContext& c = contexts_.back();
+  if (c.type == JSONContext::BASE) {
+    return 0;
+  }
+  if (c.first) {
+    c.first = false;
+    c.colon = true;
+    return 0;
+  }
+  if (c.type == JSONContext::PAIR) {
+    uint8_t ch = (c.colon ? kJSONPairSeparator : kJSONElemSeparator);
+    c.colon = !c.colon;
+    return readSyntaxChar(reader_, ch);
+  }
+  return readSyntaxChar(reader_, kJSONElemSeparator);
 }
 
 // Write the character ch as a JSON escape sequence ("\u00xx")
@@ -462,13 +524,26 @@ uint32_t TJSONProtocol::writeJSONChar(uint8_t ch) {
 // Write out the contents of the string str as a JSON string, escaping
 // characters as appropriate.
 uint32_t TJSONProtocol::writeJSONString(const std::string& str) {
-  uint32_t result = context_->write(*trans_);
+  uint32_t result = writeContext();
   result += 2; // For quotes
   trans_->write(&kJSONStringDelimiter, 1);
-  std::string::const_iterator iter(str.begin());
-  std::string::const_iterator end(str.end());
-  while (iter != end) {
-    result += writeJSONChar(*iter++);
+  if (str.length() > (std::numeric_limits<uint32_t>::max)())
+    throw TProtocolException(TProtocolException::SIZE_LIMIT);
+  const auto* ptr = reinterpret_cast<const uint8_t*>(str.data());
+  auto len = static_cast<uint32_t>(str.length());
+  while (len > 0) {
+    // write runs that need no escaping in one go
+    uint32_t plain = plainLength(ptr, len);
+    if (plain > 0) {
+      trans_->write(ptr, plain);
+      result += plain;
+      ptr += plain;
+      len -= plain;
+    }
+    if (len > 0) {
+      result += writeJSONChar(*ptr++);
+      --len;
+    }
   }
   trans_->write(&kJSONStringDelimiter, 1);
   return result;
@@ -477,26 +552,34 @@ uint32_t TJSONProtocol::writeJSONString(const std::string& str) {
 // Write out the contents of the string as JSON string, base64-encoding
 // the string's contents, and escaping as appropriate
 uint32_t TJSONProtocol::writeJSONBase64(const std::string& str) {
-  uint32_t result = context_->write(*trans_);
+  uint32_t result = writeContext();
   result += 2; // For quotes
   trans_->write(&kJSONStringDelimiter, 1);
-  uint8_t b[4];
+  // Encode 3 bytes at a time, writing out a block of them at once
+  uint8_t b[256];
+  uint32_t used = 0;
   const auto* bytes = (const uint8_t*)str.c_str();
   if (str.length() > (std::numeric_limits<uint32_t>::max)())
     throw TProtocolException(TProtocolException::SIZE_LIMIT);
   auto len = static_cast<uint32_t>(str.length());
   while (len >= 3) {
-    // Encode 3 bytes at a time
-    base64_encode(bytes, 3, b);
-    trans_->write(b, 4);
-    result += 4;
+    base64_encode(bytes, 3, b + used);
+    used += 4;
+    if (used == sizeof(b)) {
+      trans_->write(b, used);
+      result += used;
+      used = 0;
+    }
     bytes += 3;
     len -= 3;
   }
   if (len) { // Handle remainder
-    base64_encode(bytes, len, b);
-    trans_->write(b, len + 1);
-    result += len + 1;
+    base64_encode(bytes, len, b + used);
+    used += len + 1;
+  }
+  if (used) {
+    trans_->write(b, used);
+    result += used;
   }
   trans_->write(&kJSONStringDelimiter, 1);
   return result;
@@ -506,17 +589,18 @@ uint32_t TJSONProtocol::writeJSONBase64(const std::string& str) {
 // if the context requires it (eg: key in a map pair).
 template <typename NumberType>
 uint32_t TJSONProtocol::writeJSONInteger(NumberType num) {
-  uint32_t result = context_->write(*trans_);
-  std::string val(to_string(num));
-  bool escapeNum = context_->escapeNum();
+  uint32_t result = writeContext();
+  typedef typename std::conditional<std::is_signed<NumberType>::value, int64_t, uint64_t>::type
+      WideType;
+  uint8_t val[24];
+  uint32_t len = formatInteger(static_cast<WideType>(num), val + sizeof(val));
+  bool escapeNum = this->escapeNum();
   if (escapeNum) {
     trans_->write(&kJSONStringDelimiter, 1);
     result += 1;
   }
-  if (val.length() > (std::numeric_limits<uint32_t>::max)())
-    throw TProtocolException(TProtocolException::SIZE_LIMIT);
-  trans_->write((const uint8_t*)val.c_str(), static_cast<uint32_t>(val.length()));
-  result += static_cast<uint32_t>(val.length());
+  trans_->write(val + sizeof(val) - len, len);
+  result += len;
   if (escapeNum) {
     trans_->write(&kJSONStringDelimiter, 1);
     result += 1;
@@ -538,7 +622,7 @@ std::string doubleToString(double d) {
 // Convert the given double to a JSON string, which is either the number,
 // "NaN" or "Infinity" or "-Infinity".
 uint32_t TJSONProtocol::writeJSONDouble(double num) {
-  uint32_t result = context_->write(*trans_);
+  uint32_t result = writeContext();
   std::string val;
 
   bool special = false;
@@ -560,7 +644,7 @@ uint32_t TJSONProtocol::writeJSONDouble(double num) {
     break;
   }
 
-  bool escapeNum = special || context_->escapeNum();
+  bool escapeNum = special || this->escapeNum();
   if (escapeNum) {
     trans_->write(&kJSONStringDelimiter, 1);
     result += 1;
@@ -577,9 +661,9 @@ uint32_t TJSONProtocol::writeJSONDouble(double num) {
 }
 
 uint32_t TJSONProtocol::writeJSONObjectStart() {
-  uint32_t result = context_->write(*trans_);
+  uint32_t result = writeContext();
   trans_->write(&kJSONObjectStart, 1);
-  pushContext(std::shared_ptr<TJSONContext>(new JSONPairContext()));
+  pushContext(JSONContext::PAIR);
   return result + 1;
 }
 
@@ -590,9 +674,9 @@ uint32_t TJSONProtocol::writeJSONObjectEnd() {
 }
 
 uint32_t TJSONProtocol::writeJSONArrayStart() {
-  uint32_t result = context_->write(*trans_);
+  uint32_t result = writeContext();
   trans_->write(&kJSONArrayStart, 1);
-  pushContext(std::shared_ptr<TJSONContext>(new JSONListContext()));
+  pushContext(JSONContext::LIST);
   return result + 1;
 }
 
@@ -753,12 +837,28 @@ uint32_t TJSONProtocol::readJSONEscapeChar(uint16_t* out) {
 
 // Decodes a JSON string, including unescaping, and returns the string via str
 uint32_t TJSONProtocol::readJSONString(std::string& str, bool skipContext) {
-  uint32_t result = (skipContext ? 0 : context_->read(reader_));
+  uint32_t result = (skipContext ? 0 : readContext());
   result += readJSONSyntaxChar(kJSONStringDelimiter);
   std::vector<uint16_t> codeunits;
   uint8_t ch;
   str.clear();
   while (true) {
+    // take runs that need no unescaping straight from the transport buffer
+    uint32_t len;
+    const uint8_t* buf = reader_.borrow(&len);
+    if (buf != nullptr) {
+      uint32_t plain = unescapedLength(buf, len);
+      if (plain > 0) {
+        if (!codeunits.empty()) {
+          throw TProtocolException(TProtocolException::INVALID_DATA,
+                                   "Missing UTF-16 low surrogate pair.");
+        }
+        reader_.readAppend(str, plain);
+        result += plain;
+        continue;
+      }
+    }
+
     ch = reader_.read();
     ++result;
     if (ch == kJSONStringDelimiter) {
@@ -810,7 +910,7 @@ uint32_t TJSONProtocol::readJSONString(std::string& str, bool skipContext) {
 
 // Reads a block of base64 characters, decoding it, and returns via str
 uint32_t TJSONProtocol::readJSONBase64(std::string& str) {
-  std::string tmp;
+  std::string& tmp = scratch_;
   uint32_t result = readJSONString(tmp);
   auto* b = (uint8_t*)tmp.c_str();
   if (tmp.length() > (std::numeric_limits<uint32_t>::max)())
@@ -845,6 +945,21 @@ uint32_t TJSONProtocol::readJSONNumericChars(std::string& str) {
   uint32_t result = 0;
   str.clear();
   while (true) {
+    uint32_t len;
+    const uint8_t* buf = reader_.borrow(&len);
+    if (buf != nullptr) {
+      uint32_t n = 0;
+      while (n < len && isJSONNumeric(buf[n])) {
+        ++n;
+      }
+      reader_.readAppend(str, n);
+      result += n;
+      if (n < len) {
+        break;
+      }
+      continue;
+    }
+
     uint8_t ch = reader_.peek();
     if (!isJSONNumeric(ch)) {
       break;
@@ -873,19 +988,17 @@ T fromString(const std::string& s) {
 // returning them via num
 template <typename NumberType>
 uint32_t TJSONProtocol::readJSONInteger(NumberType& num) {
-  uint32_t result = context_->read(reader_);
-  if (context_->escapeNum()) {
+  uint32_t result = readContext();
+  if (escapeNum()) {
     result += readJSONSyntaxChar(kJSONStringDelimiter);
   }
-  std::string str;
+  std::string& str = scratch_;
   result += readJSONNumericChars(str);
-  try {
-    num = fromString<NumberType>(str);
-  } catch (const std::runtime_error&) {
+  if (!parseInteger(str.data(), str.data() + str.size(), num)) {
     throw TProtocolException(TProtocolException::INVALID_DATA,
                              "Expected numeric value; got \"" + str + "\"");
   }
-  if (context_->escapeNum()) {
+  if (escapeNum()) {
     result += readJSONSyntaxChar(kJSONStringDelimiter);
   }
   return result;
@@ -893,8 +1006,8 @@ uint32_t TJSONProtocol::readJSONInteger(NumberType& num) {
 
 // Reads a JSON number or string and interprets it as a double.
 uint32_t TJSONProtocol::readJSONDouble(double& num) {
-  uint32_t result = context_->read(reader_);
-  std::string str;
+  uint32_t result = readContext();
+  std::string& str = scratch_;
   if (reader_.peek() == kJSONStringDelimiter) {
     result += readJSONString(str, true);
     // Check for NaN, Infinity and -Infinity
@@ -905,7 +1018,7 @@ uint32_t TJSONProtocol::readJSONDouble(double& num) {
     } else if (str == kThriftNegativeInfinity) {
       num = -HUGE_VAL;
     } else {
-      if (!context_->escapeNum()) {
+      if (!escapeNum()) {
         // Throw exception -- we should not be in a string in this case
         throw TProtocolException(TProtocolException::INVALID_DATA,
                                      "Numeric data unexpectedly quoted");
@@ -918,7 +1031,7 @@ uint32_t TJSONProtocol::readJSONDouble(double& num) {
       }
     }
   } else {
-    if (context_->escapeNum()) {
+    if (escapeNum()) {
       // This will throw - we should have had a quote if escapeNum == true
       readJSONSyntaxChar(kJSONStringDelimiter);
     }
@@ -934,9 +1047,9 @@ uint32_t TJSONProtocol::readJSONDouble(double& num) {
 }
 
 uint32_t TJSONProtocol::readJSONObjectStart() {
-  uint32_t result = context_->read(reader_);
+  uint32_t result = readContext();
   result += readJSONSyntaxChar(kJSONObjectStart);
-  pushContext(std::shared_ptr<TJSONContext>(new JSONPairContext()));
+  pushContext(JSONContext::PAIR);
   return result;
 }
 
@@ -947,9 +1060,9 @@ uint32_t TJSONProtocol::readJSONObjectEnd() {
 }
 
 uint32_t TJSONProtocol::readJSONArrayStart() {
-  uint32_t result = context_->read(reader_);
+  uint32_t result = readContext();
   result += readJSONSyntaxChar(kJSONArrayStart);
-  pushContext(std::shared_ptr<TJSONContext>(new JSONListContext()));
+  pushContext(JSONContext::LIST);
   return result;
 }
 
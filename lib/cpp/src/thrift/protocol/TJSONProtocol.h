@@ -22,15 +22,12 @@
 
 #include <thrift/protocol/TVirtualProtocol.h>
 
-#include <stack>
+#include <vector>
 
 namespace apache {
 namespace thrift {
 namespace protocol {
 
-// Forward declaration
-class TJSONContext;
-
 /**
  * JSON protocol for Thrift.
  *
@@ -101,10 +98,41 @@ public:
   ~TJSONProtocol() override;
 
 private:
-  void pushContext(std::shared_ptr<TJSONContext> c);
+  /**
+   * Separator state of the JSON object or array being read or written.
+   * Kept by value on contexts_, so nesting does not allocate.
+   */
+  struct JSONContext {
+    enum Type { BASE, PAIR, LIST };
+
+    explicit JSONContext(Type t) : type(t), first(true), colon(true) {}
+
+    Type type;
+    bool first;
+    bool colon;
+  };
+
+  void pushContext(JSONContext::Type type);
 
   void popContext();
 
+  /**
+   * Writes or reads the separator the current context expects before the
+   * next value.
+   */
+  uint32_t writeContext();
+
+  uint32_t readContext();
+
+  /**
+   * Return true if numbers need to be escaped as strings in the current
+   * context, i.e. they are the key part of a pair.
+   */
+  bool escapeNum() const {
+    const JSONContext& c = contexts_.back();
+    return c.type == JSONContext::PAIR && c.colon;
+  }
+
   uint32_t writeJSONEscapeChar(uint8_t ch);
 
   uint32_t writeJSONChar(uint8_t ch);
@@ -289,6 +317,28 @@ public:
       return data_;
     }
 
+    /**
+     * Returns the bytes the transport has buffered, without consuming them,
+     * or nullptr if there are none or a peeked byte must be read first.
+     */
+    const uint8_t* borrow(uint32_t* len) {
+      if (hasData_) {
+        return nullptr;
+      }
+      *len = 1;
+      return trans_->borrow(nullptr, len);
+    }
+
+    /**
+     * Appends len borrowed bytes to str. They are read rather than consumed,
+     * so the transport accounts for them like for any other read.
+     */
+    void readAppend(std::string& str, uint32_t len) {
+      size_t size = str.size();
+      str.resize(size + len);
+      trans_->readAll(reinterpret_cast<uint8_t*>(&str[size]), len);
+    }
+
   private:
     TTransport* trans_;
     bool hasData_;
@@ -298,9 +348,10 @@ public:
 private:
   TTransport* trans_;
 
-  std::stack<std::shared_ptr<TJSONContext> > contexts_;
-  std::shared_ptr<TJSONContext> context_;
+  std::vector<JSONContext> contexts_;
   LookaheadReader reader_;
+  // reused for numbers and base64 text
+  std::string scratch_;
 };
 
 /**
@@ -28,6 +28,77 @@ uint32_t TProtocol::skip_virt(TType type) {
   return ::apache::thrift::protocol::skip(*this, type);
 }
 
+uint32_t TProtocol::writeI32Array_virt(const int32_t* array, const uint32_t size) {
+  uint32_t result = 0;
+  for (uint32_t i = 0; i < size; ++i) {
+    result += writeI32_virt(array[i]);
+  }
+  return result;
+}
+
+uint32_t TProtocol::writeI64Array_virt(const int64_t* array, const uint32_t size) {
+  uint32_t result = 0;
+  for (uint32_t i = 0; i < size; ++i) {
+    result += writeI64_virt(array[i]);
+  }
+  return result;
+}
+
+uint32_t TProtocol::writeDoubleArray_virt(const double* array, const uint32_t size) {
+  uint32_t result = 0;
+  for (uint32_t i = 0; i < size; ++i) {
+    result += writeDouble_virt(array[i]);
+  }
+  return result;
+}
+
+uint32_t TProtocol::writeBinarySlice_virt(const TSlice& slice) {
+  return writeBinary_virt(slice.str());
+}
+
+uint32_t TProtocol::writeEncoded_virt(const TSlice& encoded) {
+  THRIFT_UNUSED_VARIABLE(encoded);
+  throw TProtocolException(TProtocolException::NOT_IMPLEMENTED,
+                           "this protocol cannot write encoded values");
+}
+
+uint32_t TProtocol::readI32Array_virt(int32_t* array, const uint32_t size) {
+  uint32_t result = 0;
+  for (uint32_t i = 0; i < size; ++i) {
+    result += readI32_virt(array[i]);
+  }
+  return result;
+}
+
+uint32_t TProtocol::readI64Array_virt(int64_t* array, const uint32_t size) {
+  uint32_t result = 0;
+  for (uint32_t i = 0; i < size; ++i) {
+    result += readI64_virt(array[i]);
+  }
+  return result;
+}
+
+uint32_t TProtocol::readDoubleArray_virt(double* array, const uint32_t size) {
+  uint32_t result = 0;
+  for (uint32_t i = 0; i < size; ++i) {
+    result += readDouble_virt(array[i]);
+  }
+  return result;
+}
+
+uint32_t TProtocol::readBinarySlice_virt(TSlice& slice) {
+  std::string str;
+  uint32_t result = readBinary_virt(str);
+  slice = TSlice(std::move(str));
+  return result;
+}
+
+uint32_t TProtocol::readEncoded_virt(TType type, TSlice& encoded) {
+  THRIFT_UNUSED_VARIABLE(type);
+  THRIFT_UNUSED_VARIABLE(encoded);
+  return 0;
+}
+
 TProtocolFactory::~TProtocolFactory() = default;
 
 }}} // apache::thrift::protocol
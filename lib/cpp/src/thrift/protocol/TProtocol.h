@@ -60,6 +60,7 @@
 #include <map>
 #include <vector>
 #include <climits>
+#include <algorithm>
 
 // Use this to get around strict aliasing rules.
 // For example, uint64_t i = bitwise_cast<uint64_t>(returns_double());
@@ -206,6 +207,17 @@ namespace protocol {
 
 using apache::thrift::transport::TTransport;
 
+/**
+ * Wire formats a value captured by TProtocol::readEncoded() can be in. Two
+ * protocols with the same format read and write each other's values.
+ */
+enum TEncodedFormat {
+  T_ENCODED_NONE = 0,
+  T_ENCODED_BINARY = 1,
+  T_ENCODED_BINARY_LE = 2,
+  T_ENCODED_COMPACT = 3
+};
+
 /**
  * Abstract class for a thrift protocol driver. These are all the methods that
  * a protocol must implement. Essentially, there must be some way of reading
@@ -277,6 +289,16 @@ public:
 
   virtual uint32_t writeUUID_virt(const std::string& str) = 0;
 
+  virtual uint32_t writeI32Array_virt(const int32_t* array, const uint32_t size);
+
+  virtual uint32_t writeI64Array_virt(const int64_t* array, const uint32_t size);
+
+  virtual uint32_t writeDoubleArray_virt(const double* array, const uint32_t size);
+
+  virtual uint32_t writeBinarySlice_virt(const TSlice& slice);
+
+  virtual uint32_t writeEncoded_virt(const TSlice& encoded);
+
   uint32_t writeMessageBegin(const std::string& name,
                              const TMessageType messageType,
                              const int32_t seqid) {
@@ -389,6 +411,45 @@ public:
     return writeUUID_virt(str);
   }
 
+  /**
+   * Bulk writers for runs of list elements.  These write exactly the same
+   * bytes as calling writeI32() / writeI64() / writeDouble() once per element,
+   * but let protocols with a fixed-width encoding do it in one pass.
+   */
+  uint32_t writeI32Array(const int32_t* array, const uint32_t size) {
+    T_VIRTUAL_CALL();
+    return writeI32Array_virt(array, size);
+  }
+
+  uint32_t writeI64Array(const int64_t* array, const uint32_t size) {
+    T_VIRTUAL_CALL();
+    return writeI64Array_virt(array, size);
+  }
+
+  uint32_t writeDoubleArray(const double* array, const uint32_t size) {
+    T_VIRTUAL_CALL();
+    return writeDoubleArray_virt(array, size);
+  }
+
+  /**
+   * Writes the same bytes as writeBinary(), straight from the slice's
+   * storage, and lets the transport keep a reference to large slices
+   * instead of copying them.
+   */
+  uint32_t writeBinarySlice(const TSlice& slice) {
+    T_VIRTUAL_CALL();
+    return writeBinarySlice_virt(slice);
+  }
+
+  /**
+   * Writes a value captured by readEncoded() as is. Only valid if the value
+   * was captured in the format this protocol writes, see getEncodedFormat().
+   */
+  uint32_t writeEncoded(const TSlice& encoded) {
+    T_VIRTUAL_CALL();
+    return writeEncoded_virt(encoded);
+  }
+
   /**
    * Reading functions
    */
@@ -439,6 +500,16 @@ public:
 
   virtual uint32_t readUUID_virt(std::string& str) = 0;
 
+  virtual uint32_t readI32Array_virt(int32_t* array, const uint32_t size);
+
+  virtual uint32_t readI64Array_virt(int64_t* array, const uint32_t size);
+
+  virtual uint32_t readDoubleArray_virt(double* array, const uint32_t size);
+
+  virtual uint32_t readBinarySlice_virt(TSlice& slice);
+
+  virtual uint32_t readEncoded_virt(TType type, TSlice& encoded);
+
   uint32_t readMessageBegin(std::string& name, TMessageType& messageType, int32_t& seqid) {
     T_VIRTUAL_CALL();
     return readMessageBegin_virt(name, messageType, seqid);
@@ -544,6 +615,49 @@ public:
     return readUUID_virt(str);
   }
 
+  /**
+   * Bulk readers for runs of list elements, the counterparts of
+   * writeI32Array() / writeI64Array() / writeDoubleArray().
+   * The caller must provide room for size elements.
+   */
+  uint32_t readI32Array(int32_t* array, const uint32_t size) {
+    T_VIRTUAL_CALL();
+    return readI32Array_virt(array, size);
+  }
+
+  uint32_t readI64Array(int64_t* array, const uint32_t size) {
+    T_VIRTUAL_CALL();
+    return readI64Array_virt(array, size);
+  }
+
+  uint32_t readDoubleArray(double* array, const uint32_t size) {
+    T_VIRTUAL_CALL();
+    return readDoubleArray_virt(array, size);
+  }
+
+  /**
+   * Reads a binary value as a slice. Protocols that send binary values
+   * unencoded take it from TTransport::readSlice(), which shares the
+   * transport's frame buffer where it can.
+   */
+  uint32_t readBinarySlice(TSlice& slice) {
+    T_VIRTUAL_CALL();
+    return readBinarySlice_virt(slice);
+  }
+
+  /**
+   * Reads a whole value of type, nested structs and containers included,
+   * without decoding it: encoded is set to its bytes as they are on the wire,
+   * shared with the transport's frame buffer where the transport allows.
+   * Returns the number of bytes read, or 0 if the protocol cannot capture the
+   * value, e.g. because the transport cannot lend all of it, in which case
+   * nothing was read.
+   */
+  uint32_t readEncoded(TType type, TSlice& encoded) {
+    T_VIRTUAL_CALL();
+    return readEncoded_virt(type, encoded);
+  }
+
   /*
    * std::vector is specialized for bool, and its elements are individual bits
    * rather than bools.   We need to define a different version of readBool()
@@ -589,6 +703,10 @@ public:
   uint32_t getRecursionLimit() const {return recursion_limit_;}
   void setRecurisionLimit(uint32_t depth) {recursion_limit_ = depth;}
 
+  // Returns the format of the values readEncoded() captures and writeEncoded()
+  // takes, T_ENCODED_NONE if the protocol does not support them.
+  virtual TEncodedFormat getEncodedFormat() const { return T_ENCODED_NONE; }
+
   // Returns the minimum amount of bytes needed to store the smallest possible instance of TType.
   virtual int getMinSerializedSize(TType type) {
     THRIFT_UNUSED_VARIABLE(type);
@@ -694,101 +812,234 @@ struct TInputRecursionTracker {
 };
 
 /**
- * Helper template for implementing TProtocol::skip().
- *
- * Templatized to avoid having to make virtual function calls.
+ * A struct or container being skipped. skip() implementations keep these on
+ * a TSkipStack instead of recursing, so skipping deeply nested data costs
+ * neither stack space nor a call per level.
  */
-template <class Protocol_>
-uint32_t skip(Protocol_& prot, TType type) {
-  TInputRecursionTracker tracker(prot);
-
-  switch (type) {
-  case T_BOOL: {
-    bool boolv;
-    return prot.readBool(boolv);
-  }
-  case T_BYTE: {
-    int8_t bytev = 0;
-    return prot.readByte(bytev);
-  }
-  case T_I16: {
-    int16_t i16;
-    return prot.readI16(i16);
-  }
-  case T_I32: {
-    int32_t i32;
-    return prot.readI32(i32);
-  }
-  case T_I64: {
-    int64_t i64;
-    return prot.readI64(i64);
-  }
-  case T_DOUBLE: {
-    double dub;
-    return prot.readDouble(dub);
-  }
-  case T_STRING: {
-    std::string str;
-    return prot.readBinary(str);
-  }
-  case T_STRUCT: {
-    uint32_t result = 0;
-    std::string name;
-    int16_t fid;
-    TType ftype;
-    result += prot.readStructBegin(name);
-    while (true) {
-      result += prot.readFieldBegin(name, ftype, fid);
-      if (ftype == T_STOP) {
-        break;
-      }
-      result += skip(prot, ftype);
-      result += prot.readFieldEnd();
+struct TSkipFrame {
+  // T_STRUCT, T_MAP, T_SET or T_LIST
+  TType type;
+  // element type, or key type of a map
+  TType elemType;
+  // value type of a map
+  TType valType;
+  // values left, keys and values of a map counted separately. For a struct,
+  // 1 while one of its fields is being skipped.
+  uint32_t left;
+};
+
+/**
+ * Stack of TSkipFrames. Each frame counts as one level of input recursion
+ * of prot, as a recursive skip() would.
+ */
+class TSkipStack {
+public:
+  explicit TSkipStack(TProtocol& prot) : prot_(prot), size_(0) {}
+
+  ~TSkipStack() {
+    for (; size_ > 0; --size_) {
+      prot_.decrementInputRecursionDepth();
     }
-    result += prot.readStructEnd();
-    return result;
   }
-  case T_MAP: {
-    uint32_t result = 0;
-    TType keyType;
-    TType valType;
-    uint32_t i, size;
-    result += prot.readMapBegin(keyType, valType, size);
-    for (i = 0; i < size; i++) {
-      result += skip(prot, keyType);
-      result += skip(prot, valType);
+
+  bool empty() const { return size_ == 0; }
+
+  TSkipFrame& top() { return size_ <= INLINE_FRAMES ? frames_[size_ - 1] : overflow_.back(); }
+
+  TSkipFrame& push(TType type, TType elemType, TType valType, uint32_t left) {
+    ++size_;
+    prot_.incrementInputRecursionDepth();
+    if (size_ > INLINE_FRAMES) {
+      overflow_.emplace_back();
     }
-    result += prot.readMapEnd();
-    return result;
+    TSkipFrame& frame = top();
+    frame.type = type;
+    frame.elemType = elemType;
+    frame.valType = valType;
+    frame.left = left;
+    return frame;
   }
-  case T_SET: {
-    uint32_t result = 0;
-    TType elemType;
-    uint32_t i, size;
-    result += prot.readSetBegin(elemType, size);
-    for (i = 0; i < size; i++) {
-      result += skip(prot, elemType);
+
+  void pop() {
+    if (size_ > INLINE_FRAMES) {
+      overflow_.pop_back();
     }
-    result += prot.readSetEnd();
-    return result;
+    --size_;
+    prot_.decrementInputRecursionDepth();
   }
-  case T_LIST: {
-    uint32_t result = 0;
-    TType elemType;
-    uint32_t i, size;
-    result += prot.readListBegin(elemType, size);
-    for (i = 0; i < size; i++) {
-      result += skip(prot, elemType);
+
+private:
+  // enough for the default recursion limit
+  static const uint32_t INLINE_FRAMES = 64;
+
+  TProtocol& prot_;
+  uint32_t size_;
+  TSkipFrame frames_[INLINE_FRAMES];
+  std::vector<TSkipFrame> overflow_;
+};
+
+/**
+ * Discards len bytes of trans, in place if the transport can lend them.
+ */
+template <class Transport_>
+void skipBytes(Transport_& trans, uint32_t len) {
+  uint8_t buf[256];
+  if (len <= sizeof(buf)) {
+    trans.readAll(buf, len);
+    return;
+  }
+  uint32_t got = len;
+  if (trans.borrow(nullptr, &got) != nullptr) {
+    trans.consume(len);
+    return;
+  }
+  while (len > 0) {
+    uint32_t chunk = (std::min)(len, static_cast<uint32_t>(sizeof(buf)));
+    trans.readAll(buf, chunk);
+    len -= chunk;
+  }
+}
+
+/**
+ * Bytes borrowed from a transport, read by the protocols' skip code to find
+ * where a value ends without consuming it. Reading past the end throws
+ * TTransportException::END_OF_FILE.
+ */
+class TBorrowedWindow {
+public:
+  TBorrowedWindow(const uint8_t* buf, uint32_t len) : pos_(buf), end_(buf + len) {}
+
+  // Returns the next len bytes and moves past them
+  const uint8_t* take(uint32_t len) {
+    if (static_cast<uint32_t>(end_ - pos_) < len) {
+      throw apache::thrift::transport::TTransportException(
+          apache::thrift::transport::TTransportException::END_OF_FILE);
     }
-    result += prot.readListEnd();
+    const uint8_t* result = pos_;
+    pos_ += len;
     return result;
   }
-  default:
-    break;
-  }
 
-  throw TProtocolException(TProtocolException::INVALID_DATA,
-                           "invalid TType");
+  int8_t readByte() { return static_cast<int8_t>(*take(1)); }
+  void skip(uint32_t len) { take(len); }
+
+protected:
+  const uint8_t* pos_;
+  const uint8_t* end_;
+};
+
+/**
+ * Helper template for implementing TProtocol::skip().
+ *
+ * Templatized to avoid having to make virtual function calls. Nested structs
+ * and containers are tracked on a TSkipStack rather than by recursion.
+ */
+template <class Protocol_>
+uint32_t skip(Protocol_& prot, TType type) {
+  uint32_t result = 0;
+  TSkipStack stack(prot);
+  std::string str;
+
+  while (true) {
+    switch (type) {
+    case T_BOOL: {
+      bool boolv;
+      result += prot.readBool(boolv);
+      break;
+    }
+    case T_BYTE: {
+      int8_t bytev = 0;
+      result += prot.readByte(bytev);
+      break;
+    }
+    case T_I16: {
+      int16_t i16;
+      result += prot.readI16(i16);
+      break;
+    }
+    case T_I32: {
+      int32_t i32;
+      result += prot.readI32(i32);
+      break;
+    }
+    case T_I64: {
+      int64_t i64;
+      result += prot.readI64(i64);
+      break;
+    }
+    case T_DOUBLE: {
+      double dub;
+      result += prot.readDouble(dub);
+      break;
+    }
+    case T_STRING:
+      result += prot.readBinary(str);
+      break;
+    case T_UUID:
+      result += prot.readUUID(str);
+      break;
+    case T_STRUCT:
+      result += prot.readStructBegin(str);
+      stack.push(T_STRUCT, T_STOP, T_STOP, 0);
+      break;
+    case T_MAP: {
+      TType keyType;
+      TType valType;
+      uint32_t size;
+      result += prot.readMapBegin(keyType, valType, size);
+      stack.push(T_MAP, keyType, valType, 2 * size);
+      break;
+    }
+    case T_SET: {
+      TType elemType;
+      uint32_t size;
+      result += prot.readSetBegin(elemType, size);
+      stack.push(T_SET, elemType, T_STOP, size);
+      break;
+    }
+    case T_LIST: {
+      TType elemType;
+      uint32_t size;
+      result += prot.readListBegin(elemType, size);
+      stack.push(T_LIST, elemType, T_STOP, size);
+      break;
+    }
+    default:
+      throw TProtocolException(TProtocolException::INVALID_DATA,
+                               "invalid TType");
+    }
+
+    // Find the next value, closing the structs and containers that are done
+    while (true) {
+      if (stack.empty()) {
+        return result;
+      }
+      TSkipFrame& frame = stack.top();
+      if (frame.type == T_STRUCT) {
+        if (frame.left) {
+          result += prot.readFieldEnd();
+        }
+        int16_t fid;
+        result += prot.readFieldBegin(str, type, fid);
+        if (type != T_STOP) {
+          frame.left = 1;
+          break;
+        }
+        result += prot.readStructEnd();
+      } else if (frame.left > 0) {
+        type = (frame.type == T_MAP && frame.left % 2 == 1) ? frame.valType : frame.elemType;
+        --frame.left;
+        break;
+      } else if (frame.type == T_MAP) {
+        result += prot.readMapEnd();
+      } else if (frame.type == T_SET) {
+        result += prot.readSetEnd();
+      } else {
+        result += prot.readListEnd();
+      }
+      stack.pop();
+    }
+  }
 }
 
 }}} // apache::thrift::protocol
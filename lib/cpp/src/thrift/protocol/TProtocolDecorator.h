@@ -94,6 +94,22 @@ public:
   uint32_t writeBinary_virt(const std::string& str) override { return protocol->writeBinary(str); }
   uint32_t writeUUID_virt(const std::string& str) override { return protocol->writeUUID(str); }
 
+  uint32_t writeI32Array_virt(const int32_t* array, const uint32_t size) override {
+    return protocol->writeI32Array(array, size);
+  }
+  uint32_t writeI64Array_virt(const int64_t* array, const uint32_t size) override {
+    return protocol->writeI64Array(array, size);
+  }
+  uint32_t writeDoubleArray_virt(const double* array, const uint32_t size) override {
+    return protocol->writeDoubleArray(array, size);
+  }
+  uint32_t writeBinarySlice_virt(const TSlice& slice) override {
+    return protocol->writeBinarySlice(slice);
+  }
+  uint32_t writeEncoded_virt(const TSlice& encoded) override {
+    return protocol->writeEncoded(encoded);
+  }
+
   uint32_t readMessageBegin_virt(std::string& name,
                                          TMessageType& messageType,
                                          int32_t& seqid) override {
@@ -143,6 +159,26 @@ public:
   uint32_t readBinary_virt(std::string& str) override { return protocol->readBinary(str); }
   uint32_t readUUID_virt(std::string& str) override { return protocol->readUUID(str); }
 
+  uint32_t readI32Array_virt(int32_t* array, const uint32_t size) override {
+    return protocol->readI32Array(array, size);
+  }
+  uint32_t readI64Array_virt(int64_t* array, const uint32_t size) override {
+    return protocol->readI64Array(array, size);
+  }
+  uint32_t readDoubleArray_virt(double* array, const uint32_t size) override {
+    return protocol->readDoubleArray(array, size);
+  }
+  uint32_t readBinarySlice_virt(TSlice& slice) override {
+    return protocol->readBinarySlice(slice);
+  }
+  uint32_t readEncoded_virt(TType type, TSlice& encoded) override {
+    return protocol->readEncoded(type, encoded);
+  }
+
+  uint32_t skip_virt(TType type) override { return protocol->skip(type); }
+
+  TEncodedFormat getEncodedFormat() const override { return protocol->getEncodedFormat(); }
+
 private:
   shared_ptr<TProtocol> protocol;
 };
@@ -397,6 +397,26 @@ public:
     return static_cast<Protocol_*>(this)->writeUUID(str);
   }
 
+  uint32_t writeI32Array_virt(const int32_t* array, const uint32_t size) override {
+    return static_cast<Protocol_*>(this)->writeI32Array(array, size);
+  }
+
+  uint32_t writeI64Array_virt(const int64_t* array, const uint32_t size) override {
+    return static_cast<Protocol_*>(this)->writeI64Array(array, size);
+  }
+
+  uint32_t writeDoubleArray_virt(const double* array, const uint32_t size) override {
+    return static_cast<Protocol_*>(this)->writeDoubleArray(array, size);
+  }
+
+  uint32_t writeBinarySlice_virt(const TSlice& slice) override {
+    return static_cast<Protocol_*>(this)->writeBinarySlice(slice);
+  }
+
+  uint32_t writeEncoded_virt(const TSlice& encoded) override {
+    return static_cast<Protocol_*>(this)->writeEncoded(encoded);
+  }
+
   /**
    * Reading functions
    */
@@ -479,6 +499,26 @@ public:
     return static_cast<Protocol_*>(this)->readUUID(str);
   }
 
+  uint32_t readI32Array_virt(int32_t* array, const uint32_t size) override {
+    return static_cast<Protocol_*>(this)->readI32Array(array, size);
+  }
+
+  uint32_t readI64Array_virt(int64_t* array, const uint32_t size) override {
+    return static_cast<Protocol_*>(this)->readI64Array(array, size);
+  }
+
+  uint32_t readDoubleArray_virt(double* array, const uint32_t size) override {
+    return static_cast<Protocol_*>(this)->readDoubleArray(array, size);
+  }
+
+  uint32_t readBinarySlice_virt(TSlice& slice) override {
+    return static_cast<Protocol_*>(this)->readBinarySlice(slice);
+  }
+
+  uint32_t readEncoded_virt(TType type, TSlice& encoded) override {
+    return static_cast<Protocol_*>(this)->readEncoded(type, encoded);
+  }
+
   uint32_t skip_virt(TType type) override { return static_cast<Protocol_*>(this)->skip(type); }
 
   /*
@@ -511,6 +551,91 @@ public:
   }
   using Super_::readBool; // so we don't hide readBool(bool&)
 
+  /*
+   * Provide default bulk array implementations that use the non-virtual
+   * per-element methods.  Protocols with a fixed-width wire encoding can
+   * override these to transfer a whole run at once.
+   */
+  uint32_t writeI32Array(const int32_t* array, const uint32_t size) {
+    auto* const prot = static_cast<Protocol_*>(this);
+    uint32_t result = 0;
+    for (uint32_t i = 0; i < size; ++i) {
+      result += prot->writeI32(array[i]);
+    }
+    return result;
+  }
+
+  uint32_t writeI64Array(const int64_t* array, const uint32_t size) {
+    auto* const prot = static_cast<Protocol_*>(this);
+    uint32_t result = 0;
+    for (uint32_t i = 0; i < size; ++i) {
+      result += prot->writeI64(array[i]);
+    }
+    return result;
+  }
+
+  uint32_t writeDoubleArray(const double* array, const uint32_t size) {
+    auto* const prot = static_cast<Protocol_*>(this);
+    uint32_t result = 0;
+    for (uint32_t i = 0; i < size; ++i) {
+      result += prot->writeDouble(array[i]);
+    }
+    return result;
+  }
+
+  uint32_t readI32Array(int32_t* array, const uint32_t size) {
+    auto* const prot = static_cast<Protocol_*>(this);
+    uint32_t result = 0;
+    for (uint32_t i = 0; i < size; ++i) {
+      result += prot->readI32(array[i]);
+    }
+    return result;
+  }
+
+  uint32_t readI64Array(int64_t* array, const uint32_t size) {
+    auto* const prot = static_cast<Protocol_*>(this);
+    uint32_t result = 0;
+    for (uint32_t i = 0; i < size; ++i) {
+      result += prot->readI64(array[i]);
+    }
+    return result;
+  }
+
+  uint32_t readDoubleArray(double* array, const uint32_t size) {
+    auto* const prot = static_cast<Protocol_*>(this);
+    uint32_t result = 0;
+    for (uint32_t i = 0; i < size; ++i) {
+      result += prot->readDouble(array[i]);
+    }
+    return result;
+  }
+
+  /*
+   * Provide default slice implementations that go through a std::string.
+   * Protocols that send binary values unencoded can override these to
+   * avoid the copy.
+   */
+  uint32_t writeBinarySlice(const TSlice& slice) {
+    return static_cast<Protocol_*>(this)->writeBinary(slice.str());
+  }
+
+  uint32_t readBinarySlice(TSlice& slice) {
+    std::string str;
+    uint32_t result = static_cast<Protocol_*>(this)->readBinary(str);
+    slice = TSlice(std::move(str));
+    return result;
+  }
+
+  /*
+   * Provide default implementations for protocols that cannot capture
+   * encoded values.
+   */
+  uint32_t writeEncoded(const TSlice& encoded) { return TProtocol::writeEncoded_virt(encoded); }
+
+  uint32_t readEncoded(TType type, TSlice& encoded) {
+    return TProtocol::readEncoded_virt(type, encoded);
+  }
+
 protected:
   TVirtualProtocol(std::shared_ptr<TTransport> ptrans) : Super_(ptrans) {}
 };
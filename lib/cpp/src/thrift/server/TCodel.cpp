@@ -0,0 +1,85 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/server/TCodel.h>
+
+#include <algorithm>
+#include <limits>
+
+namespace apache {
+namespace thrift {
+namespace server {
+
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+
+const int64_t TCodel::DEFAULT_TARGET_DELAY_MS;
+const int64_t TCodel::DEFAULT_INTERVAL_MS;
+
+TCodel::TCodel(std::chrono::milliseconds targetDelay, std::chrono::milliseconds interval)
+  : targetDelay_(duration_cast<microseconds>(targetDelay).count()),
+    interval_(duration_cast<microseconds>(interval).count()),
+    intervalStart_(
+        duration_cast<microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count()),
+    minDelay_((std::numeric_limits<int64_t>::max)()),
+    lastSample_(intervalStart_.load()),
+    lastMinDelay_(0),
+    overloaded_(false),
+    numShed_(0) {
+}
+
+bool TCodel::shouldShed(std::chrono::steady_clock::duration delay,
+                        std::chrono::steady_clock::time_point now) {
+  int64_t delayUs = duration_cast<microseconds>(delay).count();
+  int64_t nowUs = duration_cast<microseconds>(now.time_since_epoch()).count();
+  int64_t targetDelay = targetDelay_;
+
+  int64_t interval = interval_;
+  int64_t lastSample = lastSample_.exchange(nowUs);
+  int64_t start = intervalStart_;
+  if (nowUs - lastSample > interval && intervalStart_.compare_exchange_strong(start, nowUs)) {
+    // idle for longer than an interval, the last one says nothing about now
+    minDelay_ = delayUs;
+    lastMinDelay_ = 0;
+    overloaded_ = false;
+  } else if (nowUs - start >= interval && intervalStart_.compare_exchange_strong(start, nowUs)) {
+    // this request ends the interval and is the first of the next one
+    int64_t minDelay = minDelay_.exchange(delayUs);
+    lastMinDelay_ = minDelay;
+    overloaded_ = minDelay > targetDelay;
+  } else {
+    int64_t minDelay = minDelay_;
+    while (delayUs < minDelay && !minDelay_.compare_exchange_weak(minDelay, delayUs)) {
+    }
+  }
+
+  if (overloaded_ && delayUs > 2 * targetDelay) {
+    ++numShed_;
+    return true;
+  }
+  return false;
+}
+
+uint32_t TCodel::getLoad() const {
+  int64_t targetDelay = std::max<int64_t>(targetDelay_, 1);
+  return static_cast<uint32_t>(std::min<int64_t>(100, lastMinDelay_ * 100 / targetDelay));
+}
+}
+}
+} // apache::thrift::server
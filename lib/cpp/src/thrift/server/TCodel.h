@@ -0,0 +1,114 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_SERVER_TCODEL_H_
+#define _THRIFT_SERVER_TCODEL_H_ 1
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace apache {
+namespace thrift {
+namespace server {
+
+/**
+ * Admission control by queueing delay, after the CoDel ("controlled delay")
+ * queue management algorithm, for servers that queue requests for worker
+ * threads.
+ *
+ * Every request reports how long it waited in the queue when a worker takes
+ * it. The server is overloaded for an interval if even the shortest wait in
+ * the interval before exceeded the target delay, that is if the queue never
+ * drained. While it is overloaded, requests that waited more than twice the
+ * target are shed, so that the queue drains and the remaining requests are
+ * answered in time, rather than all of them late. Short bursts, which leave
+ * some requests with short waits, are absorbed.
+ *
+ * All methods can be called from any thread, without locking.
+ */
+class TCodel {
+public:
+  /// Default target delay
+  static const int64_t DEFAULT_TARGET_DELAY_MS = 5;
+
+  /// Default interval over which the shortest delay is taken
+  static const int64_t DEFAULT_INTERVAL_MS = 100;
+
+  TCodel(std::chrono::milliseconds targetDelay = std::chrono::milliseconds(DEFAULT_TARGET_DELAY_MS),
+         std::chrono::milliseconds interval = std::chrono::milliseconds(DEFAULT_INTERVAL_MS));
+
+  void setTargetDelay(std::chrono::microseconds targetDelay) { targetDelay_ = targetDelay.count(); }
+  std::chrono::microseconds getTargetDelay() const {
+    return std::chrono::microseconds(targetDelay_.load());
+  }
+
+  void setInterval(std::chrono::microseconds interval) { interval_ = interval.count(); }
+  std::chrono::microseconds getInterval() const {
+    return std::chrono::microseconds(interval_.load());
+  }
+
+  /**
+   * Records the queueing delay of a request taken off the queue at now, and
+   * returns whether it should be shed rather than processed. A request that
+   * comes after no other did for a whole interval starts over, as the queue
+   * must have drained in between.
+   */
+  bool shouldShed(std::chrono::steady_clock::duration delay,
+                  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now());
+
+  /// Whether requests that waited long are currently shed
+  bool isOverloaded() const { return overloaded_; }
+
+  /// Shortest queueing delay of the last complete interval
+  std::chrono::microseconds getMinDelay() const {
+    return std::chrono::microseconds(lastMinDelay_.load());
+  }
+
+  /**
+   * Shortest queueing delay of the last complete interval, in percent of the
+   * target delay, capped at 100 once it reaches the target.
+   */
+  uint32_t getLoad() const;
+
+  /// Number of requests shed so far
+  uint64_t getNumShed() const { return numShed_; }
+
+private:
+  std::atomic<int64_t> targetDelay_;
+  std::atomic<int64_t> interval_;
+
+  // Start of the current interval, in microseconds of the steady clock
+  std::atomic<int64_t> intervalStart_;
+
+  // Shortest delay seen in the current interval
+  std::atomic<int64_t> minDelay_;
+
+  // When the last request was taken off the queue
+  std::atomic<int64_t> lastSample_;
+
+  std::atomic<int64_t> lastMinDelay_;
+  std::atomic<bool> overloaded_;
+  std::atomic<uint64_t> numShed_;
+};
+}
+}
+} // apache::thrift::server
+
+#endif // #ifndef _THRIFT_SERVER_TCODEL_H_
@@ -58,7 +58,7 @@ void TConnectedClient::run() {
     }
 
     try {
-      if (!processor_->process(inputProtocol_, outputProtocol_, opaqueContext_)) {
+      if (!TServer::processRequest(*processor_, inputProtocol_, outputProtocol_, opaqueContext_)) {
         break;
       }
     } catch (const TTransportException& ttx) {
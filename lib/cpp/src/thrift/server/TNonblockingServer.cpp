@@ -20,13 +20,17 @@
 #include <thrift/thrift-config.h>
 
 #include <thrift/server/TNonblockingServer.h>
+#include <thrift/TApplicationException.h>
 #include <thrift/concurrency/Exception.h>
 #include <thrift/transport/TSocket.h>
 #include <thrift/concurrency/ThreadFactory.h>
 #include <thrift/transport/PlatformSocket.h>
 
 #include <algorithm>
+#include <chrono>
 #include <iostream>
+#include <string>
+#include <thread>
 
 #ifdef HAVE_POLL_H
 #include <poll.h>
@@ -57,6 +61,10 @@
 #include <fcntl.h>
 #endif
 
+#ifdef HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
+#endif
+
 #include <assert.h>
 
 #ifdef HAVE_SCHED_H
@@ -185,6 +193,17 @@ private:
   /// Thrift call context, if any
   void* connectionContext_;
 
+  /// Next connection in the IO thread's completion queue
+  TConnection* nextCompletion_;
+
+  /// IO thread whose pools this object and its read buffer come from
+  TNonblockingIOThread* poolThread_;
+
+  /// Position in poolThread_'s list of active connections
+  size_t activeIndex_;
+
+  friend class TNonblockingIOThread;
+
   /// Go into read mode
   void setRead() { setFlags(EV_READ | EV_PERSIST); }
 
@@ -217,6 +236,9 @@ public:
               TNonblockingIOThread* ioThread) {
     readBuffer_ = nullptr;
     readBufferSize_ = 0;
+    nextCompletion_ = nullptr;
+    poolThread_ = ioThread;
+    activeIndex_ = 0;
 
     ioThread_ = ioThread;
     server_ = ioThread->getServer();
@@ -288,6 +310,13 @@ public:
    */
   int getIOThreadNumber() const { return ioThread_->getThreadNumber(); }
 
+  /// Return the IO thread whose pools this object belongs to.
+  TNonblockingIOThread* getPoolThread() const { return poolThread_; }
+
+  /// Get or set the position in the pool thread's list of active connections.
+  size_t getActiveIndex() const { return activeIndex_; }
+  void setActiveIndex(size_t index) { activeIndex_ = index; }
+
   /// Force connection shutdown for this connection.
   void forceClose() {
     appState_ = APP_CLOSE_CONNECTION;
@@ -325,17 +354,27 @@ public:
       output_(output),
       connection_(connection),
       serverEventHandler_(connection_->getServerEventHandler()),
-      connectionContext_(connection_->getConnectionContext()) {}
+      connectionContext_(connection_->getConnectionContext()),
+      queuedAt_(std::chrono::steady_clock::now()) {}
 
   void run() override {
+    TNonblockingServer* server = connection_->getServer();
     try {
-      for (;;) {
-        if (serverEventHandler_) {
-          serverEventHandler_->processContext(connectionContext_, connection_->getTSocket());
-        }
-        if (!processor_->process(input_, output_, connectionContext_)
-            || !input_->getTransport()->peek()) {
-          break;
+      if (server->getShedOnQueueDelay()
+          && server->getQueueDelayController().shouldShed(std::chrono::steady_clock::now()
+                                                          - queuedAt_)) {
+        do {
+          shedRequest();
+        } while (input_->getTransport()->peek());
+      } else {
+        for (;;) {
+          if (serverEventHandler_) {
+            serverEventHandler_->processContext(connectionContext_, connection_->getTSocket());
+          }
+          if (!processRequest(*processor_, input_, output_, connectionContext_, queuedAt_)
+              || !input_->getTransport()->peek()) {
+            break;
+          }
         }
       }
     } catch (const TTransportException& ttx) {
@@ -363,12 +402,27 @@ public:
   TConnection* getTConnection() { return connection_; }
 
 private:
+  /**
+   * Skips the next request and, unless it is oneway, answers it with a
+   * LOADSHEDDING exception.
+   */
+  void shedRequest() {
+    auto waited = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - queuedAt_);
+    rejectRequest(*input_,
+                  *output_,
+                  TApplicationException(TApplicationException::LOADSHEDDING,
+                                        "Server overloaded, request shed after waiting "
+                                            + std::to_string(waited.count()) + " ms"));
+  }
+
   std::shared_ptr<TProcessor> processor_;
   std::shared_ptr<TProtocol> input_;
   std::shared_ptr<TProtocol> output_;
   TConnection* connection_;
   std::shared_ptr<TServerEventHandler> serverEventHandler_;
   void* connectionContext_;
+  std::chrono::steady_clock::time_point queuedAt_;
 };
 
 void TNonblockingServer::TConnection::init(TNonblockingIOThread* ioThread) {
@@ -651,7 +705,11 @@ void TNonblockingServer::TConnection::transition() {
           serverEventHandler_->processContext(connectionContext_, getTSocket());
         }
         // Invoke the processor
-        processor_->process(inputProtocol_, outputProtocol_, connectionContext_);
+        processRequest(*processor_,
+                       inputProtocol_,
+                       outputProtocol_,
+                       connectionContext_,
+                       std::chrono::steady_clock::now());
       } catch (const TTransportException& ttx) {
         GlobalOutput.printf(
             "TNonblockingServer transport error in "
@@ -750,21 +808,12 @@ void TNonblockingServer::TConnection::transition() {
     readWant_ += 4;
 
     // We just read the request length
-    // Double the buffer size until it is big enough
+    // Swap the buffer for one of the next power of 2 size if it is too
+    // small, nothing in it needs to be kept
     if (readWant_ > readBufferSize_) {
-      if (readBufferSize_ == 0) {
-        readBufferSize_ = 1;
-      }
-      uint32_t newSize = readBufferSize_;
-      while (readWant_ > newSize) {
-        newSize *= 2;
-      }
-
-      auto* newBuffer = (uint8_t*)std::realloc(readBuffer_, newSize);
-      if (newBuffer == nullptr) {
-        // nothing else to be done...
-        throw std::bad_alloc();
-      }
+      uint32_t newSize = readWant_;
+      uint8_t* newBuffer = poolThread_->allocateReadBuffer(newSize);
+      poolThread_->releaseReadBuffer(readBuffer_, readBufferSize_);
       readBuffer_ = newBuffer;
       readBufferSize_ = newSize;
     }
@@ -872,7 +921,7 @@ void TNonblockingServer::TConnection::close() {
 
 void TNonblockingServer::TConnection::checkIdleBufferMemLimit(size_t readLimit, size_t writeLimit) {
   if (readLimit > 0 && readBufferSize_ > readLimit) {
-    free(readBuffer_);
+    poolThread_->releaseReadBuffer(readBuffer_, readBufferSize_);
     readBuffer_ = nullptr;
     readBufferSize_ = 0;
   }
@@ -885,15 +934,17 @@ void TNonblockingServer::TConnection::checkIdleBufferMemLimit(size_t readLimit,
 }
 
 TNonblockingServer::~TNonblockingServer() {
-  // Close any active connections (moves them to the idle connection stack)
-  while (activeConnections_.size()) {
-    activeConnections_.front()->close();
-  }
-  // Clean up unused TConnection objects in connectionStack_
-  while (!connectionStack_.empty()) {
-    TConnection* connection = connectionStack_.top();
-    connectionStack_.pop();
-    delete connection;
+  for (auto& ioThread : ioThreads_) {
+    // Close any active connections (moves them to the idle connection pool)
+    while (!ioThread->activeConnections_.empty()) {
+      ioThread->activeConnections_.back()->close();
+    }
+    // Clean up unused TConnection objects in the pool
+    for (auto connection : ioThread->idleConnections_) {
+      delete connection;
+    }
+    ioThread->idleConnections_.clear();
+    ioThread->clearReadBufferPool();
   }
   // The TNonblockingIOThread objects have shared_ptrs to the Thread
   // objects and the Thread objects have shared_ptrs to the TNonblockingIOThread
@@ -906,52 +957,74 @@ TNonblockingServer::~TNonblockingServer() {
 }
 
 /**
- * Creates a new connection either by reusing an object off the stack or
- * by allocating a new one entirely
+ * Creates a new connection either by reusing an object from the pool of the
+ * IO thread it is assigned to or by allocating a new one entirely
  */
-TNonblockingServer::TConnection* TNonblockingServer::createConnection(std::shared_ptr<TSocket> socket) {
-  // Check the stack
-  Guard g(connMutex_);
-
-  // pick an IO thread to handle this connection -- currently round robin
-  assert(nextIOThread_ < ioThreads_.size());
-  int selectedThreadIdx = nextIOThread_;
-  nextIOThread_ = static_cast<uint32_t>((nextIOThread_ + 1) % ioThreads_.size());
-
-  TNonblockingIOThread* ioThread = ioThreads_[selectedThreadIdx].get();
+TNonblockingServer::TConnection* TNonblockingServer::createConnection(std::shared_ptr<TSocket> socket,
+                                                                     TNonblockingIOThread* acceptThread) {
+  // pick an IO thread to handle this connection -- round robin, unless every
+  // IO thread accepts for itself, in which case the kernel already balanced.
+  // Otherwise only the first IO thread accepts, so nextIOThread_ is its own.
+  TNonblockingIOThread* ioThread = acceptThread;
+  if (!reusePortAccepting_) {
+    assert(nextIOThread_ < ioThreads_.size());
+    int selectedThreadIdx = nextIOThread_;
+    nextIOThread_ = static_cast<uint32_t>((nextIOThread_ + 1) % ioThreads_.size());
+
+    ioThread = ioThreads_[selectedThreadIdx].get();
+  }
 
-  // Check the connection stack to see if we can re-use
+  // Check the thread's pool to see if we can re-use
   TConnection* result = nullptr;
-  if (connectionStack_.empty()) {
+  {
+    Guard g(ioThread->poolMutex_);
+    if (!ioThread->idleConnections_.empty()) {
+      result = ioThread->idleConnections_.back();
+      ioThread->idleConnections_.pop_back();
+      --numIdleConnections_;
+    }
+  }
+  if (result == nullptr) {
     result = new TConnection(socket, ioThread);
     ++numTConnections_;
   } else {
-    result = connectionStack_.top();
-    connectionStack_.pop();
     result->setSocket(socket);
     result->init(ioThread);
   }
-  activeConnections_.push_back(result);
+
+  Guard g(ioThread->poolMutex_);
+  result->setActiveIndex(ioThread->activeConnections_.size());
+  ioThread->activeConnections_.push_back(result);
   return result;
 }
 
 /**
- * Returns a connection to the stack
+ * Returns a connection to the pool of its IO thread
  */
 void TNonblockingServer::returnConnection(TConnection* connection) {
-  Guard g(connMutex_);
+  TNonblockingIOThread* ioThread = connection->getPoolThread();
+  bool keep = !connectionStackLimit_ || numIdleConnections_ < connectionStackLimit_;
+  if (keep) {
+    connection->checkIdleBufferMemLimit(idleReadBufferLimit_, idleWriteBufferLimit_);
+  }
 
-  activeConnections_.erase(std::remove(activeConnections_.begin(),
-                                       activeConnections_.end(),
-                                       connection),
-                           activeConnections_.end());
+  {
+    Guard g(ioThread->poolMutex_);
+    std::vector<TConnection*>& active = ioThread->activeConnections_;
+    TConnection* last = active.back();
+    active[connection->getActiveIndex()] = last;
+    last->setActiveIndex(connection->getActiveIndex());
+    active.pop_back();
+
+    if (keep) {
+      ioThread->idleConnections_.push_back(connection);
+      ++numIdleConnections_;
+    }
+  }
 
-  if (connectionStackLimit_ && (connectionStack_.size() >= connectionStackLimit_)) {
+  if (!keep) {
     delete connection;
     --numTConnections_;
-  } else {
-    connection->checkIdleBufferMemLimit(idleReadBufferLimit_, idleWriteBufferLimit_);
-    connectionStack_.push(connection);
   }
 }
 
@@ -959,35 +1032,41 @@ void TNonblockingServer::returnConnection(TConnection* connection) {
  * Server socket had something happen.  We accept all waiting client
  * connections on fd and assign TConnection objects to handle those requests.
  */
-void TNonblockingServer::handleEvent(THRIFT_SOCKET fd, short which) {
+void TNonblockingServer::handleEvent(TNonblockingIOThread* ioThread, THRIFT_SOCKET fd, short which) {
   (void)which;
+  const std::shared_ptr<TNonblockingServerTransport>& listenTransport
+      = ioThread->getListenTransport() ? ioThread->getListenTransport() : serverTransport_;
   // Make sure that libevent didn't mess up the socket handles
-  assert(fd == serverSocket_);
+  assert(fd == listenTransport->getSocketFD());
+  (void)fd;
 
   // Going to accept a new client socket
   std::shared_ptr<TSocket> clientSocket;
 
-  clientSocket = serverTransport_->accept();
+  clientSocket = listenTransport->accept();
   if (clientSocket) {
     // If we're overloaded, take action here
-    if (overloadAction_ != T_OVERLOAD_NO_ACTION && serverOverloaded()) {
+    if (overloadAction_ != T_OVERLOAD_NO_ACTION) {
+      // other IO threads may be accepting at the same time
       Guard g(connMutex_);
-      nConnectionsDropped_++;
-      nTotalConnectionsDropped_++;
-      if (overloadAction_ == T_OVERLOAD_CLOSE_ON_ACCEPT) {
-        clientSocket->close();
-        return;
-      } else if (overloadAction_ == T_OVERLOAD_DRAIN_TASK_QUEUE) {
-        if (!drainPendingTask()) {
-          // Nothing left to discard, so we drop connection instead.
+      if (serverOverloaded()) {
+        nConnectionsDropped_++;
+        nTotalConnectionsDropped_++;
+        if (overloadAction_ == T_OVERLOAD_CLOSE_ON_ACCEPT) {
           clientSocket->close();
           return;
+        } else if (overloadAction_ == T_OVERLOAD_DRAIN_TASK_QUEUE) {
+          if (!drainPendingTask()) {
+            // Nothing left to discard, so we drop connection instead.
+            clientSocket->close();
+            return;
+          }
         }
       }
     }
 
     // Create a new TConnection for this client socket.
-    TConnection* clientConnection = createConnection(clientSocket);
+    TConnection* clientConnection = createConnection(clientSocket, ioThread);
 
     // Fail fast if we could not create a TConnection object
     if (clientConnection == nullptr) {
@@ -1004,11 +1083,10 @@ void TNonblockingServer::handleEvent(THRIFT_SOCKET fd, short which) {
      * (We need to avoid writing to our own notification pipe, to
      * avoid possible deadlocks if the pipe is full.)
      *
-     * The IO thread #0 is the only one that handles these listen
-     * events, so unless the connection has been assigned to thread #0
-     * we know it's not on our thread.
+     * Unless the connection has been assigned to the IO thread that
+     * accepted it, we know it's not on our thread.
      */
-    if (clientConnection->getIOThreadNumber() == 0) {
+    if (clientConnection->getIOThreadNumber() == ioThread->getThreadNumber()) {
       clientConnection->transition();
     } else {
       if (!clientConnection->notifyIOThread()) {
@@ -1042,8 +1120,10 @@ void TNonblockingServer::setThreadManager(std::shared_ptr<ThreadManager> threadM
 }
 
 bool TNonblockingServer::serverOverloaded() {
-  size_t activeConnections = numTConnections_ - connectionStack_.size();
-  if (numActiveProcessors_ > maxActiveProcessors_ || activeConnections > maxConnections_) {
+  size_t activeConnections = numTConnections_ - numIdleConnections_;
+  bool shedding = shedOnQueueDelay_ && codel_.isOverloaded();
+  if (shedding || numActiveProcessors_ > maxActiveProcessors_
+      || activeConnections > maxConnections_) {
     if (!overloaded_) {
       GlobalOutput.printf("TNonblockingServer: overload condition begun.");
       overloaded_ = true;
@@ -1105,12 +1185,39 @@ void TNonblockingServer::registerEvents(event_base* user_event_base) {
   // User-provided event-base doesn't works for multi-threaded servers
   assert(numIOThreads_ == 1 || !userEventBase_);
 
-  for (uint32_t id = 0; id < numIOThreads_; ++id) {
-    // the first IO thread also does the listening on server socket
-    THRIFT_SOCKET listenFd = (id == 0 ? serverSocket_ : THRIFT_INVALID_SOCKET);
+  // the other IO threads can only accept if they get sockets of their own
+  std::vector<std::shared_ptr<TNonblockingServerTransport> > siblings;
+  if (useReusePortAccept_ && numIOThreads_ > 1) {
+    for (uint32_t id = 1; id < numIOThreads_; ++id) {
+      std::shared_ptr<TNonblockingServerTransport> sibling;
+      try {
+        sibling = serverTransport_->listenSibling();
+      } catch (const TTransportException& ttx) {
+        GlobalOutput.printf("TNonblockingServer: listening on a sibling socket failed: %s",
+                            ttx.what());
+      }
+      if (!sibling) {
+        GlobalOutput.printf(
+            "TNonblockingServer: server transport cannot share its port, "
+            "only IO thread #0 will accept");
+        siblings.clear();
+        break;
+      }
+      siblings.push_back(sibling);
+    }
+  }
+  reusePortAccepting_ = !siblings.empty();
 
-    shared_ptr<TNonblockingIOThread> thread(
-        new TNonblockingIOThread(this, id, listenFd, useHighPriorityIOThreads_));
+  for (uint32_t id = 0; id < numIOThreads_; ++id) {
+    shared_ptr<TNonblockingIOThread> thread;
+    if (id > 0 && reusePortAccepting_) {
+      thread.reset(
+          new TNonblockingIOThread(this, id, siblings[id - 1], useHighPriorityIOThreads_));
+    } else {
+      // the first IO thread also does the listening on server socket
+      THRIFT_SOCKET listenFd = (id == 0 ? serverSocket_ : THRIFT_INVALID_SOCKET);
+      thread.reset(new TNonblockingIOThread(this, id, listenFd, useHighPriorityIOThreads_));
+    }
     ioThreads_.push_back(thread);
   }
 
@@ -1127,6 +1234,12 @@ void TNonblockingServer::registerEvents(event_base* user_event_base) {
   GlobalOutput.printf("TNonblockingServer: Serving with %d io threads.",
                       ioThreads_.size());
 
+  // Register the events of every IO thread before any of them runs, so that
+  // connections can be handed to the others as soon as the first accepts
+  for (uint32_t i = 1; i < ioThreads_.size(); ++i) {
+    ioThreads_[i]->registerEvents();
+  }
+
   // Launch all the secondary IO threads in separate threads
   if (ioThreads_.size() > 1) {
     ioThreadFactory_.reset(new ThreadFactory(
@@ -1179,27 +1292,47 @@ TNonblockingIOThread::TNonblockingIOThread(TNonblockingServer* server,
     eventBase_(nullptr),
     ownEventBase_(false),
     serverEvent_{},
-    notificationEvent_{} {
+    notificationEvent_{},
+    completions_(nullptr),
+    stopRequested_(false),
+    freeReadBufferBytes_(0) {
   notificationPipeFDs_[0] = -1;
   notificationPipeFDs_[1] = -1;
 }
 
+TNonblockingIOThread::TNonblockingIOThread(TNonblockingServer* server,
+                                           int number,
+                                           std::shared_ptr<TNonblockingServerTransport> listenTransport,
+                                           bool useHighPriority)
+  : TNonblockingIOThread(server, number, listenTransport->getSocketFD(), useHighPriority) {
+  listenTransport_ = listenTransport;
+}
+
 TNonblockingIOThread::~TNonblockingIOThread() {
   // make sure our associated thread is fully finished
   join();
 
+  clearReadBufferPool();
+
   if (eventBase_ && ownEventBase_) {
     event_base_free(eventBase_);
     ownEventBase_ = false;
   }
 
-  if (listenSocket_ != THRIFT_INVALID_SOCKET) {
+  if (listenTransport_) {
+    listenTransport_->close();
+    listenSocket_ = THRIFT_INVALID_SOCKET;
+  } else if (listenSocket_ != THRIFT_INVALID_SOCKET) {
     if (0 != ::THRIFT_CLOSESOCKET(listenSocket_)) {
       GlobalOutput.perror("TNonblockingIOThread listenSocket_ close(): ", THRIFT_GET_SOCKET_ERROR);
     }
     listenSocket_ = THRIFT_INVALID_SOCKET;
   }
 
+  if (notificationPipeFDs_[1] == notificationPipeFDs_[0]) {
+    // a single eventfd
+    notificationPipeFDs_[1] = -1;
+  }
   for (auto notificationPipeFD : notificationPipeFDs_) {
     if (notificationPipeFD >= 0) {
       if (0 != ::THRIFT_CLOSESOCKET(notificationPipeFD)) {
@@ -1212,6 +1345,15 @@ TNonblockingIOThread::~TNonblockingIOThread() {
 }
 
 void TNonblockingIOThread::createNotificationPipe() {
+#ifdef HAVE_SYS_EVENTFD_H
+  int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (fd < 0) {
+    GlobalOutput.perror("TNonblockingServer::createNotificationPipe eventfd() ", errno);
+    throw TException("can't create notification eventfd");
+  }
+  notificationPipeFDs_[0] = fd;
+  notificationPipeFDs_[1] = fd;
+#else
   if (evutil_socketpair(AF_LOCAL, SOCK_STREAM, 0, notificationPipeFDs_) == -1) {
     GlobalOutput.perror("TNonblockingServer::createNotificationPipe ", EVUTIL_SOCKET_ERROR());
     throw TException("can't create notification pipe");
@@ -1237,6 +1379,7 @@ void TNonblockingIOThread::createNotificationPipe() {
           "FD_CLOEXEC");
     }
   }
+#endif
 }
 
 /**
@@ -1265,7 +1408,7 @@ void TNonblockingIOThread::registerEvents() {
               listenSocket_,
               EV_READ | EV_PERSIST,
               TNonblockingIOThread::listenHandler,
-              server_);
+              this);
     event_base_set(eventBase_, &serverEvent_);
 
     // Add the event and start up the server
@@ -1299,84 +1442,60 @@ void TNonblockingIOThread::registerEvents() {
 }
 
 bool TNonblockingIOThread::notify(TNonblockingServer::TConnection* conn) {
-  auto fd = getNotificationSendFD();
-  if (fd < 0) {
+  if (getNotificationSendFD() < 0) {
     return false;
   }
 
-  int ret = -1;
-  long kSize = sizeof(conn);
-  const char * pos = (const char *)const_cast_sockopt(&conn);
-
-#if defined(HAVE_POLL_H) || defined(HAVE_SYS_POLL_H)
-  struct pollfd pfd = {fd, POLLOUT, 0};
-
-  while (kSize > 0) {
-    pfd.revents = 0;
-    ret = poll(&pfd, 1, -1);
-    if (ret < 0) {
-      return false;
-    } else if (ret == 0) {
-      continue;
-    }
-
-    if (pfd.revents & POLLHUP || pfd.revents & POLLERR) {
-      ::THRIFT_CLOSESOCKET(fd);
-      return false;
-    }
-
-    if (pfd.revents & POLLOUT) {
-      ret = send(fd, pos, kSize, 0);
-      if (ret < 0) {
-        if (errno == EAGAIN) {
-          continue;
-        }
-
-        ::THRIFT_CLOSESOCKET(fd);
-        return false;
-      }
-
-      kSize -= ret;
-      pos += ret;
-    }
+  if (conn == nullptr) {
+    stopRequested_ = true;
+    return wakeup();
   }
-#else
-  fd_set wfds, efds;
-
-  while (kSize > 0) {
-    FD_ZERO(&wfds);
-    FD_ZERO(&efds);
-    FD_SET(fd, &wfds);
-    FD_SET(fd, &efds);
-    ret = select(static_cast<int>(fd + 1), nullptr, &wfds, &efds, nullptr);
-    if (ret < 0) {
-      return false;
-    } else if (ret == 0) {
-      continue;
-    }
-
-    if (FD_ISSET(fd, &efds)) {
-      ::THRIFT_CLOSESOCKET(fd);
-      return false;
-    }
 
-    if (FD_ISSET(fd, &wfds)) {
-      ret = send(fd, pos, kSize, 0);
-      if (ret < 0) {
-        if (errno == EAGAIN) {
-          continue;
-        }
-
-        ::THRIFT_CLOSESOCKET(fd);
-        return false;
-      }
+  TNonblockingServer::TConnection* head = completions_.load(std::memory_order_relaxed);
+  do {
+    conn->nextCompletion_ = head;
+  } while (!completions_.compare_exchange_weak(head,
+                                               conn,
+                                               std::memory_order_release,
+                                               std::memory_order_relaxed));
+
+  // Whoever finds the queue empty wakes the IO thread; everyone else is
+  // picked up by that same wakeup.
+  if (head != nullptr || wakeup()) {
+    return true;
+  }
 
-      kSize -= ret;
-      pos += ret;
-    }
+  // The wakeup failed (logged by wakeup()). If nothing was queued behind
+  // conn yet, take it back out and let the caller close it. Otherwise the
+  // connections behind it count on our wakeup, so keep trying.
+  TNonblockingServer::TConnection* expected = conn;
+  if (completions_.compare_exchange_strong(expected,
+                                           nullptr,
+                                           std::memory_order_acquire,
+                                           std::memory_order_relaxed)) {
+    return false;
   }
-#endif
+  while (!wakeup()) {
+    std::this_thread::yield();
+  }
+  return true;
+}
 
+bool TNonblockingIOThread::wakeup() {
+  auto fd = getNotificationSendFD();
+#ifdef HAVE_SYS_EVENTFD_H
+  uint64_t one = 1;
+  long ret = ::write(fd, &one, sizeof(one));
+#else
+  char one = 1;
+  long ret = send(fd, &one, sizeof(one), 0);
+#endif
+  if (ret < 0 && THRIFT_GET_SOCKET_ERROR != THRIFT_EWOULDBLOCK
+      && THRIFT_GET_SOCKET_ERROR != THRIFT_EAGAIN) {
+    GlobalOutput.perror("TNonblocking: wakeup write() failed: ", THRIFT_GET_SOCKET_ERROR);
+    return false;
+  }
+  // if the write would block, a wakeup is already pending
   return true;
 }
 
@@ -1386,27 +1505,25 @@ void TNonblockingIOThread::notifyHandler(evutil_socket_t fd, short which, void*
   assert(ioThread);
   (void)which;
 
+  // Reset the wakeup before taking the queue, so that anything queued after
+  // that wakes us up again.
+#ifdef HAVE_SYS_EVENTFD_H
+  uint64_t count;
+  if (::read(fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+    GlobalOutput.perror("TNonblocking: notifyHandler read() failed: ", errno);
+    ioThread->breakLoop(true);
+    return;
+  }
+#else
   while (true) {
-    TNonblockingServer::TConnection* connection = nullptr;
-    const int kSize = sizeof(connection);
-    long nBytes = recv(fd, cast_sockopt(&connection), kSize, 0);
-    if (nBytes == kSize) {
-      if (connection == nullptr) {
-        // this is the command to stop our thread, exit the handler!
-        ioThread->breakLoop(false);
-        return;
-      }
-      connection->transition();
-    } else if (nBytes > 0) {
-      // throw away these bytes and hope that next time we get a solid read
-      GlobalOutput.printf("notifyHandler: Bad read of %d bytes, wanted %d", nBytes, kSize);
-      ioThread->breakLoop(true);
-      return;
+    char buf[64];
+    long nBytes = recv(fd, cast_sockopt(buf), sizeof(buf), 0);
+    if (nBytes > 0) {
+      continue;
     } else if (nBytes == 0) {
       GlobalOutput.printf("notifyHandler: Notify socket closed!");
       ioThread->breakLoop(false);
-      // exit the loop
-      break;
+      return;
     } else { // nBytes < 0
       if (THRIFT_GET_SOCKET_ERROR != THRIFT_EWOULDBLOCK
           && THRIFT_GET_SOCKET_ERROR != THRIFT_EAGAIN) {
@@ -1418,6 +1535,35 @@ void TNonblockingIOThread::notifyHandler(evutil_socket_t fd, short which, void*
       break;
     }
   }
+#endif
+
+  ioThread->drainCompletions();
+}
+
+void TNonblockingIOThread::drainCompletions() {
+  TNonblockingServer::TConnection* batch = completions_.exchange(nullptr,
+                                                                 std::memory_order_acquire);
+
+  // the queue is newest first, so reverse it to keep arrival order
+  TNonblockingServer::TConnection* ordered = nullptr;
+  while (batch != nullptr) {
+    TNonblockingServer::TConnection* next = batch->nextCompletion_;
+    batch->nextCompletion_ = ordered;
+    ordered = batch;
+    batch = next;
+  }
+
+  while (ordered != nullptr) {
+    TNonblockingServer::TConnection* connection = ordered;
+    ordered = connection->nextCompletion_;
+    connection->nextCompletion_ = nullptr;
+    connection->transition();
+  }
+
+  if (stopRequested_.exchange(false)) {
+    // this is the command to stop our thread
+    breakLoop(false);
+  }
 }
 
 void TNonblockingIOThread::breakLoop(bool error) {
@@ -1470,10 +1616,72 @@ void TNonblockingIOThread::setCurrentThreadHighPriority(bool value) {
 #endif
 }
 
+/**
+ * Read buffers come in power of 2 sizes, so that a buffer released by one
+ * connection fits the next one that grows into its size class.
+ */
+uint8_t* TNonblockingIOThread::allocateReadBuffer(uint32_t& size) {
+  uint32_t sizeClass = 0;
+  while (sizeClass < 31 && (uint32_t(1) << sizeClass) < size) {
+    ++sizeClass;
+  }
+  if ((uint32_t(1) << sizeClass) >= size) {
+    size = uint32_t(1) << sizeClass;
+    Guard g(poolMutex_);
+    std::vector<uint8_t*>& freeBuffers = freeReadBuffers_[sizeClass];
+    if (!freeBuffers.empty()) {
+      uint8_t* buffer = freeBuffers.back();
+      freeBuffers.pop_back();
+      freeReadBufferBytes_ -= size;
+      return buffer;
+    }
+  }
+
+  auto* buffer = (uint8_t*)std::malloc(size);
+  if (buffer == nullptr) {
+    // nothing else to be done...
+    throw std::bad_alloc();
+  }
+  return buffer;
+}
+
+void TNonblockingIOThread::releaseReadBuffer(uint8_t* buffer, uint32_t size) {
+  if (buffer == nullptr) {
+    return;
+  }
+  size_t poolSize = server_->getReadBufferPoolSize();
+  if ((size & (size - 1)) == 0 && size <= poolSize) {
+    Guard g(poolMutex_);
+    if (freeReadBufferBytes_ + size <= poolSize) {
+      uint32_t sizeClass = 0;
+      while ((uint32_t(1) << sizeClass) < size) {
+        ++sizeClass;
+      }
+      freeReadBuffers_[sizeClass].push_back(buffer);
+      freeReadBufferBytes_ += size;
+      return;
+    }
+  }
+  std::free(buffer);
+}
+
+void TNonblockingIOThread::clearReadBufferPool() {
+  Guard g(poolMutex_);
+  for (auto& freeBuffers : freeReadBuffers_) {
+    for (auto buffer : freeBuffers) {
+      std::free(buffer);
+    }
+    freeBuffers.clear();
+  }
+  freeReadBufferBytes_ = 0;
+}
+
 void TNonblockingIOThread::run() {
   if (eventBase_ == nullptr) {
     registerEvents();
   }
+  // the events may have been registered on another thread
+  threadId_ = Thread::get_current();
   if (useHighPriority_) {
     setCurrentThreadHighPriority(true);
   }
@@ -21,7 +21,9 @@
 #define _THRIFT_SERVER_TNONBLOCKINGSERVER_H_ 1
 
 #include <thrift/Thrift.h>
+#include <atomic>
 #include <memory>
+#include <thrift/server/TCodel.h>
 #include <thrift/server/TServer.h>
 #include <thrift/transport/PlatformSocket.h>
 #include <thrift/transport/TBufferTransports.h>
@@ -143,6 +145,9 @@ private:
   /// # of calls before resizing oversized buffers (0 = check only on close)
   static const int RESIZE_BUFFER_EVERY_N = 512;
 
+  /// Default limit on the bytes of free read buffers each IO thread keeps
+  static const size_t READ_BUFFER_POOL_SIZE = 4 * 1024 * 1024;
+
   /// # of IO threads to use by default
   static const int DEFAULT_IO_THREADS = 1;
 
@@ -152,6 +157,12 @@ private:
   /// Whether to set high scheduling priority for IO threads
   bool useHighPriorityIOThreads_;
 
+  /// Whether every IO thread should accept on its own SO_REUSEPORT socket
+  bool useReusePortAccept_;
+
+  /// Set once the IO threads are accepting on their own sockets
+  bool reusePortAccepting_;
+
   /// Server socket file descriptor
   THRIFT_SOCKET serverSocket_;
 
@@ -173,14 +184,17 @@ private:
   // Index of next IO Thread to be used (for round-robin)
   uint32_t nextIOThread_;
 
-  // Synchronizes access to connection stack and similar data
+  // Synchronizes the overload state
   Mutex connMutex_;
 
   /// Number of TConnection object we've created
-  size_t numTConnections_;
+  std::atomic<size_t> numTConnections_;
+
+  /// Number of TConnection objects in the pools of the IO threads
+  std::atomic<size_t> numIdleConnections_;
 
   /// Number of Connections processing or waiting to process
-  size_t numActiveProcessors_;
+  std::atomic<size_t> numActiveProcessors_;
 
   /// Limit for how many TConnection objects to cache
   size_t connectionStackLimit_;
@@ -207,6 +221,12 @@ private:
   /// Action to take when we're overloaded.
   TOverloadAction overloadAction_;
 
+  /// Whether tasks that waited too long for a worker thread are shed
+  bool shedOnQueueDelay_;
+
+  /// Tracks how long tasks wait for a worker thread
+  TCodel codel_;
+
   /**
    * The write buffer is initialized (and when idleWriteBufferLimit_ is checked
    * and found to be exceeded, reinitialized) to this size.
@@ -215,15 +235,22 @@ private:
 
   /**
    * Max read buffer size for an idle TConnection.  When we place an idle
-   * TConnection into connectionStack_ or on every resizeBufferEveryN_ calls,
-   * we will free the buffer (such that it will be reinitialized by the next
-   * received frame) if it has exceeded this limit.  0 disables this check.
+   * TConnection into its IO thread's pool or on every resizeBufferEveryN_
+   * calls, we will release the buffer (such that it will be reinitialized by
+   * the next received frame) if it has exceeded this limit.  0 disables this
+   * check.
    */
   size_t idleReadBufferLimit_;
 
+  /**
+   * Max bytes of free read buffers each IO thread keeps for reuse, rather
+   * than giving them back to the system allocator.  0 disables pooling.
+   */
+  size_t readBufferPoolSize_;
+
   /**
    * Max write buffer size for an idle connection.  When we place an idle
-   * TConnection into connectionStack_ or on every resizeBufferEveryN_ calls,
+   * TConnection into its IO thread's pool or on every resizeBufferEveryN_ calls,
    * we insure that its write buffer is <= to this size; otherwise we
    * replace it with a new one of writeBufferDefaultSize_ bytes to insure that
    * idle connections don't hog memory. 0 disables this check.
@@ -245,22 +272,6 @@ private:
   /// Count of connections dropped on overload since server started
   uint64_t nTotalConnectionsDropped_;
 
-  /**
-   * This is a stack of all the objects that have been created but that
-   * are NOT currently in use. When we close a connection, we place it on this
-   * stack so that the object can be reused later, rather than freeing the
-   * memory and reallocating a new object later.
-   */
-  std::stack<TConnection*> connectionStack_;
-
-  /**
-   * This container holds pointers to all active connections. This container
-   * allows the server to clean up unlcosed connection objects at destruction,
-   * which in turn allows their transports, protocols, processors and handlers
-   * to deallocate and clean up correctly.
-   */
-  std::vector<TConnection*> activeConnections_;
-
   /*
   */
   std::shared_ptr<TNonblockingServerTransport> serverTransport_;
@@ -270,18 +281,22 @@ private:
    * client connections on listen socket fd and assign TConnection objects
    * to handle those requests.
    *
+   * @param ioThread the IO thread that owns the listen socket.
    * @param which the event flag that triggered the handler.
    */
-  void handleEvent(THRIFT_SOCKET fd, short which);
+  void handleEvent(TNonblockingIOThread* ioThread, THRIFT_SOCKET fd, short which);
 
   void init() {
     serverSocket_ = THRIFT_INVALID_SOCKET;
     numIOThreads_ = DEFAULT_IO_THREADS;
     nextIOThread_ = 0;
     useHighPriorityIOThreads_ = false;
+    useReusePortAccept_ = false;
+    reusePortAccepting_ = false;
     userEventBase_ = nullptr;
     threadPoolProcessing_ = false;
     numTConnections_ = 0;
+    numIdleConnections_ = 0;
     numActiveProcessors_ = 0;
     connectionStackLimit_ = CONNECTION_STACK_LIMIT;
     maxActiveProcessors_ = MAX_ACTIVE_PROCESSORS;
@@ -290,8 +305,10 @@ private:
     taskExpireTime_ = 0;
     overloadHysteresis_ = 0.8;
     overloadAction_ = T_OVERLOAD_NO_ACTION;
+    shedOnQueueDelay_ = false;
     writeBufferDefaultSize_ = WRITE_BUFFER_DEFAULT_SIZE;
     idleReadBufferLimit_ = IDLE_READ_BUFFER_LIMIT;
+    readBufferPoolSize_ = READ_BUFFER_POOL_SIZE;
     idleWriteBufferLimit_ = IDLE_WRITE_BUFFER_LIMIT;
     resizeBufferEveryN_ = RESIZE_BUFFER_EVERY_N;
     overloaded_ = false;
@@ -399,6 +416,20 @@ public:
   /** Set whether the IO threads will get high scheduling priority. */
   void setUseHighPriorityIOThreads(bool val) { useHighPriorityIOThreads_ = val; }
 
+  /** Return whether each IO thread accepts connections on its own socket */
+  bool useReusePortAccept() const { return useReusePortAccept_; }
+
+  /**
+   * Set whether each IO thread should accept connections on its own listen
+   * socket, sharing the port with SO_REUSEPORT, and handle the connections
+   * it accepts itself. The kernel then spreads new connections across the
+   * IO threads, instead of the first IO thread accepting them all and
+   * handing them out.  The server transport must have SO_REUSEPORT enabled
+   * (see TNonblockingServerSocket::setReusePort()); otherwise only the first
+   * IO thread accepts, as usual. Must be called before serve().
+   */
+  void setUseReusePortAccept(bool val) { useReusePortAccept_ = val; }
+
   /** Return the number of IO threads used by this server. */
   size_t getNumIOThreads() const { return numIOThreads_; }
 
@@ -411,6 +442,8 @@ public:
 
   /**
    * Set the maximum number of unused TConnection we will hold in reserve.
+   * The unused objects are kept by the IO thread that last used them, and
+   * reused for the connections that thread is assigned.
    *
    * @param sz the new limit for TConnection pool size.
    */
@@ -441,7 +474,7 @@ public:
    *
    * @return count of idle connection objects.
    */
-  size_t getNumIdleConnections() const { return connectionStack_.size(); }
+  size_t getNumIdleConnections() const { return numIdleConnections_; }
 
   /**
    * Return count of number of connections which are currently processing.
@@ -454,16 +487,12 @@ public:
   size_t getNumActiveProcessors() const { return numActiveProcessors_; }
 
   /// Increment the count of connections currently processing.
-  void incrementActiveProcessors() {
-    Guard g(connMutex_);
-    ++numActiveProcessors_;
-  }
+  void incrementActiveProcessors() { ++numActiveProcessors_; }
 
   /// Decrement the count of connections currently processing.
   void decrementActiveProcessors() {
-    Guard g(connMutex_);
-    if (numActiveProcessors_ > 0) {
-      --numActiveProcessors_;
+    size_t current = numActiveProcessors_;
+    while (current > 0 && !numActiveProcessors_.compare_exchange_weak(current, current - 1)) {
     }
   }
 
@@ -561,12 +590,40 @@ public:
    */
   void setTaskExpireTime(int64_t taskExpireTime) { taskExpireTime_ = taskExpireTime; }
 
+  /**
+   * Get whether requests are shed by the time they wait for a worker thread.
+   *
+   * @return true if requests are shed by their queueing delay.
+   */
+  bool getShedOnQueueDelay() const { return shedOnQueueDelay_; }
+
+  /**
+   * Set whether requests are shed by the time they wait for a worker thread.
+   * When the thread manager falls behind, the requests that waited longest
+   * are answered with a TApplicationException of type LOADSHEDDING instead
+   * of being processed, see TCodel.  Its target delay and interval are set,
+   * and its state read, through getQueueDelayController().  Only requests
+   * processed on a thread manager are shed.
+   *
+   * @param shed true to shed requests by their queueing delay.
+   */
+  void setShedOnQueueDelay(bool shed) { shedOnQueueDelay_ = shed; }
+
+  /**
+   * Return the controller deciding which requests to shed, which also
+   * counts the shed requests.
+   *
+   * @return the controller tracking the queueing delay of requests.
+   */
+  TCodel& getQueueDelayController() { return codel_; }
+
   /**
    * Determine if the server is currently overloaded.
    * This function checks the maximums for open connections and connections
    * currently in processing, and sets an overload condition if they are
-   * exceeded.  The overload will persist until both values are below the
-   * current hysteresis fraction of their maximums.
+   * exceeded, or if requests are shed by their queueing delay.  The overload
+   * will persist until both values are below the current hysteresis fraction
+   * of their maximums and requests are no longer shed.
    *
    * @return true if an overload condition exists, false if not.
    */
@@ -630,6 +687,23 @@ public:
    */
   void setIdleBufferMemLimit(size_t limit) { idleReadBufferLimit_ = limit; }
 
+  /**
+   * Get the maximum bytes of free read buffers each IO thread keeps.
+   *
+   * @return # bytes of released read buffers kept for reuse per IO thread.
+   */
+  size_t getReadBufferPoolSize() const { return readBufferPoolSize_; }
+
+  /**
+   * Set the maximum bytes of free read buffers each IO thread keeps.  Read
+   * buffers are sized in powers of 2; those released when a connection's
+   * buffer grows, or is shrunk by the idle limit, are kept by its IO thread
+   * and handed to the next of its connections that needs one of that size.
+   *
+   * @param size # bytes kept per IO thread, or 0 to free buffers at once.
+   */
+  void setReadBufferPoolSize(size_t size) { readBufferPoolSize_ = size; }
+
   /**
    * Get the maximum size of write buffer allocated to idle TConnection objects.
    *
@@ -714,11 +788,10 @@ private:
    * and flags.
    *
    * @param socket FD of socket associated with this connection.
-   * @param addr the sockaddr of the client
-   * @param addrLen the length of addr
+   * @param acceptThread the IO thread that accepted the connection.
    * @return pointer to initialized TConnection object.
    */
-  TConnection* createConnection(std::shared_ptr<TSocket> socket);
+  TConnection* createConnection(std::shared_ptr<TSocket> socket, TNonblockingIOThread* acceptThread);
 
   /**
    * Returns a connection to pool or deletion.  If the connection pool
@@ -740,6 +813,13 @@ public:
                        THRIFT_SOCKET listenSocket,
                        bool useHighPriority);
 
+  // Creates an IO thread that accepts on its own listening transport, which
+  // is closed when the thread is destroyed.
+  TNonblockingIOThread(TNonblockingServer* server,
+                       int number,
+                       std::shared_ptr<TNonblockingServerTransport> listenTransport,
+                       bool useHighPriority);
+
   ~TNonblockingIOThread() override;
 
   // Returns the event-base for this thread.
@@ -751,11 +831,17 @@ public:
   // Returns the number of this IO thread.
   int getThreadNumber() const { return number_; }
 
+  // Returns the transport this thread accepts on, if it has its own.
+  const std::shared_ptr<TNonblockingServerTransport>& getListenTransport() const {
+    return listenTransport_;
+  }
+
   // Returns the thread id associated with this object.  This should
   // only be called after the thread has been started.
   Thread::id_t getThreadId() const { return threadId_; }
 
-  // Returns the send-fd for task complete notifications.
+  // Returns the send-fd for task complete notifications.  With eventfd this
+  // is the same descriptor as the read-fd.
   evutil_socket_t getNotificationSendFD() const { return notificationPipeFDs_[1]; }
 
   // Returns the read-fd for task complete notifications.
@@ -767,9 +853,23 @@ public:
   // Sets the actual thread object associated with this IO thread.
   void setThread(const std::shared_ptr<Thread>& t) { thread_ = t; }
 
-  // Used by TConnection objects to indicate processing has finished.
+  // Used by TConnection objects to indicate processing has finished.  The
+  // connection is queued without locking, and the IO thread is only woken
+  // up if the queue was empty, so completions arriving together are handled
+  // in one batch.  A nullptr conn asks the thread to exit its loop.
+  // Returns false if conn could not be queued or the IO thread could not
+  // be woken up for it, in which case the caller still owns it.
   bool notify(TNonblockingServer::TConnection* conn);
 
+  // Returns a read buffer of at least size bytes, rounded up to a power of
+  // 2, and sets size to its actual size.  Reuses a buffer from this thread's
+  // pool if it has one.
+  uint8_t* allocateReadBuffer(uint32_t& size);
+
+  // Gives back a buffer from allocateReadBuffer(), which is kept for reuse
+  // unless the pool is full.
+  void releaseReadBuffer(uint8_t* buffer, uint32_t size);
+
   // Enters the event loop and does not return until a call to stop().
   void run() override;
 
@@ -785,30 +885,37 @@ public:
 private:
   /**
    * C-callable event handler for signaling task completion.  Provides a
-   * callback that libevent can understand that will read a connection
-   * object's address from a pipe and call connection->transition() for
-   * that object.
+   * callback that libevent can understand that will reset the wakeup
+   * descriptor and call connection->transition() for every connection in
+   * the completion queue.
    *
    * @param fd the descriptor the event occurred on.
    */
   static void notifyHandler(evutil_socket_t fd, short which, void* v);
 
+  /// Wakes up the event loop through the notification descriptor.
+  bool wakeup();
+
+  /// Transitions every queued connection, in the order they were queued.
+  void drainCompletions();
+
   /**
    * C-callable event handler for listener events.  Provides a callback
    * that libevent can understand which invokes server->handleEvent().
    *
    * @param fd the descriptor the event occurred on.
    * @param which the flags associated with the event.
-   * @param v void* callback arg where we placed TNonblockingServer's "this".
+   * @param v void* callback arg where we placed TNonblockingIOThread's "this".
    */
   static void listenHandler(evutil_socket_t fd, short which, void* v) {
-    ((TNonblockingServer*)v)->handleEvent(fd, which);
+    auto* ioThread = (TNonblockingIOThread*)v;
+    ioThread->getServer()->handleEvent(ioThread, fd, which);
   }
 
   /// Exits the loop ASAP in case of shutdown or error.
   void breakLoop(bool error);
 
-  /// Create the pipe used to notify I/O process of task completion.
+  /// Create the eventfd (or pipe) used to notify I/O process of task completion.
   void createNotificationPipe();
 
   /// Unregisters our events for notification and listen sockets.
@@ -817,6 +924,11 @@ private:
   /// Sets (or clears) high priority scheduling status for the current thread.
   void setCurrentThreadHighPriority(bool value);
 
+  /// Frees the buffers in the read buffer pool.
+  void clearReadBufferPool();
+
+  friend class TNonblockingServer;
+
 private:
   /// associated server
   TNonblockingServer* server_;
@@ -830,6 +942,9 @@ private:
   /// If listenSocket_ >= 0, adds an event on the event_base to accept conns
   THRIFT_SOCKET listenSocket_;
 
+  /// Owns listenSocket_ when this thread has a listen socket of its own
+  std::shared_ptr<TNonblockingServerTransport> listenTransport_;
+
   /// Sets a high scheduling priority when running
   bool useHighPriority_;
 
@@ -849,6 +964,28 @@ private:
   /// File descriptors for pipe used for task completion notification.
   evutil_socket_t notificationPipeFDs_[2];
 
+  /// Completed connections, newest first, linked through nextCompletion_
+  std::atomic<TNonblockingServer::TConnection*> completions_;
+
+  /// Set by notify(nullptr) to exit the loop after the queue is drained
+  std::atomic<bool> stopRequested_;
+
+  /// Guards the connection and read buffer pools below.  It is only
+  /// contended when another thread accepts or closes one of our connections.
+  Mutex poolMutex_;
+
+  /// Connections of this thread that are in use, to close them at shutdown
+  std::vector<TNonblockingServer::TConnection*> activeConnections_;
+
+  /// Connection objects of this thread that are not in use
+  std::vector<TNonblockingServer::TConnection*> idleConnections_;
+
+  /// Free read buffers by size class, freeReadBuffers_[i] has 2^i bytes each
+  std::vector<uint8_t*> freeReadBuffers_[32];
+
+  /// Total bytes of the buffers in freeReadBuffers_
+  size_t freeReadBufferBytes_;
+
   /// Actual IO Thread
   std::shared_ptr<Thread> thread_;
 };
@@ -19,6 +19,12 @@
 
 #include <thrift/thrift-config.h>
 
+#include <algorithm>
+#include <string>
+
+#include <thrift/TDeadline.h>
+#include <thrift/server/TServer.h>
+
 #ifdef HAVE_SYS_TIME_H
 #include <sys/time.h>
 #endif
@@ -34,8 +40,66 @@ namespace apache {
 namespace thrift {
 namespace server {
 
+using apache::thrift::protocol::TMessageType;
+using std::chrono::steady_clock;
+
+bool TServer::processRequest(TProcessor& processor,
+                             const std::shared_ptr<TProtocol>& input,
+                             const std::shared_ptr<TProtocol>& output,
+                             void* connectionContext,
+                             steady_clock::time_point receivedAt) {
+  auto carrier = dynamic_cast<TDeadlineCarrier*>(input->getTransport().get());
+  std::chrono::milliseconds timeout;
+  if (!carrier || !carrier->readRequestTimeout(timeout)) {
+    return processor.process(input, output, connectionContext);
+  }
+
+  if (receivedAt == steady_clock::time_point()) {
+    receivedAt = steady_clock::now();
+  }
+
+  // Timeouts too long to add to the clock are as good as none
+  if (timeout > std::chrono::duration_cast<std::chrono::milliseconds>(
+                    steady_clock::time_point::max() - receivedAt)) {
+    return processor.process(input, output, connectionContext);
+  }
+
+  TDeadlineScope scope(receivedAt + std::max(timeout, std::chrono::milliseconds(0)));
+  if (TDeadline::expired()) {
+    auto waited
+        = std::chrono::duration_cast<std::chrono::milliseconds>(steady_clock::now() - receivedAt);
+    rejectRequest(*input,
+                  *output,
+                  TApplicationException(TApplicationException::TIMEOUT,
+                                        "Request timed out after waiting "
+                                            + std::to_string(waited.count()) + " ms of "
+                                            + std::to_string(timeout.count()) + " ms"));
+    return true;
+  }
+  return processor.process(input, output, connectionContext);
+}
+
+void TServer::rejectRequest(TProtocol& input, TProtocol& output, const TApplicationException& x) {
+  std::string fname;
+  TMessageType mtype;
+  int32_t seqid;
+  input.readMessageBegin(fname, mtype, seqid);
+  input.skip(protocol::T_STRUCT);
+  input.readMessageEnd();
+  input.getTransport()->readEnd();
+  if (mtype == protocol::T_ONEWAY) {
+    return;
+  }
+
+  output.writeMessageBegin(fname, protocol::T_EXCEPTION, seqid);
+  x.write(&output);
+  output.writeMessageEnd();
+  output.getTransport()->writeEnd();
+  output.getTransport()->flush();
+}
+
 #ifdef HAVE_SYS_RESOURCE_H
-int increase_max_fds(int max_fds = (1 << 24)) {
+int increase_max_fds(int max_fds) {
   struct rlimit fdmaxrl;
 
   for (fdmaxrl.rlim_cur = max_fds, fdmaxrl.rlim_max = max_fds;
@@ -20,11 +20,13 @@
 #ifndef _THRIFT_SERVER_TSERVER_H_
 #define _THRIFT_SERVER_TSERVER_H_ 1
 
+#include <thrift/TApplicationException.h>
 #include <thrift/TProcessor.h>
 #include <thrift/transport/TServerTransport.h>
 #include <thrift/protocol/TBinaryProtocol.h>
 #include <thrift/concurrency/Thread.h>
 
+#include <chrono>
 #include <memory>
 
 namespace apache {
@@ -123,6 +125,30 @@ public:
 
   std::shared_ptr<TServerEventHandler> getEventHandler() { return eventHandler_; }
 
+  /**
+   * Processes the next request on input, unless the caller sent a deadline
+   * for it in the client_timeout THeader header and that deadline passed
+   * already. Such requests are answered with a TIMEOUT exception without
+   * calling the handler. The deadline counts from receivedAt, when the
+   * server got the request, or from when the request is read if receivedAt
+   * is not given, and is installed with a TDeadlineScope while the handler
+   * runs.
+   *
+   * Returns what TProcessor::process() returns.
+   */
+  static bool processRequest(TProcessor& processor,
+                             const std::shared_ptr<TProtocol>& input,
+                             const std::shared_ptr<TProtocol>& output,
+                             void* connectionContext,
+                             std::chrono::steady_clock::time_point receivedAt
+                             = std::chrono::steady_clock::time_point());
+
+  /**
+   * Skips the next request on input and, unless it is oneway, answers it
+   * with the given exception.
+   */
+  static void rejectRequest(TProtocol& input, TProtocol& output, const TApplicationException& x);
+
 protected:
   TServer(const std::shared_ptr<TProcessorFactory>& processorFactory)
     : processorFactory_(processorFactory) {
@@ -0,0 +1,987 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/thrift-config.h>
+
+#include <thrift/server/TUringServer.h>
+#include <thrift/concurrency/Exception.h>
+#include <thrift/concurrency/ThreadFactory.h>
+#include <thrift/transport/TBufferTransports.h>
+#include <thrift/transport/TSocket.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cinttypes>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <typeinfo>
+#include <unordered_set>
+
+#ifdef HAVE_LINUX_IO_URING_H
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#ifdef HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#endif
+
+#ifdef HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#endif
+
+#ifdef HAVE_ARPA_INET_H
+#include <arpa/inet.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include <errno.h>
+
+namespace apache {
+namespace thrift {
+namespace server {
+
+using apache::thrift::concurrency::Guard;
+using apache::thrift::concurrency::IllegalStateException;
+using apache::thrift::concurrency::Runnable;
+using apache::thrift::concurrency::Thread;
+using apache::thrift::concurrency::ThreadFactory;
+using apache::thrift::concurrency::ThreadManager;
+using apache::thrift::concurrency::TimedOutException;
+using apache::thrift::transport::TMemoryBuffer;
+using apache::thrift::transport::TServerSocket;
+using apache::thrift::transport::TSocket;
+using apache::thrift::transport::TTransportException;
+
+#ifdef HAVE_LINUX_IO_URING_H
+
+namespace {
+
+/**
+ * The submission and completion queues of a ring, mapped from the kernel.
+ * Used by the thread that created it only.
+ */
+class TUring {
+public:
+  explicit TUring(uint32_t entries)
+    : fd_(-1), sqRing_(MAP_FAILED), cqRing_(MAP_FAILED), sqes_(MAP_FAILED) {
+    struct io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    // completions of multishot requests can outnumber submissions by far
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = entries * 8;
+    fd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    if (fd_ < 0) {
+      throwError("io_uring_setup", errno);
+    }
+
+    sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (singleMmap) {
+      sqRingSize_ = cqRingSize_ = (std::max)(sqRingSize_, cqRingSize_);
+    }
+    sqRing_ = mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_,
+                   IORING_OFF_SQ_RING);
+    if (sqRing_ == MAP_FAILED) {
+      int errno_copy = errno;
+      close();
+      throwError("mmap", errno_copy);
+    }
+    if (singleMmap) {
+      cqRing_ = sqRing_;
+    } else {
+      cqRing_ = mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     fd_, IORING_OFF_CQ_RING);
+    }
+    sqesSize_ = params.sq_entries * sizeof(struct io_uring_sqe);
+    if (cqRing_ != MAP_FAILED) {
+      sqes_ = mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_,
+                   IORING_OFF_SQES);
+    }
+    if (cqRing_ == MAP_FAILED || sqes_ == MAP_FAILED) {
+      int errno_copy = errno;
+      close();
+      throwError("mmap", errno_copy);
+    }
+
+    auto sq = static_cast<uint8_t*>(sqRing_);
+    sqHead_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sqTail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sqMask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sqArray_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    sqEntries_ = params.sq_entries;
+    sqeTail_ = *sqTail_;
+
+    auto cq = static_cast<uint8_t*>(cqRing_);
+    cqHead_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cqTail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cqMask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+  }
+
+  ~TUring() { close(); }
+
+  int getFD() const { return fd_; }
+
+  /**
+   * Returns a cleared submission queue entry, submitting the queued ones
+   * first if the queue is full.
+   */
+  struct io_uring_sqe* getSqe() {
+    if (sqeTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE) >= sqEntries_) {
+      submit(0);
+      if (sqeTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE) >= sqEntries_) {
+        throw TException("TUringServer: io_uring submission queue is full");
+      }
+    }
+    unsigned index = sqeTail_ & sqMask_;
+    struct io_uring_sqe* sqe = static_cast<struct io_uring_sqe*>(sqes_) + index;
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqArray_[index] = index;
+    sqeTail_++;
+    return sqe;
+  }
+
+  /**
+   * Submits the queued entries and waits for minComplete completions, in
+   * one system call. Returns early if interrupted by a signal.
+   */
+  void submit(unsigned minComplete) {
+    __atomic_store_n(sqTail_, sqeTail_, __ATOMIC_RELEASE);
+    unsigned pending = sqeTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+    if (pending == 0 && minComplete == 0) {
+      return;
+    }
+    unsigned flags = minComplete > 0 ? IORING_ENTER_GETEVENTS : 0;
+    if (syscall(__NR_io_uring_enter, fd_, pending, minComplete, flags, nullptr, 0) < 0) {
+      int errno_copy = errno;
+      if (errno_copy != EINTR && errno_copy != EAGAIN && errno_copy != EBUSY) {
+        throw TException("TUringServer: io_uring_enter failed: "
+                         + TOutput::strerror_s(errno_copy));
+      }
+    }
+  }
+
+  /**
+   * Returns the oldest completion not seen yet, or nullptr.
+   */
+  struct io_uring_cqe* peekCqe() {
+    unsigned head = *cqHead_;
+    if (head == __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE)) {
+      return nullptr;
+    }
+    return &cqes_[head & cqMask_];
+  }
+
+  void seenCqe() { __atomic_store_n(cqHead_, *cqHead_ + 1, __ATOMIC_RELEASE); }
+
+private:
+  static void throwError(const char* call, int errno_copy) {
+    throw TException(std::string("TUringServer: ") + call + " failed: "
+                     + TOutput::strerror_s(errno_copy));
+  }
+
+  void close() {
+    if (sqes_ != MAP_FAILED) {
+      munmap(sqes_, sqesSize_);
+    }
+    if (cqRing_ != MAP_FAILED && cqRing_ != sqRing_) {
+      munmap(cqRing_, cqRingSize_);
+    }
+    if (sqRing_ != MAP_FAILED) {
+      munmap(sqRing_, sqRingSize_);
+    }
+    sqes_ = cqRing_ = sqRing_ = MAP_FAILED;
+    if (fd_ >= 0) {
+      ::close(fd_);
+      fd_ = -1;
+    }
+  }
+
+  int fd_;
+  void* sqRing_;
+  size_t sqRingSize_;
+  void* cqRing_;
+  size_t cqRingSize_;
+  void* sqes_;
+  size_t sqesSize_;
+
+  unsigned* sqHead_;
+  unsigned* sqTail_;
+  unsigned sqMask_;
+  unsigned* sqArray_;
+  unsigned sqEntries_;
+  // tail of the entries handed out, published to the kernel on submit
+  unsigned sqeTail_;
+
+  unsigned* cqHead_;
+  unsigned* cqTail_;
+  unsigned cqMask_;
+  struct io_uring_cqe* cqes_;
+};
+
+/**
+ * Buffers registered with a ring, for the kernel to pick from when data
+ * arrives on a recv that selects its buffer.
+ */
+class TProvidedBuffers {
+public:
+  TProvidedBuffers(int ringFD, uint16_t group, uint32_t count, uint32_t size)
+    : ringFD_(ringFD), group_(group), count_(1), size_(size), tail_(0) {
+    // the kernel requires a power of 2
+    while (count_ < count) {
+      count_ <<= 1;
+    }
+    ringSize_ = count_ * sizeof(struct io_uring_buf);
+    ring_ = static_cast<struct io_uring_buf*>(
+        mmap(nullptr, ringSize_, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0));
+    if (ring_ == MAP_FAILED) {
+      int errno_copy = errno;
+      throw TException("TUringServer: mmap failed: " + TOutput::strerror_s(errno_copy));
+    }
+
+    struct io_uring_buf_reg reg;
+    std::memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uintptr_t>(ring_);
+    reg.ring_entries = count_;
+    reg.bgid = group_;
+    if (syscall(__NR_io_uring_register, ringFD_, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+      int errno_copy = errno;
+      munmap(ring_, ringSize_);
+      throw TException("TUringServer: registering buffers failed: "
+                       + TOutput::strerror_s(errno_copy));
+    }
+
+    data_.reset(new uint8_t[static_cast<size_t>(count_) * size_]);
+    for (uint32_t bid = 0; bid < count_; bid++) {
+      add(static_cast<uint16_t>(bid));
+    }
+    commit();
+  }
+
+  ~TProvidedBuffers() {
+    struct io_uring_buf_reg reg;
+    std::memset(&reg, 0, sizeof(reg));
+    reg.bgid = group_;
+    syscall(__NR_io_uring_register, ringFD_, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+    munmap(ring_, ringSize_);
+  }
+
+  uint16_t getGroup() const { return group_; }
+
+  const uint8_t* get(uint16_t bid) const { return data_.get() + static_cast<size_t>(bid) * size_; }
+
+  // Gives a buffer back to the kernel, once commit() is called
+  void add(uint16_t bid) {
+    struct io_uring_buf* buf = &ring_[tail_ & (count_ - 1)];
+    buf->addr = reinterpret_cast<uintptr_t>(get(bid));
+    buf->len = size_;
+    buf->bid = bid;
+    tail_++;
+  }
+
+  // the ring's tail overlays the reserved field of its first entry
+  void commit() { __atomic_store_n(&ring_[0].resv, tail_, __ATOMIC_RELEASE); }
+
+private:
+  int ringFD_;
+  uint16_t group_;
+  uint32_t count_;
+  uint32_t size_;
+  // struct io_uring_buf_ring, whose layout differs in C++
+  struct io_uring_buf* ring_;
+  size_t ringSize_;
+  uint16_t tail_;
+  std::unique_ptr<uint8_t[]> data_;
+};
+}
+
+/**
+ * Serves the connections accepted on one ring.
+ */
+class TUringIOThread : public Runnable {
+public:
+  explicit TUringIOThread(TUringServer* server);
+  ~TUringIOThread() override;
+
+  void run() override;
+
+  /**
+   * Makes run() return once all connections are closed. Can be called from
+   * any thread.
+   */
+  void stop();
+
+private:
+  class Connection;
+  class Task;
+
+  // the operation a completion belongs to, in the low bits of its user_data
+  enum Op { OP_NONE = 0, OP_ACCEPT = 1, OP_RECV = 2, OP_SEND = 3, OP_WAKEUP = 4 };
+  static const uint64_t OP_MASK = 7;
+
+  // Hands a processed request back from a worker thread
+  void notify(Connection* connection);
+
+  void handle(uint64_t userData, int32_t res, uint32_t flags);
+  void onAccept(int32_t res, uint32_t flags);
+  void onRecv(Connection* connection, int32_t res, uint32_t flags);
+  void onSend(Connection* connection, int32_t res);
+  void onWakeup();
+
+  void armAccept();
+  void armRecv(Connection* connection);
+  void armWakeup();
+  void send(Connection* connection);
+
+  void processFrames(Connection* connection);
+  void dispatch(Connection* connection, uint32_t frameSize);
+  void finishRequest(Connection* connection);
+  void closeConnection(Connection* connection);
+  void releaseIfDone(Connection* connection);
+  void beginStop();
+
+  TUringServer* server_;
+  TUring ring_;
+  TProvidedBuffers buffers_;
+  THRIFT_SOCKET listenSocket_;
+  int wakeupFD_;
+  uint64_t wakeupValue_;
+
+  bool multishotAccept_;
+  bool multishotRecv_;
+  bool acceptArmed_;
+  bool stopping_;
+  std::atomic<bool> stopRequested_;
+
+  std::unordered_set<Connection*> connections_;
+
+  // requests processed by worker threads, for the IO thread to answer
+  concurrency::Mutex completedMutex_;
+  std::vector<Connection*> completed_;
+};
+
+class TUringIOThread::Connection {
+public:
+  Connection(TUringIOThread* ioThread, THRIFT_SOCKET fd)
+    : ioThread(ioThread),
+      fd(fd),
+      socket(new TSocket(fd)),
+      inputBuffer(new TMemoryBuffer()),
+      outputBuffer(new TMemoryBuffer()),
+      readBuffer(nullptr),
+      readSize(0),
+      readCapacity(0),
+      requestBuffer(nullptr),
+      requestCapacity(0),
+      sendBuffer(nullptr),
+      sendSize(0),
+      sendPos(0),
+      recvArmed(false),
+      sending(false),
+      processing(false),
+      closing(false),
+      failed(false) {
+    TUringServer* server = ioThread->server_;
+    std::shared_ptr<TTransport> input
+        = server->getInputTransportFactory()->getTransport(inputBuffer);
+    std::shared_ptr<TTransport> output
+        = server->getOutputTransportFactory()->getTransport(outputBuffer);
+    inputProtocol = server->getInputProtocolFactory()->getProtocol(input);
+    outputProtocol = server->getOutputProtocolFactory()->getProtocol(output);
+
+    eventHandler = server->getEventHandler();
+    context = eventHandler ? eventHandler->createContext(inputProtocol, outputProtocol) : nullptr;
+    processor = server->getProcessor(inputProtocol, outputProtocol, socket);
+  }
+
+  ~Connection() {
+    if (eventHandler) {
+      eventHandler->deleteContext(context, inputProtocol, outputProtocol);
+    }
+    std::free(readBuffer);
+    std::free(requestBuffer);
+  }
+
+  // Runs the processor on the request in inputBuffer
+  void process() {
+    try {
+      if (eventHandler) {
+        eventHandler->processContext(context, socket);
+      }
+      processor->process(inputProtocol, outputProtocol, context);
+    } catch (const TTransportException& ttx) {
+      GlobalOutput.printf("TUringServer: client died: %s", ttx.what());
+      failed = true;
+    } catch (const std::bad_alloc&) {
+      GlobalOutput("TUringServer: caught bad_alloc exception.");
+      exit(1);
+    } catch (const std::exception& x) {
+      GlobalOutput.printf("TUringServer: process() exception: %s: %s", typeid(x).name(), x.what());
+      failed = true;
+    } catch (...) {
+      GlobalOutput.printf("TUringServer: unknown exception while processing.");
+      failed = true;
+    }
+  }
+
+  // Appends received data to readBuffer
+  void append(const uint8_t* data, uint32_t len) {
+    reserve(readSize + len);
+    std::memcpy(readBuffer + readSize, data, len);
+    readSize += len;
+  }
+
+  void reserve(uint32_t size) {
+    if (size > readCapacity) {
+      uint32_t capacity = (std::max)(size, readCapacity * 2);
+      auto buffer = static_cast<uint8_t*>(std::realloc(readBuffer, capacity));
+      if (buffer == nullptr) {
+        throw std::bad_alloc();
+      }
+      readBuffer = buffer;
+      readCapacity = capacity;
+    }
+  }
+
+  TUringIOThread* ioThread;
+  THRIFT_SOCKET fd;
+  std::shared_ptr<TSocket> socket;
+  std::shared_ptr<TMemoryBuffer> inputBuffer;
+  std::shared_ptr<TMemoryBuffer> outputBuffer;
+  std::shared_ptr<TProtocol> inputProtocol;
+  std::shared_ptr<TProtocol> outputProtocol;
+  std::shared_ptr<TProcessor> processor;
+  std::shared_ptr<TServerEventHandler> eventHandler;
+  void* context;
+
+  // data received and not yet dispatched, starting with a frame header
+  uint8_t* readBuffer;
+  uint32_t readSize;
+  uint32_t readCapacity;
+
+  // the frame being processed, which inputBuffer observes
+  uint8_t* requestBuffer;
+  uint32_t requestCapacity;
+
+  // the response being sent, owned by outputBuffer
+  uint8_t* sendBuffer;
+  uint32_t sendSize;
+  uint32_t sendPos;
+
+  // the operations in flight, the connection is released when none is
+  bool recvArmed;
+  bool sending;
+  bool processing;
+
+  bool closing;
+  // set by a worker thread that could not process the request
+  bool failed;
+};
+
+class TUringIOThread::Task : public Runnable {
+public:
+  explicit Task(Connection* connection) : connection_(connection) {}
+
+  void run() override {
+    connection_->process();
+    connection_->ioThread->notify(connection_);
+  }
+
+private:
+  Connection* connection_;
+};
+
+TUringIOThread::TUringIOThread(TUringServer* server)
+  : server_(server),
+    ring_(server->getRingEntries()),
+    buffers_(ring_.getFD(), 0, server->getNumBuffers(), server->getBufferSize()),
+    listenSocket_(server->serverSocket_->getSocketFD()),
+    wakeupFD_(eventfd(0, EFD_CLOEXEC)),
+    wakeupValue_(0),
+    multishotAccept_(true),
+    multishotRecv_(true),
+    acceptArmed_(false),
+    stopping_(false),
+    stopRequested_(false) {
+  if (wakeupFD_ < 0) {
+    int errno_copy = errno;
+    throw TException("TUringServer: eventfd failed: " + TOutput::strerror_s(errno_copy));
+  }
+}
+
+TUringIOThread::~TUringIOThread() {
+  for (Connection* connection : connections_) {
+    delete connection;
+  }
+  ::close(wakeupFD_);
+}
+
+void TUringIOThread::run() {
+  armWakeup();
+  armAccept();
+  while (!stopping_ || acceptArmed_ || !connections_.empty()) {
+    ring_.submit(1);
+    struct io_uring_cqe* cqe;
+    while ((cqe = ring_.peekCqe()) != nullptr) {
+      uint64_t userData = cqe->user_data;
+      int32_t res = cqe->res;
+      uint32_t flags = cqe->flags;
+      ring_.seenCqe();
+      handle(userData, res, flags);
+    }
+  }
+}
+
+void TUringIOThread::stop() {
+  stopRequested_ = true;
+  uint64_t one = 1;
+  if (::write(wakeupFD_, &one, sizeof(one)) != sizeof(one)) {
+    GlobalOutput.perror("TUringServer: stop() write ", errno);
+  }
+}
+
+void TUringIOThread::notify(Connection* connection) {
+  {
+    Guard g(completedMutex_);
+    completed_.push_back(connection);
+  }
+  uint64_t one = 1;
+  if (::write(wakeupFD_, &one, sizeof(one)) != sizeof(one)) {
+    GlobalOutput.perror("TUringServer: notify() write ", errno);
+  }
+}
+
+void TUringIOThread::handle(uint64_t userData, int32_t res, uint32_t flags) {
+  auto connection = reinterpret_cast<Connection*>(userData & ~OP_MASK);
+  switch (static_cast<Op>(userData & OP_MASK)) {
+  case OP_ACCEPT:
+    onAccept(res, flags);
+    break;
+  case OP_RECV:
+    onRecv(connection, res, flags);
+    break;
+  case OP_SEND:
+    onSend(connection, res);
+    break;
+  case OP_WAKEUP:
+    onWakeup();
+    break;
+  case OP_NONE:
+    break;
+  }
+}
+
+void TUringIOThread::armAccept() {
+  struct io_uring_sqe* sqe = ring_.getSqe();
+  sqe->opcode = IORING_OP_ACCEPT;
+  sqe->fd = listenSocket_;
+  sqe->accept_flags = SOCK_CLOEXEC;
+  if (multishotAccept_) {
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+  }
+  sqe->user_data = OP_ACCEPT;
+  acceptArmed_ = true;
+}
+
+void TUringIOThread::armRecv(Connection* connection) {
+  struct io_uring_sqe* sqe = ring_.getSqe();
+  sqe->opcode = IORING_OP_RECV;
+  sqe->fd = connection->fd;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = buffers_.getGroup();
+  if (multishotRecv_) {
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+  }
+  sqe->user_data = reinterpret_cast<uintptr_t>(connection) | OP_RECV;
+  connection->recvArmed = true;
+}
+
+void TUringIOThread::armWakeup() {
+  struct io_uring_sqe* sqe = ring_.getSqe();
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = wakeupFD_;
+  sqe->addr = reinterpret_cast<uintptr_t>(&wakeupValue_);
+  sqe->len = sizeof(wakeupValue_);
+  sqe->user_data = OP_WAKEUP;
+}
+
+void TUringIOThread::send(Connection* connection) {
+  struct io_uring_sqe* sqe = ring_.getSqe();
+  sqe->opcode = IORING_OP_SEND;
+  sqe->fd = connection->fd;
+  sqe->addr = reinterpret_cast<uintptr_t>(connection->sendBuffer + connection->sendPos);
+  sqe->len = connection->sendSize - connection->sendPos;
+  sqe->msg_flags = MSG_NOSIGNAL;
+  sqe->user_data = reinterpret_cast<uintptr_t>(connection) | OP_SEND;
+  connection->sending = true;
+}
+
+void TUringIOThread::onAccept(int32_t res, uint32_t flags) {
+  if (!(flags & IORING_CQE_F_MORE)) {
+    acceptArmed_ = false;
+  }
+  if (res >= 0) {
+    if (stopping_) {
+      ::close(res);
+    } else {
+      int one = 1;
+      // fails harmlessly on unix domain sockets
+      setsockopt(res, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+      Connection* connection = nullptr;
+      try {
+        connection = new Connection(this, res);
+      } catch (const std::exception& x) {
+        GlobalOutput.printf("TUringServer: failed to set up connection: %s", x.what());
+        ::close(res);
+      }
+      if (connection) {
+        connections_.insert(connection);
+        armRecv(connection);
+      }
+    }
+  } else if (res == -EINVAL && multishotAccept_) {
+    // the kernel predates multishot accept
+    multishotAccept_ = false;
+  } else if (res != -ECANCELED) {
+    GlobalOutput.perror("TUringServer: accept ", -res);
+  }
+  if (!acceptArmed_ && !stopping_) {
+    armAccept();
+  }
+}
+
+void TUringIOThread::onRecv(Connection* connection, int32_t res, uint32_t flags) {
+  if (!(flags & IORING_CQE_F_MORE)) {
+    connection->recvArmed = false;
+  }
+  if (flags & IORING_CQE_F_BUFFER) {
+    auto bid = static_cast<uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT);
+    if (res > 0 && !connection->closing) {
+      connection->append(buffers_.get(bid), static_cast<uint32_t>(res));
+    }
+    buffers_.add(bid);
+    buffers_.commit();
+  }
+
+  if (res > 0) {
+    processFrames(connection);
+  } else if (res == -ENOBUFS) {
+    // all buffers were in use, recv is armed again below
+  } else if (res == -EINVAL && multishotRecv_) {
+    // the kernel predates multishot recv
+    multishotRecv_ = false;
+  } else {
+    // the client closed the connection, or failed
+    closeConnection(connection);
+  }
+
+  if (!connection->recvArmed && !connection->closing) {
+    armRecv(connection);
+  }
+  releaseIfDone(connection);
+}
+
+void TUringIOThread::onSend(Connection* connection, int32_t res) {
+  connection->sending = false;
+  if (res < 0) {
+    if (res != -EPIPE && res != -ECONNRESET) {
+      GlobalOutput.perror("TUringServer: send ", -res);
+    }
+    closeConnection(connection);
+  } else if (!connection->closing) {
+    connection->sendPos += static_cast<uint32_t>(res);
+    if (connection->sendPos < connection->sendSize) {
+      send(connection);
+    } else {
+      connection->outputBuffer->resetBuffer();
+      processFrames(connection);
+    }
+  }
+  releaseIfDone(connection);
+}
+
+void TUringIOThread::onWakeup() {
+  std::vector<Connection*> completed;
+  {
+    Guard g(completedMutex_);
+    completed.swap(completed_);
+  }
+  for (Connection* connection : completed) {
+    finishRequest(connection);
+    releaseIfDone(connection);
+  }
+  if (stopRequested_ && !stopping_) {
+    beginStop();
+  }
+  armWakeup();
+}
+
+void TUringIOThread::processFrames(Connection* connection) {
+  while (!connection->processing && !connection->sending && !connection->closing
+         && connection->readSize >= 4) {
+    uint32_t frameSize;
+    std::memcpy(&frameSize, connection->readBuffer, sizeof(frameSize));
+    frameSize = ntohl(frameSize);
+    if (frameSize > server_->getMaxFrameSize()) {
+      GlobalOutput.printf("TUringServer: frame size too large (%" PRIu32 " > %" PRIu32
+                          ") from client %s. Remote side not using TFramedTransport?",
+                          frameSize,
+                          server_->getMaxFrameSize(),
+                          connection->socket->getSocketInfo().c_str());
+      closeConnection(connection);
+      return;
+    }
+    if (connection->readSize - 4 < frameSize) {
+      // make room for the rest of the frame at once
+      connection->reserve(frameSize + 4);
+      return;
+    }
+    dispatch(connection, frameSize);
+  }
+}
+
+void TUringIOThread::dispatch(Connection* connection, uint32_t frameSize) {
+  // The frame moves to requestBuffer, so that data received while it is
+  // processed cannot move it. Data already received past the frame stays.
+  uint32_t frameEnd = frameSize + 4;
+  std::swap(connection->readBuffer, connection->requestBuffer);
+  std::swap(connection->readCapacity, connection->requestCapacity);
+  uint32_t rest = connection->readSize - frameEnd;
+  connection->readSize = 0;
+  if (rest > 0) {
+    connection->append(connection->requestBuffer + frameEnd, rest);
+  }
+
+  connection->inputBuffer->resetBuffer(connection->requestBuffer + 4, frameSize);
+  connection->outputBuffer->resetBuffer();
+  // leave room for the frame size
+  connection->outputBuffer->getWritePtr(4);
+  connection->outputBuffer->wroteBytes(4);
+  connection->processing = true;
+
+  std::shared_ptr<ThreadManager> threadManager = server_->getThreadManager();
+  if (threadManager) {
+    try {
+      threadManager->add(std::make_shared<Task>(connection));
+    } catch (const IllegalStateException& ise) {
+      GlobalOutput.printf("IllegalStateException: TUringServer::dispatch() %s", ise.what());
+      connection->processing = false;
+      closeConnection(connection);
+    } catch (const TimedOutException& to) {
+      GlobalOutput.printf("[ERROR] TimedOutException: TUringServer::dispatch() %s", to.what());
+      connection->processing = false;
+      closeConnection(connection);
+    }
+    return;
+  }
+
+  connection->process();
+  finishRequest(connection);
+}
+
+void TUringIOThread::finishRequest(Connection* connection) {
+  connection->processing = false;
+  if (connection->failed) {
+    closeConnection(connection);
+    return;
+  }
+  if (connection->closing) {
+    return;
+  }
+
+  connection->outputBuffer->getBuffer(&connection->sendBuffer, &connection->sendSize);
+  // 4 bytes were reserved for the frame size, a oneway request has no result
+  if (connection->sendSize > 4) {
+    uint32_t frameSize = htonl(connection->sendSize - 4);
+    std::memcpy(connection->sendBuffer, &frameSize, sizeof(frameSize));
+    connection->sendPos = 0;
+    send(connection);
+  } else {
+    processFrames(connection);
+  }
+}
+
+void TUringIOThread::closeConnection(Connection* connection) {
+  if (!connection->closing) {
+    connection->closing = true;
+    // completes the armed recv, and any send, so the connection can go
+    ::shutdown(connection->fd, SHUT_RDWR);
+  }
+}
+
+void TUringIOThread::releaseIfDone(Connection* connection) {
+  if (connection->closing && !connection->recvArmed && !connection->sending
+      && !connection->processing) {
+    connections_.erase(connection);
+    delete connection;
+  }
+}
+
+void TUringIOThread::beginStop() {
+  stopping_ = true;
+  if (acceptArmed_) {
+    struct io_uring_sqe* sqe = ring_.getSqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = OP_ACCEPT;
+    sqe->user_data = OP_NONE;
+  }
+  std::vector<Connection*> connections(connections_.begin(), connections_.end());
+  for (Connection* connection : connections) {
+    closeConnection(connection);
+    releaseIfDone(connection);
+  }
+}
+
+#else // HAVE_LINUX_IO_URING_H
+
+class TUringIOThread : public Runnable {
+public:
+  explicit TUringIOThread(TUringServer*) {
+    throw TException("TUringServer: io_uring is not available in this build");
+  }
+  void run() override {}
+  void stop() {}
+};
+
+#endif // HAVE_LINUX_IO_URING_H
+
+TUringServer::TUringServer(const std::shared_ptr<TProcessorFactory>& processorFactory,
+                           const std::shared_ptr<TServerSocket>& serverSocket,
+                           const std::shared_ptr<ThreadManager>& threadManager)
+  : TServer(processorFactory, serverSocket),
+    serverSocket_(serverSocket),
+    threadManager_(threadManager),
+    numIOThreads_(1),
+    ringEntries_(DEFAULT_RING_ENTRIES),
+    numBuffers_(DEFAULT_NUM_BUFFERS),
+    bufferSize_(DEFAULT_BUFFER_SIZE),
+    maxFrameSize_(MAX_FRAME_SIZE),
+    stopped_(false) {}
+
+TUringServer::TUringServer(const std::shared_ptr<TProcessor>& processor,
+                           const std::shared_ptr<TServerSocket>& serverSocket,
+                           const std::shared_ptr<ThreadManager>& threadManager)
+  : TServer(processor, serverSocket),
+    serverSocket_(serverSocket),
+    threadManager_(threadManager),
+    numIOThreads_(1),
+    ringEntries_(DEFAULT_RING_ENTRIES),
+    numBuffers_(DEFAULT_NUM_BUFFERS),
+    bufferSize_(DEFAULT_BUFFER_SIZE),
+    maxFrameSize_(MAX_FRAME_SIZE),
+    stopped_(false) {}
+
+TUringServer::TUringServer(const std::shared_ptr<TProcessorFactory>& processorFactory,
+                           const std::shared_ptr<TServerSocket>& serverSocket,
+                           const std::shared_ptr<TProtocolFactory>& protocolFactory,
+                           const std::shared_ptr<ThreadManager>& threadManager)
+  : TUringServer(processorFactory, serverSocket, threadManager) {
+  setInputProtocolFactory(protocolFactory);
+  setOutputProtocolFactory(protocolFactory);
+}
+
+TUringServer::TUringServer(const std::shared_ptr<TProcessor>& processor,
+                           const std::shared_ptr<TServerSocket>& serverSocket,
+                           const std::shared_ptr<TProtocolFactory>& protocolFactory,
+                           const std::shared_ptr<ThreadManager>& threadManager)
+  : TUringServer(processor, serverSocket, threadManager) {
+  setInputProtocolFactory(protocolFactory);
+  setOutputProtocolFactory(protocolFactory);
+}
+
+TUringServer::~TUringServer() = default;
+
+bool TUringServer::isSupported() {
+#ifdef HAVE_LINUX_IO_URING_H
+  try {
+    TUring ring(4);
+    TProvidedBuffers buffers(ring.getFD(), 0, 1, 64);
+    return true;
+  } catch (const TException&) {
+    return false;
+  }
+#else
+  return false;
+#endif
+}
+
+void TUringServer::serve() {
+  serverSocket_->listen();
+
+  std::vector<std::shared_ptr<Thread> > threads;
+  {
+    Guard g(mutex_);
+    if (stopped_) {
+      serverSocket_->close();
+      return;
+    }
+    for (size_t i = 0; i < (std::max)(numIOThreads_, size_t(1)); i++) {
+      ioThreads_.push_back(std::make_shared<TUringIOThread>(this));
+    }
+    ThreadFactory threadFactory(false);
+    for (size_t i = 1; i < ioThreads_.size(); i++) {
+      threads.push_back(threadFactory.newThread(ioThreads_[i]));
+      threads.back()->start();
+    }
+  }
+
+  if (eventHandler_) {
+    eventHandler_->preServe();
+  }
+
+  // the calling thread serves the first ring
+  try {
+    ioThreads_[0]->run();
+  } catch (...) {
+    stop();
+    for (auto& thread : threads) {
+      thread->join();
+    }
+    throw;
+  }
+
+  for (auto& thread : threads) {
+    thread->join();
+  }
+
+  Guard g(mutex_);
+  ioThreads_.clear();
+  stopped_ = false;
+  serverSocket_->close();
+}
+
+void TUringServer::stop() {
+  Guard g(mutex_);
+  stopped_ = true;
+  for (auto& ioThread : ioThreads_) {
+    ioThread->stop();
+  }
+}
+}
+}
+} // apache::thrift::server
@@ -0,0 +1,156 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_SERVER_TURINGSERVER_H_
+#define _THRIFT_SERVER_TURINGSERVER_H_ 1
+
+#include <thrift/Thrift.h>
+#include <thrift/concurrency/Mutex.h>
+#include <thrift/concurrency/ThreadManager.h>
+#include <thrift/server/TServer.h>
+#include <thrift/transport/TServerSocket.h>
+
+#include <memory>
+#include <vector>
+
+namespace apache {
+namespace thrift {
+namespace server {
+
+class TUringIOThread;
+
+/**
+ * A server for framed requests, like TNonblockingServer, that does its
+ * socket IO with Linux io_uring rather than with readiness notifications
+ * and a system call per read or write.
+ *
+ * Every IO thread owns a ring. It keeps a multishot accept armed on the
+ * listening socket and a multishot recv on each of the connections it
+ * accepted, which fill buffers from a ring of buffers provided to the
+ * kernel up front. All submissions made while handling a batch of
+ * completions, such as the responses to the requests that arrived
+ * together, go to the kernel with the next wait, in a single system call.
+ *
+ * Requests are processed on the IO thread, or handed to the ThreadManager
+ * if one is given. The requests of a connection are processed one at a
+ * time and answered in order, further requests sent meanwhile are
+ * buffered. THeader is not supported.
+ *
+ * The server needs Linux 5.19 or later, and falls back to re-arming
+ * accept and recv after every completion where the kernel does not
+ * support multishot requests. isSupported() tells whether the running
+ * kernel allows io_uring at all.
+ */
+class TUringServer : public TServer {
+public:
+  /// Default number of entries of each submission queue
+  static const uint32_t DEFAULT_RING_ENTRIES = 256;
+
+  /// Default number of receive buffers of each IO thread
+  static const uint32_t DEFAULT_NUM_BUFFERS = 256;
+
+  /// Default size of a receive buffer
+  static const uint32_t DEFAULT_BUFFER_SIZE = 16 * 1024;
+
+  /// Default limit on frame size
+  static const uint32_t MAX_FRAME_SIZE = 256 * 1024 * 1024;
+
+  TUringServer(const std::shared_ptr<TProcessorFactory>& processorFactory,
+               const std::shared_ptr<transport::TServerSocket>& serverSocket,
+               const std::shared_ptr<concurrency::ThreadManager>& threadManager = nullptr);
+
+  TUringServer(const std::shared_ptr<TProcessor>& processor,
+               const std::shared_ptr<transport::TServerSocket>& serverSocket,
+               const std::shared_ptr<concurrency::ThreadManager>& threadManager = nullptr);
+
+  TUringServer(const std::shared_ptr<TProcessorFactory>& processorFactory,
+               const std::shared_ptr<transport::TServerSocket>& serverSocket,
+               const std::shared_ptr<TProtocolFactory>& protocolFactory,
+               const std::shared_ptr<concurrency::ThreadManager>& threadManager = nullptr);
+
+  TUringServer(const std::shared_ptr<TProcessor>& processor,
+               const std::shared_ptr<transport::TServerSocket>& serverSocket,
+               const std::shared_ptr<TProtocolFactory>& protocolFactory,
+               const std::shared_ptr<concurrency::ThreadManager>& threadManager = nullptr);
+
+  ~TUringServer() override;
+
+  /**
+   * Whether this build and the running kernel support the server.
+   */
+  static bool isSupported();
+
+  void setNumIOThreads(size_t numIOThreads) { numIOThreads_ = numIOThreads; }
+  size_t getNumIOThreads() const { return numIOThreads_; }
+
+  void setRingEntries(uint32_t ringEntries) { ringEntries_ = ringEntries; }
+  uint32_t getRingEntries() const { return ringEntries_; }
+
+  /**
+   * Sets the number of receive buffers of each IO thread, rounded up to a
+   * power of 2. Data is copied out of a buffer as soon as it was received,
+   * so a few hundred serve thousands of connections.
+   */
+  void setNumBuffers(uint32_t numBuffers) { numBuffers_ = numBuffers; }
+  uint32_t getNumBuffers() const { return numBuffers_; }
+
+  void setBufferSize(uint32_t bufferSize) { bufferSize_ = bufferSize; }
+  uint32_t getBufferSize() const { return bufferSize_; }
+
+  void setMaxFrameSize(uint32_t maxFrameSize) { maxFrameSize_ = maxFrameSize; }
+  uint32_t getMaxFrameSize() const { return maxFrameSize_; }
+
+  std::shared_ptr<concurrency::ThreadManager> getThreadManager() const { return threadManager_; }
+
+  int getListenPort() const { return serverSocket_->getPort(); }
+
+  /**
+   * Listens and serves until stop() is called, on the calling thread and
+   * getNumIOThreads() - 1 more.
+   */
+  void serve() override;
+
+  /**
+   * Closes all connections, once their current request is answered, and
+   * makes serve() return. Can be called from any thread.
+   */
+  void stop() override;
+
+private:
+  friend class TUringIOThread;
+
+  std::shared_ptr<transport::TServerSocket> serverSocket_;
+  std::shared_ptr<concurrency::ThreadManager> threadManager_;
+
+  size_t numIOThreads_;
+  uint32_t ringEntries_;
+  uint32_t numBuffers_;
+  uint32_t bufferSize_;
+  uint32_t maxFrameSize_;
+
+  // Guards ioThreads_ and stopped_ between serve() and stop()
+  concurrency::Mutex mutex_;
+  std::vector<std::shared_ptr<TUringIOThread> > ioThreads_;
+  bool stopped_;
+};
+}
+}
+} // apache::thrift::server
+
+#endif // #ifndef _THRIFT_SERVER_TURINGSERVER_H_
@@ -88,11 +88,12 @@ void TBufferedTransport::writeSlow(const uint8_t* buf, uint32_t len) {
   // This case also covers the case where the buffer is empty,
   // but it is clearer (I think) to think of it as two separate cases.
   if ((have_bytes + len >= 2 * wBufSize_) || (have_bytes == 0)) {
-    // TODO(dreiss): writev
     if (have_bytes > 0) {
-      transport_->write(wBuf_.get(), have_bytes);
+      TIoVec iov[2] = {{wBuf_.get(), have_bytes}, {buf, len}};
+      transport_->writev(iov, 2);
+    } else {
+      transport_->write(buf, len);
     }
-    transport_->write(buf, len);
     wBase_ = wBuf_.get();
     return;
   }
@@ -208,20 +209,55 @@ bool TFramedTransport::readFrame() {
     throw TTransportException(TTransportException::CORRUPTED_DATA, "Received an oversized frame");
 
   // Read the frame payload, and reset markers.
-  if (sz > static_cast<int32_t>(rBufSize_)) {
-    rBuf_.reset(new uint8_t[sz]);
-    rBufSize_ = sz;
-  }
+  ensureReadBuffer(sz);
   transport_->readAll(rBuf_.get(), sz);
   setReadBuffer(rBuf_.get(), sz);
   return true;
 }
 
+void TFramedTransport::ensureReadBuffer(uint32_t sz) {
+  if (sz > rBufSize_ || rBuf_.use_count() > 1) {
+    // slices of the previous frame keep the old buffer alive
+    uint32_t size = (std::max)(sz, rBufSize_);
+    rBuf_.reset(new uint8_t[size], std::default_delete<uint8_t[]>());
+    rBufSize_ = size;
+  }
+}
+
+TSlice TFramedTransport::readSlice(uint32_t len) {
+  if (len > 0 && rBase_ == rBound_ && !readFrame()) {
+    // EOF; let the copying path report it
+    return TTransport::readSlice(len);
+  }
+  uint8_t* buf = rBuf_.get();
+  if (len > 0 && buf != nullptr && rBase_ >= buf && rBound_ <= buf + rBufSize_
+      && static_cast<ptrdiff_t>(len) <= rBound_ - rBase_) {
+    std::shared_ptr<const uint8_t> data(rBuf_, rBase_);
+    consume(len);
+    return TSlice(std::move(data), len);
+  }
+  return TTransport::readSlice(len);
+}
+
+void TFramedTransport::writeSlice(const TSlice& slice) {
+  if (slice.size() < MIN_DEFERRED_SLICE_SIZE) {
+    write(slice.data(), static_cast<uint32_t>(slice.size()));
+    return;
+  }
+  auto have = static_cast<uint32_t>(wBase_ - wBuf_.get());
+  if (slice.size() + have + wSliceBytes_ > 0x7fffffff) {
+    throw TTransportException(TTransportException::BAD_ARGS,
+                              "Attempted to write over 2 GB to TFramedTransport.");
+  }
+  wSlices_.emplace_back(have, slice);
+  wSliceBytes_ += static_cast<uint32_t>(slice.size());
+}
+
 void TFramedTransport::writeSlow(const uint8_t* buf, uint32_t len) {
   // Double buffer size until sufficient.
   auto have = static_cast<uint32_t>(wBase_ - wBuf_.get());
   uint32_t new_size = wBufSize_;
-  if (len + have < have /* overflow */ || len + have > 0x7fffffff) {
+  if (len + have < have /* overflow */ || len + have > 0x7fffffff - wSliceBytes_) {
     throw TTransportException(TTransportException::BAD_ARGS,
                               "Attempted to write over 2 GB to TFramedTransport.");
   }
@@ -255,7 +291,8 @@ void TFramedTransport::flush() {
   assert(wBufSize_ > sizeof(sz_nbo));
 
   // Slip the frame size into the start of the buffer.
-  sz_hbo = static_cast<uint32_t>(wBase_ - (wBuf_.get() + sizeof(sz_nbo)));
+  auto have = static_cast<uint32_t>(wBase_ - wBuf_.get());
+  sz_hbo = static_cast<uint32_t>(have - sizeof(sz_nbo) + wSliceBytes_);
   sz_nbo = (int32_t)htonl((uint32_t)(sz_hbo));
   memcpy(wBuf_.get(), (uint8_t*)&sz_nbo, sizeof(sz_nbo));
 
@@ -265,9 +302,30 @@ void TFramedTransport::flush() {
     // (i.e. internal buffer cleaned) if the underlying write throws
     // up an exception
     wBase_ = wBuf_.get() + sizeof(sz_nbo);
-
-    // Write size and frame body.
-    transport_->write(wBuf_.get(), static_cast<uint32_t>(sizeof(sz_nbo)) + sz_hbo);
+    std::vector<std::pair<uint32_t, TSlice> > slices;
+    slices.swap(wSlices_);
+    wSliceBytes_ = 0;
+
+    if (slices.empty()) {
+      transport_->write(wBuf_.get(), have);
+    } else {
+      // Write size and frame body, with any deferred slices in between, in
+      // one gathered write.
+      std::vector<TIoVec> iov;
+      iov.reserve(2 * slices.size() + 1);
+      uint32_t done = 0;
+      for (auto& slice : slices) {
+        if (slice.first > done) {
+          iov.push_back({wBuf_.get() + done, slice.first - done});
+          done = slice.first;
+        }
+        iov.push_back({slice.second.data(), static_cast<uint32_t>(slice.second.size())});
+      }
+      if (have > done) {
+        iov.push_back({wBuf_.get() + done, have - done});
+      }
+      transport_->writev(iov.data(), static_cast<uint32_t>(iov.size()));
+    }
   }
 
   // Flush the underlying transport.
@@ -286,7 +344,7 @@ void TFramedTransport::flush() {
 }
 
 uint32_t TFramedTransport::writeEnd() {
-  return static_cast<uint32_t>(wBase_ - wBuf_.get());
+  return static_cast<uint32_t>(wBase_ - wBuf_.get()) + wSliceBytes_;
 }
 
 const uint8_t* TFramedTransport::borrowSlow(uint8_t* buf, uint32_t* len) {
@@ -23,6 +23,8 @@
 #include <cstdlib>
 #include <cstring>
 #include <limits>
+#include <utility>
+#include <vector>
 
 #include <thrift/transport/TTransport.h>
 #include <thrift/transport/TVirtualTransport.h>
@@ -313,6 +315,8 @@ class TFramedTransport : public TVirtualTransport<TFramedTransport, TBufferBase>
 public:
   static const int DEFAULT_BUFFER_SIZE = 512;
   static const int DEFAULT_MAX_FRAME_SIZE = 256 * 1024 * 1024;
+  /// Slices at least this large are written by reference rather than copied.
+  static const uint32_t MIN_DEFERRED_SLICE_SIZE = 64 * 1024;
 
   /// Use default buffer sizes.
   TFramedTransport(std::shared_ptr<TConfiguration> config = nullptr)
@@ -322,6 +326,7 @@ public:
       wBufSize_(DEFAULT_BUFFER_SIZE),
       rBuf_(),
       wBuf_(new uint8_t[wBufSize_]),
+      wSliceBytes_(0),
       bufReclaimThresh_((std::numeric_limits<uint32_t>::max)()) {
     initPointers();
   }
@@ -333,6 +338,7 @@ public:
       wBufSize_(DEFAULT_BUFFER_SIZE),
       rBuf_(),
       wBuf_(new uint8_t[wBufSize_]),
+      wSliceBytes_(0),
       bufReclaimThresh_((std::numeric_limits<uint32_t>::max)()),
       maxFrameSize_(configuration_->getMaxFrameSize()) {
     initPointers();
@@ -348,6 +354,7 @@ public:
       wBufSize_(sz),
       rBuf_(),
       wBuf_(new uint8_t[wBufSize_]),
+      wSliceBytes_(0),
       bufReclaimThresh_(bufReclaimThresh),
       maxFrameSize_(configuration_->getMaxFrameSize()) {
     initPointers();
@@ -376,6 +383,19 @@ public:
 
   const uint8_t* borrowSlow(uint8_t* buf, uint32_t* len) override;
 
+  /**
+   * Returns a slice of the current frame without copying it. The frame
+   * buffer is not reused for the next frame while any slice still refers
+   * to it.
+   */
+  TSlice readSlice(uint32_t len) override;
+
+  /**
+   * Large slices are not copied into the write buffer; flush() writes them
+   * to the underlying transport in place, between the buffered bytes.
+   */
+  void writeSlice(const TSlice& slice) override;
+
   std::shared_ptr<TTransport> getUnderlyingTransport() { return transport_; }
 
   /*
@@ -408,6 +428,12 @@ protected:
    */
   virtual bool readFrame();
 
+  /**
+   * Makes rBuf_ hold at least sz bytes, replacing it if it is too small or
+   * still shared with slices of an earlier frame.
+   */
+  void ensureReadBuffer(uint32_t sz);
+
   void initPointers() {
     setReadBuffer(nullptr, 0);
     setWriteBuffer(wBuf_.get(), wBufSize_);
@@ -421,8 +447,11 @@ protected:
 
   uint32_t rBufSize_;
   uint32_t wBufSize_;
-  std::unique_ptr<uint8_t[]> rBuf_;
+  std::shared_ptr<uint8_t> rBuf_;
   std::unique_ptr<uint8_t[]> wBuf_;
+  /// Deferred slices, each to be written after the given offset into wBuf_.
+  std::vector<std::pair<uint32_t, TSlice> > wSlices_;
+  uint32_t wSliceBytes_;
   uint32_t bufReclaimThresh_;
   uint32_t maxFrameSize_;
 };
@@ -0,0 +1,604 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/thrift-config.h>
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <string>
+#include <zlib.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef HAVE_LZ4
+#include <lz4frame.h>
+#endif
+
+#include <thrift/transport/TCompressionTransport.h>
+#include <thrift/transport/TZlibTransport.h>
+
+using apache::thrift::concurrency::Guard;
+
+namespace apache {
+namespace thrift {
+namespace transport {
+
+namespace {
+
+class ZlibCompressor : public TStreamCompressor {
+public:
+  ZlibCompressor(int level, int windowBits) {
+    int rv = deflateInit2(&stream_, level, Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY);
+    if (rv != Z_OK) {
+      throw TZlibTransportException(rv, stream_.msg);
+    }
+  }
+
+  ~ZlibCompressor() override { deflateEnd(&stream_); }
+
+  void reset() override {
+    int rv = deflateReset(&stream_);
+    if (rv != Z_OK) {
+      throw TZlibTransportException(rv, stream_.msg);
+    }
+  }
+
+  void compress(const uint8_t* in, uint32_t len, Flush flush, TMemoryBuffer& out) override {
+    int mode = flush == FLUSH_END ? Z_FINISH : flush == FLUSH_BLOCK ? Z_SYNC_FLUSH : Z_NO_FLUSH;
+    stream_.next_in = const_cast<Bytef*>(in);
+    stream_.avail_in = len;
+    do {
+      auto room = static_cast<uint32_t>(deflateBound(&stream_, stream_.avail_in)) + 16;
+      room = (std::max)(room, out.available_write());
+      stream_.next_out = out.getWritePtr(room);
+      stream_.avail_out = room;
+      int rv = deflate(&stream_, mode);
+      out.wroteBytes(room - stream_.avail_out);
+      if (rv != Z_OK && rv != Z_STREAM_END && rv != Z_BUF_ERROR) {
+        throw TZlibTransportException(rv, stream_.msg);
+      }
+      // deflate() is done once it leaves room in the output
+    } while (stream_.avail_out == 0 || stream_.avail_in > 0);
+  }
+
+private:
+  z_stream stream_ = z_stream();
+};
+
+class ZlibDecompressor : public TStreamDecompressor {
+public:
+  ZlibDecompressor() : finished_(false) {
+    // a full window inflates streams of any window size
+    int rv = inflateInit2(&stream_, MAX_WBITS);
+    if (rv != Z_OK) {
+      throw TZlibTransportException(rv, stream_.msg);
+    }
+  }
+
+  ~ZlibDecompressor() override { inflateEnd(&stream_); }
+
+  void reset() override {
+    int rv = inflateReset(&stream_);
+    if (rv != Z_OK) {
+      throw TZlibTransportException(rv, stream_.msg);
+    }
+    finished_ = false;
+  }
+
+  uint32_t decompress(const uint8_t** in, uint32_t* inLen, uint8_t* out, uint32_t outLen) override {
+    if (finished_) {
+      return 0;
+    }
+    stream_.next_in = const_cast<Bytef*>(*in);
+    stream_.avail_in = *inLen;
+    stream_.next_out = out;
+    stream_.avail_out = outLen;
+    int rv = inflate(&stream_, Z_SYNC_FLUSH);
+    if (rv == Z_STREAM_END) {
+      finished_ = true;
+    } else if (rv != Z_OK && rv != Z_BUF_ERROR) {
+      throw TZlibTransportException(rv, stream_.msg);
+    }
+    *in += *inLen - stream_.avail_in;
+    *inLen = stream_.avail_in;
+    return outLen - stream_.avail_out;
+  }
+
+  bool finished() const override { return finished_; }
+
+private:
+  z_stream stream_ = z_stream();
+  bool finished_;
+};
+
+#ifdef HAVE_ZSTD
+void checkZstd(size_t rv) {
+  if (ZSTD_isError(rv)) {
+    throw TTransportException(TTransportException::INTERNAL_ERROR,
+                              std::string("zstd error: ") + ZSTD_getErrorName(rv));
+  }
+}
+
+class ZstdCompressor : public TStreamCompressor {
+public:
+  ZstdCompressor(int level, int windowBits) : cctx_(ZSTD_createCCtx()) {
+    if (cctx_ == nullptr) {
+      throw std::bad_alloc();
+    }
+    try {
+      checkZstd(ZSTD_CCtx_setParameter(cctx_, ZSTD_c_compressionLevel, level));
+      if (windowBits != 0) {
+        checkZstd(ZSTD_CCtx_setParameter(cctx_, ZSTD_c_windowLog, windowBits));
+      }
+    } catch (...) {
+      ZSTD_freeCCtx(cctx_);
+      throw;
+    }
+  }
+
+  ~ZstdCompressor() override { ZSTD_freeCCtx(cctx_); }
+
+  void reset() override { checkZstd(ZSTD_CCtx_reset(cctx_, ZSTD_reset_session_only)); }
+
+  void compress(const uint8_t* in, uint32_t len, Flush flush, TMemoryBuffer& out) override {
+    ZSTD_EndDirective mode = flush == FLUSH_END     ? ZSTD_e_end
+                             : flush == FLUSH_BLOCK ? ZSTD_e_flush
+                                                    : ZSTD_e_continue;
+    ZSTD_inBuffer input = {in, len, 0};
+    size_t left;
+    do {
+      auto room = (std::max)(static_cast<uint32_t>(ZSTD_compressBound(input.size - input.pos)),
+                             out.available_write());
+      ZSTD_outBuffer output = {out.getWritePtr(room), room, 0};
+      left = ZSTD_compressStream2(cctx_, &output, &input, mode);
+      out.wroteBytes(static_cast<uint32_t>(output.pos));
+      checkZstd(left);
+    } while (mode == ZSTD_e_continue ? input.pos < input.size : left > 0);
+  }
+
+private:
+  ZSTD_CCtx* cctx_;
+};
+
+class ZstdDecompressor : public TStreamDecompressor {
+public:
+  ZstdDecompressor() : dctx_(ZSTD_createDCtx()) {
+    if (dctx_ == nullptr) {
+      throw std::bad_alloc();
+    }
+  }
+
+  ~ZstdDecompressor() override { ZSTD_freeDCtx(dctx_); }
+
+  void reset() override { checkZstd(ZSTD_DCtx_reset(dctx_, ZSTD_reset_session_only)); }
+
+  uint32_t decompress(const uint8_t** in, uint32_t* inLen, uint8_t* out, uint32_t outLen) override {
+    ZSTD_inBuffer input = {*in, *inLen, 0};
+    ZSTD_outBuffer output = {out, outLen, 0};
+    checkZstd(ZSTD_decompressStream(dctx_, &output, &input));
+    *in += input.pos;
+    *inLen -= static_cast<uint32_t>(input.pos);
+    return static_cast<uint32_t>(output.pos);
+  }
+
+  // frames simply follow each other
+  bool finished() const override { return false; }
+
+private:
+  ZSTD_DCtx* dctx_;
+};
+#endif
+
+#ifdef HAVE_LZ4
+void checkLz4(size_t rv) {
+  if (LZ4F_isError(rv)) {
+    throw TTransportException(TTransportException::INTERNAL_ERROR,
+                              std::string("lz4 error: ") + LZ4F_getErrorName(rv));
+  }
+}
+
+class Lz4Compressor : public TStreamCompressor {
+public:
+  Lz4Compressor(int level) : cctx_(nullptr), started_(false) {
+    checkLz4(LZ4F_createCompressionContext(&cctx_, LZ4F_VERSION));
+    memset(&prefs_, 0, sizeof(prefs_));
+    prefs_.compressionLevel = level < 0 ? 0 : level;
+    prefs_.frameInfo.blockMode = LZ4F_blockLinked;
+  }
+
+  ~Lz4Compressor() override { LZ4F_freeCompressionContext(cctx_); }
+
+  void reset() override { started_ = false; }
+
+  void compress(const uint8_t* in, uint32_t len, Flush flush, TMemoryBuffer& out) override {
+    if (!started_) {
+      uint8_t* dst = out.getWritePtr(LZ4F_HEADER_SIZE_MAX);
+      size_t rv = LZ4F_compressBegin(cctx_, dst, LZ4F_HEADER_SIZE_MAX, &prefs_);
+      checkLz4(rv);
+      out.wroteBytes(static_cast<uint32_t>(rv));
+      started_ = true;
+    }
+    if (len > 0) {
+      auto room = static_cast<uint32_t>(LZ4F_compressBound(len, &prefs_));
+      size_t rv = LZ4F_compressUpdate(cctx_, out.getWritePtr(room), room, in, len, nullptr);
+      checkLz4(rv);
+      out.wroteBytes(static_cast<uint32_t>(rv));
+    }
+    if (flush != FLUSH_NONE) {
+      auto room = static_cast<uint32_t>(LZ4F_compressBound(0, &prefs_));
+      size_t rv = flush == FLUSH_END
+                      ? LZ4F_compressEnd(cctx_, out.getWritePtr(room), room, nullptr)
+                      : LZ4F_flush(cctx_, out.getWritePtr(room), room, nullptr);
+      checkLz4(rv);
+      out.wroteBytes(static_cast<uint32_t>(rv));
+      if (flush == FLUSH_END) {
+        started_ = false;
+      }
+    }
+  }
+
+private:
+  LZ4F_cctx* cctx_;
+  LZ4F_preferences_t prefs_;
+  bool started_;
+};
+
+class Lz4Decompressor : public TStreamDecompressor {
+public:
+  Lz4Decompressor() : dctx_(nullptr) {
+    checkLz4(LZ4F_createDecompressionContext(&dctx_, LZ4F_VERSION));
+  }
+
+  ~Lz4Decompressor() override { LZ4F_freeDecompressionContext(dctx_); }
+
+  void reset() override { LZ4F_resetDecompressionContext(dctx_); }
+
+  uint32_t decompress(const uint8_t** in, uint32_t* inLen, uint8_t* out, uint32_t outLen) override {
+    size_t outSize = outLen;
+    size_t inSize = *inLen;
+    checkLz4(LZ4F_decompress(dctx_, out, &outSize, *in, &inSize, nullptr));
+    *in += inSize;
+    *inLen -= static_cast<uint32_t>(inSize);
+    return static_cast<uint32_t>(outSize);
+  }
+
+  // frames simply follow each other
+  bool finished() const override { return false; }
+
+private:
+  LZ4F_dctx* dctx_;
+};
+#endif
+}
+
+bool TCompressionContextPool::isCodecSupported(Codec codec) {
+  switch (codec) {
+  case ZLIB:
+    return true;
+#ifdef HAVE_ZSTD
+  case ZSTD:
+    return true;
+#endif
+#ifdef HAVE_LZ4
+  case LZ4:
+    return true;
+#endif
+  default:
+    return false;
+  }
+}
+
+TCompressionContextPool::TCompressionContextPool(Codec codec,
+                                                 int level,
+                                                 int windowBits,
+                                                 uint32_t maxIdle)
+  : codec_(codec), level_(level), windowBits_(windowBits), maxIdle_(maxIdle), numCreated_(0) {
+  if (!isCodecSupported(codec)) {
+    throw TTransportException(TTransportException::BAD_ARGS,
+                              "TCompressionContextPool: codec not supported by this build");
+  }
+  if (codec == ZLIB && windowBits != 0 && (windowBits < 9 || windowBits > MAX_WBITS)) {
+    throw TTransportException(TTransportException::BAD_ARGS,
+                              "TCompressionContextPool: zlib window bits must be 9 to 15");
+  }
+}
+
+std::unique_ptr<TStreamCompressor> TCompressionContextPool::acquireCompressor() {
+  {
+    Guard g(mutex_);
+    if (!compressors_.empty()) {
+      std::unique_ptr<TStreamCompressor> compressor = std::move(compressors_.back());
+      compressors_.pop_back();
+      return compressor;
+    }
+    numCreated_++;
+  }
+
+  switch (codec_) {
+#ifdef HAVE_ZSTD
+  case ZSTD:
+    return std::unique_ptr<TStreamCompressor>(
+        new ZstdCompressor(level_ == DEFAULT_LEVEL ? ZSTD_CLEVEL_DEFAULT : level_, windowBits_));
+#endif
+#ifdef HAVE_LZ4
+  case LZ4:
+    return std::unique_ptr<TStreamCompressor>(new Lz4Compressor(level_));
+#endif
+  default:
+    return std::unique_ptr<TStreamCompressor>(
+        new ZlibCompressor(level_, windowBits_ != 0 ? windowBits_ : MAX_WBITS));
+  }
+}
+
+std::unique_ptr<TStreamDecompressor> TCompressionContextPool::acquireDecompressor() {
+  {
+    Guard g(mutex_);
+    if (!decompressors_.empty()) {
+      std::unique_ptr<TStreamDecompressor> decompressor = std::move(decompressors_.back());
+      decompressors_.pop_back();
+      return decompressor;
+    }
+    numCreated_++;
+  }
+
+  switch (codec_) {
+#ifdef HAVE_ZSTD
+  case ZSTD:
+    return std::unique_ptr<TStreamDecompressor>(new ZstdDecompressor());
+#endif
+#ifdef HAVE_LZ4
+  case LZ4:
+    return std::unique_ptr<TStreamDecompressor>(new Lz4Decompressor());
+#endif
+  default:
+    return std::unique_ptr<TStreamDecompressor>(new ZlibDecompressor());
+  }
+}
+
+void TCompressionContextPool::release(std::unique_ptr<TStreamCompressor> compressor) {
+  // a context that cannot be reset is simply dropped
+  try {
+    compressor->reset();
+  } catch (const TException&) {
+    return;
+  }
+  Guard g(mutex_);
+  if (compressors_.size() < maxIdle_) {
+    compressors_.push_back(std::move(compressor));
+  }
+}
+
+void TCompressionContextPool::release(std::unique_ptr<TStreamDecompressor> decompressor) {
+  try {
+    decompressor->reset();
+  } catch (const TException&) {
+    return;
+  }
+  Guard g(mutex_);
+  if (decompressors_.size() < maxIdle_) {
+    decompressors_.push_back(std::move(decompressor));
+  }
+}
+
+uint64_t TCompressionContextPool::getNumCreated() {
+  Guard g(mutex_);
+  return numCreated_;
+}
+
+TCompressionTransport::TCompressionTransport(std::shared_ptr<TTransport> transport,
+                                             std::shared_ptr<TCompressionContextPool> pool,
+                                             std::shared_ptr<TConfiguration> config)
+  : TVirtualTransport(config),
+    transport_(transport),
+    pool_(pool),
+    uwpos_(0),
+    unflushed_(0),
+    minFlushBytes_(0),
+    outputFinished_(false),
+    urpos_(0),
+    urlen_(0),
+    crpos_(0),
+    crlen_(0) {
+}
+
+TCompressionTransport::~TCompressionTransport() {
+  if (compressor_) {
+    pool_->release(std::move(compressor_));
+  }
+  if (decompressor_) {
+    pool_->release(std::move(decompressor_));
+  }
+}
+
+bool TCompressionTransport::isOpen() const {
+  return urpos_ < urlen_ || crpos_ < crlen_ || transport_->isOpen();
+}
+
+bool TCompressionTransport::peek() {
+  return urpos_ < urlen_ || crpos_ < crlen_ || transport_->peek();
+}
+
+uint32_t TCompressionTransport::read(uint8_t* buf, uint32_t len) {
+  checkReadBytesAvailable(len);
+  if (urpos_ == urlen_) {
+    // large reads skip urbuf_
+    if (len >= READ_BUFFER_SIZE) {
+      return decompress(buf, len);
+    }
+    if (!urbuf_) {
+      urbuf_.reset(new uint8_t[READ_BUFFER_SIZE]);
+    }
+    urpos_ = 0;
+    urlen_ = decompress(urbuf_.get(), READ_BUFFER_SIZE);
+  }
+
+  uint32_t give = (std::min)(len, urlen_ - urpos_);
+  memcpy(buf, urbuf_.get() + urpos_, give);
+  urpos_ += give;
+  return give;
+}
+
+uint32_t TCompressionTransport::decompress(uint8_t* buf, uint32_t len) {
+  if (!decompressor_) {
+    decompressor_ = pool_->acquireDecompressor();
+  }
+  if (!crbuf_) {
+    crbuf_.reset(new uint8_t[READ_BUFFER_SIZE]);
+  }
+
+  while (true) {
+    // even without new input the codec may have output left
+    const uint8_t* in = crbuf_.get() + crpos_;
+    uint32_t inLen = crlen_ - crpos_;
+    uint32_t got = decompressor_->decompress(&in, &inLen, buf, len);
+    crpos_ = crlen_ - inLen;
+    if (got > 0) {
+      return got;
+    }
+    if (decompressor_->finished()) {
+      return 0;
+    }
+
+    // keep what the codec could not use yet and read more
+    if (crpos_ > 0) {
+      memmove(crbuf_.get(), crbuf_.get() + crpos_, crlen_ - crpos_);
+      crlen_ -= crpos_;
+      crpos_ = 0;
+    }
+    if (crlen_ == READ_BUFFER_SIZE) {
+      throw TTransportException(TTransportException::CORRUPTED_DATA,
+                                "TCompressionTransport: codec made no progress");
+    }
+    uint32_t read = transport_->read(crbuf_.get() + crlen_, READ_BUFFER_SIZE - crlen_);
+    if (read == 0) {
+      return 0;
+    }
+    crlen_ += read;
+  }
+}
+
+const uint8_t* TCompressionTransport::borrow(uint8_t* buf, uint32_t* len) {
+  (void)buf;
+  if (urlen_ - urpos_ >= *len) {
+    *len = urlen_ - urpos_;
+    return urbuf_.get() + urpos_;
+  }
+  return nullptr;
+}
+
+void TCompressionTransport::consume(uint32_t len) {
+  countConsumedMessageBytes(len);
+  if (urlen_ - urpos_ >= len) {
+    urpos_ += len;
+  } else {
+    throw TTransportException(TTransportException::BAD_ARGS, "consume did not follow a borrow.");
+  }
+}
+
+void TCompressionTransport::write(const uint8_t* buf, uint32_t len) {
+  if (outputFinished_) {
+    throw TTransportException(TTransportException::BAD_ARGS, "write() called after finish()");
+  }
+  if (!uwbuf_) {
+    uwbuf_.reset(new uint8_t[WRITE_BUFFER_SIZE]);
+  }
+  unflushed_ += len;
+
+  // Small writes are gathered, larger ones go to the compressor directly
+  if (len <= WRITE_BUFFER_SIZE - uwpos_) {
+    memcpy(uwbuf_.get() + uwpos_, buf, len);
+    uwpos_ += len;
+    return;
+  }
+  compressPending(TStreamCompressor::FLUSH_NONE);
+  if (len < WRITE_BUFFER_SIZE) {
+    memcpy(uwbuf_.get(), buf, len);
+    uwpos_ = len;
+    return;
+  }
+  compressor_->compress(buf, len, TStreamCompressor::FLUSH_NONE, cwbuf_);
+  writeCompressed();
+}
+
+void TCompressionTransport::compressPending(TStreamCompressor::Flush flush) {
+  if (!compressor_) {
+    compressor_ = pool_->acquireCompressor();
+  }
+  if (uwpos_ > 0 || flush != TStreamCompressor::FLUSH_NONE) {
+    compressor_->compress(uwbuf_.get(), uwpos_, flush, cwbuf_);
+    uwpos_ = 0;
+  }
+  writeCompressed();
+}
+
+void TCompressionTransport::writeCompressed() {
+  uint8_t* data;
+  uint32_t size;
+  cwbuf_.getBuffer(&data, &size);
+  if (size > 0) {
+    transport_->write(data, size);
+    cwbuf_.resetBuffer();
+  }
+}
+
+void TCompressionTransport::flush() {
+  if (outputFinished_) {
+    throw TTransportException(TTransportException::BAD_ARGS, "flush() called after finish()");
+  }
+  resetConsumedMessageSize();
+
+  // let small messages share a block
+  if (unflushed_ < minFlushBytes_) {
+    return;
+  }
+  forceFlush();
+}
+
+void TCompressionTransport::forceFlush() {
+  if (outputFinished_) {
+    throw TTransportException(TTransportException::BAD_ARGS, "flush() called after finish()");
+  }
+  if (unflushed_ > 0) {
+    compressPending(TStreamCompressor::FLUSH_BLOCK);
+    unflushed_ = 0;
+  }
+  transport_->flush();
+}
+
+void TCompressionTransport::finish() {
+  if (outputFinished_) {
+    throw TTransportException(TTransportException::BAD_ARGS, "finish() called more than once");
+  }
+  compressPending(TStreamCompressor::FLUSH_END);
+  outputFinished_ = true;
+  unflushed_ = 0;
+  transport_->flush();
+  pool_->release(std::move(compressor_));
+}
+
+std::shared_ptr<TTransport> TCompressionTransportFactory::getTransport(
+    std::shared_ptr<TTransport> trans) {
+  std::shared_ptr<TCompressionTransport> transport(new TCompressionTransport(trans, pool_));
+  transport->setMinFlushBytes(minFlushBytes_);
+  return transport;
+}
+}
+}
+} // apache::thrift::transport
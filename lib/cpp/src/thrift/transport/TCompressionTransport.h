@@ -0,0 +1,261 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_TRANSPORT_TCOMPRESSIONTRANSPORT_H_
+#define _THRIFT_TRANSPORT_TCOMPRESSIONTRANSPORT_H_ 1
+
+#include <memory>
+#include <vector>
+
+#include <thrift/concurrency/Mutex.h>
+#include <thrift/transport/TBufferTransports.h>
+#include <thrift/transport/TTransport.h>
+#include <thrift/transport/TVirtualTransport.h>
+
+namespace apache {
+namespace thrift {
+namespace transport {
+
+/**
+ * Compresses one direction of a stream.
+ */
+class TStreamCompressor {
+public:
+  enum Flush {
+    // the codec may keep the output back until a later call
+    FLUSH_NONE,
+    // the peer can decompress everything compressed so far
+    FLUSH_BLOCK,
+    // ends the stream
+    FLUSH_END
+  };
+
+  virtual ~TStreamCompressor() = default;
+
+  /**
+   * Prepares for a new stream, keeping allocated state.
+   */
+  virtual void reset() = 0;
+
+  /**
+   * Compresses len bytes of in, appending the output to out.
+   */
+  virtual void compress(const uint8_t* in, uint32_t len, Flush flush, TMemoryBuffer& out) = 0;
+};
+
+/**
+ * Decompresses one direction of a stream.
+ */
+class TStreamDecompressor {
+public:
+  virtual ~TStreamDecompressor() = default;
+
+  /**
+   * Prepares for a new stream, keeping allocated state.
+   */
+  virtual void reset() = 0;
+
+  /**
+   * Decompresses from *in into out, advancing *in and *inLen past the input
+   * used. Returns the number of bytes written to out, which may be 0 if the
+   * input did not complete anything.
+   */
+  virtual uint32_t decompress(const uint8_t** in, uint32_t* inLen, uint8_t* out, uint32_t outLen)
+      = 0;
+
+  /**
+   * True once the end of a stream that cannot be continued was decoded.
+   */
+  virtual bool finished() const = 0;
+};
+
+/**
+ * Keeps the compression contexts of closed connections for new ones, so a
+ * connection does not pay for setting up (de)compressor state and buffers.
+ * A pool is thread safe and is usually shared by all connections using the
+ * same codec and settings.
+ */
+class TCompressionContextPool {
+public:
+  enum Codec {
+    // zlib stream format, readable by TZlibTransport
+    ZLIB,
+    // zstd frames
+    ZSTD,
+    // lz4 frames, with linked blocks
+    LZ4
+  };
+
+  static const int DEFAULT_LEVEL = -1;
+  static const uint32_t DEFAULT_MAX_IDLE = 64;
+
+  /**
+   * Whether this build of the library includes codec.
+   */
+  static bool isCodecSupported(Codec codec);
+
+  /**
+   * @param codec       the stream format
+   * @param level       compression level of the codec, DEFAULT_LEVEL for its default
+   * @param windowBits  log2 of the compression window, 0 for the codec
+   *                    default. zlib takes 9 to 15, zstd 10 and up, lz4
+   *                    always uses 64KB.
+   * @param maxIdle     contexts of each direction kept for reuse
+   */
+  TCompressionContextPool(Codec codec,
+                          int level = DEFAULT_LEVEL,
+                          int windowBits = 0,
+                          uint32_t maxIdle = DEFAULT_MAX_IDLE);
+
+  Codec getCodec() const { return codec_; }
+
+  std::unique_ptr<TStreamCompressor> acquireCompressor();
+  std::unique_ptr<TStreamDecompressor> acquireDecompressor();
+
+  /**
+   * Returns a context, reset, to the pool.
+   */
+  void release(std::unique_ptr<TStreamCompressor> compressor);
+  void release(std::unique_ptr<TStreamDecompressor> decompressor);
+
+  // number of contexts created, as opposed to reused
+  uint64_t getNumCreated();
+
+private:
+  Codec codec_;
+  int level_;
+  int windowBits_;
+  uint32_t maxIdle_;
+
+  apache::thrift::concurrency::Mutex mutex_;
+  std::vector<std::unique_ptr<TStreamCompressor> > compressors_;
+  std::vector<std::unique_ptr<TStreamDecompressor> > decompressors_;
+  uint64_t numCreated_;
+};
+
+/**
+ * Compresses written data and decompresses read data as a stream, with the
+ * codec and contexts of a TCompressionContextPool. Contexts are taken from
+ * the pool on first use and returned when the transport is destroyed.
+ *
+ * By default every flush() ends a compression block and flushes the
+ * underlying transport, like TZlibTransport. With setMinFlushBytes(),
+ * flush() keeps small messages back until enough data is pending, so they
+ * share a block; forceFlush() sends everything regardless.
+ */
+class TCompressionTransport : public TVirtualTransport<TCompressionTransport> {
+public:
+  static const uint32_t READ_BUFFER_SIZE = 16 * 1024;
+  static const uint32_t WRITE_BUFFER_SIZE = 4 * 1024;
+
+  TCompressionTransport(std::shared_ptr<TTransport> transport,
+                        std::shared_ptr<TCompressionContextPool> pool,
+                        std::shared_ptr<TConfiguration> config = nullptr);
+
+  /**
+   * Warning: Destroying a TCompressionTransport object may discard any
+   * written but unflushed data.
+   */
+  ~TCompressionTransport() override;
+
+  bool isOpen() const override;
+  bool peek() override;
+
+  void open() override { transport_->open(); }
+
+  void close() override { transport_->close(); }
+
+  uint32_t read(uint8_t* buf, uint32_t len);
+
+  void write(const uint8_t* buf, uint32_t len);
+
+  void flush() override;
+
+  /**
+   * Ends a compression block and flushes the underlying transport, however
+   * little data is pending.
+   */
+  void forceFlush();
+
+  /**
+   * Ends the compressed stream. No data can be written afterwards.
+   */
+  void finish();
+
+  const uint8_t* borrow(uint8_t* buf, uint32_t* len);
+
+  void consume(uint32_t len);
+
+  void setMinFlushBytes(uint32_t minFlushBytes) { minFlushBytes_ = minFlushBytes; }
+  uint32_t getMinFlushBytes() const { return minFlushBytes_; }
+
+  std::shared_ptr<TTransport> getUnderlyingTransport() const { return transport_; }
+
+protected:
+  void compressPending(TStreamCompressor::Flush flush);
+  void writeCompressed();
+  uint32_t decompress(uint8_t* buf, uint32_t len);
+
+  std::shared_ptr<TTransport> transport_;
+  std::shared_ptr<TCompressionContextPool> pool_;
+  std::unique_ptr<TStreamCompressor> compressor_;
+  std::unique_ptr<TStreamDecompressor> decompressor_;
+
+  // uncompressed data waiting for the compressor
+  std::unique_ptr<uint8_t[]> uwbuf_;
+  uint32_t uwpos_;
+  // compressed data waiting for the underlying transport
+  TMemoryBuffer cwbuf_;
+  // bytes written since the last block ended
+  uint64_t unflushed_;
+  uint32_t minFlushBytes_;
+  bool outputFinished_;
+
+  // decompressed data not read yet
+  std::unique_ptr<uint8_t[]> urbuf_;
+  uint32_t urpos_;
+  uint32_t urlen_;
+  // compressed data not decompressed yet
+  std::unique_ptr<uint8_t[]> crbuf_;
+  uint32_t crpos_;
+  uint32_t crlen_;
+};
+
+/**
+ * Wraps transports into TCompressionTransports sharing one context pool.
+ */
+class TCompressionTransportFactory : public TTransportFactory {
+public:
+  TCompressionTransportFactory(std::shared_ptr<TCompressionContextPool> pool,
+                               uint32_t minFlushBytes = 0)
+    : pool_(pool), minFlushBytes_(minFlushBytes) {}
+
+  ~TCompressionTransportFactory() override = default;
+
+  std::shared_ptr<TTransport> getTransport(std::shared_ptr<TTransport> trans) override;
+
+protected:
+  std::shared_ptr<TCompressionContextPool> pool_;
+  uint32_t minFlushBytes_;
+};
+}
+}
+} // apache::thrift::transport
+
+#endif // #ifndef _THRIFT_TRANSPORT_TCOMPRESSIONTRANSPORT_H_
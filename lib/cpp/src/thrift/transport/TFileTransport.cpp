@@ -70,6 +70,7 @@ TFileTransport::TFileTransport(string path, bool readOnly, std::shared_ptr<TConf
     eventBufferSize_(DEFAULT_EVENT_BUFFER_SIZE),
     flushMaxUs_(DEFAULT_FLUSH_MAX_US),
     flushMaxBytes_(DEFAULT_FLUSH_MAX_BYTES),
+    writeBatchSize_(DEFAULT_WRITE_BATCH_SIZE),
     maxEventSize_(DEFAULT_MAX_EVENT_SIZE),
     maxCorruptedEvents_(DEFAULT_MAX_CORRUPTED_EVENTS),
     eofSleepTime_(DEFAULT_EOF_SLEEP_TIME_US),
@@ -80,8 +81,12 @@ TFileTransport::TFileTransport(string path, bool readOnly, std::shared_ptr<TConf
     notFull_(&mutex_),
     notEmpty_(&mutex_),
     closing_(false),
-    flushed_(&mutex_),
-    forceFlush_(false),
+    enqueuedSeq_(0),
+    flushRequestSeq_(0),
+    syncRequestSeq_(0),
+    durableSeq_(0),
+    syncFd_(0),
+    stopSyncer_(false),
     filename_(path),
     fd_(0),
     bufferAndThreadInitialized_(false),
@@ -241,17 +246,13 @@ void TFileTransport::enqueueEvent(const uint8_t* buf, uint32_t eventLen) {
     notFull_.wait();
   }
 
-  // We shouldn't be trying to enqueue new data while a forced flush is
-  // requested.  (Otherwise the writer thread might not ever be able to finish
-  // the flush if more data keeps being enqueued.)
-  assert(!forceFlush_);
-
   // add to the buffer
   eventInfo* pEvent = toEnqueue.release();
   if (!enqueueBuffer_->addEvent(pEvent)) {
     delete pEvent;
     return;
   }
+  ++enqueuedSeq_;
 
   // signal anybody who's waiting for the buffer to be non-empty
   notEmpty_.notify();
@@ -332,20 +333,61 @@ void TFileTransport::writerThread() {
     }
   }
 
+  // fsync() runs on its own thread from here on
+  std::shared_ptr<Thread> syncer = threadFactory_.newThread(
+      apache::thrift::concurrency::FunctionRunner::create(startSyncerThread, this));
+  syncer->start();
+
   // Figure out the next time by which a flush must take place
   auto ts_next_flush = getNextFlushTime();
   uint32_t unflushed = 0;
 
+  // Events are not written one by one but gathered into writeBatch, zero
+  // padding at chunk boundaries included, and go out in one write()
+  std::unique_ptr<uint8_t[]> writeBatch(new uint8_t[writeBatchSize_]);
+  uint32_t batchLen = 0;
+  // Number of events handled so far and the part of them that was synced
+  uint64_t writtenSeq = 0;
+  uint64_t syncedSeq = 0;
+
+  auto writeBatchOut = [&]() {
+    if (batchLen == 0) {
+      return;
+    }
+    if (writeFully(writeBatch.get(), batchLen)) {
+      unflushed += batchLen;
+      offset_ += batchLen;
+    } else {
+      int errno_copy = THRIFT_ERRNO;
+      GlobalOutput.perror("TFileTransport: error while writing event ", errno_copy);
+      hasIOError = true;
+    }
+    batchLen = 0;
+  };
+
   while (1) {
     // this will only be true when the destructor is being invoked
     if (closing_) {
       if (hasIOError) {
+        requestSync(0, writtenSeq);
+        {
+          Synchronized s(durable_);
+          stopSyncer_ = true;
+          durable_.notifyAll();
+        }
+        syncer->join();
         return;
       }
 
       // Try to empty buffers before exit
       if (enqueueBuffer_->isEmpty() && dequeueBuffer_->isEmpty()) {
-        ::THRIFT_FSYNC(fd_);
+        requestSync(fd_, writtenSeq);
+        {
+          Synchronized s(durable_);
+          stopSyncer_ = true;
+          durable_.notifyAll();
+        }
+        syncer->join();
         if (-1 == ::THRIFT_CLOSE(fd_)) {
           int errno_copy = THRIFT_ERRNO;
           GlobalOutput.perror("TFileTransport: writerThread() ::close() ", errno_copy);
@@ -360,6 +402,9 @@ void TFileTransport::writerThread() {
     if (swapEventBuffers(&ts_next_flush)) {
       eventInfo* outEvent;
       while (nullptr != (outEvent = dequeueBuffer_->getNext())) {
+        // Dropped or not, the event is done with
+        ++writtenSeq;
+
         // Remove an event from the buffer and write it out to disk. If there is any IO error, for
         // instance,
         // the output file is unmounted or deleted, then this event is dropped. However, the writer
@@ -374,9 +419,24 @@ void TFileTransport::writerThread() {
               writerThreadIOErrorSleepTime_);
           THRIFT_SLEEP_USEC(writerThreadIOErrorSleepTime_);
           if (closing_) {
+            requestSync(0, writtenSeq);
+            {
+              Synchronized s(durable_);
+              stopSyncer_ = true;
+              durable_.notifyAll();
+            }
+            syncer->join();
             return;
           }
-          if (!fd_) {
+          // The syncer may still be syncing fd_; let it finish before the
+          // descriptor is closed and replaced
+          uint64_t pendingSync;
+          {
+            Synchronized s(durable_);
+            pendingSync = syncRequestSeq_;
+          }
+          waitForDurable(pendingSync);
+          if (fd_ > 0) {
             ::THRIFT_CLOSE(fd_);
             fd_ = 0;
           }
@@ -402,8 +462,13 @@ void TFileTransport::writerThread() {
           continue;
         }
 
+        if (outEvent->eventSize_ == 0) {
+          continue;
+        }
+
         // If chunking is required, then make sure that msg does not cross chunk boundary
-        if ((outEvent->eventSize_ > 0) && (chunkSize_ != 0)) {
+        uint32_t padding = 0;
+        if (chunkSize_ != 0) {
           // event size must be less than chunk size
           if (outEvent->eventSize_ > chunkSize_) {
             T_ERROR("TFileTransport: event size(%u) > chunk size(%u): skipping event",
@@ -412,19 +477,35 @@ void TFileTransport::writerThread() {
             continue;
           }
 
-          int64_t chunk1 = offset_ / chunkSize_;
-          int64_t chunk2 = (offset_ + outEvent->eventSize_ - 1) / chunkSize_;
+          if (batchLen == 0) {
+            // refetch the offset to keep in sync
+            offset_ = THRIFT_LSEEK(fd_, 0, SEEK_CUR);
+          }
+          off_t end = offset_ + batchLen;
+          int64_t chunk1 = end / chunkSize_;
+          int64_t chunk2 = (end + outEvent->eventSize_ - 1) / chunkSize_;
 
           // if adding this event will cross a chunk boundary, pad the chunk with zeros
           if (chunk1 != chunk2) {
-            // refetch the offset to keep in sync
-            offset_ = THRIFT_LSEEK(fd_, 0, SEEK_CUR);
-            auto padding = (int32_t)((offset_ / chunkSize_ + 1) * chunkSize_ - offset_);
+            padding = static_cast<uint32_t>((chunk1 + 1) * chunkSize_ - end);
+          }
+        }
 
-            auto* zeros = new uint8_t[padding];
-            memset(zeros, '\0', padding);
-            std::unique_ptr<uint8_t[]> array(zeros);
-            if (-1 == ::THRIFT_WRITE(fd_, zeros, padding)) {
+        // Large events and padding go out on their own rather than through the batch
+        if (batchLen + padding + outEvent->eventSize_ > writeBatchSize_) {
+          writeBatchOut();
+          if (hasIOError) {
+            continue;
+          }
+        }
+
+        if (padding > 0) {
+          if (padding <= writeBatchSize_ - batchLen) {
+            memset(writeBatch.get() + batchLen, '\0', padding);
+            batchLen += padding;
+          } else {
+            std::unique_ptr<uint8_t[]> zeros(new uint8_t[padding]());
+            if (!writeFully(zeros.get(), padding)) {
               int errno_copy = THRIFT_ERRNO;
               GlobalOutput.perror("TFileTransport: writerThread() error while padding zeros ",
                                   errno_copy);
@@ -437,8 +518,11 @@ void TFileTransport::writerThread() {
         }
 
         // write the dequeued event to the file
-        if (outEvent->eventSize_ > 0) {
-          if (-1 == ::THRIFT_WRITE(fd_, outEvent->eventBuff_, outEvent->eventSize_)) {
+        if (outEvent->eventSize_ <= writeBatchSize_ - batchLen) {
+          memcpy(writeBatch.get() + batchLen, outEvent->eventBuff_, outEvent->eventSize_);
+          batchLen += outEvent->eventSize_;
+        } else {
+          if (!writeFully(outEvent->eventBuff_, outEvent->eventSize_)) {
             int errno_copy = THRIFT_ERRNO;
             GlobalOutput.perror("TFileTransport: error while writing event ", errno_copy);
             hasIOError = true;
@@ -448,6 +532,7 @@ void TFileTransport::writerThread() {
           offset_ += outEvent->eventSize_;
         }
       }
+      writeBatchOut();
       dequeueBuffer_->reset();
     }
 
@@ -455,26 +540,19 @@ void TFileTransport::writerThread() {
       continue;
     }
 
-    // Local variable to cache the state of forceFlush_.
+    // Local variable to cache whether a flush() waits for us.
     //
-    // We only want to check the value of forceFlush_ once each time around the
+    // We only want to check the flush request once each time around the
     // loop.  If we check it more than once without holding the lock the entire
     // time, it could have changed state in between.  This will result in us
     // making inconsistent decisions.
     bool forced_flush = false;
     {
       Guard g(mutex_);
-      if (forceFlush_) {
-        if (!enqueueBuffer_->isEmpty()) {
-          // If forceFlush_ is true, we need to flush all available data.
-          // If enqueueBuffer_ is not empty, go back to the start of the loop to
-          // write it out.
-          //
-          // We know the main thread is waiting on forceFlush_ to be cleared,
-          // so no new events will be added to enqueueBuffer_ until we clear
-          // forceFlush_.  Therefore the next time around the loop enqueueBuffer_
-          // is guaranteed to be empty.  (I.e., we're guaranteed to make progress
-          // and clear forceFlush_ the next time around the loop.)
+      if (flushRequestSeq_ > syncedSeq) {
+        if (flushRequestSeq_ > writtenSeq) {
+          // Some of the events flush() waits for are still in enqueueBuffer_,
+          // go back to the start of the loop to write them out.
           continue;
         }
         forced_flush = true;
@@ -498,40 +576,110 @@ void TFileTransport::writerThread() {
     }
 
     if (flush) {
-      // sync (force flush) file to disk
-      THRIFT_FSYNC(fd_);
+      // hand the fsync to the syncer, anybody waiting is notified from there
+      requestSync(fd_, writtenSeq);
+      syncedSeq = writtenSeq;
       unflushed = 0;
       ts_next_flush = getNextFlushTime();
+    }
+  }
+}
 
-      // notify anybody waiting for flush completion
-      if (forced_flush) {
-        Guard g(mutex_);
-        forceFlush_ = false;
-        assert(enqueueBuffer_->isEmpty());
-        assert(dequeueBuffer_->isEmpty());
-        flushed_.notifyAll();
+bool TFileTransport::writeFully(const uint8_t* buf, uint32_t len) {
+  while (len > 0) {
+    auto written = ::THRIFT_WRITE(fd_, buf, len);
+    if (written < 0) {
+      if (THRIFT_ERRNO == THRIFT_EINTR) {
+        continue;
       }
+      return false;
     }
+    buf += written;
+    len -= static_cast<uint32_t>(written);
+  }
+  return true;
+}
+
+void TFileTransport::requestSync(int fd, uint64_t sequence) {
+  Synchronized s(durable_);
+  if (sequence > syncRequestSeq_) {
+    syncRequestSeq_ = sequence;
+    syncFd_ = fd;
+    durable_.notifyAll();
   }
 }
 
+void TFileTransport::syncerThread() {
+  Synchronized s(durable_);
+  while (true) {
+    while (syncRequestSeq_ == durableSeq_ && !stopSyncer_) {
+      durable_.waitForever();
+    }
+    if (syncRequestSeq_ == durableSeq_) {
+      return;
+    }
+
+    // Everything written up to here goes to disk with one fsync
+    uint64_t sequence = syncRequestSeq_;
+    int fd = syncFd_;
+    durable_.unlock();
+    if (fd > 0) {
+      THRIFT_FSYNC(fd);
+    }
+    if (durableCallback_) {
+      durableCallback_(sequence);
+    }
+    durable_.lock();
+
+    durableSeq_ = sequence;
+    durable_.notifyAll();
+  }
+}
+
+uint64_t TFileTransport::getEnqueuedSequence() {
+  Guard g(mutex_);
+  return enqueuedSeq_;
+}
+
+uint64_t TFileTransport::getDurableSequence() {
+  Synchronized s(durable_);
+  return durableSeq_;
+}
+
+bool TFileTransport::waitForDurable(uint64_t sequence, uint32_t timeoutMs) {
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+  Synchronized s(durable_);
+  while (durableSeq_ < sequence) {
+    if (timeoutMs == 0) {
+      durable_.waitForever();
+    } else if (durable_.waitForTime(deadline) == THRIFT_ETIMEDOUT) {
+      return durableSeq_ >= sequence;
+    }
+  }
+  return true;
+}
+
 void TFileTransport::flush() {
   resetConsumedMessageSize();
   // file must be open for writing for any flushing to take place
   if (!writerThread_.get()) {
     return;
   }
-  // wait for flush to take place
-  Guard g(mutex_);
-
-  // Indicate that we are requesting a flush
-  forceFlush_ = true;
-  // Wake up the writer thread so it will perform the flush immediately
-  notEmpty_.notify();
 
-  while (forceFlush_) {
-    flushed_.wait();
+  uint64_t sequence;
+  {
+    Guard g(mutex_);
+    sequence = enqueuedSeq_;
+    if (sequence > flushRequestSeq_) {
+      // Indicate that we are requesting a flush
+      flushRequestSeq_ = sequence;
+    }
+    // Wake up the writer thread so it will perform the flush immediately
+    notEmpty_.notify();
   }
+
+  // wait for flush to take place
+  waitForDurable(sequence);
 }
 
 uint32_t TFileTransport::readAll(uint8_t* buf, uint32_t len) {
@@ -25,6 +25,7 @@
 #include <thrift/TProcessor.h>
 
 #include <atomic>
+#include <functional>
 #include <string>
 #include <stdio.h>
 
@@ -240,6 +241,43 @@ public:
   }
   uint32_t getFlushMaxBytes() { return flushMaxBytes_; }
 
+  // The writer thread combines queued events into writes of up to this many bytes
+  void setWriteBatchSize(uint32_t writeBatchSize) {
+    if (writeBatchSize) {
+      writeBatchSize_ = writeBatchSize;
+    }
+  }
+  uint32_t getWriteBatchSize() { return writeBatchSize_; }
+
+  /**
+   * Events are numbered from 1 in the order write() accepted them.
+   * Returns the number of the last accepted event.
+   */
+  uint64_t getEnqueuedSequence();
+
+  /**
+   * Returns the number of the last event known to be on disk. Events are
+   * synced in groups, at the latest flushMaxUs after they were written.
+   * Events the writer had to drop (oversized, IO errors) count as synced.
+   */
+  uint64_t getDurableSequence();
+
+  /**
+   * Blocks until event number sequence is on disk, or for at most timeoutMs
+   * milliseconds (0 waits forever). Returns false on timeout. Unlike flush()
+   * this does not force a sync, so all waiters share the next group commit.
+   */
+  bool waitForDurable(uint64_t sequence, uint32_t timeoutMs = 0);
+
+  /**
+   * Called on the sync thread with the new durable sequence after every
+   * sync, before getDurableSequence() reports it and before waitForDurable()
+   * and flush() return for it. Set it before the first write().
+   */
+  void setDurableCallback(std::function<void(uint64_t)> callback) {
+    durableCallback_ = callback;
+  }
+
   void setMaxEventSize(uint32_t maxEventSize) { maxEventSize_ = maxEventSize; }
   uint32_t getMaxEventSize() { return maxEventSize_; }
 
@@ -276,6 +314,15 @@ private:
     return nullptr;
   }
   void writerThread();
+  bool writeFully(const uint8_t* buf, uint32_t len);
+
+  // fsync() runs on its own thread, so the writer keeps draining the queue
+  static void* startSyncerThread(void* ptr) {
+    static_cast<TFileTransport*>(ptr)->syncerThread();
+    return nullptr;
+  }
+  void syncerThread();
+  void requestSync(int fd, uint64_t sequence);
 
   // helper functions for reading from a file
   eventInfo* readEvent();
@@ -315,6 +362,10 @@ private:
   uint32_t flushMaxBytes_;
   static const uint32_t DEFAULT_FLUSH_MAX_BYTES = 1000 * 1024;
 
+  // max number of bytes handed to one write() by the writer thread
+  uint32_t writeBatchSize_;
+  static const uint32_t DEFAULT_WRITE_BATCH_SIZE = 1024 * 1024;
+
   // max event size
   uint32_t maxEventSize_;
   static const uint32_t DEFAULT_MAX_EVENT_SIZE = 0;
@@ -348,13 +399,23 @@ private:
   Monitor notFull_, notEmpty_;
   std::atomic<bool> closing_;
 
-  // To keep track of whether the buffer has been flushed
-  Monitor flushed_;
-  std::atomic<bool> forceFlush_;
-
   // Mutex that is grabbed when enqueueing and swapping the read/write buffers
   Mutex mutex_;
 
+  // Sequence numbers of the last enqueued event and of the last event a
+  // flush() waits for, both guarded by mutex_
+  uint64_t enqueuedSeq_;
+  uint64_t flushRequestSeq_;
+
+  // Group commit state shared by the writer and the syncer thread, guarded
+  // by durable_. The syncer syncs syncFd_ until syncRequestSeq_ is durable.
+  Monitor durable_;
+  uint64_t syncRequestSeq_;
+  uint64_t durableSeq_;
+  int syncFd_;
+  bool stopSyncer_;
+  std::function<void(uint64_t)> durableCallback_;
+
   // File information
   std::string filename_;
   int fd_;
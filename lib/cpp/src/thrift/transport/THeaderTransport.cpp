@@ -23,11 +23,23 @@
 #include <thrift/protocol/TBinaryProtocol.h>
 #include <thrift/protocol/TCompactProtocol.h>
 
+#include <cerrno>
+#include <cstdlib>
+#include <exception>
 #include <limits>
 #include <utility>
 #include <string>
 #include <string.h>
 #include <zlib.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#endif
+#ifdef HAVE_SNAPPY
+#include <snappy-c.h>
+#endif
 
 using std::map;
 using std::string;
@@ -43,6 +55,90 @@ namespace transport {
 using namespace apache::thrift::protocol;
 using apache::thrift::protocol::TBinaryProtocol;
 
+struct THeaderZstdDictionary::Impl {
+#ifdef HAVE_ZSTD
+  Impl() : cdict(nullptr), ddict(nullptr) {}
+  ~Impl() {
+    ZSTD_freeCDict(cdict);
+    ZSTD_freeDDict(ddict);
+  }
+
+  ZSTD_CDict* cdict;
+  ZSTD_DDict* ddict;
+#endif
+};
+
+THeaderZstdDictionary::THeaderZstdDictionary(const string& dictionary, int level)
+  : impl_(new Impl()) {
+#ifdef HAVE_ZSTD
+  impl_->cdict = ZSTD_createCDict(dictionary.data(), dictionary.size(), level);
+  impl_->ddict = ZSTD_createDDict(dictionary.data(), dictionary.size());
+  if (impl_->cdict == nullptr || impl_->ddict == nullptr) {
+    throw TTransportException(TTransportException::BAD_ARGS, "Invalid zstd dictionary");
+  }
+#else
+  (void)dictionary;
+  (void)level;
+  throw TTransportException(TTransportException::BAD_ARGS, "Built without zstd support");
+#endif
+}
+
+THeaderZstdDictionary::~THeaderZstdDictionary() = default;
+
+struct THeaderTransport::Codecs {
+#ifdef HAVE_ZSTD
+  Codecs() : zstdOut(ZSTD_createCCtx()), zstdIn(ZSTD_createDCtx()) {
+    if (zstdOut == nullptr || zstdIn == nullptr) {
+      ZSTD_freeCCtx(zstdOut);
+      ZSTD_freeDCtx(zstdIn);
+      throw std::bad_alloc();
+    }
+  }
+  ~Codecs() {
+    ZSTD_freeCCtx(zstdOut);
+    ZSTD_freeDCtx(zstdIn);
+  }
+
+  ZSTD_CCtx* zstdOut;
+  ZSTD_DCtx* zstdIn;
+#endif
+};
+
+THeaderTransport::Codecs& THeaderTransport::codecs() {
+  if (!codecs_) {
+    codecs_ = std::make_shared<Codecs>();
+  }
+  return *codecs_;
+}
+
+bool THeaderTransport::isTransformSupported(uint16_t transId) {
+  switch (transId) {
+  case ZLIB_TRANSFORM:
+    return true;
+#ifdef HAVE_SNAPPY
+  case SNAPPY_TRANSFORM:
+    return true;
+#endif
+#ifdef HAVE_ZSTD
+  case ZSTD_TRANSFORM:
+    return true;
+#endif
+#ifdef HAVE_LZ4
+  case LZ4_TRANSFORM:
+    return true;
+#endif
+  default:
+    return false;
+  }
+}
+
+void THeaderTransport::setTransform(uint16_t transId) {
+  if (!isTransformSupported(transId)) {
+    throw TTransportException(TTransportException::BAD_ARGS, "Unsupported transform");
+  }
+  writeTrans_.push_back(transId);
+}
+
 uint32_t THeaderTransport::readSlow(uint8_t* buf, uint32_t len) {
   if (clientType == THRIFT_UNFRAMED_BINARY || clientType == THRIFT_UNFRAMED_COMPACT) {
     return transport_->read(buf, len);
@@ -61,13 +157,6 @@ uint16_t THeaderTransport::getProtocolId() const {
   }
 }
 
-void THeaderTransport::ensureReadBuffer(uint32_t sz) {
-  if (sz > rBufSize_) {
-    rBuf_.reset(new uint8_t[sz]);
-    rBufSize_ = sz;
-  }
-}
-
 bool THeaderTransport::readFrame() {
   // szN is network byte order of sz
   uint32_t szN;
@@ -261,50 +350,126 @@ void THeaderTransport::readHeaderFormat(uint16_t headerSize, uint32_t sz) {
 }
 
 void THeaderTransport::untransform(uint8_t* ptr, uint32_t sz) {
-  // Update the transform buffer size if needed
-  resizeTransformBuffer();
-
   for (vector<uint16_t>::const_iterator it = readTrans_.begin(); it != readTrans_.end(); ++it) {
-    const uint16_t transId = *it;
-
-    if (transId == ZLIB_TRANSFORM) {
-      z_stream stream;
-      int err;
-
-      stream.next_in = ptr;
-      stream.avail_in = sz;
-
-      // Setting these to 0 means use the default free/alloc functions
-      stream.zalloc = (alloc_func)nullptr;
-      stream.zfree = (free_func)nullptr;
-      stream.opaque = (voidpf)nullptr;
-      err = inflateInit(&stream);
-      if (err != Z_OK) {
-        throw TApplicationException(TApplicationException::MISSING_RESULT,
-                                    "Error while zlib deflateInit");
-      }
-      stream.next_out = tBuf_.get();
-      stream.avail_out = tBufSize_;
-      err = inflate(&stream, Z_FINISH);
-      if (err != Z_STREAM_END || stream.avail_out == 0) {
-        throw TApplicationException(TApplicationException::MISSING_RESULT,
-                                    "Error while zlib deflate");
-      }
-      sz = stream.total_out;
+    sz = decompress(*it, ptr, sz);
+    // the result is in spareBuf_; make it the frame and reuse the old frame
+    // buffer next time
+    std::swap(rBuf_, spareBuf_);
+    std::swap(rBufSize_, spareBufSize_);
+    ptr = rBuf_.get();
+  }
 
-      err = inflateEnd(&stream);
-      if (err != Z_OK) {
-        throw TApplicationException(TApplicationException::MISSING_RESULT,
-                                    "Error while zlib deflateEnd");
-      }
+  setReadBuffer(ptr, sz);
+}
+
+uint32_t THeaderTransport::decompress(uint16_t transId, const uint8_t* src, uint32_t sz) {
+  const auto maxSize = static_cast<uint32_t>(getMaxMessageSize());
+
+  if (transId == ZLIB_TRANSFORM) {
+    z_stream stream;
+    int err;
 
-      memcpy(ptr, tBuf_.get(), sz);
+    stream.next_in = const_cast<uint8_t*>(src);
+    stream.avail_in = sz;
+
+    // Setting these to 0 means use the default free/alloc functions
+    stream.zalloc = (alloc_func)nullptr;
+    stream.zfree = (free_func)nullptr;
+    stream.opaque = (voidpf)nullptr;
+    err = inflateInit(&stream);
+    if (err != Z_OK) {
+      throw TApplicationException(TApplicationException::MISSING_RESULT,
+                                  "Error while zlib deflateInit");
+    }
+    // the inflated size is not recorded, so grow the buffer as we go
+    uint32_t cap = (std::min)((std::max)(sz, static_cast<uint32_t>(DEFAULT_BUFFER_SIZE)) * 4,
+                              maxSize);
+    uint32_t outSz = 0;
+    do {
+      uint8_t* out = ensureSpareBuffer(cap, outSz);
+      stream.next_out = out + outSz;
+      stream.avail_out = cap - outSz;
+      err = inflate(&stream, Z_FINISH);
+      outSz = cap - stream.avail_out;
+      if (err == Z_BUF_ERROR && stream.avail_out == 0 && cap < maxSize) {
+        cap = (std::min)(cap * 2, maxSize);
+        err = Z_OK;
+      }
+    } while (err == Z_OK);
+    inflateEnd(&stream);
+    if (err != Z_STREAM_END) {
+      throw TApplicationException(TApplicationException::MISSING_RESULT,
+                                  "Error while zlib deflate");
+    }
+    return outSz;
+  }
+#ifdef HAVE_SNAPPY
+  if (transId == SNAPPY_TRANSFORM) {
+    size_t outSz;
+    if (snappy_uncompressed_length(reinterpret_cast<const char*>(src), sz, &outSz) != SNAPPY_OK
+        || outSz > maxSize) {
+      throw TTransportException(TTransportException::CORRUPTED_DATA, "Invalid snappy frame");
+    }
+    uint8_t* out = ensureSpareBuffer(static_cast<uint32_t>(outSz));
+    if (snappy_uncompress(reinterpret_cast<const char*>(src), sz, reinterpret_cast<char*>(out),
+                          &outSz) != SNAPPY_OK) {
+      throw TTransportException(TTransportException::CORRUPTED_DATA, "Invalid snappy frame");
+    }
+    return static_cast<uint32_t>(outSz);
+  }
+#endif
+#ifdef HAVE_ZSTD
+  if (transId == ZSTD_TRANSFORM) {
+    unsigned long long outSz = ZSTD_getFrameContentSize(src, sz);
+    if (outSz == ZSTD_CONTENTSIZE_UNKNOWN || outSz == ZSTD_CONTENTSIZE_ERROR || outSz > maxSize) {
+      throw TTransportException(TTransportException::CORRUPTED_DATA, "Invalid zstd frame");
+    }
+    uint8_t* out = ensureSpareBuffer(static_cast<uint32_t>(outSz));
+    size_t ret;
+    if (zstdDictionary_) {
+      ret = ZSTD_decompress_usingDDict(codecs().zstdIn, out, static_cast<size_t>(outSz), src, sz,
+                                       zstdDictionary_->impl_->ddict);
     } else {
-      throw TApplicationException(TApplicationException::MISSING_RESULT, "Unknown transform");
+      ret = ZSTD_decompressDCtx(codecs().zstdIn, out, static_cast<size_t>(outSz), src, sz);
+    }
+    if (ZSTD_isError(ret) || ret != outSz) {
+      throw TTransportException(TTransportException::CORRUPTED_DATA, "Invalid zstd frame");
+    }
+    return static_cast<uint32_t>(ret);
+  }
+#endif
+#ifdef HAVE_LZ4
+  if (transId == LZ4_TRANSFORM) {
+    int32_t outSz;
+    uint32_t prefix = readVarint32(src, &outSz, src + sz);
+    if (outSz < 0 || static_cast<uint32_t>(outSz) > maxSize) {
+      throw TTransportException(TTransportException::CORRUPTED_DATA, "Invalid lz4 frame");
+    }
+    uint8_t* out = ensureSpareBuffer(static_cast<uint32_t>(outSz));
+    int ret = LZ4_decompress_safe(reinterpret_cast<const char*>(src + prefix),
+                                  reinterpret_cast<char*>(out), static_cast<int>(sz - prefix),
+                                  outSz);
+    if (ret != outSz) {
+      throw TTransportException(TTransportException::CORRUPTED_DATA, "Invalid lz4 frame");
     }
+    return static_cast<uint32_t>(ret);
   }
+#endif
+  throw TApplicationException(TApplicationException::MISSING_RESULT, "Unknown transform");
+}
 
-  setReadBuffer(ptr, sz);
+uint8_t* THeaderTransport::ensureSpareBuffer(uint32_t sz, uint32_t keep) {
+  if (sz > spareBufSize_ || spareBuf_.use_count() > 1) {
+    // slices of an earlier frame may still point into the spare buffer
+    uint32_t size = (std::max)(sz, spareBufSize_);
+    std::shared_ptr<uint8_t> buf(new uint8_t[size], std::default_delete<uint8_t[]>());
+    if (keep > 0) {
+      memcpy(buf.get(), spareBuf_.get(), keep);
+    }
+    spareBuf_ = std::move(buf);
+    spareBufSize_ = size;
+  }
+  return spareBuf_.get();
 }
 
 /**
@@ -323,62 +488,158 @@ void THeaderTransport::resizeTransformBuffer(uint32_t additionalSize) {
   }
 }
 
+void THeaderTransport::ensureTransformBuffer(uint32_t sz) {
+  if (tBufSize_ < sz) {
+    tBuf_.reset(new uint8_t[sz]);
+    tBufSize_ = sz;
+  }
+}
+
 void THeaderTransport::transform(uint8_t* ptr, uint32_t sz) {
-  // Update the transform buffer size if needed
-  resizeTransformBuffer();
+  // answer with the peer's transforms unless we were given our own
+  const vector<uint16_t>& trans = writeTrans_.empty() ? readTrans_ : writeTrans_;
 
-  for (vector<uint16_t>::const_iterator it = writeTrans_.begin(); it != writeTrans_.end(); ++it) {
-    const uint16_t transId = *it;
+  appliedTrans_.clear();
+  if (sz < minCompressBytes_) {
+    return;
+  }
 
-    if (transId == ZLIB_TRANSFORM) {
-      z_stream stream;
-      int err;
+  for (vector<uint16_t>::const_iterator it = trans.begin(); it != trans.end(); ++it) {
+    sz = compress(*it, ptr, sz);
+    appliedTrans_.push_back(*it);
+    // the result is in tBuf_; make it the write buffer
+    std::swap(wBuf_, tBuf_);
+    std::swap(wBufSize_, tBufSize_);
+    ptr = wBuf_.get();
+  }
 
-      stream.next_in = ptr;
-      stream.avail_in = sz;
+  if (!appliedTrans_.empty()) {
+    setWriteBuffer(wBuf_.get(), wBufSize_);
+    wBase_ = wBuf_.get() + sz;
+  }
+}
 
-      stream.zalloc = (alloc_func)nullptr;
-      stream.zfree = (free_func)nullptr;
-      stream.opaque = (voidpf)nullptr;
-      err = deflateInit(&stream, Z_DEFAULT_COMPRESSION);
-      if (err != Z_OK) {
-        throw TTransportException(TTransportException::CORRUPTED_DATA,
-                                  "Error while zlib deflateInit");
-      }
-      uint32_t tbuf_size = 0;
-      while (err == Z_OK) {
-        resizeTransformBuffer(tbuf_size);
-
-        stream.next_out = tBuf_.get();
-        stream.avail_out = tBufSize_;
-        err = deflate(&stream, Z_FINISH);
-        tbuf_size += DEFAULT_BUFFER_SIZE;
-      }
-      sz = stream.total_out;
+uint32_t THeaderTransport::compress(uint16_t transId, const uint8_t* src, uint32_t sz) {
+  if (transId == ZLIB_TRANSFORM) {
+    z_stream stream;
+    int err;
 
-      err = deflateEnd(&stream);
-      if (err != Z_OK) {
-        throw TTransportException(TTransportException::CORRUPTED_DATA,
-                                  "Error while zlib deflateEnd");
-      }
+    stream.next_in = const_cast<uint8_t*>(src);
+    stream.avail_in = sz;
 
-      memcpy(ptr, tBuf_.get(), sz);
+    stream.zalloc = (alloc_func)nullptr;
+    stream.zfree = (free_func)nullptr;
+    stream.opaque = (voidpf)nullptr;
+    err = deflateInit(&stream, Z_DEFAULT_COMPRESSION);
+    if (err != Z_OK) {
+      throw TTransportException(TTransportException::CORRUPTED_DATA,
+                                "Error while zlib deflateInit");
+    }
+    ensureTransformBuffer(static_cast<uint32_t>(deflateBound(&stream, sz)));
+    stream.next_out = tBuf_.get();
+    stream.avail_out = tBufSize_;
+    err = deflate(&stream, Z_FINISH);
+    uint32_t outSz = static_cast<uint32_t>(stream.total_out);
+    if (deflateEnd(&stream) != Z_OK || err != Z_STREAM_END) {
+      throw TTransportException(TTransportException::CORRUPTED_DATA,
+                                "Error while zlib deflate");
+    }
+    return outSz;
+  }
+#ifdef HAVE_SNAPPY
+  if (transId == SNAPPY_TRANSFORM) {
+    size_t outSz = snappy_max_compressed_length(sz);
+    ensureTransformBuffer(static_cast<uint32_t>(outSz));
+    if (snappy_compress(reinterpret_cast<const char*>(src), sz,
+                        reinterpret_cast<char*>(tBuf_.get()), &outSz) != SNAPPY_OK) {
+      throw TTransportException(TTransportException::CORRUPTED_DATA, "Error while snappy compress");
+    }
+    return static_cast<uint32_t>(outSz);
+  }
+#endif
+#ifdef HAVE_ZSTD
+  if (transId == ZSTD_TRANSFORM) {
+    ensureTransformBuffer(static_cast<uint32_t>(ZSTD_compressBound(sz)));
+    size_t ret;
+    if (zstdDictionary_) {
+      ret = ZSTD_compress_usingCDict(codecs().zstdOut, tBuf_.get(), tBufSize_, src, sz,
+                                     zstdDictionary_->impl_->cdict);
     } else {
-      throw TTransportException(TTransportException::CORRUPTED_DATA, "Unknown transform");
+      ret = ZSTD_compressCCtx(codecs().zstdOut, tBuf_.get(), tBufSize_, src, sz, 1);
     }
+    if (ZSTD_isError(ret)) {
+      throw TTransportException(TTransportException::CORRUPTED_DATA, "Error while zstd compress");
+    }
+    return static_cast<uint32_t>(ret);
   }
-
-  wBase_ = wBuf_.get() + sz;
+#endif
+#ifdef HAVE_LZ4
+  if (transId == LZ4_TRANSFORM) {
+    ensureTransformBuffer(THRIFT_MAX_VARINT32_BYTES
+                          + static_cast<uint32_t>(LZ4_compressBound(static_cast<int>(sz))));
+    uint32_t prefix = writeVarint32(static_cast<int32_t>(sz), tBuf_.get());
+    int ret = LZ4_compress_default(reinterpret_cast<const char*>(src),
+                                   reinterpret_cast<char*>(tBuf_.get() + prefix),
+                                   static_cast<int>(sz), static_cast<int>(tBufSize_ - prefix));
+    if (ret <= 0) {
+      throw TTransportException(TTransportException::CORRUPTED_DATA, "Error while lz4 compress");
+    }
+    return prefix + static_cast<uint32_t>(ret);
+  }
+#endif
+  throw TTransportException(TTransportException::CORRUPTED_DATA, "Unknown transform");
 }
 
 void THeaderTransport::resetProtocol() {
   // Set to anything except HTTP type so we don't flush again
   clientType = THRIFT_HEADER_CLIENT_TYPE;
 
+  if (framePrefetched_) {
+    framePrefetched_ = false;
+    if (prefetchError_) {
+      std::exception_ptr error = prefetchError_;
+      prefetchError_ = nullptr;
+      std::rethrow_exception(error);
+    }
+    return;
+  }
+
   // Read the header and decide which protocol to go with
   readFrame();
 }
 
+bool THeaderTransport::prefetchFrame() {
+  clientType = THRIFT_HEADER_CLIENT_TYPE;
+  try {
+    framePrefetched_ = readFrame();
+  } catch (const TApplicationException&) {
+    // Thrown again by resetProtocol(), where THeaderProtocol answers it
+    prefetchError_ = std::current_exception();
+    framePrefetched_ = true;
+  }
+  return framePrefetched_;
+}
+
+bool THeaderTransport::readRequestTimeout(std::chrono::milliseconds& timeout) {
+  // only header frames replace the headers of the frame before
+  if (!prefetchFrame() || prefetchError_ || clientType != THRIFT_HEADER_CLIENT_TYPE) {
+    return false;
+  }
+  auto it = readHeaders_.find(TDeadline::HEADER);
+  if (it == readHeaders_.end() || it->second.empty()) {
+    return false;
+  }
+
+  char* end;
+  errno = 0;
+  long long ms = strtoll(it->second.c_str(), &end, 10);
+  if (*end != '\0' || errno == ERANGE) {
+    return false;
+  }
+  timeout = std::chrono::milliseconds(ms);
+  return true;
+}
+
 uint32_t THeaderTransport::getWriteBytes() {
   return safe_numeric_cast<uint32_t>(wBase_ - wBuf_.get());
 }
@@ -437,23 +698,22 @@ void THeaderTransport::flush() {
   if (clientType == THRIFT_HEADER_CLIENT_TYPE) {
     // header size will need to be updated at the end because of varints.
     // Make it big enough here for max varint size, plus 4 for padding.
-    uint32_t headerSize = (2 + getNumTransforms()) * THRIFT_MAX_VARINT32_BYTES + 4;
+    uint32_t headerSize = (2 + static_cast<uint32_t>(appliedTrans_.size()))
+                          * THRIFT_MAX_VARINT32_BYTES + 4;
     // add approximate size of info headers
     headerSize += getMaxWriteHeadersSize();
 
     // Pkt size
     uint32_t maxSzHbo = headerSize + haveBytes // thrift header + payload
                         + 10;                  // common header section
+    // only the header is built in tBuf_, the payload is written from wBuf_
+    ensureTransformBuffer(maxSzHbo - haveBytes + 4);
+
     uint8_t* pkt = tBuf_.get();
     uint8_t* headerStart;
     uint8_t* headerSizePtr;
     uint8_t* pktStart = pkt;
 
-    if (maxSzHbo > tBufSize_) {
-      throw TTransportException(TTransportException::CORRUPTED_DATA,
-                                "Attempting to header frame that is too large");
-    }
-
     uint32_t szHbo;
     uint32_t szNbo;
     uint16_t headerSizeN;
@@ -475,10 +735,11 @@ void THeaderTransport::flush() {
     headerStart = pkt;
 
     pkt += writeVarint32(protoId, pkt);
-    pkt += writeVarint32(getNumTransforms(), pkt);
+    pkt += writeVarint32(static_cast<int32_t>(appliedTrans_.size()), pkt);
 
     // For now, each transform is only the ID, no following data.
-    for (vector<uint16_t>::const_iterator it = writeTrans_.begin(); it != writeTrans_.end(); ++it) {
+    for (vector<uint16_t>::const_iterator it = appliedTrans_.begin(); it != appliedTrans_.end();
+         ++it) {
       pkt += writeVarint32(*it, pkt);
     }
 
@@ -524,14 +785,14 @@ void THeaderTransport::flush() {
     szNbo = htonl(szHbo);
     memcpy(pktStart, &szNbo, sizeof(szNbo));
 
-    outTransport_->write(pktStart, szHbo - haveBytes + 4);
-    outTransport_->write(wBuf_.get(), haveBytes);
+    TIoVec iov[2] = {{pktStart, szHbo - haveBytes + 4}, {wBuf_.get(), haveBytes}};
+    outTransport_->writev(iov, 2);
   } else if (clientType == THRIFT_FRAMED_BINARY || clientType == THRIFT_FRAMED_COMPACT) {
     auto szHbo = (uint32_t)haveBytes;
     uint32_t szNbo = htonl(szHbo);
 
-    outTransport_->write(reinterpret_cast<uint8_t*>(&szNbo), 4);
-    outTransport_->write(wBuf_.get(), haveBytes);
+    TIoVec iov[2] = {{reinterpret_cast<uint8_t*>(&szNbo), 4}, {wBuf_.get(), haveBytes}};
+    outTransport_->writev(iov, 2);
   } else if (clientType == THRIFT_UNFRAMED_BINARY || clientType == THRIFT_UNFRAMED_COMPACT) {
     outTransport_->write(wBuf_.get(), haveBytes);
   } else {
@@ -21,6 +21,8 @@
 #define THRIFT_TRANSPORT_THEADERTRANSPORT_H_ 1
 
 #include <bitset>
+#include <chrono>
+#include <exception>
 #include <limits>
 #include <vector>
 #include <stdexcept>
@@ -33,6 +35,7 @@
 #include <inttypes.h>
 #endif
 
+#include <thrift/TDeadline.h>
 #include <thrift/protocol/TProtocolTypes.h>
 #include <thrift/transport/TBufferTransports.h>
 #include <thrift/transport/TTransport.h>
@@ -53,6 +56,31 @@ namespace transport {
 
 using apache::thrift::protocol::T_COMPACT_PROTOCOL;
 
+/**
+ * A zstd dictionary, prepared once for compression and decompression and
+ * shared by any number of header transports. Both peers must use the same
+ * dictionary. Throws TTransportException if the library was built without
+ * zstd or the dictionary cannot be loaded.
+ */
+class THeaderZstdDictionary {
+public:
+  /**
+   * @param dictionary Raw dictionary contents, as trained by zstd
+   * @param level      Compression level to use with this dictionary
+   */
+  explicit THeaderZstdDictionary(const std::string& dictionary, int level = 1);
+  ~THeaderZstdDictionary();
+
+private:
+  THeaderZstdDictionary(const THeaderZstdDictionary&) = delete;
+  THeaderZstdDictionary& operator=(const THeaderZstdDictionary&) = delete;
+
+  struct Impl;
+  std::unique_ptr<Impl> impl_;
+
+  friend class THeaderTransport;
+};
+
 /**
  * Header transport. All writes go into an in-memory buffer until flush is
  * called, at which point the transport writes the length of the entire
@@ -65,8 +93,13 @@ using apache::thrift::protocol::T_COMPACT_PROTOCOL;
  * Header Transport *must* be the same transport for both input and
  * output when used on the server side - client responses should be
  * the same protocol as those in the request.
+ *
+ * A transport that has not been given transforms of its own answers with
+ * the transforms of the last frame it received, so a server compresses its
+ * responses the way each client compresses its requests.
  */
-class THeaderTransport : public TVirtualTransport<THeaderTransport, TFramedTransport> {
+class THeaderTransport : public TVirtualTransport<THeaderTransport, TFramedTransport>,
+                         public TDeadlineCarrier {
 public:
   static const int DEFAULT_BUFFER_SIZE = 512u;
   static const int THRIFT_MAX_VARINT32_BYTES = 5;
@@ -80,8 +113,11 @@ public:
       clientType(THRIFT_HEADER_CLIENT_TYPE),
       seqId(0),
       flags(0),
+      framePrefetched_(false),
+      minCompressBytes_(0),
       tBufSize_(0),
-      tBuf_(nullptr) {
+      tBuf_(nullptr),
+      spareBufSize_(0) {
     if (!transport_) throw std::invalid_argument("transport is empty");
     initBuffers();
   }
@@ -95,8 +131,11 @@ public:
       clientType(THRIFT_HEADER_CLIENT_TYPE),
       seqId(0),
       flags(0),
+      framePrefetched_(false),
+      minCompressBytes_(0),
       tBufSize_(0),
-      tBuf_(nullptr) {
+      tBuf_(nullptr),
+      spareBufSize_(0) {
     if (!transport_) throw std::invalid_argument("inTransport is empty");
     if (!outTransport_) throw std::invalid_argument("outTransport is empty");
     initBuffers();
@@ -105,6 +144,13 @@ public:
   uint32_t readSlow(uint8_t* buf, uint32_t len) override;
   void flush() override;
 
+  /**
+   * Transforms apply to the whole frame, so slices are always copied.
+   */
+  void writeSlice(const TSlice& slice) override {
+    write(slice.data(), static_cast<uint32_t>(slice.size()));
+  }
+
   void resizeTransformBuffer(uint32_t additionalSize = 0);
 
   uint16_t getProtocolId() const;
@@ -112,6 +158,20 @@ public:
 
   void resetProtocol();
 
+  /**
+   * Reads the next frame ahead of the protocol, so that its headers can be
+   * looked at before the message is. The next resetProtocol() uses this
+   * frame rather than reading another one.
+   *
+   * Returns false on EOF.
+   */
+  bool prefetchFrame();
+
+  /**
+   * Prefetches the next frame and reads the client_timeout header of it.
+   */
+  bool readRequestTimeout(std::chrono::milliseconds& timeout) override;
+
   /**
    * We know we got a packet in header format here, try to parse the header
    *
@@ -144,7 +204,31 @@ public:
     return safe_numeric_cast<uint16_t>(writeTrans_.size());
   }
 
-  void setTransform(uint16_t transId) { writeTrans_.push_back(transId); }
+  /**
+   * Adds a transform to every frame written. Throws TTransportException if
+   * this build does not support the transform.
+   */
+  void setTransform(uint16_t transId);
+
+  /**
+   * Whether this build of the library can apply the given transform.
+   */
+  static bool isTransformSupported(uint16_t transId);
+
+  /**
+   * Frames whose payload is smaller than this are sent without transforms.
+   * Defaults to 0, which transforms every frame.
+   */
+  void setMinCompressBytes(uint32_t bytes) { minCompressBytes_ = bytes; }
+  uint32_t getMinCompressBytes() const { return minCompressBytes_; }
+
+  /**
+   * Uses the given dictionary for ZSTD_TRANSFORM in both directions, or
+   * none if it is empty.
+   */
+  void setZstdDictionary(std::shared_ptr<const THeaderZstdDictionary> dictionary) {
+    zstdDictionary_ = dictionary;
+  }
 
   // Info headers
 
@@ -166,6 +250,9 @@ public:
 
   enum TRANSFORMS {
     ZLIB_TRANSFORM = 0x01,
+    SNAPPY_TRANSFORM = 0x03,
+    ZSTD_TRANSFORM = 0x05,
+    LZ4_TRANSFORM = 0x06,
   };
 
 protected:
@@ -177,7 +264,6 @@ protected:
    */
   bool readFrame() override;
 
-  void ensureReadBuffer(uint32_t sz);
   uint32_t getWriteBytes();
 
   void initBuffers() {
@@ -199,8 +285,16 @@ protected:
   uint32_t seqId;
   uint16_t flags;
 
+  // whether prefetchFrame() read the frame the next resetProtocol() is for
+  bool framePrefetched_;
+  std::exception_ptr prefetchError_;
+
   std::vector<uint16_t> readTrans_;
   std::vector<uint16_t> writeTrans_;
+  // the transforms transform() applied to the frame being flushed
+  std::vector<uint16_t> appliedTrans_;
+  uint32_t minCompressBytes_;
+  std::shared_ptr<const THeaderZstdDictionary> zstdDictionary_;
 
   // Map to use for headers
   StringToStringMap readHeaders_;
@@ -222,6 +316,31 @@ protected:
   // Buffers to use for transform processing
   uint32_t tBufSize_;
   std::unique_ptr<uint8_t[]> tBuf_;
+  // untransform() decompresses into this and swaps it with rBuf_
+  uint32_t spareBufSize_;
+  std::shared_ptr<uint8_t> spareBuf_;
+
+  /**
+   * Makes tBuf_ hold at least sz bytes, discarding its contents.
+   */
+  void ensureTransformBuffer(uint32_t sz);
+
+  /**
+   * Makes spareBuf_ hold at least sz bytes and keeps its first keep bytes.
+   */
+  uint8_t* ensureSpareBuffer(uint32_t sz, uint32_t keep = 0);
+
+  /**
+   * Compresses or decompresses a whole frame with one transform, returning
+   * the size of the result.
+   */
+  uint32_t compress(uint16_t transId, const uint8_t* src, uint32_t sz);
+  uint32_t decompress(uint16_t transId, const uint8_t* src, uint32_t sz);
+
+  // per transport codec state, created on first use
+  struct Codecs;
+  std::shared_ptr<Codecs> codecs_;
+  Codecs& codecs();
 
   void readString(uint8_t*& ptr, /* out */ std::string& str, uint8_t const* headerBoundary);
 
@@ -265,8 +384,23 @@ public:
    * Wraps the transport into a header one.
    */
   std::shared_ptr<TTransport> getTransport(std::shared_ptr<TTransport> trans) override {
-    return std::shared_ptr<TTransport>(new THeaderTransport(trans));
+    std::shared_ptr<THeaderTransport> header(new THeaderTransport(trans));
+    header->setMinCompressBytes(minCompressBytes_);
+    header->setZstdDictionary(zstdDictionary_);
+    return header;
+  }
+
+  /**
+   * Applied to every transport this factory creates.
+   */
+  void setMinCompressBytes(uint32_t bytes) { minCompressBytes_ = bytes; }
+  void setZstdDictionary(std::shared_ptr<const THeaderZstdDictionary> dictionary) {
+    zstdDictionary_ = dictionary;
   }
+
+private:
+  uint32_t minCompressBytes_ = 0;
+  std::shared_ptr<const THeaderZstdDictionary> zstdDictionary_;
 };
 }
 }
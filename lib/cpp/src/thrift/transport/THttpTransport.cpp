@@ -17,6 +17,8 @@
  * under the License.
  */
 
+#include <algorithm>
+#include <cstring>
 #include <sstream>
 
 #include <thrift/transport/THttpTransport.h>
@@ -40,10 +42,12 @@ THttpTransport::THttpTransport(std::shared_ptr<TTransport> transport, std::share
     chunkedDone_(false),
     chunkSize_(0),
     contentLength_(0),
+    contentRemaining_(0),
     httpBuf_(nullptr),
     httpPos_(0),
     httpBufLen_(0),
-    httpBufSize_(1024) {
+    httpBufSize_(1024),
+    httpScanPos_(0) {
   init();
 }
 
@@ -63,16 +67,45 @@ THttpTransport::~THttpTransport() {
 
 uint32_t THttpTransport::read(uint8_t* buf, uint32_t len) {
   checkReadBytesAvailable(len);
-  if (readBuffer_.available_read() == 0) {
+  if (readBuffer_.available_read() == 0 && contentRemaining_ == 0) {
     readBuffer_.resetBuffer();
     uint32_t got = readMoreData();
     if (got == 0) {
       return 0;
     }
   }
+  if (contentRemaining_ > 0) {
+    return readBody(buf, len);
+  }
   return readBuffer_.read(buf, len);
 }
 
+const uint8_t* THttpTransport::borrow(uint8_t* buf, uint32_t* len) {
+  if (readBuffer_.available_read() > 0) {
+    return readBuffer_.borrow(buf, len);
+  }
+  // Hand out the body right where it was received
+  uint32_t avail = (std::min)(contentRemaining_, httpBufLen_ - httpPos_);
+  if (avail > 0 && *len <= avail) {
+    *len = avail;
+    return reinterpret_cast<const uint8_t*>(httpBuf_ + httpPos_);
+  }
+  return nullptr;
+}
+
+void THttpTransport::consume(uint32_t len) {
+  if (readBuffer_.available_read() > 0) {
+    readBuffer_.consume(len);
+    return;
+  }
+  if (len > contentRemaining_ || len > httpBufLen_ - httpPos_) {
+    throw TTransportException(TTransportException::BAD_ARGS, "consume did not follow a borrow.");
+  }
+  countConsumedMessageBytes(len);
+  httpPos_ += len;
+  contentRemaining_ -= len;
+}
+
 uint32_t THttpTransport::readEnd() {
   // Read any pending chunked data (footers etc.)
   if (chunked_) {
@@ -80,6 +113,11 @@ uint32_t THttpTransport::readEnd() {
       readChunked();
     }
   }
+  // Skip what the protocol left of the body, a pipelined request may follow
+  uint8_t skip[256];
+  while (contentRemaining_ > 0) {
+    readBody(skip, sizeof(skip));
+  }
   return 0;
 }
 
@@ -87,7 +125,10 @@ uint32_t THttpTransport::readMoreData() {
   uint32_t size;
 
   if (httpPos_ == httpBufLen_) {
-    // Get more data!
+    // Get more data! Everything buffered was consumed, so start over.
+    httpPos_ = 0;
+    httpBufLen_ = 0;
+    httpScanPos_ = 0;
     refill();
   }
 
@@ -98,13 +139,41 @@ uint32_t THttpTransport::readMoreData() {
   if (chunked_) {
     size = readChunked();
   } else {
-    size = readContent(contentLength_);
+    // The body is not copied, read() takes it from httpBuf_ or the wire
+    contentRemaining_ = contentLength_;
+    size = contentLength_;
     readHeaders_ = true;
   }
 
   return size;
 }
 
+uint32_t THttpTransport::readBody(uint8_t* buf, uint32_t len) {
+  uint32_t want = (std::min)(len, contentRemaining_);
+  uint32_t avail = httpBufLen_ - httpPos_;
+  if (avail == 0) {
+    httpPos_ = 0;
+    httpBufLen_ = 0;
+    httpScanPos_ = 0;
+    if (want >= httpBufSize_) {
+      // Large reads go straight from the wire to the caller
+      uint32_t got = transport_->read(buf, want);
+      if (got == 0) {
+        throw TTransportException(TTransportException::END_OF_FILE, "Could not refill buffer");
+      }
+      contentRemaining_ -= got;
+      return got;
+    }
+    refill();
+    avail = httpBufLen_;
+  }
+  uint32_t give = (std::min)(want, avail);
+  memcpy(buf, httpBuf_ + httpPos_, give);
+  httpPos_ += give;
+  contentRemaining_ -= give;
+  return give;
+}
+
 uint32_t THttpTransport::readChunked() {
   uint32_t length = 0;
 
@@ -150,6 +219,7 @@ uint32_t THttpTransport::readContent(uint32_t size) {
       // We have given all the data, reset position to head of the buffer
       httpPos_ = 0;
       httpBufLen_ = 0;
+      httpScanPos_ = 0;
       refill();
 
       // Now have available however much we read
@@ -167,21 +237,38 @@ uint32_t THttpTransport::readContent(uint32_t size) {
 }
 
 char* THttpTransport::readLine() {
+  // Somebody else consumed from httpBuf_ since the last search
+  if (httpScanPos_ < httpPos_ || httpScanPos_ > httpBufLen_) {
+    httpScanPos_ = httpPos_;
+  }
+
   while (true) {
     char* eol = nullptr;
 
-    eol = strstr(httpBuf_ + httpPos_, CRLF);
+    // Only look at bytes which were not searched before. A CR at the end of
+    // the last search is caught by looking behind each LF.
+    char* line = httpBuf_ + httpPos_;
+    char* end = httpBuf_ + httpBufLen_;
+    char* lf = httpBuf_ + httpScanPos_;
+    while ((lf = static_cast<char*>(memchr(lf, '\n', end - lf))) != nullptr) {
+      if (lf > line && lf[-1] == '\r') {
+        eol = lf - 1;
+        break;
+      }
+      ++lf;
+    }
 
     // No CRLF yet?
     if (eol == nullptr) {
+      httpScanPos_ = httpBufLen_;
       // Shift whatever we have now to front and refill
       shift();
       refill();
     } else {
       // Return pointer to next line
       *eol = '\0';
-      char* line = httpBuf_ + httpPos_;
       httpPos_ = static_cast<uint32_t>((eol - httpBuf_) + CRLF_LEN);
+      httpScanPos_ = httpPos_;
       return line;
     }
   }
@@ -196,6 +283,7 @@ void THttpTransport::shift() {
   } else {
     httpBufLen_ = 0;
   }
+  httpScanPos_ = httpScanPos_ > httpPos_ ? httpScanPos_ - httpPos_ : 0;
   httpPos_ = 0;
   httpBuf_[httpBufLen_] = '\0';
 }
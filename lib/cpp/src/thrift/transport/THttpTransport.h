@@ -44,12 +44,19 @@ public:
 
   bool isOpen() const override { return transport_->isOpen(); }
 
-  bool peek() override { return transport_->peek(); }
+  // Pipelined requests may already wait in httpBuf_
+  bool peek() override {
+    return readBuffer_.available_read() > 0 || httpPos_ < httpBufLen_ || transport_->peek();
+  }
 
   void close() override { transport_->close(); }
 
   uint32_t read(uint8_t* buf, uint32_t len);
 
+  const uint8_t* borrow(uint8_t* buf, uint32_t* len);
+
+  void consume(uint32_t len);
+
   uint32_t readEnd() override;
 
   void write(const uint8_t* buf, uint32_t len);
@@ -72,11 +79,16 @@ protected:
   bool chunkedDone_;
   uint32_t chunkSize_;
   uint32_t contentLength_;
+  // Bytes of a Content-Length body the protocol has not read yet. They are
+  // handed out from httpBuf_ or the wire directly, never via readBuffer_.
+  uint32_t contentRemaining_;
 
   char* httpBuf_;
   uint32_t httpPos_;
   uint32_t httpBufLen_;
   uint32_t httpBufSize_;
+  // readLine() has searched httpBuf_ for CRLF up to here
+  uint32_t httpScanPos_;
 
   virtual void init();
 
@@ -92,6 +104,7 @@ protected:
   uint32_t parseChunkSize(char* line);
 
   uint32_t readContent(uint32_t size);
+  uint32_t readBody(uint8_t* buf, uint32_t len);
 
   void refill();
   void shift();
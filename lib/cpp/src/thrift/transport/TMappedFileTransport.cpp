@@ -0,0 +1,773 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/thrift-config.h>
+
+#include <fcntl.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+#ifdef _WIN32
+#include <io.h>
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <limits>
+
+#include <thrift/TLogging.h>
+#include <thrift/concurrency/FunctionRunner.h>
+#include <thrift/concurrency/ThreadFactory.h>
+#include <thrift/transport/TMappedFileTransport.h>
+#include <thrift/transport/TTransportUtils.h>
+#include <thrift/transport/PlatformSocket.h>
+
+namespace apache {
+namespace thrift {
+namespace transport {
+
+using apache::thrift::concurrency::FunctionRunner;
+using apache::thrift::concurrency::Guard;
+using apache::thrift::concurrency::Synchronized;
+using apache::thrift::concurrency::Thread;
+using apache::thrift::concurrency::ThreadFactory;
+using apache::thrift::protocol::TProtocol;
+using std::shared_ptr;
+
+static const char INDEX_MAGIC[8] = {'T', 'F', 'L', 'I', 'D', 'X', '0', '1'};
+
+/**
+ * A read-only view of the first size bytes of a file
+ */
+class TMappedLogFile::Mapping {
+public:
+  Mapping(int fd, uint64_t size) : data_(nullptr), size_(size) {
+    if (size_ == 0) {
+      return;
+    }
+#ifdef _WIN32
+    handle_ = CreateFileMapping(reinterpret_cast<HANDLE>(_get_osfhandle(fd)),
+                                nullptr,
+                                PAGE_READONLY,
+                                static_cast<DWORD>(size_ >> 32),
+                                static_cast<DWORD>(size_),
+                                nullptr);
+    if (handle_ != nullptr) {
+      data_ = static_cast<uint8_t*>(
+          MapViewOfFile(handle_, FILE_MAP_READ, 0, 0, static_cast<SIZE_T>(size_)));
+    }
+    if (data_ == nullptr) {
+      int errno_copy = static_cast<int>(GetLastError());
+      if (handle_ != nullptr) {
+        CloseHandle(handle_);
+      }
+      throw TTransportException(TTransportException::UNKNOWN,
+                                "TMappedLogFile: MapViewOfFile()",
+                                errno_copy);
+    }
+#else
+    void* data = ::mmap(nullptr, static_cast<size_t>(size_), PROT_READ, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+      int errno_copy = THRIFT_ERRNO;
+      throw TTransportException(TTransportException::UNKNOWN, "TMappedLogFile: mmap()", errno_copy);
+    }
+    data_ = static_cast<uint8_t*>(data);
+#endif
+  }
+
+  ~Mapping() {
+    if (data_ == nullptr) {
+      return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(data_);
+    CloseHandle(handle_);
+#else
+    ::munmap(data_, static_cast<size_t>(size_));
+#endif
+  }
+
+  const uint8_t* data() const { return data_; }
+  uint64_t size() const { return size_; }
+
+private:
+  Mapping(const Mapping&) = delete;
+  Mapping& operator=(const Mapping&) = delete;
+
+  uint8_t* data_;
+  uint64_t size_;
+#ifdef _WIN32
+  HANDLE handle_;
+#endif
+};
+
+TMappedLogFile::TMappedLogFile(const std::string& path, uint32_t chunkSize, uint32_t maxEventSize)
+  : path_(path),
+    chunkSize_(chunkSize ? chunkSize : DEFAULT_CHUNK_SIZE),
+    maxEventSize_(maxEventSize) {
+#ifndef _WIN32
+  fd_ = ::THRIFT_OPEN(path_.c_str(), O_RDONLY);
+#else
+  fd_ = ::THRIFT_OPEN(path_.c_str(), _O_RDONLY | _O_BINARY);
+#endif
+  if (fd_ == -1) {
+    int errno_copy = THRIFT_ERRNO;
+    GlobalOutput.perror("TMappedLogFile: open() file: " + path_, errno_copy);
+    throw TTransportException(TTransportException::NOT_OPEN, path_, errno_copy);
+  }
+
+  try {
+    refresh();
+  } catch (...) {
+    ::THRIFT_CLOSE(fd_);
+    throw;
+  }
+}
+
+TMappedLogFile::~TMappedLogFile() {
+  // chunks handed out keep their mapping, which does not need the descriptor
+  ::THRIFT_CLOSE(fd_);
+}
+
+bool TMappedLogFile::refresh() {
+  struct THRIFT_STAT f_info;
+  if (::THRIFT_FSTAT(fd_, &f_info) < 0) {
+    int errno_copy = THRIFT_ERRNO;
+    throw TTransportException(TTransportException::UNKNOWN,
+                              "TMappedLogFile::refresh() (fstat)",
+                              errno_copy);
+  }
+  uint64_t size = static_cast<uint64_t>(f_info.st_size);
+
+  {
+    Guard g(mutex_);
+    if (mapping_ && size <= mapping_->size()) {
+      return false;
+    }
+  }
+
+  // Earlier mappings stay alive as long as a chunk refers to them, so
+  // cursors are never affected by a remap
+  shared_ptr<const Mapping> mapping(new Mapping(fd_, size));
+  Guard g(mutex_);
+  if (mapping_ && mapping_->size() >= size) {
+    return false;
+  }
+  mapping_ = mapping;
+  return true;
+}
+
+uint64_t TMappedLogFile::getSize() {
+  Guard g(mutex_);
+  return mapping_->size();
+}
+
+uint32_t TMappedLogFile::getNumChunks() {
+  return numChunks(getSize());
+}
+
+uint32_t TMappedLogFile::numChunks(uint64_t size) const {
+  // counted the way TFileTransport counts them
+  if (size == 0) {
+    return 0;
+  }
+  uint64_t chunks = size / chunkSize_ + 1;
+  if (chunks > (std::numeric_limits<uint32_t>::max)()) {
+    throw TTransportException("Too many chunks");
+  }
+  return static_cast<uint32_t>(chunks);
+}
+
+TMappedLogFile::ChunkIndex TMappedLogFile::indexChunk(const Mapping& mapping, uint32_t chunk) const {
+  ChunkIndex result;
+  std::shared_ptr<std::vector<uint32_t> > events(new std::vector<uint32_t>());
+  uint64_t base = uint64_t(chunk) * chunkSize_;
+  result.indexedSize = mapping.size();
+
+  if (base < mapping.size()) {
+    const uint8_t* begin = mapping.data() + base;
+    auto limit = static_cast<uint32_t>((std::min)(uint64_t(chunkSize_), mapping.size() - base));
+
+    // An event never crosses the end of its chunk, a size header that would
+    // is the start of the padding up to the next chunk
+    uint32_t pos = 0;
+    while (limit - pos >= 4) {
+      uint32_t eventSize;
+      memcpy(&eventSize, begin + pos, sizeof(eventSize));
+      if (eventSize == 0) {
+        // 0 length event indicates padding
+        pos += 4;
+        continue;
+      }
+      if (eventSize > chunkSize_ - pos - 4 || (maxEventSize_ > 0 && eventSize > maxEventSize_)) {
+        T_ERROR("TMappedLogFile: corrupt event of size %u at offset %lu, skipping rest of chunk %u",
+                eventSize,
+                static_cast<unsigned long>(base + pos),
+                chunk);
+        result.complete = true;
+        break;
+      }
+      if (eventSize > limit - pos - 4) {
+        // not written in full yet
+        break;
+      }
+      events->push_back(pos);
+      pos += 4 + eventSize;
+    }
+  }
+
+  if (base + chunkSize_ <= mapping.size()) {
+    result.complete = true;
+  }
+  result.events = events;
+  return result;
+}
+
+TMappedLogFile::Chunk TMappedLogFile::getChunk(uint32_t chunk) {
+  shared_ptr<const Mapping> mapping;
+  ChunkIndex index;
+  {
+    Guard g(mutex_);
+    mapping = mapping_;
+    if (chunk < index_.size()) {
+      index = index_[chunk];
+    }
+  }
+
+  if (!index.events || (!index.complete && index.indexedSize < mapping->size())) {
+    // Index outside the lock so cursors on other chunks are not held up.
+    // Two cursors might index the same chunk at once, which is harmless.
+    index = indexChunk(*mapping, chunk);
+    Guard g(mutex_);
+    if (index_.size() <= chunk) {
+      index_.resize(chunk + 1);
+    }
+    ChunkIndex& cached = index_[chunk];
+    if (!cached.events || (!cached.complete && cached.indexedSize < index.indexedSize)) {
+      cached = index;
+    }
+  }
+
+  Chunk result;
+  result.mapping = mapping;
+  uint64_t base = uint64_t(chunk) * chunkSize_;
+  if (base < mapping->size()) {
+    result.begin = mapping->data() + base;
+    result.size = static_cast<uint32_t>((std::min)(uint64_t(chunkSize_), mapping->size() - base));
+  }
+  result.events = index.events;
+  result.complete = index.complete;
+  return result;
+}
+
+uint64_t TMappedLogFile::getNumEvents() {
+  uint64_t numEvents = 0;
+  uint32_t chunks = getNumChunks();
+  for (uint32_t chunk = 0; chunk < chunks; ++chunk) {
+    numEvents += getChunk(chunk).events->size();
+  }
+  return numEvents;
+}
+
+bool TMappedLogFile::findEvent(uint64_t event, uint32_t* chunk, uint32_t* index) {
+  uint32_t chunks = getNumChunks();
+  for (uint32_t i = 0; i < chunks; ++i) {
+    size_t numEvents = getChunk(i).events->size();
+    if (event < numEvents) {
+      *chunk = i;
+      *index = static_cast<uint32_t>(event);
+      return true;
+    }
+    event -= numEvents;
+  }
+  return false;
+}
+
+void TMappedLogFile::saveIndex(const std::string& path) {
+  // only complete chunks are saved, the last one may still be growing
+  std::vector<shared_ptr<const std::vector<uint32_t> > > chunks;
+  uint32_t numChunks = getNumChunks();
+  for (uint32_t chunk = 0; chunk < numChunks; ++chunk) {
+    Chunk c = getChunk(chunk);
+    if (!c.complete) {
+      break;
+    }
+    chunks.push_back(c.events);
+  }
+
+  std::ofstream out(path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+  auto count = static_cast<uint32_t>(chunks.size());
+  out.write(INDEX_MAGIC, sizeof(INDEX_MAGIC));
+  out.write(reinterpret_cast<const char*>(&chunkSize_), sizeof(chunkSize_));
+  out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+  for (const auto& events : chunks) {
+    auto numEvents = static_cast<uint32_t>(events->size());
+    out.write(reinterpret_cast<const char*>(&numEvents), sizeof(numEvents));
+    if (numEvents > 0) {
+      out.write(reinterpret_cast<const char*>(&(*events)[0]), numEvents * sizeof(uint32_t));
+    }
+  }
+  out.close();
+  if (!out) {
+    throw TTransportException(TTransportException::UNKNOWN,
+                              "TMappedLogFile: unable to write index " + path);
+  }
+}
+
+bool TMappedLogFile::loadIndex(const std::string& path) {
+  std::ifstream in(path.c_str(), std::ios::in | std::ios::binary);
+  char magic[sizeof(INDEX_MAGIC)];
+  uint32_t chunkSize = 0;
+  uint32_t count = 0;
+  in.read(magic, sizeof(magic));
+  in.read(reinterpret_cast<char*>(&chunkSize), sizeof(chunkSize));
+  in.read(reinterpret_cast<char*>(&count), sizeof(count));
+  if (!in || memcmp(magic, INDEX_MAGIC, sizeof(magic)) != 0 || chunkSize != chunkSize_) {
+    return false;
+  }
+
+  // the chunks of the index must all be there in full
+  uint64_t size = getSize();
+  if (uint64_t(count) * chunkSize_ > size) {
+    return false;
+  }
+
+  std::vector<ChunkIndex> chunks(count);
+  for (uint32_t chunk = 0; chunk < count; ++chunk) {
+    uint32_t numEvents = 0;
+    in.read(reinterpret_cast<char*>(&numEvents), sizeof(numEvents));
+    if (!in || numEvents > chunkSize_ / 5) {
+      return false;
+    }
+    std::shared_ptr<std::vector<uint32_t> > events(new std::vector<uint32_t>(numEvents));
+    if (numEvents > 0) {
+      in.read(reinterpret_cast<char*>(&(*events)[0]), numEvents * sizeof(uint32_t));
+      if (!in) {
+        return false;
+      }
+    }
+    for (uint32_t i = 0; i < numEvents; ++i) {
+      if ((*events)[i] > chunkSize_ - 5 || (i > 0 && (*events)[i] <= (*events)[i - 1])) {
+        return false;
+      }
+    }
+    chunks[chunk].events = events;
+    chunks[chunk].indexedSize = uint64_t(chunk + 1) * chunkSize_;
+    chunks[chunk].complete = true;
+  }
+
+  Guard g(mutex_);
+  if (index_.size() < count) {
+    index_.resize(count);
+  }
+  std::copy(chunks.begin(), chunks.end(), index_.begin());
+  return true;
+}
+
+TMappedFileReaderTransport::TMappedFileReaderTransport(const std::string& path,
+                                                       std::shared_ptr<TConfiguration> config)
+  : TMappedFileReaderTransport(std::make_shared<TMappedLogFile>(path), config) {
+}
+
+TMappedFileReaderTransport::TMappedFileReaderTransport(std::shared_ptr<TMappedLogFile> file,
+                                                       std::shared_ptr<TConfiguration> config)
+  : TTransport(config),
+    file_(file),
+    curChunk_(0),
+    nextEvent_(0),
+    eventPtr_(nullptr),
+    eventLeft_(0),
+    haveEvent_(false),
+    readTimeout_(TFileTransport::NO_TAIL_READ_TIMEOUT),
+    eofSleepTime_(DEFAULT_EOF_SLEEP_TIME_US) {
+}
+
+void TMappedFileReaderTransport::loadChunk(uint32_t chunk) {
+  chunk_ = file_->getChunk(chunk);
+  curChunk_ = chunk;
+  nextEvent_ = 0;
+  eventPtr_ = nullptr;
+  eventLeft_ = 0;
+  haveEvent_ = false;
+}
+
+bool TMappedFileReaderTransport::nextEvent() {
+  int readTries = 0;
+
+  if (!chunk_.events) {
+    loadChunk(curChunk_);
+  }
+
+  while (1) {
+    if (nextEvent_ < chunk_.events->size()) {
+      // Offsets from a loaded index were only checked against the chunk
+      // size, the events they point at must not run past the chunk either
+      uint32_t offset = (*chunk_.events)[nextEvent_++];
+      uint32_t eventSize = 0;
+      if (offset <= chunk_.size && chunk_.size - offset >= 4) {
+        memcpy(&eventSize, chunk_.begin + offset, sizeof(eventSize));
+      }
+      if (eventSize == 0 || eventSize > chunk_.size - offset - 4) {
+        T_ERROR("TMappedFileReaderTransport: corrupt event at offset %u, skipping rest of chunk %u",
+                offset,
+                curChunk_);
+        nextEvent_ = static_cast<uint32_t>(chunk_.events->size());
+        continue;
+      }
+      eventLeft_ = eventSize;
+      eventPtr_ = chunk_.begin + offset + 4;
+      haveEvent_ = true;
+      return true;
+    }
+
+    if (chunk_.complete && curChunk_ + 1 < file_->getNumChunks()) {
+      loadChunk(curChunk_ + 1);
+      continue;
+    }
+
+    // out of events, see whether the writer added some
+    if (file_->refresh()) {
+      uint32_t next = nextEvent_;
+      loadChunk(curChunk_);
+      nextEvent_ = next;
+      continue;
+    }
+
+    if (readTimeout_ == TFileTransport::TAIL_READ_TIMEOUT) {
+      // wait indefinitely if there is no timeout
+      THRIFT_SLEEP_USEC(eofSleepTime_);
+    } else if (readTimeout_ > 0 && readTries == 0) {
+      THRIFT_SLEEP_USEC(readTimeout_ * 1000);
+      readTries++;
+    } else {
+      return false;
+    }
+  }
+}
+
+bool TMappedFileReaderTransport::peek() {
+  if (!haveEvent_ && !nextEvent()) {
+    return false;
+  }
+  return eventLeft_ > 0;
+}
+
+uint32_t TMappedFileReaderTransport::read(uint8_t* buf, uint32_t len) {
+  checkReadBytesAvailable(len);
+  if (!haveEvent_ && !nextEvent()) {
+    return 0;
+  }
+
+  // like TFileTransport, a read never goes past the end of an event
+  uint32_t get = (std::min)(len, eventLeft_);
+  memcpy(buf, eventPtr_, get);
+  eventPtr_ += get;
+  eventLeft_ -= get;
+  if (eventLeft_ == 0) {
+    haveEvent_ = false;
+  }
+  return get;
+}
+
+uint32_t TMappedFileReaderTransport::readAll(uint8_t* buf, uint32_t len) {
+  checkReadBytesAvailable(len);
+  uint32_t have = 0;
+  uint32_t get = 0;
+
+  while (have < len) {
+    get = read(buf + have, len - have);
+    if (get <= 0) {
+      throw TEOFException();
+    }
+    have += get;
+  }
+
+  return have;
+}
+
+const uint8_t* TMappedFileReaderTransport::borrow(uint8_t* buf, uint32_t* len) {
+  (void)buf;
+  // only the rest of the current event is handed out, the way a read()
+  // would return it
+  if (haveEvent_ && *len <= eventLeft_) {
+    *len = eventLeft_;
+    return eventPtr_;
+  }
+  return nullptr;
+}
+
+void TMappedFileReaderTransport::consume(uint32_t len) {
+  if (!haveEvent_ || len > eventLeft_) {
+    throw TTransportException(TTransportException::BAD_ARGS, "consume did not follow a borrow.");
+  }
+  eventPtr_ += len;
+  eventLeft_ -= len;
+  if (eventLeft_ == 0) {
+    haveEvent_ = false;
+  }
+}
+
+void TMappedFileReaderTransport::seekToChunk(int32_t chunk) {
+  file_->refresh();
+  auto numChunks = static_cast<int32_t>(getNumChunks());
+
+  // file is empty, seeking to chunk is pointless
+  if (numChunks == 0) {
+    return;
+  }
+
+  // negative indicates reverse seek (from the end)
+  if (chunk < 0) {
+    chunk += numChunks;
+  }
+
+  // too large a value for reverse seek, just seek to beginning
+  if (chunk < 0) {
+    T_DEBUG("%s", "Incorrect value for reverse seek. Seeking to beginning...");
+    chunk = 0;
+  }
+
+  // cannot seek past EOF
+  if (chunk >= numChunks) {
+    T_DEBUG("%s", "Trying to seek past EOF. Seeking to EOF instead...");
+    seekToEnd();
+    return;
+  }
+
+  loadChunk(static_cast<uint32_t>(chunk));
+}
+
+void TMappedFileReaderTransport::seekToEnd() {
+  file_->refresh();
+  uint32_t numChunks = getNumChunks();
+  loadChunk(numChunks > 0 ? numChunks - 1 : 0);
+  nextEvent_ = static_cast<uint32_t>(chunk_.events->size());
+}
+
+void TMappedFileReaderTransport::seekToEvent(uint64_t event) {
+  uint32_t chunk;
+  uint32_t index;
+  if (!file_->findEvent(event, &chunk, &index)) {
+    throw TEOFException();
+  }
+  seekToChunkEvent(chunk, index);
+}
+
+void TMappedFileReaderTransport::seekToChunkEvent(uint32_t chunk, uint32_t index) {
+  loadChunk(chunk);
+  nextEvent_ = index;
+}
+
+uint32_t TMappedFileReaderTransport::getEventsLeftInChunk() {
+  if (!chunk_.events) {
+    loadChunk(curChunk_);
+  }
+  return static_cast<uint32_t>(chunk_.events->size()) - nextEvent_ + (haveEvent_ ? 1 : 0);
+}
+
+struct TParallelFileProcessor::Worker {
+  shared_ptr<TMappedFileReaderTransport> input;
+  shared_ptr<TProtocol> inputProtocol;
+  shared_ptr<TProtocol> outputProtocol;
+  shared_ptr<TProcessor> processor;
+  shared_ptr<Thread> thread;
+  uint64_t numEvents;
+  uint64_t numBytes;
+  uint64_t numErrors;
+
+  Worker() : numEvents(0), numBytes(0), numErrors(0) {}
+};
+
+TParallelFileProcessor::TParallelFileProcessor(
+    shared_ptr<apache::thrift::TProcessorFactory> processorFactory,
+    shared_ptr<TProtocolFactory> protocolFactory,
+    shared_ptr<TMappedLogFile> file,
+    uint32_t numWorkers,
+    Ordering ordering)
+  : processorFactory_(processorFactory),
+    protocolFactory_(protocolFactory),
+    file_(file),
+    numWorkers_(numWorkers ? numWorkers : 1),
+    ordering_(ordering),
+    batchSize_(DEFAULT_BATCH_SIZE),
+    stopOnError_(false),
+    numChunks_(0),
+    nextChunk_(0),
+    nextIndex_(0),
+    chunkEvents_(0),
+    chunkIndexed_(false),
+    turn_(0),
+    stopped_(false) {
+}
+
+void TParallelFileProcessor::process() {
+  auto start = std::chrono::steady_clock::now();
+  file_->refresh();
+
+  numChunks_ = file_->getNumChunks();
+  nextChunk_ = 0;
+  nextIndex_ = 0;
+  chunkIndexed_ = false;
+  turn_ = 0;
+  stopped_ = false;
+
+  // processors are created here, getProcessor() need not be thread safe
+  std::vector<std::unique_ptr<Worker> > workers;
+  ThreadFactory threadFactory(false);
+  for (uint32_t i = 0; i < numWorkers_; ++i) {
+    std::unique_ptr<Worker> worker(new Worker());
+    worker->input = std::make_shared<TMappedFileReaderTransport>(file_);
+    worker->inputProtocol = protocolFactory_->getProtocol(worker->input);
+    worker->outputProtocol = protocolFactory_->getProtocol(std::make_shared<TNullTransport>());
+    apache::thrift::TConnectionInfo connInfo;
+    connInfo.input = worker->inputProtocol;
+    connInfo.output = worker->outputProtocol;
+    connInfo.transport = worker->input;
+    worker->processor = processorFactory_->getProcessor(connInfo);
+    worker->thread = threadFactory.newThread(
+        FunctionRunner::create(std::bind(&TParallelFileProcessor::runWorker, this, worker.get())));
+    workers.push_back(std::move(worker));
+  }
+
+  for (auto& worker : workers) {
+    worker->thread->start();
+  }
+  for (auto& worker : workers) {
+    worker->thread->join();
+  }
+
+  stats_ = TReplayStats();
+  stats_.numChunks = numChunks_;
+  for (auto& worker : workers) {
+    stats_.numEvents += worker->numEvents;
+    stats_.numBytes += worker->numBytes;
+    stats_.numErrors += worker->numErrors;
+    stats_.workerEvents.push_back(worker->numEvents);
+  }
+  stats_.elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - start);
+}
+
+bool TParallelFileProcessor::nextWork(uint32_t* chunk, uint32_t* first, uint32_t* count) {
+  Synchronized s(monitor_);
+  while (!stopped_ && nextChunk_ < numChunks_) {
+    if (ordering_ != UNORDERED) {
+      *chunk = nextChunk_++;
+      *first = 0;
+      *count = (std::numeric_limits<uint32_t>::max)();
+      return true;
+    }
+
+    uint32_t current = nextChunk_;
+    if (!chunkIndexed_) {
+      // index without holding up the other workers
+      monitor_.unlock();
+      auto numEvents = static_cast<uint32_t>(file_->getChunk(current).events->size());
+      monitor_.lock();
+      if (nextChunk_ == current && !chunkIndexed_) {
+        chunkEvents_ = numEvents;
+        chunkIndexed_ = true;
+      }
+      continue;
+    }
+
+    if (nextIndex_ >= chunkEvents_) {
+      nextChunk_++;
+      nextIndex_ = 0;
+      chunkIndexed_ = false;
+      continue;
+    }
+
+    *chunk = current;
+    *first = nextIndex_;
+    *count = (std::min)(batchSize_, chunkEvents_ - nextIndex_);
+    nextIndex_ += *count;
+    return true;
+  }
+  return false;
+}
+
+void TParallelFileProcessor::runWorker(Worker* worker) {
+  uint32_t chunk;
+  uint32_t first;
+  uint32_t count;
+  while (nextWork(&chunk, &first, &count)) {
+    if (ordering_ == STRICT) {
+      // index the chunk, faulting it in, while the chunks before it are processed
+      file_->getChunk(chunk);
+      Synchronized s(monitor_);
+      while (turn_ != chunk && !stopped_) {
+        monitor_.waitForever();
+      }
+      if (stopped_) {
+        return;
+      }
+    }
+
+    processEvents(worker, chunk, first, count);
+
+    if (ordering_ == STRICT) {
+      Synchronized s(monitor_);
+      turn_ = chunk + 1;
+      monitor_.notifyAll();
+    }
+  }
+}
+
+void TParallelFileProcessor::processEvents(Worker* worker,
+                                           uint32_t chunk,
+                                           uint32_t first,
+                                           uint32_t count) {
+  TMappedLogFile::Chunk events = file_->getChunk(chunk);
+  auto end = static_cast<uint32_t>(
+      (std::min)(uint64_t(events.events->size()), uint64_t(first) + count));
+
+  worker->input->seekToChunkEvent(chunk, first);
+  for (uint32_t i = first; i < end; ++i) {
+    uint32_t eventSize;
+    memcpy(&eventSize, events.begin + (*events.events)[i], sizeof(eventSize));
+    try {
+      worker->processor->process(worker->inputProtocol, worker->outputProtocol, nullptr);
+      worker->numEvents++;
+      worker->numBytes += eventSize;
+    } catch (TException& te) {
+      worker->numErrors++;
+      GlobalOutput.printf("TParallelFileProcessor: event %u of chunk %u: %s", i, chunk, te.what());
+      if (stopOnError_) {
+        Synchronized s(monitor_);
+        stopped_ = true;
+        monitor_.notifyAll();
+        return;
+      }
+      // drop whatever is left of the event
+      worker->input->seekToChunkEvent(chunk, i + 1);
+    }
+  }
+}
+}
+}
+} // apache::thrift::transport
@@ -0,0 +1,329 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_TRANSPORT_TMAPPEDFILETRANSPORT_H_
+#define _THRIFT_TRANSPORT_TMAPPEDFILETRANSPORT_H_ 1
+
+#include <thrift/transport/TFileTransport.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <thrift/concurrency/Monitor.h>
+#include <thrift/concurrency/Mutex.h>
+
+namespace apache {
+namespace thrift {
+namespace transport {
+
+/**
+ * Read-only memory mapping of a log written by TFileTransport, together with
+ * an index of the events in each chunk. The index of a chunk is built the
+ * first time the chunk is used and can be saved next to the log, so later
+ * readers can jump to any event without scanning.
+ *
+ * One TMappedLogFile can be shared by any number of
+ * TMappedFileReaderTransport cursors, also across threads.
+ */
+class TMappedLogFile {
+public:
+  class Mapping;
+
+  /**
+   * The events of one chunk. begin points at the start of the chunk in a
+   * mapping that stays valid as long as the Chunk exists, size is the
+   * number of bytes of the chunk mapped there, and events holds the offsets
+   * of the event size headers relative to begin.
+   */
+  struct Chunk {
+    std::shared_ptr<const Mapping> mapping;
+    const uint8_t* begin;
+    uint32_t size;
+    std::shared_ptr<const std::vector<uint32_t> > events;
+    // false while the writer may still append events to this chunk
+    bool complete;
+
+    Chunk() : begin(nullptr), size(0), complete(false) {}
+  };
+
+  // same as the default chunk size of TFileTransport
+  static const uint32_t DEFAULT_CHUNK_SIZE = 16 * 1024 * 1024;
+
+  TMappedLogFile(const std::string& path,
+                 uint32_t chunkSize = DEFAULT_CHUNK_SIZE,
+                 uint32_t maxEventSize = 0);
+  ~TMappedLogFile();
+
+  const std::string& getPath() const { return path_; }
+  uint32_t getChunkSize() const { return chunkSize_; }
+
+  /**
+   * Maps whatever was appended to the file since it was last mapped.
+   * Returns true if the file grew.
+   */
+  bool refresh();
+
+  uint64_t getSize();
+  uint32_t getNumChunks();
+
+  /**
+   * Returns the events of chunk, indexing the chunk if needed.
+   */
+  Chunk getChunk(uint32_t chunk);
+
+  /**
+   * Returns the number of events in the file, indexing all of it.
+   */
+  uint64_t getNumEvents();
+
+  /**
+   * Finds event number event (counting from 0) in the file. Returns false if
+   * the file has fewer events.
+   */
+  bool findEvent(uint64_t event, uint32_t* chunk, uint32_t* index);
+
+  /**
+   * Writes the index of all complete chunks to path.
+   */
+  void saveIndex(const std::string& path);
+
+  /**
+   * Loads an index written by saveIndex(). Returns false, leaving the index
+   * alone, if the file is missing or does not belong to this log.
+   */
+  bool loadIndex(const std::string& path);
+
+private:
+  struct ChunkIndex {
+    std::shared_ptr<const std::vector<uint32_t> > events;
+    // number of mapped bytes the index was built from
+    uint64_t indexedSize;
+    bool complete;
+
+    ChunkIndex() : indexedSize(0), complete(false) {}
+  };
+
+  ChunkIndex indexChunk(const Mapping& mapping, uint32_t chunk) const;
+  uint32_t numChunks(uint64_t size) const;
+
+  std::string path_;
+  uint32_t chunkSize_;
+  uint32_t maxEventSize_;
+  int fd_;
+
+  // guards mapping_ and index_
+  apache::thrift::concurrency::Mutex mutex_;
+  std::shared_ptr<const Mapping> mapping_;
+  std::vector<ChunkIndex> index_;
+};
+
+/**
+ * Reads the events of a TFileTransport log through a TMappedLogFile. It is
+ * a drop-in replacement for TFileTransport as the input of TFileProcessor,
+ * but serves reads straight from the mapping, supports borrow(), and can
+ * position itself on any event.
+ *
+ * Cursors are not thread safe, but cursors sharing a TMappedLogFile can be
+ * used on different threads, e.g. one per chunk.
+ */
+class TMappedFileReaderTransport : public TFileReaderTransport {
+public:
+  TMappedFileReaderTransport(const std::string& path,
+                             std::shared_ptr<TConfiguration> config = nullptr);
+  TMappedFileReaderTransport(std::shared_ptr<TMappedLogFile> file,
+                             std::shared_ptr<TConfiguration> config = nullptr);
+
+  bool isOpen() const override { return true; }
+  bool peek() override;
+
+  uint32_t read(uint8_t* buf, uint32_t len);
+  uint32_t readAll(uint8_t* buf, uint32_t len);
+  const uint8_t* borrow(uint8_t* buf, uint32_t* len);
+  void consume(uint32_t len);
+
+  // log-file specific functions
+  void seekToChunk(int32_t chunk) override;
+  void seekToEnd() override;
+  uint32_t getNumChunks() override { return file_->getNumChunks(); }
+  uint32_t getCurChunk() override { return curChunk_; }
+
+  /**
+   * Positions the cursor on event number event (counting from 0) of the
+   * file. Throws TEOFException if the file has fewer events.
+   */
+  void seekToEvent(uint64_t event);
+
+  /**
+   * Positions the cursor on event number index of chunk.
+   */
+  void seekToChunkEvent(uint32_t chunk, uint32_t index);
+
+  /**
+   * Number of events left in the current chunk, the current event included.
+   */
+  uint32_t getEventsLeftInChunk();
+
+  std::shared_ptr<TMappedLogFile> getFile() { return file_; }
+
+  void setReadTimeout(int32_t readTimeout) override { readTimeout_ = readTimeout; }
+  int32_t getReadTimeout() override { return readTimeout_; }
+
+  void setEofSleepTimeUs(uint32_t eofSleepTime) {
+    if (eofSleepTime) {
+      eofSleepTime_ = eofSleepTime;
+    }
+  }
+  uint32_t getEofSleepTimeUs() { return eofSleepTime_; }
+
+  /*
+   * Override TTransport *_virt() functions to invoke our implementations.
+   * We cannot use TVirtualTransport to provide these, since we need to inherit
+   * virtually from TTransport.
+   */
+  uint32_t read_virt(uint8_t* buf, uint32_t len) override { return this->read(buf, len); }
+  uint32_t readAll_virt(uint8_t* buf, uint32_t len) override { return this->readAll(buf, len); }
+  const uint8_t* borrow_virt(uint8_t* buf, uint32_t* len) override {
+    return this->borrow(buf, len);
+  }
+  void consume_virt(uint32_t len) override { this->consume(len); }
+
+private:
+  void loadChunk(uint32_t chunk);
+  bool nextEvent();
+
+  std::shared_ptr<TMappedLogFile> file_;
+
+  // the chunk being read and the index of the next event in it
+  TMappedLogFile::Chunk chunk_;
+  uint32_t curChunk_;
+  uint32_t nextEvent_;
+
+  // unread part of the current event
+  const uint8_t* eventPtr_;
+  uint32_t eventLeft_;
+  bool haveEvent_;
+
+  int32_t readTimeout_;
+  uint32_t eofSleepTime_;
+  static const uint32_t DEFAULT_EOF_SLEEP_TIME_US = 500 * 1000;
+};
+
+// Throughput of a TParallelFileProcessor::process() run
+struct TReplayStats {
+  uint64_t numEvents;
+  uint64_t numBytes;
+  // events the processor threw on
+  uint64_t numErrors;
+  uint32_t numChunks;
+  std::chrono::microseconds elapsed;
+  // events processed by each worker
+  std::vector<uint64_t> workerEvents;
+
+  TReplayStats() : numEvents(0), numBytes(0), numErrors(0), numChunks(0), elapsed(0) {}
+
+  double eventsPerSecond() const {
+    return elapsed.count() > 0 ? numEvents * 1000000.0 / elapsed.count() : 0.0;
+  }
+  double bytesPerSecond() const {
+    return elapsed.count() > 0 ? numBytes * 1000000.0 / elapsed.count() : 0.0;
+  }
+};
+
+/**
+ * Replays a log with several workers, each with its own processor, from
+ * processorFactory, and its own cursor on file. Unlike TFileProcessor it
+ * always replays the log as it is when process() is called and does not tail.
+ */
+class TParallelFileProcessor {
+public:
+  enum Ordering {
+    // Events are processed one at a time in file order. Workers take turns
+    // per chunk and index their next chunk while waiting for their turn.
+    STRICT,
+    // The events of a chunk are processed in order by one worker, chunks are
+    // processed in parallel.
+    PER_CHUNK,
+    // Events are handed out in batches of getBatchSize() events, so the
+    // workers stay busy even when the chunks differ in size.
+    UNORDERED
+  };
+
+  TParallelFileProcessor(std::shared_ptr<apache::thrift::TProcessorFactory> processorFactory,
+                         std::shared_ptr<TProtocolFactory> protocolFactory,
+                         std::shared_ptr<TMappedLogFile> file,
+                         uint32_t numWorkers,
+                         Ordering ordering = PER_CHUNK);
+
+  void setBatchSize(uint32_t batchSize) {
+    if (batchSize) {
+      batchSize_ = batchSize;
+    }
+  }
+  uint32_t getBatchSize() const { return batchSize_; }
+
+  // Stops at the first event the processor throws on, like TFileProcessor
+  void setStopOnError(bool stopOnError) { stopOnError_ = stopOnError; }
+  bool getStopOnError() const { return stopOnError_; }
+
+  /**
+   * Processes all events of the file and blocks until done.
+   */
+  void process();
+
+  /**
+   * Statistics of the last process() call
+   */
+  const TReplayStats& getStats() const { return stats_; }
+
+private:
+  struct Worker;
+
+  bool nextWork(uint32_t* chunk, uint32_t* first, uint32_t* count);
+  void runWorker(Worker* worker);
+  void processEvents(Worker* worker, uint32_t chunk, uint32_t first, uint32_t count);
+
+  std::shared_ptr<apache::thrift::TProcessorFactory> processorFactory_;
+  std::shared_ptr<TProtocolFactory> protocolFactory_;
+  std::shared_ptr<TMappedLogFile> file_;
+  uint32_t numWorkers_;
+  Ordering ordering_;
+  uint32_t batchSize_;
+  bool stopOnError_;
+  static const uint32_t DEFAULT_BATCH_SIZE = 64;
+
+  // state of a process() run, guarded by monitor_
+  apache::thrift::concurrency::Monitor monitor_;
+  uint32_t numChunks_;
+  // next chunk to hand out and, in UNORDERED order, its next event
+  uint32_t nextChunk_;
+  uint32_t nextIndex_;
+  uint32_t chunkEvents_;
+  bool chunkIndexed_;
+  // chunk whose turn it is in STRICT order
+  uint32_t turn_;
+  bool stopped_;
+  TReplayStats stats_;
+};
+}
+}
+} // apache::thrift::transport
+
+#endif // _THRIFT_TRANSPORT_TMAPPEDFILETRANSPORT_H_
@@ -97,6 +97,7 @@ TNonblockingServerSocket::TNonblockingServerSocket(int port)
     tcpSendBuffer_(0),
     tcpRecvBuffer_(0),
     keepAlive_(false),
+    reusePort_(false),
     listening_(false) {
 }
 
@@ -112,6 +113,7 @@ TNonblockingServerSocket::TNonblockingServerSocket(int port, int sendTimeout, in
     tcpSendBuffer_(0),
     tcpRecvBuffer_(0),
     keepAlive_(false),
+    reusePort_(false),
     listening_(false) {
 }
 
@@ -128,6 +130,7 @@ TNonblockingServerSocket::TNonblockingServerSocket(const string& address, int po
     tcpSendBuffer_(0),
     tcpRecvBuffer_(0),
     keepAlive_(false),
+    reusePort_(false),
     listening_(false) {
 }
 
@@ -144,6 +147,7 @@ TNonblockingServerSocket::TNonblockingServerSocket(const string& path)
     tcpSendBuffer_(0),
     tcpRecvBuffer_(0),
     keepAlive_(false),
+    reusePort_(false),
     listening_(false) {
 }
 
@@ -349,6 +353,23 @@ void TNonblockingServerSocket::_setup_tcp_sockopts() {
   }
 #endif
 
+  if (reusePort_) {
+#ifdef SO_REUSEPORT
+    if (-1 == setsockopt(serverSocket_, SOL_SOCKET, SO_REUSEPORT, cast_sockopt(&one), sizeof(one))) {
+      int errno_copy = THRIFT_GET_SOCKET_ERROR;
+      GlobalOutput.perror("TNonblockingServerSocket::listen() setsockopt() SO_REUSEPORT ", errno_copy);
+      close();
+      throw TTransportException(TTransportException::NOT_OPEN,
+                                "Could not set SO_REUSEPORT",
+                                errno_copy);
+    }
+#else
+    close();
+    throw TTransportException(TTransportException::NOT_OPEN,
+                              "SO_REUSEPORT is not supported on this platform");
+#endif
+  }
+
 } // _setup_tcp_sockopts()
 
 void TNonblockingServerSocket::listen() {
@@ -607,6 +628,33 @@ shared_ptr<TSocket> TNonblockingServerSocket::createSocket(THRIFT_SOCKET clientS
   return std::make_shared<TSocket>(clientSocket);
 }
 
+shared_ptr<TNonblockingServerTransport> TNonblockingServerSocket::listenSibling() {
+  if (!reusePort_ || !listening_ || isUnixDomainSocket()) {
+    return shared_ptr<TNonblockingServerTransport>();
+  }
+
+  // bind the port we actually got, in case we were asked for an ephemeral one
+  shared_ptr<TNonblockingServerSocket> sibling = newSibling(address_, listenPort_);
+  sibling->acceptBacklog_ = acceptBacklog_;
+  sibling->sendTimeout_ = sendTimeout_;
+  sibling->recvTimeout_ = recvTimeout_;
+  sibling->retryLimit_ = retryLimit_;
+  sibling->retryDelay_ = retryDelay_;
+  sibling->tcpSendBuffer_ = tcpSendBuffer_;
+  sibling->tcpRecvBuffer_ = tcpRecvBuffer_;
+  sibling->keepAlive_ = keepAlive_;
+  sibling->reusePort_ = true;
+  sibling->listenCallback_ = listenCallback_;
+  sibling->acceptCallback_ = acceptCallback_;
+  sibling->listen();
+  return sibling;
+}
+
+shared_ptr<TNonblockingServerSocket> TNonblockingServerSocket::newSibling(const string& address,
+                                                                          int port) {
+  return std::make_shared<TNonblockingServerSocket>(address, port);
+}
+
 void TNonblockingServerSocket::close() {
   if (serverSocket_ != THRIFT_INVALID_SOCKET) {
     shutdown(serverSocket_, THRIFT_SHUT_RDWR);
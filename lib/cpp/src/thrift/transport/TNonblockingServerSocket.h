@@ -85,6 +85,13 @@ public:
 
   void setKeepAlive(bool keepAlive) { keepAlive_ = keepAlive; }
 
+  /**
+   * Sets SO_REUSEPORT on the listening socket so that listenSibling() can
+   * open more sockets on the same port. Not supported for unix sockets, or
+   * on platforms without SO_REUSEPORT.
+   */
+  void setReusePort(bool reusePort) { reusePort_ = reusePort; }
+
   void setTcpSendBuffer(int tcpSendBuffer);
   void setTcpRecvBuffer(int tcpRecvBuffer);
 
@@ -112,10 +119,19 @@ public:
   void listen() override;
   void close() override;
 
+  std::shared_ptr<TNonblockingServerTransport> listenSibling() override;
+
 protected:
   std::shared_ptr<TSocket> acceptImpl() override;
   virtual std::shared_ptr<TSocket> createSocket(THRIFT_SOCKET client);
 
+  /**
+   * Creates an unopened server socket of the same kind as this one, for
+   * listenSibling(). Subclasses that change how clients are accepted
+   * override this.
+   */
+  virtual std::shared_ptr<TNonblockingServerSocket> newSibling(const std::string& address, int port);
+
 private:
   void _setup_sockopts();
   void _setup_unixdomain_sockopts();
@@ -134,6 +150,7 @@ private:
   int tcpSendBuffer_;
   int tcpRecvBuffer_;
   bool keepAlive_;
+  bool reusePort_;
   bool listening_;
 
   socket_func_t listenCallback_;
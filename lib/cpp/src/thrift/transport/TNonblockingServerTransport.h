@@ -76,6 +76,17 @@ public:
 
   virtual int getListenPort() = 0;
 
+  /**
+   * Opens another listening transport bound to the same address as this one,
+   * so that several threads can each accept connections on their own socket
+   * and let the kernel balance between them (SO_REUSEPORT). Must be called
+   * after listen().
+   *
+   * @return the new, listening transport, or nullptr if this transport cannot
+   * share its address.
+   */
+  virtual std::shared_ptr<TNonblockingServerTransport> listenSibling() { return nullptr; }
+
   /**
    * Closes this transport such that future calls to accept will do nothing.
    */
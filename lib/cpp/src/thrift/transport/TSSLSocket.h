@@ -81,6 +81,8 @@ public:
   uint32_t read(uint8_t* buf, uint32_t len) override;
   void write(const uint8_t* buf, uint32_t len) override;
   uint32_t write_partial(const uint8_t* buf, uint32_t len) override;
+  // each buffer goes through SSL_write on its own
+  void writev(const TIoVec* iov, uint32_t count) override { TTransport::writev(iov, count); }
   void flush() override;
   /**
   * Set whether to use client or server side SSL handshake protocol.
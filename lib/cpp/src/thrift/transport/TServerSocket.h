@@ -114,12 +114,14 @@ public:
 
   // When enabled (the default), new children TSockets will be constructed so
   // they can be interrupted by TServerTransport::interruptChildren().
-  // This is more expensive in terms of system calls (poll + recv) however
-  // ensures a connected client cannot interfere with TServer::stop().
+  // Children first try a non-blocking recv and only poll() the socket and
+  // the interrupt when no data is ready, so reads cost an extra poll() only
+  // when they would wait. This ensures a connected client cannot interfere
+  // with TServer::stop().
   //
-  // When disabled, TSocket children do not incur an additional poll() call.
-  // Server-side reads are more efficient, however a client can interfere with
-  // the server's ability to shutdown properly by staying connected.
+  // When disabled, TSocket children never poll(); blocking reads are a
+  // single recv(), however a client can interfere with the server's ability
+  // to shutdown properly by staying connected.
   //
   // Must be called before listen(); mode cannot be switched after that.
   // \throws std::logic_error if listen() has been called
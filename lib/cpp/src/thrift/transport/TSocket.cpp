@@ -30,6 +30,9 @@
 #ifdef HAVE_SYS_SOCKET_H
 #include <sys/socket.h>
 #endif
+#ifdef HAVE_SYS_UIO_H
+#include <sys/uio.h>
+#endif
 #ifdef HAVE_SYS_UN_H
 #include <sys/un.h>
 #endif
@@ -211,7 +214,17 @@ bool TSocket::peek() {
   if (!isOpen()) {
     return false;
   }
+  uint8_t buf;
+  int r = -1;
   if (interruptListener_) {
+#ifdef MSG_DONTWAIT
+    // Look first, so that a socket with data ready costs a single recv(),
+    // and poll for the interrupt only when there is nothing to see
+    r = static_cast<int>(recv(socket_, cast_sockopt(&buf), 1, MSG_PEEK | MSG_DONTWAIT));
+    if (r >= 0) {
+      return (r > 0);
+    }
+#endif
     for (int retries = 0;;) {
       struct THRIFT_POLLFD fds[2];
       std::memset(fds, 0, sizeof(fds));
@@ -243,8 +256,7 @@ bool TSocket::peek() {
   }
 
   // Check to see if data is available or if the remote side closed
-  uint8_t buf;
-  int r = static_cast<int>(recv(socket_, cast_sockopt(&buf), 1, MSG_PEEK));
+  r = static_cast<int>(recv(socket_, cast_sockopt(&buf), 1, MSG_PEEK));
   if (r == -1) {
     int errno_copy = THRIFT_GET_SOCKET_ERROR;
 #if defined __FreeBSD__ || defined __MACH__
@@ -545,8 +557,19 @@ try_again:
   }
 
   int got = 0;
+  bool received = false;
 
+#ifdef MSG_DONTWAIT
   if (interruptListener_) {
+    // Try the read first, so that a socket with data ready costs a single
+    // recv(), and poll for the interrupt only when the read would block.
+    // Data already received is therefore still read after an interrupt.
+    got = static_cast<int>(recv(socket_, cast_sockopt(buf), len, MSG_DONTWAIT));
+    received = (got >= 0 || THRIFT_GET_SOCKET_ERROR != THRIFT_EAGAIN);
+  }
+#endif
+
+  if (interruptListener_ && !received) {
     struct THRIFT_POLLFD fds[2];
     std::memset(fds, 0, sizeof(fds));
     fds[0].fd = socket_;
@@ -576,7 +599,9 @@ try_again:
     // falling through means there is something to recv and it cannot block
   }
 
-  got = static_cast<int>(recv(socket_, cast_sockopt(buf), len, 0));
+  if (!received) {
+    got = static_cast<int>(recv(socket_, cast_sockopt(buf), len, 0));
+  }
   // THRIFT_GETTIMEOFDAY can change THRIFT_GET_SOCKET_ERROR
   int errno_copy = THRIFT_GET_SOCKET_ERROR;
 
@@ -690,6 +715,76 @@ uint32_t TSocket::write_partial(const uint8_t* buf, uint32_t len) {
   return b;
 }
 
+void TSocket::writev(const TIoVec* iov, uint32_t count) {
+#ifdef HAVE_SYS_UIO_H
+  if (socket_ == THRIFT_INVALID_SOCKET) {
+    throw TTransportException(TTransportException::NOT_OPEN, "Called write on non-open socket");
+  }
+
+  int flags = 0;
+#ifdef MSG_NOSIGNAL
+  flags |= MSG_NOSIGNAL;
+#endif // ifdef MSG_NOSIGNAL
+
+  // iov[next] is the first buffer not yet completely sent
+  static const uint32_t MAX_IOV = 64;
+  struct iovec vec[MAX_IOV];
+  uint32_t next = 0;
+  uint32_t offset = 0;
+
+  while (true) {
+    int n = 0;
+    for (uint32_t i = next; i < count && n < static_cast<int>(MAX_IOV); i++) {
+      uint32_t skip = (i == next) ? offset : 0;
+      if (iov[i].size > skip) {
+        vec[n].iov_base = const_cast<uint8_t*>(iov[i].data) + skip;
+        vec[n].iov_len = iov[i].size - skip;
+        n++;
+      }
+    }
+    if (n == 0) {
+      return;
+    }
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = vec;
+    msg.msg_iovlen = n;
+    ssize_t b = sendmsg(socket_, &msg, flags);
+
+    if (b < 0) {
+      int errno_copy = THRIFT_GET_SOCKET_ERROR;
+      if (errno_copy == THRIFT_EWOULDBLOCK || errno_copy == THRIFT_EAGAIN) {
+        // This should only happen if the timeout set with SO_SNDTIMEO expired.
+        throw TTransportException(TTransportException::TIMED_OUT, "send timeout expired");
+      }
+      GlobalOutput.perror("TSocket::writev() sendmsg() " + getSocketInfo(), errno_copy);
+
+      if (errno_copy == THRIFT_EPIPE || errno_copy == THRIFT_ECONNRESET
+          || errno_copy == THRIFT_ENOTCONN) {
+        throw TTransportException(TTransportException::NOT_OPEN, "writev() sendmsg()", errno_copy);
+      }
+
+      throw TTransportException(TTransportException::UNKNOWN, "writev() sendmsg()", errno_copy);
+    }
+    if (b == 0) {
+      throw TTransportException(TTransportException::NOT_OPEN, "Socket send returned 0.");
+    }
+
+    // skip past what was sent
+    auto sent = static_cast<size_t>(b);
+    while (next < count && sent >= iov[next].size - offset) {
+      sent -= iov[next].size - offset;
+      offset = 0;
+      next++;
+    }
+    offset += static_cast<uint32_t>(sent);
+  }
+#else
+  TTransport::writev(iov, count);
+#endif
+}
+
 std::string TSocket::getHost() const {
   return host_;
 }
@@ -136,6 +136,12 @@ public:
    */
   virtual uint32_t write_partial(const uint8_t* buf, uint32_t len);
 
+  /**
+   * Writes all the buffers to the underlying socket, handing as many as
+   * possible to each sendmsg().  Loops until done or fail.
+   */
+  void writev(const TIoVec* iov, uint32_t count) override;
+
   /**
    * Get the host that the socket is connected to
    *
@@ -329,7 +335,9 @@ protected:
 
   /**
    * A shared socket pointer that will interrupt a blocking read if data
-   * becomes available on it
+   * becomes available on it. Reads are only interrupted once no more data
+   * is ready on the socket, as the listener is polled only when a read
+   * would otherwise block.
    */
   std::shared_ptr<THRIFT_SOCKET> interruptListener_;
 
@@ -22,6 +22,7 @@
 
 #include <thrift/Thrift.h>
 #include <thrift/TConfiguration.h>
+#include <thrift/TSlice.h>
 #include <thrift/transport/TTransportException.h>
 #include <memory>
 #include <string>
@@ -49,6 +50,14 @@ uint32_t readAll(Transport_& trans, uint8_t* buf, uint32_t len) {
   return have;
 }
 
+/**
+ * One buffer of a gathered write, in the manner of struct iovec.
+ */
+struct TIoVec {
+  const uint8_t* data;
+  uint32_t size;
+};
+
 /**
  * Generic interface for a method of transporting data. A TTransport may be
  * capable of either reading or writing, but not necessarily both.
@@ -238,6 +247,49 @@ public:
     throw TTransportException(TTransportException::NOT_OPEN, "Base TTransport cannot consume.");
   }
 
+  /**
+   * Reads exactly \c len bytes as a slice. Transports that hold a whole frame
+   * in memory return a slice sharing the frame instead of copying out of it.
+   * By default the bytes are read into a newly allocated buffer.
+   *
+   * @param len  How many bytes to read
+   * @return The bytes read
+   * @throws TTransportException If insufficient data was read
+   */
+  virtual TSlice readSlice(uint32_t len) {
+    if (len == 0) {
+      return TSlice();
+    }
+    std::shared_ptr<uint8_t> buf(new uint8_t[len], std::default_delete<uint8_t[]>());
+    readAll(buf.get(), len);
+    return TSlice(std::move(buf), len);
+  }
+
+  /**
+   * Writes the contents of a slice. Transports that buffer output until
+   * flush() may hold on to a large slice rather than copy it.
+   *
+   * @param slice  The data to write out
+   * @throws TTransportException if an error occurs
+   */
+  virtual void writeSlice(const TSlice& slice) {
+    write(slice.data(), static_cast<uint32_t>(slice.size()));
+  }
+
+  /**
+   * Writes several buffers in order, as if each was passed to write().
+   * Transports that can hand all of them to the OS at once override this.
+   *
+   * @param iov    The buffers to write out
+   * @param count  Number of buffers
+   * @throws TTransportException if an error occurs
+   */
+  virtual void writev(const TIoVec* iov, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+      write(iov[i].data, iov[i].size);
+    }
+  }
+
   /**
    * Returns the origin of the transports call. The value depends on the
    * transport used. An IP based transport for example will return the
@@ -0,0 +1,73 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_TRANSPORT_TWEBSOCKETCOMPRESSION_H_
+#define _THRIFT_TRANSPORT_TWEBSOCKETCOMPRESSION_H_ 1
+
+#include <functional>
+#include <memory>
+#include <string>
+
+#include <thrift/transport/TBufferTransports.h>
+
+namespace apache {
+namespace thrift {
+namespace transport {
+
+/**
+ * Per-message compression extension for TWebSocketServer (RFC 7692).
+ *
+ * One instance serves exactly one connection, since the extension may keep
+ * the compression context alive from one message to the next. The zlib
+ * backed permessage-deflate implementation lives in libthriftz, see
+ * TWebSocketDeflate.
+ */
+class TWebSocketCompression {
+public:
+  virtual ~TWebSocketCompression() = default;
+
+  /**
+   * Picks one of the offers of a Sec-WebSocket-Extensions request header.
+   *
+   * @return the Sec-WebSocket-Extensions response header value, or an empty
+   *         string if none of the offers is acceptable.
+   */
+  virtual std::string negotiate(const std::string& offers) = 0;
+
+  /**
+   * Decompresses all readable bytes of in and appends them to out.
+   * Throws if the decompressed message would grow beyond maxSize.
+   */
+  virtual void decompress(TMemoryBuffer& in, TMemoryBuffer& out, uint32_t maxSize) = 0;
+
+  /**
+   * Compresses all readable bytes of in and appends them to out.
+   */
+  virtual void compress(TMemoryBuffer& in, TMemoryBuffer& out) = 0;
+};
+
+/**
+ * Creates the compression extension of a new connection.
+ */
+using TWebSocketCompressionFactory = std::function<std::shared_ptr<TWebSocketCompression>()>;
+}
+}
+} // apache::thrift::transport
+
+#endif // #ifndef _THRIFT_TRANSPORT_TWEBSOCKETCOMPRESSION_H_
@@ -0,0 +1,255 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <thrift/transport/TWebSocketDeflate.h>
+#include <thrift/transport/TZlibTransport.h>
+
+using std::string;
+
+namespace apache {
+namespace thrift {
+namespace transport {
+
+namespace {
+
+// Every message ends in an empty stored block which is not sent on the wire
+const uint8_t EMPTY_BLOCK[] = {0x00, 0x00, 0xff, 0xff};
+
+const char* const EXTENSION = "permessage-deflate";
+
+string trim(const string& s) {
+  const char* whitespace = " \t\r\n";
+  size_t first = s.find_first_not_of(whitespace);
+  if (first == string::npos) {
+    return string();
+  }
+  size_t last = s.find_last_not_of(whitespace);
+  return s.substr(first, last - first + 1);
+}
+
+std::vector<string> split(const string& s, char separator) {
+  std::vector<string> parts;
+  size_t begin = 0;
+  for (;;) {
+    size_t end = s.find(separator, begin);
+    parts.push_back(trim(s.substr(begin, end - begin)));
+    if (end == string::npos) {
+      return parts;
+    }
+    begin = end + 1;
+  }
+}
+
+// Parses the window size of a max_window_bits parameter, 0 if invalid
+int parseWindowBits(string value) {
+  if (value.size() >= 2 && value.front() == '"' && value.back() == '"') {
+    value = value.substr(1, value.size() - 2);
+  }
+  if (value.empty() || value.size() > 2
+      || value.find_first_not_of("0123456789") != string::npos) {
+    return 0;
+  }
+  int bits = atoi(value.c_str());
+  return bits >= 8 && bits <= 15 ? bits : 0;
+}
+}
+
+TWebSocketDeflate::TWebSocketDeflate(int level)
+  : level_(level),
+    noContextTakeover_(false),
+    windowBits_(MAX_WBITS),
+    rstream_(nullptr),
+    wstream_(nullptr) {
+}
+
+TWebSocketDeflate::~TWebSocketDeflate() {
+  end();
+}
+
+void TWebSocketDeflate::end() {
+  if (rstream_ != nullptr) {
+    inflateEnd(rstream_);
+    delete rstream_;
+    rstream_ = nullptr;
+  }
+  if (wstream_ != nullptr) {
+    deflateEnd(wstream_);
+    delete wstream_;
+    wstream_ = nullptr;
+  }
+}
+
+string TWebSocketDeflate::negotiate(const string& offers) {
+  end();
+  for (const string& offer : split(offers, ',')) {
+    if (!accept(offer)) {
+      continue;
+    }
+
+    rstream_ = new z_stream();
+    int rv = inflateInit2(rstream_, -MAX_WBITS);
+    if (rv != Z_OK) {
+      end();
+      throw TZlibTransportException(rv, nullptr);
+    }
+    wstream_ = new z_stream();
+    // zlib cannot produce raw streams with a 256 byte window, accept()
+    // turned such offers down.
+    rv = deflateInit2(wstream_, level_, Z_DEFLATED, -windowBits_, 8, Z_DEFAULT_STRATEGY);
+    if (rv != Z_OK) {
+      end();
+      throw TZlibTransportException(rv, nullptr);
+    }
+
+    string response = EXTENSION;
+    if (noContextTakeover_) {
+      response += "; server_no_context_takeover";
+    }
+    if (windowBits_ != MAX_WBITS) {
+      response += "; server_max_window_bits=" + std::to_string(windowBits_);
+    }
+    return response;
+  }
+  return string();
+}
+
+bool TWebSocketDeflate::accept(const string& offer) {
+  std::vector<string> params = split(offer, ';');
+  if (params[0] != EXTENSION) {
+    return false;
+  }
+
+  noContextTakeover_ = false;
+  windowBits_ = MAX_WBITS;
+  bool clientNoContextTakeover = false;
+  bool clientMaxWindowBits = false;
+  bool serverMaxWindowBits = false;
+
+  for (size_t i = 1; i < params.size(); i++) {
+    size_t equals = params[i].find('=');
+    string name = trim(params[i].substr(0, equals));
+    string value = equals == string::npos ? string() : trim(params[i].substr(equals + 1));
+    bool hasValue = equals != string::npos;
+
+    // Parameters must not repeat
+    if (name == "server_no_context_takeover" && !hasValue && !noContextTakeover_) {
+      noContextTakeover_ = true;
+    } else if (name == "client_no_context_takeover" && !hasValue && !clientNoContextTakeover) {
+      // Our inflater copes whether or not the client resets its context.
+      clientNoContextTakeover = true;
+    } else if (name == "server_max_window_bits" && !serverMaxWindowBits) {
+      windowBits_ = parseWindowBits(value);
+      if (windowBits_ < 9) {
+        return false;
+      }
+      serverMaxWindowBits = true;
+    } else if (name == "client_max_window_bits" && !clientMaxWindowBits) {
+      // Our inflater uses the largest window, so any client window will do.
+      if (hasValue && parseWindowBits(value) == 0) {
+        return false;
+      }
+      clientMaxWindowBits = true;
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+void TWebSocketDeflate::decompress(TMemoryBuffer& in, TMemoryBuffer& out, uint32_t maxSize) {
+  if (rstream_ == nullptr) {
+    throw TTransportException(TTransportException::BAD_ARGS, "permessage-deflate not negotiated");
+  }
+
+  uint32_t size = in.available_read();
+  const uint8_t* data = in.borrow(nullptr, &size);
+
+  const uint8_t* inputs[] = {data, EMPTY_BLOCK};
+  const uint32_t sizes[] = {size, sizeof(EMPTY_BLOCK)};
+  for (int part = 0; part < 2; part++) {
+    rstream_->next_in = const_cast<Bytef*>(inputs[part]);
+    rstream_->avail_in = sizes[part];
+    do {
+      uint32_t room = (std::max)(out.available_write(), (std::max)(sizes[part] * 2, 4096u));
+      uint8_t* dst = out.getWritePtr(room);
+      rstream_->next_out = dst;
+      rstream_->avail_out = room;
+      int rv = inflate(rstream_, Z_SYNC_FLUSH);
+      out.wroteBytes(room - rstream_->avail_out);
+      if (out.available_read() > maxSize) {
+        throw TTransportException(TTransportException::END_OF_FILE, "MaxMessageSize reached");
+      }
+      if (rv == Z_STREAM_END) {
+        // The sender closed its stream, the next message starts a new one.
+        inflateReset(rstream_);
+        in.consume(size);
+        return;
+      }
+      if (rv == Z_BUF_ERROR) {
+        break;
+      }
+      if (rv != Z_OK) {
+        throw TZlibTransportException(rv, rstream_->msg);
+      }
+    } while (rstream_->avail_in > 0 || rstream_->avail_out == 0);
+  }
+  in.consume(size);
+}
+
+void TWebSocketDeflate::compress(TMemoryBuffer& in, TMemoryBuffer& out) {
+  if (wstream_ == nullptr) {
+    throw TTransportException(TTransportException::BAD_ARGS, "permessage-deflate not negotiated");
+  }
+
+  uint32_t size = in.available_read();
+  const uint8_t* data = in.borrow(nullptr, &size);
+  wstream_->next_in = const_cast<Bytef*>(data);
+  wstream_->avail_in = size;
+
+  // The trailing EMPTY_BLOCK is kept behind the committed bytes of out, so
+  // it is dropped without copying the message again.
+  uint32_t pending = 0;
+  do {
+    auto room = static_cast<uint32_t>(deflateBound(wstream_, wstream_->avail_in)) + 16;
+    uint8_t* dst = out.getWritePtr(pending + room);
+    wstream_->next_out = dst + pending;
+    wstream_->avail_out = room;
+    int rv = deflate(wstream_, Z_SYNC_FLUSH);
+    if (rv != Z_OK && rv != Z_BUF_ERROR) {
+      throw TZlibTransportException(rv, wstream_->msg);
+    }
+    uint32_t total = pending + room - wstream_->avail_out;
+    uint32_t commit = total > sizeof(EMPTY_BLOCK) ? total - sizeof(EMPTY_BLOCK) : 0;
+    out.wroteBytes(commit);
+    pending = total - commit;
+  } while (wstream_->avail_out == 0);
+
+  in.consume(size);
+  if (noContextTakeover_) {
+    deflateReset(wstream_);
+  }
+}
+}
+}
+} // apache::thrift::transport
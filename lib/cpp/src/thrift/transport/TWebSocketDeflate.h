@@ -0,0 +1,68 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_TRANSPORT_TWEBSOCKETDEFLATE_H_
+#define _THRIFT_TRANSPORT_TWEBSOCKETDEFLATE_H_ 1
+
+#include <thrift/transport/TWebSocketCompression.h>
+
+struct z_stream_s;
+
+namespace apache {
+namespace thrift {
+namespace transport {
+
+/**
+ * The permessage-deflate extension of RFC 7692, backed by zlib.
+ *
+ * Accepts the first offer whose parameters it can honour. Both directions
+ * keep their sliding window across messages unless the client asks for
+ * server_no_context_takeover.
+ */
+class TWebSocketDeflate : public TWebSocketCompression {
+public:
+  /**
+   * @param level zlib compression level of outgoing messages, -1 uses the
+   *        zlib default.
+   */
+  explicit TWebSocketDeflate(int level = -1);
+
+  ~TWebSocketDeflate() override;
+
+  std::string negotiate(const std::string& offers) override;
+
+  void decompress(TMemoryBuffer& in, TMemoryBuffer& out, uint32_t maxSize) override;
+
+  void compress(TMemoryBuffer& in, TMemoryBuffer& out) override;
+
+private:
+  bool accept(const std::string& offer);
+  void end();
+
+  int level_;
+  bool noContextTakeover_;
+  int windowBits_;
+  struct z_stream_s* rstream_;
+  struct z_stream_s* wstream_;
+};
+}
+}
+} // apache::thrift::transport
+
+#endif // #ifndef _THRIFT_TRANSPORT_TWEBSOCKETDEFLATE_H_
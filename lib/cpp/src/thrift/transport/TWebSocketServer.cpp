@@ -17,6 +17,7 @@
  * under the License.
  */
 
+#include <cstring>
 #include <functional>
 #include <memory>
 #include <string>
@@ -25,6 +26,11 @@
 #include <openssl/evp.h>
 
 #include <thrift/Thrift.h>
+#include <thrift/transport/TWebSocketServer.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 using std::string;
 
@@ -47,6 +53,34 @@ std::string base64Encode(unsigned char* data, int length) {
   length = BIO_get_mem_data(dest, &encoded);
   return std::string(encoded, length);
 }
+
+void unmaskWebSocketPayload(uint8_t* data, uint32_t length, const uint8_t* mask) {
+  // The key repeats every 4 bytes, so a wider key is just the key repeated.
+  uint32_t mask32;
+  memcpy(&mask32, mask, 4);
+  uint64_t mask64 = (static_cast<uint64_t>(mask32) << 32) | mask32;
+  uint32_t i = 0;
+
+#if defined(__SSE2__)
+  const __m128i mask128 = _mm_set1_epi32(static_cast<int>(mask32));
+  for (; i + 16 <= length; i += 16) {
+    auto* p = reinterpret_cast<__m128i*>(data + i);
+    _mm_storeu_si128(p, _mm_xor_si128(_mm_loadu_si128(p), mask128));
+  }
+#endif
+
+  for (; i + 8 <= length; i += 8) {
+    uint64_t word;
+    memcpy(&word, data + i, 8);
+    word ^= mask64;
+    memcpy(data + i, &word, 8);
+  }
+
+  // The tail is shorter than a word
+  for (; i < length; i++) {
+    data[i] ^= mask[i & 3];
+  }
+}
 } // namespace transport
 } // namespace thrift
 } // namespace apache
@@ -30,6 +30,7 @@
 #include <thrift/protocol/TProtocol.h>
 #include <thrift/transport/TSocket.h>
 #include <thrift/transport/THttpServer.h>
+#include <thrift/transport/TWebSocketCompression.h>
 #if defined(_MSC_VER) || defined(__MINGW32__)
 #include <Shlwapi.h>
 #define THRIFT_strncasecmp(str1, str2, len) _strnicmp(str1, str2, len)
@@ -38,9 +39,6 @@
 #define THRIFT_strncasecmp(str1, str2, len) strncasecmp(str1, str2, len)
 #define THRIFT_strcasestr(haystack, needle) strcasestr(haystack, needle)
 #endif
-#if defined(__CYGWIN__)
-#include <alloca.h>
-#endif
 
 using std::string;
 
@@ -50,11 +48,24 @@ namespace transport {
 
 std::string base64Encode(unsigned char* data, int length);
 
+/**
+ * XORs length bytes of a client frame payload with the 4 byte masking key,
+ * in place and a machine word (or SIMD register) at a time.
+ */
+void unmaskWebSocketPayload(uint8_t* data, uint32_t length, const uint8_t* mask);
+
 template <bool binary>
 class TWebSocketServer : public THttpServer {
 public:
-  TWebSocketServer(std::shared_ptr<TTransport> transport, std::shared_ptr<TConfiguration> config = nullptr)
-    : THttpServer(transport, config) {
+  /**
+   * @param compression optional per-message compression extension, used when
+   *        the client offers it during the handshake. Must not be shared with
+   *        other connections.
+   */
+  TWebSocketServer(std::shared_ptr<TTransport> transport,
+                   std::shared_ptr<TConfiguration> config = nullptr,
+                   std::shared_ptr<TWebSocketCompression> compression = nullptr)
+    : THttpServer(transport, config), compression_(compression), compressing_(false) {
       resetHandshake();
   }
 
@@ -72,38 +83,45 @@ public:
         return 0;
       }
       // Otherwise, send back the 101 response.
+      negotiateExtensions();
       THttpServer::flush();
     }
 
-    uint32_t want = len;
-    auto have = readBuffer_.available_read();
-
-    // If we have some data in the buffer, copy it out and return it.
-    // We have to return it without attempting to read more, since we aren't
-    // guaranteed that the underlying transport actually has more data, so
-    // attempting to read from it could block.
-    if (have > 0 && have >= want) {
-      return readBuffer_.read(buf, want);
-    }
-
-    // Read another frame.
-    if (!readFrame()) {
-      // EOF.  No frame available.
-      return 0;
+    // Whole messages are reassembled in readBuffer_. We only go back to the
+    // wire if nothing has been handed out yet: the next message may not come
+    // before this one is answered, so short reads end at message boundaries.
+    uint32_t have = 0;
+    while (have < len) {
+      if (readBuffer_.available_read() == 0) {
+        if (have > 0 || !readMessage()) {
+          // EOF, or the end of the message.
+          break;
+        }
+      }
+      have += readBuffer_.read(buf + have, len - have);
     }
-
-    // Hand over whatever we have.
-    uint32_t give = (std::min)(want, readBuffer_.available_read());
-    return readBuffer_.read(buf, give);
+    return have;
   }
 
   void flush() override {
     resetConsumedMessageSize();
-    writeFrameHeader();
+    TMemoryBuffer* message = &writeBuffer_;
+    if (compressing_) {
+      compressBuffer_.resetBuffer();
+      compression_->compress(writeBuffer_, compressBuffer_);
+      message = &compressBuffer_;
+    }
     uint8_t* buffer;
     uint32_t length;
-    writeBuffer_.getBuffer(&buffer, &length);
-    transport_->write(buffer, length);
+    message->getBuffer(&buffer, &length);
+
+    uint8_t header[MAX_HEADER_SIZE];
+    TIoVec iov[2];
+    iov[0].data = header;
+    iov[0].size = writeFrameHeader(header, dataOpcode(), length, compressing_);
+    iov[1].data = buffer;
+    iov[1].size = length;
+    transport_->writev(iov, 2);
     transport_->flush();
     writeBuffer_.resetBuffer();
   }
@@ -114,7 +132,11 @@ protected:
     std::ostringstream h;
     h << "HTTP/1.1 101 Switching Protocols" << CRLF << "Server: Thrift/" << PACKAGE_VERSION << CRLF
       << "Upgrade: websocket" << CRLF << "Connection: Upgrade" << CRLF
-      << "Sec-WebSocket-Accept: " << acceptKey_ << CRLF << CRLF;
+      << "Sec-WebSocket-Accept: " << acceptKey_ << CRLF;
+    if (!extensionResponse_.empty()) {
+      h << "Sec-WebSocket-Extensions: " << extensionResponse_ << CRLF;
+    }
+    h << CRLF;
     return h.str();
   }
 
@@ -145,6 +167,12 @@ protected:
       if (THRIFT_strcasestr(value, "13") != nullptr) {
         secWebSocketVersion_ = true;
       }
+    } else if (THRIFT_strncasecmp(header, "Sec-WebSocket-Extensions", sz) == 0) {
+      // The header may be repeated, which is the same as one comma separated list.
+      if (!extensionOffers_.empty()) {
+        extensionOffers_ += ',';
+      }
+      extensionOffers_ += value;
     }
   }
 
@@ -198,10 +226,22 @@ private:
     Pong = 0xA
   };
 
+  // 2 bytes of flags and length plus up to 8 bytes of extended length.
+  constexpr static const uint32_t MAX_HEADER_SIZE = 10;
+  // Control frames must not be fragmented and carry at most 125 bytes.
+  constexpr static const uint32_t MAX_CONTROL_PAYLOAD = 125;
+
+  static Opcode dataOpcode() { return binary ? Opcode::Binary : Opcode::Text; }
+
   void failConnection(CloseCode reason) {
-    writeFrameHeader(Opcode::Close);
-    auto buffer = htons(static_cast<uint16_t>(reason));
-    transport_->write(reinterpret_cast<const uint8_t*>(&buffer), 2);
+    uint8_t header[MAX_HEADER_SIZE];
+    auto code = htons(static_cast<uint16_t>(reason));
+    TIoVec iov[2];
+    iov[0].data = header;
+    iov[0].size = writeFrameHeader(header, Opcode::Close, 2, false);
+    iov[1].data = reinterpret_cast<const uint8_t*>(&code);
+    iov[1].size = 2;
+    transport_->writev(iov, 2);
     transport_->flush();
     transport_->close();
   }
@@ -210,115 +250,193 @@ private:
     return upgrade_ && connection_ && secWebSocketKey_ && secWebSocketVersion_;
   }
 
-  void pong() {
-    writeFrameHeader(Opcode::Pong);
-    uint8_t* buffer;
-    uint32_t size;
-    readBuffer_.getBuffer(&buffer, &size);
-    transport_->write(buffer, size);
-    transport_->flush();
-  }
-
-  bool readFrame() {
-    uint8_t headerBuffer[8];
-
-    auto read = transport_->read(headerBuffer, 2);
-    if (read < 2) {
-      return false;
-    }
-    // Since Thrift has its own message end marker and we read frame by frame,
-    // it doesn't really matter if the frame is marked as FIN.
-    // Capture it only for debugging only.
-    auto fin = (headerBuffer[0] & 0x80) != 0;
-    THRIFT_UNUSED_VARIABLE(fin);
-
-    // RSV1, RSV2, RSV3
-    if ((headerBuffer[0] & 0x70) != 0) {
-      failConnection(CloseCode::ProtocolError);
-      throw TTransportException(TTransportException::CORRUPTED_DATA,
-                                "Reserved bits must be zeroes");
+  void negotiateExtensions() {
+    extensionResponse_.clear();
+    if (compression_ && !extensionOffers_.empty()) {
+      extensionResponse_ = compression_->negotiate(extensionOffers_);
     }
+    compressing_ = !extensionResponse_.empty();
+  }
 
-    auto opcode = (Opcode)(headerBuffer[0] & 0x0F);
+  void pong(const uint8_t* payload, uint32_t length) {
+    uint8_t header[MAX_HEADER_SIZE];
+    TIoVec iov[2];
+    iov[0].data = header;
+    iov[0].size = writeFrameHeader(header, Opcode::Pong, length, false);
+    iov[1].data = payload;
+    iov[1].size = length;
+    transport_->writev(iov, 2);
+    transport_->flush();
+  }
 
-    // Mask
-    if ((headerBuffer[1] & 0x80) == 0) {
-      failConnection(CloseCode::ProtocolError);
-      throw TTransportException(TTransportException::CORRUPTED_DATA,
-                                "Messages from the client must be masked");
+  // Reads until len bytes arrived, returns false on EOF.
+  bool readFully(uint8_t* buf, uint32_t len) {
+    uint32_t have = 0;
+    // Frames sent right behind the handshake may already sit in httpBuf_
+    if (httpPos_ < httpBufLen_) {
+      have = (std::min)(len, httpBufLen_ - httpPos_);
+      memcpy(buf, httpBuf_ + httpPos_, have);
+      httpPos_ += have;
     }
-
-    // Read the length
-    uint64_t payloadLength = headerBuffer[1] & 0x7F;
-    if (payloadLength == 126) {
-      read = transport_->read(headerBuffer, 2);
-      if (read < 2) {
+    while (have < len) {
+      uint32_t got = transport_->read(buf + have, len - have);
+      if (got == 0) {
         return false;
       }
-      payloadLength = ntohs(*reinterpret_cast<uint16_t*>(headerBuffer));
-    } else if (payloadLength == 127) {
-      read = transport_->read(headerBuffer, 8);
-      if (read < 8) {
+      have += got;
+    }
+    return true;
+  }
+
+  /**
+   * Reads frames until the last fragment of a data message arrived. Each
+   * payload is read straight to its place behind the previous fragments and
+   * unmasked there, so the message is reassembled without extra copies.
+   * Control frames may come in between fragments and are answered right away.
+   */
+  bool readMessage() {
+    readBuffer_.resetBuffer();
+    TMemoryBuffer* message = &readBuffer_;
+    bool started = false;
+    bool compressed = false;
+
+    for (;;) {
+      uint8_t headerBuffer[8];
+      if (!readFully(headerBuffer, 2)) {
         return false;
       }
-      payloadLength = THRIFT_ntohll(*reinterpret_cast<uint64_t*>(headerBuffer));
-      if ((payloadLength & 0x8000000000000000) != 0) {
+      auto fin = (headerBuffer[0] & 0x80) != 0;
+      auto rsv1 = (headerBuffer[0] & 0x40) != 0;
+      auto opcode = (Opcode)(headerBuffer[0] & 0x0F);
+      auto control = (headerBuffer[0] & 0x08) != 0;
+
+      // RSV2, RSV3, and RSV1 unless it flags the first frame of a compressed
+      // data message.
+      if ((headerBuffer[0] & 0x30) != 0 || (rsv1 && (!compressing_ || started || control))) {
         failConnection(CloseCode::ProtocolError);
-        throw TTransportException(
-            TTransportException::CORRUPTED_DATA,
-            "The most significant bit of the payload length must be zero");
+        throw TTransportException(TTransportException::CORRUPTED_DATA,
+                                  "Reserved bits must be zeroes");
       }
-    }
 
-    // size_t is smaller than a ulong on a 32-bit system
-    if (payloadLength > UINT32_MAX) {
-      failConnection(CloseCode::MessageTooBig);
-      return false;
-    }
+      // Mask
+      if ((headerBuffer[1] & 0x80) == 0) {
+        failConnection(CloseCode::ProtocolError);
+        throw TTransportException(TTransportException::CORRUPTED_DATA,
+                                  "Messages from the client must be masked");
+      }
 
-    auto length = static_cast<uint32_t>(payloadLength);
+      // Read the length
+      uint64_t payloadLength = headerBuffer[1] & 0x7F;
+      if (payloadLength == 126) {
+        if (!readFully(headerBuffer, 2)) {
+          return false;
+        }
+        payloadLength = ntohs(*reinterpret_cast<uint16_t*>(headerBuffer));
+      } else if (payloadLength == 127) {
+        if (!readFully(headerBuffer, 8)) {
+          return false;
+        }
+        payloadLength = THRIFT_ntohll(*reinterpret_cast<uint64_t*>(headerBuffer));
+        if ((payloadLength & 0x8000000000000000) != 0) {
+          failConnection(CloseCode::ProtocolError);
+          throw TTransportException(
+              TTransportException::CORRUPTED_DATA,
+              "The most significant bit of the payload length must be zero");
+        }
+      }
 
-    if (length > 0) {
-      // Read the masking key
-      read = transport_->read(headerBuffer, 4);
-      if (read < 4) {
+      // The masking key is there even if the payload is empty
+      uint8_t mask[4];
+      if (!readFully(mask, 4)) {
         return false;
       }
 
-      readBuffer_.resetBuffer(length);
-      uint8_t* buffer = readBuffer_.getWritePtr(length);
-      read = transport_->read(buffer, length);
-      readBuffer_.wroteBytes(read);
-      if (read < length) {
-        return false;
+      if (control) {
+        if (!fin || payloadLength > MAX_CONTROL_PAYLOAD) {
+          failConnection(CloseCode::ProtocolError);
+          throw TTransportException(TTransportException::CORRUPTED_DATA,
+                                    "Control frames must not be fragmented");
+        }
+        auto length = static_cast<uint32_t>(payloadLength);
+        uint8_t payload[MAX_CONTROL_PAYLOAD];
+        if (!readFully(payload, length)) {
+          return false;
+        }
+        unmaskWebSocketPayload(payload, length, mask);
+        if (!handleControlFrame(opcode, payload, length)) {
+          return false;
+        }
+        continue;
+      }
+
+      if (!started) {
+        if (opcode == Opcode::Continuation) {
+          failConnection(CloseCode::ProtocolError);
+          throw TTransportException(TTransportException::CORRUPTED_DATA,
+                                    "Continuation frame without a message");
+        }
+        started = true;
+        compressed = rsv1;
+        if (compressed) {
+          compressBuffer_.resetBuffer();
+          message = &compressBuffer_;
+        }
+      } else if (opcode != Opcode::Continuation) {
+        failConnection(CloseCode::ProtocolError);
+        throw TTransportException(TTransportException::CORRUPTED_DATA,
+                                  "Data frame inside a fragmented message");
+      }
+
+      if (payloadLength + message->available_read()
+          > static_cast<uint64_t>(getMaxMessageSize())) {
+        failConnection(CloseCode::MessageTooBig);
+        throw TTransportException(TTransportException::END_OF_FILE, "MaxMessageSize reached");
       }
-      
-      // Unmask the data
-      for (size_t i = 0; i < length; i++) {
-        buffer[i] ^= headerBuffer[i % 4];
+
+      auto length = static_cast<uint32_t>(payloadLength);
+      if (length > 0) {
+        uint8_t* payload = message->getWritePtr(length);
+        if (!readFully(payload, length)) {
+          return false;
+        }
+        unmaskWebSocketPayload(payload, length, mask);
+        message->wroteBytes(length);
       }
 
-      T_DEBUG("FIN=%d, Opcode=%X, length=%d, payload=%s", fin, opcode, length,
-              binary ? readBuffer_.toHexString() : cast(string) readBuffer_);
+      T_DEBUG("FIN=%d, Opcode=%X, length=%u", fin, static_cast<unsigned>(opcode), length);
+
+      if (fin) {
+        break;
+      }
     }
 
+    if (compressed) {
+      compression_->decompress(compressBuffer_, readBuffer_,
+                               static_cast<uint32_t>(getMaxMessageSize()));
+    }
+    return true;
+  }
+
+  // Returns false if the frame closed the connection.
+  bool handleControlFrame(Opcode opcode, const uint8_t* payload, uint32_t length) {
     switch (opcode) {
     case Opcode::Close:
       if (length >= 2) {
-        uint8_t buffer[2];
-        readBuffer_.read(buffer, 2);
-        CloseCode closeCode = static_cast<CloseCode>(ntohs(*reinterpret_cast<uint16_t*>(buffer)));
+        CloseCode closeCode = static_cast<CloseCode>((payload[0] << 8) | payload[1]);
         THRIFT_UNUSED_VARIABLE(closeCode);
-        string closeReason = readBuffer_.readAsString(length - 2);
-        T_DEBUG("Connection closed: %d %s", closeCode, closeReason);
+        T_DEBUG("Connection closed: %d %.*s", static_cast<int>(closeCode),
+                static_cast<int>(length - 2), reinterpret_cast<const char*>(payload + 2));
       }
       transport_->close();
       return false;
     case Opcode::Ping:
-      pong();
-      return readFrame();
-    default:
+      pong(payload, length);
+      return true;
+    case Opcode::Pong:
       return true;
+    default:
+      failConnection(CloseCode::ProtocolError);
+      throw TTransportException(TTransportException::CORRUPTED_DATA, "Unknown control frame");
     }
   }
 
@@ -327,6 +445,9 @@ private:
     secWebSocketKey_ = false;
     secWebSocketVersion_ = false;
     upgrade_ = false;
+    compressing_ = false;
+    extensionOffers_.clear();
+    extensionResponse_.clear();
   }
 
   void sendBadRequest() {
@@ -338,34 +459,28 @@ private:
     transport_->close();
   }
 
-  void writeFrameHeader(Opcode opcode = Opcode::Continuation) {
-    uint32_t headerSize = 1;
-    uint32_t length = writeBuffer_.available_read();
-    if (length < 126) {
-      ++headerSize;
-    } else if (length < 65536) {
-      headerSize += 3;
-    } else {
-      headerSize += 9;
-    }
-    // The server does not mask the response
-
-    uint8_t* header = static_cast<uint8_t*>(alloca(headerSize));
-    if (opcode == Opcode::Continuation) {
-      opcode = binary ? Opcode::Binary : Opcode::Text;
-    }
+  // Fills header with a final frame header and returns its size.
+  // The server does not mask the response.
+  static uint32_t writeFrameHeader(uint8_t* header, Opcode opcode, uint32_t length, bool compressed) {
+    uint32_t headerSize = 2;
     header[0] = static_cast<uint8_t>(opcode) | 0x80;
+    if (compressed) {
+      header[0] |= 0x40;
+    }
     if (length < 126) {
       header[1] = static_cast<uint8_t>(length);
     } else if (length < 65536) {
       header[1] = 126;
-      *reinterpret_cast<uint16_t*>(header + 2) = htons(length);
+      uint16_t extended = htons(static_cast<uint16_t>(length));
+      memcpy(header + 2, &extended, 2);
+      headerSize += 2;
     } else {
       header[1] = 127;
-      *reinterpret_cast<uint64_t*>(header + 2) = THRIFT_htonll(length);
+      uint64_t extended = THRIFT_htonll(static_cast<uint64_t>(length));
+      memcpy(header + 2, &extended, 8);
+      headerSize += 8;
     }
-
-    transport_->write(header, headerSize);
+    return headerSize;
   }
 
   // Add constant here to avoid a linker error on Windows
@@ -375,6 +490,12 @@ private:
   bool secWebSocketKey_;
   bool secWebSocketVersion_;
   bool upgrade_;
+  std::string extensionOffers_;
+  std::string extensionResponse_;
+  std::shared_ptr<TWebSocketCompression> compression_;
+  bool compressing_;
+  // Compressed messages in either direction
+  TMemoryBuffer compressBuffer_;
 };
 
 /**
@@ -382,7 +503,12 @@ private:
  */
 class TBinaryWebSocketServerTransportFactory : public TTransportFactory {
 public:
-  TBinaryWebSocketServerTransportFactory() = default;
+  /**
+   * @param compression creates the per-message compression extension offered
+   *        to every new connection, e.g. a TWebSocketDeflate.
+   */
+  explicit TBinaryWebSocketServerTransportFactory(TWebSocketCompressionFactory compression = nullptr)
+    : compression_(compression) {}
 
   ~TBinaryWebSocketServerTransportFactory() override = default;
 
@@ -390,8 +516,12 @@ public:
    * Wraps the transport into a buffered one.
    */
   std::shared_ptr<TTransport> getTransport(std::shared_ptr<TTransport> trans) override {
-    return std::shared_ptr<TTransport>(new TWebSocketServer<true>(trans));
+    return std::shared_ptr<TTransport>(
+        new TWebSocketServer<true>(trans, nullptr, compression_ ? compression_() : nullptr));
   }
+
+private:
+  TWebSocketCompressionFactory compression_;
 };
 
 /**
@@ -399,7 +529,12 @@ public:
  */
 class TTextWebSocketServerTransportFactory : public TTransportFactory {
 public:
-  TTextWebSocketServerTransportFactory() = default;
+  /**
+   * @param compression creates the per-message compression extension offered
+   *        to every new connection, e.g. a TWebSocketDeflate.
+   */
+  explicit TTextWebSocketServerTransportFactory(TWebSocketCompressionFactory compression = nullptr)
+    : compression_(compression) {}
 
   ~TTextWebSocketServerTransportFactory() override = default;
 
@@ -407,8 +542,12 @@ public:
    * Wraps the transport into a buffered one.
    */
   std::shared_ptr<TTransport> getTransport(std::shared_ptr<TTransport> trans) override {
-    return std::shared_ptr<TTransport>(new TWebSocketServer<false>(trans));
+    return std::shared_ptr<TTransport>(
+        new TWebSocketServer<false>(trans, nullptr, compression_ ? compression_() : nullptr));
   }
+
+private:
+  TWebSocketCompressionFactory compression_;
 };
 } // namespace transport
 } // namespace thrift
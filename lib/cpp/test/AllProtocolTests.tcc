@@ -20,7 +20,9 @@
 #ifndef _THRIFT_TEST_GENERICPROTOCOLTEST_TCC_
 #define _THRIFT_TEST_GENERICPROTOCOLTEST_TCC_ 1
 
+#include <algorithm>
 #include <limits>
+#include <vector>
 
 #include <thrift/protocol/TBinaryProtocol.h>
 #include <thrift/transport/TBufferTransports.h>
@@ -94,6 +96,50 @@ void testField(const Val val) {
   protocol->readStructEnd();
 }
 
+template <typename TProto, typename Val>
+void testArray(const std::vector<Val>& vals, shared_ptr<TTransport> transport) {
+  shared_ptr<TProtocol> protocol(new TProto(transport));
+  const auto size = static_cast<uint32_t>(vals.size());
+
+  // bulk and per-element encodings must be interchangeable on the wire
+  uint32_t wsize = GenericIO::writeArray(protocol, vals.data(), size);
+  for (uint32_t i = 0; i < size; i++) {
+    wsize -= GenericIO::write(protocol, vals[i]);
+  }
+  transport->flush();
+
+  std::vector<Val> out(vals.size());
+  for (uint32_t i = 0; i < size; i++) {
+    GenericIO::read(protocol, out[i]);
+  }
+  if (wsize != 0 || out != vals) {
+    THRIFT_SNPRINTF(errorMessage,
+                    ERR_LEN,
+                    "Invalid bulk array write (type: %s)",
+                    ClassNames::getName<Val>());
+    throw TException(errorMessage);
+  }
+
+  std::fill(out.begin(), out.end(), Val());
+  GenericIO::readArray(protocol, out.data(), size);
+  if (out != vals) {
+    THRIFT_SNPRINTF(errorMessage,
+                    ERR_LEN,
+                    "Invalid bulk array read (type: %s)",
+                    ClassNames::getName<Val>());
+    throw TException(errorMessage);
+  }
+}
+
+template <typename TProto, typename Val>
+void testArray(const std::vector<Val>& vals) {
+  // a memory buffer can lend the whole run...
+  testArray<TProto, Val>(vals, shared_ptr<TTransport>(new TMemoryBuffer()));
+  // ...a small buffered transport cannot, once the run exceeds its buffer
+  shared_ptr<TTransport> buffer(new TMemoryBuffer());
+  testArray<TProto, Val>(vals, shared_ptr<TTransport>(new TBufferedTransport(buffer, 64)));
+}
+
 template <typename TProto>
 void testMessage() {
   struct TMessage {
@@ -125,6 +171,154 @@ void testMessage() {
   }
 }
 
+/**
+ * Writes a struct with fields of every type, nested structs and containers
+ * of both fixed width and variable width values. Returns the bytes written.
+ */
+inline uint32_t writeSkipStruct(shared_ptr<TProtocol> protocol, int depth) {
+  uint32_t wsize = 0;
+  wsize += protocol->writeStructBegin("skipped");
+
+  wsize += protocol->writeFieldBegin("flag", T_BOOL, 1);
+  wsize += protocol->writeBool(true);
+  wsize += protocol->writeFieldBegin("id", T_I64, 2);
+  wsize += protocol->writeI64(-1234567890123LL);
+  // a field id jump too large for a delta
+  wsize += protocol->writeFieldBegin("name", T_STRING, 20);
+  wsize += protocol->writeString(std::string(300, 'x'));
+  wsize += protocol->writeFieldBegin("off", T_BOOL, 21);
+  wsize += protocol->writeBool(false);
+  wsize += protocol->writeFieldBegin("ratio", T_DOUBLE, 22);
+  wsize += protocol->writeDouble(0.25);
+  wsize += protocol->writeFieldBegin("small", T_I16, 23);
+  wsize += protocol->writeI16(-300);
+  wsize += protocol->writeFieldBegin("tiny", T_BYTE, 24);
+  wsize += protocol->writeByte(7);
+
+  wsize += protocol->writeFieldBegin("ids", T_LIST, 30);
+  wsize += protocol->writeListBegin(T_I32, 100);
+  for (int32_t i = 0; i < 100; i++) {
+    wsize += protocol->writeI32(i * -7919);
+  }
+  wsize += protocol->writeListEnd();
+  wsize += protocol->writeFieldBegin("flags", T_LIST, 31);
+  wsize += protocol->writeListBegin(T_BOOL, 20);
+  for (int i = 0; i < 20; i++) {
+    wsize += protocol->writeBool(i % 3 == 0);
+  }
+  wsize += protocol->writeListEnd();
+  wsize += protocol->writeFieldBegin("names", T_MAP, 32);
+  wsize += protocol->writeMapBegin(T_I32, T_STRING, 5);
+  for (int32_t i = 0; i < 5; i++) {
+    wsize += protocol->writeI32(i);
+    wsize += protocol->writeString(std::string(i * 10, 'n'));
+  }
+  wsize += protocol->writeMapEnd();
+  wsize += protocol->writeFieldBegin("weights", T_MAP, 33);
+  wsize += protocol->writeMapBegin(T_I64, T_I16, 50);
+  for (int64_t i = 0; i < 50; i++) {
+    wsize += protocol->writeI64(i << 30);
+    wsize += protocol->writeI16((int16_t)-i);
+  }
+  wsize += protocol->writeMapEnd();
+  wsize += protocol->writeFieldBegin("points", T_SET, 34);
+  wsize += protocol->writeSetBegin(T_DOUBLE, 10);
+  for (int i = 0; i < 10; i++) {
+    wsize += protocol->writeDouble(i * 1.5);
+  }
+  wsize += protocol->writeSetEnd();
+  wsize += protocol->writeFieldBegin("empty", T_MAP, 35);
+  wsize += protocol->writeMapBegin(T_STRING, T_STRUCT, 0);
+  wsize += protocol->writeMapEnd();
+  wsize += protocol->writeFieldBegin("matrix", T_LIST, 36);
+  wsize += protocol->writeListBegin(T_LIST, 3);
+  for (int i = 0; i < 3; i++) {
+    wsize += protocol->writeListBegin(T_I64, 4);
+    for (int64_t j = 0; j < 4; j++) {
+      wsize += protocol->writeI64(i * j);
+    }
+    wsize += protocol->writeListEnd();
+  }
+  wsize += protocol->writeListEnd();
+
+  if (depth > 0) {
+    wsize += protocol->writeFieldBegin("child", T_STRUCT, 40);
+    wsize += writeSkipStruct(protocol, depth - 1);
+    wsize += protocol->writeFieldBegin("children", T_MAP, 41);
+    wsize += protocol->writeMapBegin(T_STRING, T_STRUCT, 2);
+    for (int i = 0; i < 2; i++) {
+      wsize += protocol->writeString(std::string(1, (char)('a' + i)));
+      wsize += writeSkipStruct(protocol, depth - 1);
+    }
+    wsize += protocol->writeMapEnd();
+  }
+
+  wsize += protocol->writeFieldStop();
+  wsize += protocol->writeStructEnd();
+  return wsize;
+}
+
+template <typename TProto>
+void testSkip(shared_ptr<TTransport> transport) {
+  shared_ptr<TProtocol> protocol(new TProto(transport));
+
+  // the protocol's own skip() and the generic one must agree
+  for (int pass = 0; pass < 2; pass++) {
+    uint32_t wsize = writeSkipStruct(protocol, 3);
+    protocol->writeI32(0x5eed);
+    transport->flush();
+
+    uint32_t rsize = pass == 0 ? protocol->skip(T_STRUCT)
+                               : apache::thrift::protocol::skip(*protocol, T_STRUCT);
+    int32_t marker;
+    protocol->readI32(marker);
+    if (rsize != wsize || marker != 0x5eed) {
+      THRIFT_SNPRINTF(errorMessage,
+                      ERR_LEN,
+                      "Invalid skip (pass %d: wrote %u, skipped %u)",
+                      pass,
+                      wsize,
+                      rsize);
+      throw TException(errorMessage);
+    }
+  }
+}
+
+template <typename TProto>
+void testSkipDepth() {
+  shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  shared_ptr<TProtocol> protocol(new TProto(buffer));
+  const int depth = static_cast<int>(protocol->getRecursionLimit()) + 1;
+  for (int i = 0; i < depth; i++) {
+    protocol->writeStructBegin("deep");
+    protocol->writeFieldBegin("next", T_STRUCT, 1);
+  }
+  protocol->writeStructBegin("deep");
+  protocol->writeFieldStop();
+  protocol->writeStructEnd();
+  for (int i = 0; i < depth; i++) {
+    protocol->writeFieldStop();
+    protocol->writeStructEnd();
+  }
+
+  try {
+    protocol->skip(T_STRUCT);
+    throw TException("Skipped data nested beyond the recursion limit");
+  } catch (const TProtocolException& e) {
+    if (e.getType() != TProtocolException::DEPTH_LIMIT) {
+      throw;
+    }
+  }
+
+  // the levels of the failed skip were given back
+  buffer->resetBuffer();
+  writeSkipStruct(protocol, 3);
+  protocol->skip(T_STRUCT);
+  if (buffer->available_read() != 0) {
+    throw TException("Skip after a depth limit error failed");
+  }
+}
+
 template <typename TProto>
 void testProtocol(const char* protoname) {
   try {
@@ -213,8 +407,31 @@ void testProtocol(const char* protoname) {
     testField<TProto, T_STRING, std::string>("borderlinetiny");
     testField<TProto, T_STRING, std::string>("a bit longer than the smallest possible");
 
+    std::vector<int32_t> i32s;
+    std::vector<int64_t> i64s;
+    std::vector<double> doubles;
+    for (int32_t i = 0; i < 1000; i++) {
+      i32s.push_back(i * 0x10001 - 0x2000000);
+      i64s.push_back(static_cast<int64_t>(i) * 0x100000001LL - (1LL << 40));
+      doubles.push_back(i * -1.25e7);
+    }
+    i32s.push_back((std::numeric_limits<int32_t>::min)());
+    i32s.push_back((std::numeric_limits<int32_t>::max)());
+    i64s.push_back((std::numeric_limits<int64_t>::min)());
+    i64s.push_back((std::numeric_limits<int64_t>::max)());
+    testArray<TProto, int32_t>(std::vector<int32_t>());
+    testArray<TProto, int32_t>(std::vector<int32_t>(i32s.begin(), i32s.begin() + 3));
+    testArray<TProto, int32_t>(i32s);
+    testArray<TProto, int64_t>(i64s);
+    testArray<TProto, double>(doubles);
+
     testMessage<TProto>();
 
+    testSkip<TProto>(shared_ptr<TTransport>(new TMemoryBuffer()));
+    shared_ptr<TTransport> buffer(new TMemoryBuffer());
+    testSkip<TProto>(shared_ptr<TTransport>(new TBufferedTransport(buffer, 64)));
+    testSkipDepth<TProto>();
+
     printf("%s => OK\n", protoname);
   } catch (const TException &e) {
     THRIFT_SNPRINTF(errorMessage, ERR_LEN, "%s => Test FAILED: %s", protoname, e.what());
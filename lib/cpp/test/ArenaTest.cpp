@@ -0,0 +1,181 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <cstdint>
+#include <map>
+#include <memory>
+
+#include <thrift/TArena.h>
+#include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/transport/TBufferTransports.h>
+
+#include "gen-cpp/ArenaService.h"
+#include "gen-cpp/ArenaTest_types.h"
+
+#define BOOST_TEST_MODULE ArenaTest
+#include <boost/test/unit_test.hpp>
+
+using apache::thrift::TArena;
+using apache::thrift::TArenaScope;
+using apache::thrift::protocol::TBinaryProtocol;
+using apache::thrift::transport::TMemoryBuffer;
+using std::shared_ptr;
+using namespace arenatest;
+
+static Tree makeTree() {
+  Tree tree;
+  tree.name = "root";
+  for (int32_t i = 0; i < 100; i++) {
+    Leaf leaf;
+    leaf.id = i;
+    for (int64_t v = 0; v < i; v++) {
+      leaf.values.push_back(v * 1000);
+    }
+    leaf.tags.insert("tag" + std::to_string(i % 7));
+    tree.leaves.push_back(leaf);
+    tree.index["key" + std::to_string(i)].push_back(i);
+    tree.__isset.byId = true;
+    tree.byId[i] = leaf;
+  }
+  return tree;
+}
+
+BOOST_AUTO_TEST_CASE(test_arena_allocate) {
+  TArena arena(64, 256);
+  BOOST_CHECK(arena.allocate(1, 1) != nullptr);
+  for (size_t align = 1; align <= 64; align *= 2) {
+    void* p = arena.allocate(3, align);
+    BOOST_CHECK_EQUAL(reinterpret_cast<uintptr_t>(p) % align, 0u);
+  }
+  void* big = arena.allocate(4096);
+  BOOST_CHECK(big != nullptr);
+  BOOST_CHECK(arena.used() >= 4096u);
+
+  arena.reset();
+  BOOST_CHECK_EQUAL(arena.used(), 0u);
+  BOOST_CHECK(arena.allocate(8) != nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(test_arena_scope) {
+  TArena outer;
+  TArena inner;
+  BOOST_CHECK(TArena::current() == nullptr);
+  {
+    TArenaScope outerScope(outer);
+    outer.allocate(16);
+    {
+      TArenaScope innerScope(inner);
+      BOOST_CHECK(TArena::current() == &inner);
+      {
+        TArenaScope nestedScope(outer);
+        BOOST_CHECK(TArena::current() == &outer);
+      }
+      // only the outermost scope of an arena resets it
+      BOOST_CHECK(outer.used() > 0u);
+    }
+    BOOST_CHECK(TArena::current() == &outer);
+  }
+  BOOST_CHECK(TArena::current() == nullptr);
+  BOOST_CHECK_EQUAL(outer.used(), 0u);
+}
+
+BOOST_AUTO_TEST_CASE(test_arena_read) {
+  shared_ptr<TMemoryBuffer> buf(new TMemoryBuffer());
+  shared_ptr<TBinaryProtocol> prot(new TBinaryProtocol(buf));
+  const Tree tree = makeTree();
+  tree.write(prot.get());
+  BOOST_CHECK(tree.leaves.get_allocator().arena() == nullptr);
+
+  TArena arena;
+  Tree copy;
+  {
+    TArenaScope scope(arena);
+    Tree result;
+    result.read(prot.get());
+    BOOST_CHECK(result == tree);
+    BOOST_CHECK(result.leaves.get_allocator().arena() == &arena);
+    BOOST_CHECK(result.leaves[50].values.get_allocator().arena() == &arena);
+    BOOST_CHECK(result.index["key3"].get_allocator().arena() == &arena);
+    BOOST_CHECK(arena.used() > 0u);
+
+    // copies leave the arena behind
+    copy = result;
+    Tree constructed(result);
+    BOOST_CHECK(constructed.leaves.get_allocator().arena() == nullptr);
+  }
+  BOOST_CHECK_EQUAL(arena.used(), 0u);
+  BOOST_CHECK(copy == tree);
+  BOOST_CHECK(copy.leaves.get_allocator().arena() == nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(test_arena_assign) {
+  shared_ptr<TMemoryBuffer> buf(new TMemoryBuffer());
+  shared_ptr<TBinaryProtocol> prot(new TBinaryProtocol(buf));
+  const Tree tree = makeTree();
+  tree.write(prot.get());
+
+  // containers created inside the scope but not read into stay on the heap,
+  // so assigning arena backed data to them copies it out of the arena
+  TArena arena;
+  std::map<int32_t, Tree> saved;
+  {
+    TArenaScope scope(arena);
+    Tree result;
+    result.read(prot.get());
+    saved[1] = result;
+    Tree assigned;
+    assigned.leaves = result.leaves;
+    BOOST_CHECK(assigned.leaves.get_allocator().arena() == nullptr);
+    saved[2] = assigned;
+  }
+  BOOST_CHECK_EQUAL(arena.used(), 0u);
+  BOOST_CHECK(saved[1] == tree);
+  BOOST_CHECK(saved[1].leaves.get_allocator().arena() == nullptr);
+  BOOST_CHECK(saved[1].index["key3"].get_allocator().arena() == nullptr);
+  BOOST_CHECK(saved[2].leaves == tree.leaves);
+}
+
+class ArenaHandler : public ArenaServiceIf {
+public:
+  void echo(Tree& _return, const Tree& tree) override {
+    BOOST_CHECK(tree.leaves.get_allocator().arena() == &TArena::threadArena());
+    BOOST_CHECK(_return.leaves.get_allocator().arena() == nullptr);
+    _return = tree;
+  }
+};
+
+BOOST_AUTO_TEST_CASE(test_arena_processor) {
+  shared_ptr<TMemoryBuffer> request(new TMemoryBuffer());
+  shared_ptr<TMemoryBuffer> response(new TMemoryBuffer());
+  shared_ptr<TBinaryProtocol> requestProt(new TBinaryProtocol(request));
+  shared_ptr<TBinaryProtocol> responseProt(new TBinaryProtocol(response));
+  ArenaServiceClient client(responseProt, requestProt);
+  ArenaServiceProcessor processor(std::make_shared<ArenaHandler>());
+  const Tree tree = makeTree();
+
+  for (int i = 0; i < 3; i++) {
+    client.send_echo(tree);
+    BOOST_CHECK(processor.process(requestProt, responseProt, nullptr));
+    BOOST_CHECK_EQUAL(TArena::threadArena().used(), 0u);
+
+    Tree result;
+    client.recv_echo(result);
+    BOOST_CHECK(result == tree);
+  }
+}
@@ -0,0 +1,39 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+namespace cpp arenatest
+
+// compiled with --gen cpp:arena, for use in ArenaTest.cpp
+
+struct Leaf {
+  1: i32 id,
+  2: list<i64> values,
+  3: set<string> tags
+}
+
+struct Tree {
+  1: string name,
+  2: list<Leaf> leaves,
+  3: map<string, list<i32>> index,
+  4: optional map<i32, Leaf> byId
+}
+
+service ArenaService {
+  Tree echo(1: Tree tree)
+}
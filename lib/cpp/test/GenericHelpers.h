@@ -102,6 +102,32 @@ public:
   static uint32_t read(std::shared_ptr<apache::thrift::protocol::TProtocol> proto, std::string& val) {
     return proto->readString(val);
   }
+
+  /* Bulk array functions */
+
+  static uint32_t writeArray(std::shared_ptr<apache::thrift::protocol::TProtocol> proto, const int32_t* vals, uint32_t size) {
+    return proto->writeI32Array(vals, size);
+  }
+
+  static uint32_t writeArray(std::shared_ptr<apache::thrift::protocol::TProtocol> proto, const int64_t* vals, uint32_t size) {
+    return proto->writeI64Array(vals, size);
+  }
+
+  static uint32_t writeArray(std::shared_ptr<apache::thrift::protocol::TProtocol> proto, const double* vals, uint32_t size) {
+    return proto->writeDoubleArray(vals, size);
+  }
+
+  static uint32_t readArray(std::shared_ptr<apache::thrift::protocol::TProtocol> proto, int32_t* vals, uint32_t size) {
+    return proto->readI32Array(vals, size);
+  }
+
+  static uint32_t readArray(std::shared_ptr<apache::thrift::protocol::TProtocol> proto, int64_t* vals, uint32_t size) {
+    return proto->readI64Array(vals, size);
+  }
+
+  static uint32_t readArray(std::shared_ptr<apache::thrift::protocol::TProtocol> proto, double* vals, uint32_t size) {
+    return proto->readDoubleArray(vals, size);
+  }
 };
 
 #endif
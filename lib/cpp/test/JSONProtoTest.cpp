@@ -20,6 +20,7 @@
 #define _USE_MATH_DEFINES
 #include <cmath>
 #include <iomanip>
+#include <limits>
 #include <sstream>
 #include <thrift/protocol/TJSONProtocol.h>
 #include <memory>
@@ -359,3 +360,43 @@ BOOST_AUTO_TEST_CASE(test_json_unicode_escaped_missing_hi_surrogate) {
   BOOST_CHECK_THROW(ooe2.read(proto.get()),
     apache::thrift::protocol::TProtocolException);
 }
+
+BOOST_AUTO_TEST_CASE(test_json_round_trip_buffered) {
+  OneOfEach ooe;
+  ooe.im_true = true;
+  ooe.integer32 = -(std::numeric_limits<int32_t>::max)() - 1;
+  ooe.integer64 = (std::numeric_limits<int64_t>::min)();
+  ooe.double_precision = 0.125;
+  // long enough to be scanned in blocks, with characters to escape in
+  // between and at the ends
+  ooe.some_characters = "\"starts with a quote, has a \\ backslash, a \t tab,"
+                        " a \x01 control character and ends with a newline\n";
+  ooe.zomg_unicode = "\xe0\xb8\x81 \xf0\x9d\x94\xbe and some more plain text";
+  ooe.base64 = std::string(1000, '\xff');
+  ooe.i64_list.push_back((std::numeric_limits<int64_t>::max)());
+  ooe.rfc4122_uuid = "5e2ab188-1726-4e75-a04f-1ed9a6a89c4c";
+
+  std::shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  std::shared_ptr<TJSONProtocol> proto(new TJSONProtocol(buffer));
+  ooe.write(proto.get());
+
+  // a small buffered transport makes every run cross buffer boundaries
+  std::shared_ptr<transport::TBufferedTransport> buffered(
+      new transport::TBufferedTransport(buffer, 7));
+  std::shared_ptr<TJSONProtocol> reader(new TJSONProtocol(buffered));
+  OneOfEach ooe2;
+  ooe2.read(reader.get());
+  BOOST_CHECK(ooe == ooe2);
+}
+
+BOOST_AUTO_TEST_CASE(test_json_integer_out_of_range) {
+  const char json_string[] = "{\"4\":{\"i16\":32768}}";
+
+  std::shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer(
+    (uint8_t*)(json_string), sizeof(json_string)));
+  std::shared_ptr<TJSONProtocol> proto(new TJSONProtocol(buffer));
+
+  OneOfEach ooe2;
+  BOOST_CHECK_THROW(ooe2.read(proto.get()),
+    apache::thrift::protocol::TProtocolException);
+}
@@ -0,0 +1,231 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <memory>
+#include <string>
+
+#include <thrift/TToString.h>
+#include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/protocol/TCompactProtocol.h>
+#include <thrift/transport/TBufferTransports.h>
+
+#include "gen-cpp/LazyTest_types.h"
+
+#define BOOST_TEST_MODULE LazyTest
+#include <boost/test/unit_test.hpp>
+
+using apache::thrift::protocol::TBinaryProtocol;
+using apache::thrift::protocol::TCompactProtocol;
+using apache::thrift::protocol::TLEBinaryProtocol;
+using apache::thrift::protocol::TProtocol;
+using apache::thrift::transport::TBufferedTransport;
+using apache::thrift::transport::TFramedTransport;
+using apache::thrift::transport::TMemoryBuffer;
+using apache::thrift::transport::TTransport;
+using std::shared_ptr;
+using namespace lazytest;
+
+static Shape makeShape(const std::string& name, int points) {
+  Shape shape;
+  shape.__set_name(name);
+  for (int i = 0; i < points; i++) {
+    Point point;
+    point.__set_x(i);
+    point.__set_y(-i);
+    shape.mutable_points().push_back(point);
+  }
+  shape.mutable_tags()["points"] = points;
+  return shape;
+}
+
+static Drawing makeDrawing() {
+  Drawing drawing;
+  drawing.__set_id(7);
+  drawing.__set_title("plan");
+  drawing.__set_shape(makeShape("outline", 4));
+  for (int i = 0; i < 3; i++) {
+    drawing.mutable_layers().push_back(makeShape("layer" + std::to_string(i), 100));
+  }
+  drawing.__set_overlay(makeShape("grid", 2));
+  drawing.__set_visible(true);
+  return drawing;
+}
+
+template <class Protocol_>
+static std::string serialize(const Drawing& drawing) {
+  shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  Protocol_ protocol(buffer);
+  drawing.write(&protocol);
+  return buffer->getBufferAsString();
+}
+
+// Reads drawing the way a server does, from a frame
+template <class Protocol_>
+static void readFramed(const std::string& data, Drawing& drawing) {
+  shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  TFramedTransport framed(buffer);
+  framed.write(reinterpret_cast<const uint8_t*>(data.data()), static_cast<uint32_t>(data.size()));
+  framed.flush();
+  Protocol_ protocol(shared_ptr<TTransport>(new TFramedTransport(buffer)));
+  drawing.read(&protocol);
+}
+
+template <class Protocol_>
+static void testRoundTrip() {
+  const Drawing original = makeDrawing();
+  const std::string data = serialize<Protocol_>(original);
+
+  Drawing drawing;
+  readFramed<Protocol_>(data, drawing);
+  BOOST_CHECK_EQUAL(drawing.id, 7);
+  BOOST_CHECK(drawing.visible);
+
+  // nothing but the scalars was decoded
+  BOOST_CHECK(!drawing.__encoded_title.empty());
+  BOOST_CHECK(!drawing.__encoded_shape.empty());
+  BOOST_CHECK(!drawing.__encoded_layers.empty());
+  BOOST_CHECK(drawing.__encoded_title.isPending());
+  BOOST_CHECK(drawing.__encoded_layers.isPending());
+
+  // untouched fields are written as they were read
+  BOOST_CHECK(serialize<Protocol_>(drawing) == data);
+
+  BOOST_CHECK_EQUAL(drawing.get_title(), "plan");
+  BOOST_CHECK(!drawing.__encoded_title.isPending());
+  BOOST_CHECK(!drawing.__encoded_title.empty());
+  BOOST_CHECK_EQUAL(drawing.get_layers().size(), 3u);
+  BOOST_CHECK(drawing.get_layers()[1] == original.get_layers()[1]);
+  BOOST_CHECK(drawing == original);
+  BOOST_CHECK_EQUAL(apache::thrift::to_string(drawing), apache::thrift::to_string(original));
+  BOOST_CHECK(serialize<Protocol_>(drawing) == data);
+}
+
+BOOST_AUTO_TEST_CASE(test_round_trip) {
+  testRoundTrip<TBinaryProtocol>();
+  testRoundTrip<TLEBinaryProtocol>();
+  testRoundTrip<TCompactProtocol>();
+}
+
+BOOST_AUTO_TEST_CASE(test_nested) {
+  const std::string data = serialize<TCompactProtocol>(makeDrawing());
+  Drawing drawing;
+  readFramed<TCompactProtocol>(data, drawing);
+
+  // decoding a field leaves the fields of the nested struct encoded, and
+  // they share the frame rather than copying it
+  const Shape& layer = drawing.get_layers()[2];
+  BOOST_CHECK(!drawing.__encoded_layers.isPending());
+  BOOST_CHECK(layer.__encoded_points.isPending());
+  BOOST_CHECK_EQUAL(layer.get_points().size(), 100u);
+  BOOST_CHECK_EQUAL(layer.get_points()[99].y, -99);
+  BOOST_CHECK_EQUAL(layer.get_tags().at("points"), 100);
+}
+
+BOOST_AUTO_TEST_CASE(test_modify) {
+  const Drawing original = makeDrawing();
+  const std::string data = serialize<TBinaryProtocol>(original);
+  Drawing drawing;
+  readFramed<TBinaryProtocol>(data, drawing);
+
+  drawing.mutable_shape().mutable_points().pop_back();
+  drawing.__set_title("changed");
+  BOOST_CHECK(drawing.__encoded_shape.empty());
+  BOOST_CHECK(!drawing.__encoded_layers.empty());
+
+  Drawing expected = original;
+  expected.mutable_shape().mutable_points().pop_back();
+  expected.__set_title("changed");
+  BOOST_CHECK(serialize<TBinaryProtocol>(drawing) == serialize<TBinaryProtocol>(expected));
+  BOOST_CHECK(drawing == expected);
+}
+
+BOOST_AUTO_TEST_CASE(test_other_protocol) {
+  const Drawing original = makeDrawing();
+  Drawing drawing;
+  readFramed<TBinaryProtocol>(serialize<TBinaryProtocol>(original), drawing);
+
+  // a value captured as binary is decoded to be written as compact
+  const std::string compact = serialize<TCompactProtocol>(drawing);
+  BOOST_CHECK(compact == serialize<TCompactProtocol>(original));
+  BOOST_CHECK(!drawing.__encoded_shape.isPending());
+  BOOST_CHECK(serialize<TBinaryProtocol>(drawing) == serialize<TBinaryProtocol>(original));
+}
+
+BOOST_AUTO_TEST_CASE(test_pass_through) {
+  const Drawing original = makeDrawing();
+  const std::string data = serialize<TBinaryProtocol>(original);
+  Drawing drawing;
+  readFramed<TBinaryProtocol>(data, drawing);
+
+  // reading fields keeps their bytes
+  BOOST_CHECK_EQUAL(drawing.get_layers()[0].get_points().size(), 100u);
+  BOOST_CHECK_EQUAL(drawing.get_shape().get_name(), "outline");
+  BOOST_CHECK(!drawing.__encoded_layers.empty());
+  BOOST_CHECK(!drawing.__encoded_shape.empty());
+  BOOST_CHECK(serialize<TBinaryProtocol>(drawing) == data);
+
+  // changing one nested field re-encodes only the structs on its path, the
+  // other layers and the rest of the changed layer are written as read
+  drawing.mutable_layers()[1].__set_name("renamed");
+  BOOST_CHECK(drawing.__encoded_layers.empty());
+  BOOST_CHECK(drawing.get_layers()[1].__encoded_name.empty());
+  BOOST_CHECK(drawing.get_layers()[1].__encoded_points.isPending());
+  BOOST_CHECK(!drawing.get_layers()[2].__encoded_points.empty());
+
+  Drawing expected = original;
+  expected.mutable_layers()[1].__set_name("renamed");
+  BOOST_CHECK(serialize<TBinaryProtocol>(drawing) == serialize<TBinaryProtocol>(expected));
+  BOOST_CHECK(drawing.get_layers()[1].__encoded_points.isPending());
+}
+
+BOOST_AUTO_TEST_CASE(test_copy_and_swap) {
+  const Drawing original = makeDrawing();
+  Drawing drawing;
+  readFramed<TBinaryProtocol>(serialize<TBinaryProtocol>(original), drawing);
+
+  Drawing copy(drawing);
+  BOOST_CHECK(!copy.__encoded_layers.empty());
+  BOOST_CHECK(copy == original);
+
+  Drawing assigned;
+  assigned = drawing;
+  Drawing other = makeDrawing();
+  other.__set_title("other");
+  swap(assigned, other);
+  BOOST_CHECK_EQUAL(assigned.get_title(), "other");
+  BOOST_CHECK(!other.__encoded_shape.empty());
+  BOOST_CHECK(other == original);
+}
+
+BOOST_AUTO_TEST_CASE(test_unbuffered) {
+  const Drawing original = makeDrawing();
+  const std::string data = serialize<TBinaryProtocol>(original);
+
+  // values that do not fit into the transport's buffer are decoded at once
+  shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  buffer->write(reinterpret_cast<const uint8_t*>(data.data()), static_cast<uint32_t>(data.size()));
+  TBinaryProtocol protocol(shared_ptr<TTransport>(new TBufferedTransport(buffer, 64)));
+  Drawing drawing;
+  drawing.read(&protocol);
+  BOOST_CHECK(!drawing.__encoded_title.empty());
+  BOOST_CHECK(drawing.__encoded_layers.empty());
+  BOOST_CHECK_EQUAL(drawing.get_layers().size(), 3u);
+  BOOST_CHECK(drawing == original);
+  BOOST_CHECK(serialize<TBinaryProtocol>(drawing) == data);
+}
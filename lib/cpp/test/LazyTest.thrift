@@ -0,0 +1,42 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+namespace cpp lazytest
+
+// compiled with --gen cpp:lazy, for use in LazyTest.cpp
+
+struct Point {
+  1: i32 x,
+  2: i32 y
+}
+
+struct Shape {
+  1: string name,
+  2: list<Point> points,
+  3: map<string, i64> tags
+}
+
+struct Drawing {
+  1: i32 id,
+  2: string title,
+  3: Shape shape,
+  4: list<Shape> layers,
+  5: optional Shape overlay,
+  6: bool visible
+}
@@ -236,4 +236,37 @@ BOOST_AUTO_TEST_CASE( JSON_BufferedHTTP )
 #endif
 }
 
+BOOST_AUTO_TEST_CASE( PipelinedRequests )
+{
+  const std::string bodies[] = {"first", std::string(5000, 'x'), "third"};
+  std::string requests;
+  for (const std::string& body : bodies) {
+    requests += "POST /service HTTP/1.1\r\nHost: localhost\r\nContent-Length: "
+                + std::to_string(body.size()) + "\r\n\r\n" + body;
+  }
+  std::shared_ptr<TMemoryBuffer> wire(new TMemoryBuffer());
+  wire->write(reinterpret_cast<const uint8_t*>(requests.data()), static_cast<uint32_t>(requests.size()));
+  std::shared_ptr<TTransport> transport(new THttpServer(wire));
+
+  // The body is lent out right from the receive buffer
+  uint8_t buf[100];
+  BOOST_REQUIRE_EQUAL(transport->read(buf, 1), 1u);
+  uint32_t len = 4;
+  const uint8_t* borrowed = transport->borrow(nullptr, &len);
+  BOOST_REQUIRE(borrowed != nullptr);
+  BOOST_CHECK_EQUAL(len, 4u);
+  BOOST_CHECK(std::string(reinterpret_cast<const char*>(borrowed), len) == "irst");
+  transport->consume(len);
+  transport->readEnd();
+
+  // Unread parts of a body are skipped, so the next request is found
+  BOOST_CHECK_EQUAL(transport->readAll(buf, sizeof(buf)), sizeof(buf));
+  BOOST_CHECK(std::string(reinterpret_cast<const char*>(buf), sizeof(buf)) == bodies[1].substr(0, sizeof(buf)));
+  transport->readEnd();
+
+  BOOST_CHECK_EQUAL(transport->readAll(buf, 5), 5u);
+  BOOST_CHECK(std::string(reinterpret_cast<const char*>(buf), 5) == bodies[2]);
+  transport->readEnd();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
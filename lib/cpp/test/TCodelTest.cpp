@@ -0,0 +1,113 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <chrono>
+
+#include <boost/test/unit_test.hpp>
+
+#include <thrift/server/TCodel.h>
+
+using apache::thrift::server::TCodel;
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+
+BOOST_AUTO_TEST_SUITE(TCodelTest)
+
+BOOST_AUTO_TEST_CASE(test_standing_queue) {
+  // target 5ms, interval 100ms
+  TCodel codel;
+  steady_clock::time_point now = steady_clock::now() + milliseconds(150);
+  BOOST_CHECK(!codel.shouldShed(milliseconds(1), now));
+
+  // a burst that the queue absorbs: some requests hardly wait
+  for (int i = 1; i < 10; i++) {
+    now += milliseconds(10);
+    BOOST_CHECK(!codel.shouldShed(milliseconds(i % 2 ? 50 : 1), now));
+  }
+  now += milliseconds(10);
+  BOOST_CHECK(!codel.shouldShed(milliseconds(8), now));
+  BOOST_CHECK(!codel.isOverloaded());
+  BOOST_CHECK_EQUAL(codel.getMinDelay().count(), 1000);
+  BOOST_CHECK_EQUAL(codel.getLoad(), 20u);
+
+  // no request got through in less than 8ms for a whole interval
+  for (int i = 1; i < 10; i++) {
+    now += milliseconds(10);
+    BOOST_CHECK(!codel.shouldShed(milliseconds(8 + i), now));
+  }
+  now += milliseconds(10);
+  codel.shouldShed(milliseconds(9), now);
+  BOOST_CHECK(codel.isOverloaded());
+  BOOST_CHECK_EQUAL(codel.getMinDelay().count(), 8000);
+  BOOST_CHECK_EQUAL(codel.getLoad(), 100u);
+
+  // while overloaded, only the requests that waited more than twice the
+  // target are shed
+  uint64_t shed = codel.getNumShed();
+  BOOST_CHECK(!codel.shouldShed(milliseconds(10), now));
+  BOOST_CHECK(codel.shouldShed(milliseconds(11), now));
+  BOOST_CHECK_EQUAL(codel.getNumShed(), shed + 1);
+
+  // the queue drains
+  for (int i = 1; i <= 10; i++) {
+    now += milliseconds(10);
+    codel.shouldShed(milliseconds(2), now);
+  }
+  BOOST_CHECK(!codel.isOverloaded());
+  BOOST_CHECK(!codel.shouldShed(milliseconds(500), now));
+}
+
+BOOST_AUTO_TEST_CASE(test_idle) {
+  TCodel codel;
+  steady_clock::time_point now = steady_clock::now();
+
+  // the first interval already detects a standing queue
+  for (int i = 1; i <= 10; i++) {
+    now += milliseconds(10);
+    codel.shouldShed(milliseconds(20), now);
+  }
+  BOOST_CHECK(codel.isOverloaded());
+  BOOST_CHECK(codel.shouldShed(milliseconds(20), now));
+
+  // a request after an idle spell is not judged by the interval before it
+  now += milliseconds(250);
+  BOOST_CHECK(!codel.shouldShed(milliseconds(20), now));
+  BOOST_CHECK(!codel.isOverloaded());
+  BOOST_CHECK_EQUAL(codel.getMinDelay().count(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(test_settings) {
+  TCodel codel(milliseconds(1), milliseconds(10));
+  BOOST_CHECK_EQUAL(codel.getTargetDelay().count(), 1000);
+  BOOST_CHECK_EQUAL(codel.getInterval().count(), 10000);
+  codel.setTargetDelay(milliseconds(20));
+  BOOST_CHECK_EQUAL(codel.getTargetDelay().count(), 20000);
+
+  // waiting 30ms is too long for a target of 20ms, but not long enough to
+  // be shed
+  steady_clock::time_point now = steady_clock::now();
+  for (int i = 0; i < 10; i++) {
+    now += milliseconds(5);
+    BOOST_CHECK(!codel.shouldShed(milliseconds(30), now));
+  }
+  BOOST_CHECK(codel.isOverloaded());
+  BOOST_CHECK_EQUAL(codel.getNumShed(), 0u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
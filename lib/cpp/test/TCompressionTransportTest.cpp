@@ -0,0 +1,176 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <memory>
+#include <string>
+
+#include <thrift/transport/TBufferTransports.h>
+#include <thrift/transport/TCompressionTransport.h>
+#include <thrift/transport/TZlibTransport.h>
+
+#define BOOST_TEST_MODULE TCompressionTransportTest
+#include <boost/test/unit_test.hpp>
+
+using apache::thrift::transport::TCompressionContextPool;
+using apache::thrift::transport::TCompressionTransport;
+using apache::thrift::transport::TCompressionTransportFactory;
+using apache::thrift::transport::TMemoryBuffer;
+using apache::thrift::transport::TTransport;
+using apache::thrift::transport::TTransportException;
+using apache::thrift::transport::TZlibTransport;
+using std::shared_ptr;
+
+static const TCompressionContextPool::Codec codecs[] = {TCompressionContextPool::ZLIB,
+                                                        TCompressionContextPool::ZSTD,
+                                                        TCompressionContextPool::LZ4};
+
+static std::string makePayload(size_t size) {
+  std::string payload(size, '\0');
+  for (size_t i = 0; i < size; i++) {
+    payload[i] = "compressible"[i % 12] + static_cast<char>(i / 4096 % 3);
+  }
+  return payload;
+}
+
+static void send(TTransport& out, const std::string& payload) {
+  out.write(reinterpret_cast<const uint8_t*>(payload.data()),
+            static_cast<uint32_t>(payload.size()));
+  out.flush();
+}
+
+static std::string receive(TTransport& in, size_t size) {
+  std::string result(size, '\0');
+  in.readAll(reinterpret_cast<uint8_t*>(&result[0]), static_cast<uint32_t>(size));
+  return result;
+}
+
+BOOST_AUTO_TEST_CASE(test_round_trip) {
+  BOOST_CHECK(TCompressionContextPool::isCodecSupported(TCompressionContextPool::ZLIB));
+  for (TCompressionContextPool::Codec codec : codecs) {
+    if (!TCompressionContextPool::isCodecSupported(codec)) {
+      BOOST_CHECK_THROW(TCompressionContextPool pool(codec), TTransportException);
+      continue;
+    }
+    BOOST_TEST_MESSAGE("codec " << codec);
+    shared_ptr<TCompressionContextPool> pool(new TCompressionContextPool(codec));
+    for (size_t size : {size_t(1), size_t(100), size_t(1024 * 1024)}) {
+      shared_ptr<TMemoryBuffer> wire(new TMemoryBuffer());
+      TCompressionTransport out(wire, pool);
+      TCompressionTransport in(wire, pool);
+
+      const std::string payload = makePayload(size);
+      send(out, payload);
+      if (size > 100) {
+        BOOST_CHECK_LT(wire->available_read(), size / 4);
+      }
+      BOOST_CHECK(receive(in, size) == payload);
+
+      // the stream continues across flushes
+      send(out, payload);
+      send(out, payload);
+      BOOST_CHECK(receive(in, size) == payload);
+      BOOST_CHECK(receive(in, size) == payload);
+
+      // nothing is read past the end of the stream
+      out.finish();
+      BOOST_CHECK_THROW(out.write(reinterpret_cast<const uint8_t*>("x"), 1), TTransportException);
+      uint8_t byte;
+      BOOST_CHECK_EQUAL(in.read(&byte, 1), 0u);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_zlib_compatibility) {
+  shared_ptr<TCompressionContextPool> pool(
+      new TCompressionContextPool(TCompressionContextPool::ZLIB));
+  const std::string payload = makePayload(100000);
+
+  shared_ptr<TMemoryBuffer> wire(new TMemoryBuffer());
+  TCompressionTransport out(wire, pool);
+  TZlibTransport zin(wire);
+  send(out, payload);
+  BOOST_CHECK(receive(zin, payload.size()) == payload);
+
+  TZlibTransport zout(wire);
+  TCompressionTransport in(wire, pool);
+  send(zout, payload);
+  BOOST_CHECK(receive(in, payload.size()) == payload);
+
+  // zlib windows are limited to 9 - 15 bits
+  BOOST_CHECK_THROW(TCompressionContextPool(TCompressionContextPool::ZLIB, -1, 16),
+                    TTransportException);
+  shared_ptr<TCompressionContextPool> small(
+      new TCompressionContextPool(TCompressionContextPool::ZLIB, 1, 9));
+  shared_ptr<TMemoryBuffer> smallWire(new TMemoryBuffer());
+  TCompressionTransport smallOut(smallWire, small);
+  TCompressionTransport smallIn(smallWire, pool);
+  send(smallOut, payload);
+  BOOST_CHECK(receive(smallIn, payload.size()) == payload);
+}
+
+BOOST_AUTO_TEST_CASE(test_min_flush_bytes) {
+  for (TCompressionContextPool::Codec codec : codecs) {
+    if (!TCompressionContextPool::isCodecSupported(codec)) {
+      continue;
+    }
+    shared_ptr<TCompressionContextPool> pool(new TCompressionContextPool(codec));
+    shared_ptr<TMemoryBuffer> wire(new TMemoryBuffer());
+    TCompressionTransport out(wire, pool);
+    TCompressionTransport in(wire, pool);
+    out.setMinFlushBytes(1000);
+
+    // small messages are kept back until enough data is pending
+    const std::string message = makePayload(100);
+    for (int i = 0; i < 9; i++) {
+      send(out, message);
+    }
+    BOOST_CHECK_EQUAL(wire->available_read(), 0u);
+    send(out, message);
+    BOOST_CHECK_GT(wire->available_read(), 0u);
+    for (int i = 0; i < 10; i++) {
+      BOOST_CHECK(receive(in, message.size()) == message);
+    }
+
+    send(out, message);
+    BOOST_CHECK_EQUAL(wire->available_read(), 0u);
+    out.forceFlush();
+    BOOST_CHECK(receive(in, message.size()) == message);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_context_reuse) {
+  for (TCompressionContextPool::Codec codec : codecs) {
+    if (!TCompressionContextPool::isCodecSupported(codec)) {
+      continue;
+    }
+    shared_ptr<TCompressionContextPool> pool(new TCompressionContextPool(codec));
+    TCompressionTransportFactory factory(pool);
+    const std::string payload = makePayload(5000);
+
+    for (int i = 0; i < 20; i++) {
+      shared_ptr<TMemoryBuffer> wire(new TMemoryBuffer());
+      shared_ptr<TTransport> out = factory.getTransport(wire);
+      shared_ptr<TTransport> in = factory.getTransport(wire);
+      send(*out, payload);
+      BOOST_CHECK(receive(*in, payload.size()) == payload);
+    }
+    // one compressor and one decompressor served all connections
+    BOOST_CHECK_EQUAL(pool->getNumCreated(), 2u);
+  }
+}
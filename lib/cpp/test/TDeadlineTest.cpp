@@ -0,0 +1,234 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <chrono>
+#include <memory>
+#include <string>
+
+#include <thrift/TApplicationException.h>
+#include <thrift/TDeadline.h>
+#include <thrift/protocol/THeaderProtocol.h>
+#include <thrift/server/TServer.h>
+#include <thrift/transport/TBufferTransports.h>
+
+#include "gen-cpp/ParentService.h"
+
+#define BOOST_TEST_MODULE TDeadlineTest
+#include <boost/test/unit_test.hpp>
+
+using apache::thrift::TApplicationException;
+using apache::thrift::TDeadline;
+using apache::thrift::TDeadlineScope;
+using apache::thrift::protocol::THeaderProtocol;
+using apache::thrift::protocol::TMessageType;
+using apache::thrift::server::TServer;
+using apache::thrift::transport::TMemoryBuffer;
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+using std::make_shared;
+using std::shared_ptr;
+
+namespace test = apache::thrift::test;
+
+struct Handler : public test::ParentServiceIf {
+  Handler() : calls(0), hadDeadline(false) {}
+
+  // records the deadline the request was handled under
+  void getDataWait(std::string&, const int32_t) override {
+    ++calls;
+    hadDeadline = TDeadline::isSet();
+    remaining = TDeadline::remaining();
+  }
+
+  // dummy overrides not used in this test
+  void addString(const std::string&) override {}
+  void getStrings(std::vector<std::string>&) override {}
+  int32_t incrementGeneration() override { return 0; }
+  int32_t getGeneration() override { return 0; }
+  void onewayWait() override {}
+  void exceptionWait(const std::string&) override {}
+  void unexpectedExceptionWait(const std::string&) override {}
+
+  int calls;
+  bool hadDeadline;
+  milliseconds remaining;
+};
+
+/**
+ * A client and a server talking THeader through memory buffers.
+ */
+struct Fixture {
+  Fixture()
+    : requests(make_shared<TMemoryBuffer>()),
+      responses(make_shared<TMemoryBuffer>()),
+      clientProtocol(make_shared<THeaderProtocol>(responses, requests)),
+      serverProtocol(make_shared<THeaderProtocol>(requests, responses)),
+      handler(make_shared<Handler>()),
+      processor(handler),
+      client(clientProtocol) {}
+
+  bool process(steady_clock::time_point receivedAt = steady_clock::time_point()) {
+    return TServer::processRequest(processor, serverProtocol, serverProtocol, nullptr, receivedAt);
+  }
+
+  shared_ptr<TMemoryBuffer> requests;
+  shared_ptr<TMemoryBuffer> responses;
+  shared_ptr<THeaderProtocol> clientProtocol;
+  shared_ptr<THeaderProtocol> serverProtocol;
+  shared_ptr<Handler> handler;
+  test::ParentServiceProcessor processor;
+  test::ParentServiceClient client;
+};
+
+BOOST_AUTO_TEST_SUITE(TDeadlineTest)
+
+BOOST_AUTO_TEST_CASE(test_scopes) {
+  BOOST_CHECK(!TDeadline::isSet());
+  BOOST_CHECK(!TDeadline::expired());
+  BOOST_CHECK(TDeadline::remaining() == milliseconds::max());
+
+  {
+    TDeadlineScope outer(milliseconds(1000));
+    steady_clock::time_point deadline = TDeadline::current();
+    BOOST_CHECK(TDeadline::isSet());
+    BOOST_CHECK(!TDeadline::expired());
+    BOOST_CHECK(TDeadline::remaining() <= milliseconds(1000));
+
+    {
+      // an inner scope can shorten the deadline, but not extend it
+      TDeadlineScope longer(milliseconds(10000));
+      BOOST_CHECK(TDeadline::current() == deadline);
+      TDeadlineScope passed(milliseconds(-1));
+      BOOST_CHECK(TDeadline::expired());
+      BOOST_CHECK(TDeadline::remaining() < milliseconds(0));
+    }
+    BOOST_CHECK(TDeadline::current() == deadline);
+  }
+  BOOST_CHECK(!TDeadline::isSet());
+}
+
+BOOST_AUTO_TEST_CASE(test_propagation) {
+  auto buffer = make_shared<TMemoryBuffer>();
+  THeaderProtocol out(buffer);
+  THeaderProtocol in(buffer);
+  std::string name;
+  TMessageType type;
+  int32_t seqid;
+
+  // calls made under a deadline carry the time left
+  {
+    TDeadlineScope scope(milliseconds(500));
+    out.writeMessageBegin("call", apache::thrift::protocol::T_CALL, 1);
+    out.writeMessageEnd();
+    out.getTransport()->flush();
+  }
+  in.readMessageBegin(name, type, seqid);
+  in.readMessageEnd();
+  auto it = in.getHeaders().find(TDeadline::HEADER);
+  BOOST_REQUIRE(it != in.getHeaders().end());
+  BOOST_CHECK_GT(std::stoll(it->second), 0);
+  BOOST_CHECK_LE(std::stoll(it->second), 500);
+
+  // replies and calls without a deadline do not
+  {
+    TDeadlineScope scope(milliseconds(500));
+    out.writeMessageBegin("call", apache::thrift::protocol::T_REPLY, 1);
+    out.writeMessageEnd();
+    out.getTransport()->flush();
+  }
+  in.readMessageBegin(name, type, seqid);
+  in.readMessageEnd();
+  BOOST_CHECK(in.getHeaders().count(TDeadline::HEADER) == 0);
+
+  out.writeMessageBegin("call", apache::thrift::protocol::T_CALL, 2);
+  out.writeMessageEnd();
+  out.getTransport()->flush();
+  in.readMessageBegin(name, type, seqid);
+  in.readMessageEnd();
+  BOOST_CHECK(in.getHeaders().count(TDeadline::HEADER) == 0);
+
+  // a header the caller set wins
+  {
+    TDeadlineScope scope(milliseconds(500));
+    out.setHeader(TDeadline::HEADER, "20000");
+    out.writeMessageBegin("call", apache::thrift::protocol::T_CALL, 3);
+    out.writeMessageEnd();
+    out.getTransport()->flush();
+  }
+  in.readMessageBegin(name, type, seqid);
+  in.readMessageEnd();
+  BOOST_CHECK_EQUAL(in.getHeaders().find(TDeadline::HEADER)->second, "20000");
+}
+
+BOOST_FIXTURE_TEST_CASE(test_handler_sees_deadline, Fixture) {
+  std::string result;
+  {
+    TDeadlineScope scope(milliseconds(5000));
+    client.send_getDataWait(0);
+  }
+  BOOST_CHECK(process());
+  BOOST_CHECK_EQUAL(handler->calls, 1);
+  BOOST_CHECK(handler->hadDeadline);
+  BOOST_CHECK(handler->remaining > milliseconds(0));
+  BOOST_CHECK(handler->remaining <= milliseconds(5000));
+  BOOST_CHECK(!TDeadline::isSet());
+  client.recv_getDataWait(result);
+
+  // requests without a deadline are handled without one
+  client.send_getDataWait(0);
+  BOOST_CHECK(process());
+  BOOST_CHECK_EQUAL(handler->calls, 2);
+  BOOST_CHECK(!handler->hadDeadline);
+  client.recv_getDataWait(result);
+}
+
+BOOST_FIXTURE_TEST_CASE(test_expired_requests_are_dropped, Fixture) {
+  std::string result;
+
+  // the request waited in the server longer than its caller does
+  {
+    TDeadlineScope scope(milliseconds(100));
+    client.send_getDataWait(0);
+  }
+  BOOST_CHECK(process(steady_clock::now() - milliseconds(1000)));
+  BOOST_CHECK_EQUAL(handler->calls, 0);
+  try {
+    client.recv_getDataWait(result);
+    BOOST_FAIL("expected a TIMEOUT exception");
+  } catch (const TApplicationException& x) {
+    BOOST_CHECK_EQUAL(x.getType(), TApplicationException::TIMEOUT);
+  }
+
+  // the caller gave up before sending it
+  {
+    TDeadlineScope scope(milliseconds(-5));
+    client.send_getDataWait(0);
+  }
+  BOOST_CHECK(process());
+  BOOST_CHECK_EQUAL(handler->calls, 0);
+  BOOST_CHECK_THROW(client.recv_getDataWait(result), TApplicationException);
+
+  // the connection is still good for the next request
+  client.send_getDataWait(0);
+  BOOST_CHECK(process());
+  BOOST_CHECK_EQUAL(handler->calls, 1);
+  client.recv_getDataWait(result);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
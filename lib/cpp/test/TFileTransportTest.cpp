@@ -26,9 +26,18 @@
 #include <sys/time.h>
 #endif
 #include <getopt.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
 #include <boost/test/unit_test.hpp>
 
 #include <thrift/transport/TFileTransport.h>
+#include <thrift/transport/TMappedFileTransport.h>
+#include <thrift/transport/TBufferTransports.h>
+#include <thrift/protocol/TBinaryProtocol.h>
 
 #ifdef __MINGW32__
   #include <io.h>
@@ -336,6 +345,389 @@ BOOST_AUTO_TEST_CASE(test_noop_flush) {
   }
 }
 
+/**
+ * Make sure writes are acknowledged as durable in order, and that flush()
+ * covers everything written before it.
+ */
+BOOST_AUTO_TEST_CASE(test_group_commit) {
+  TempFile f(tmp_dir, "thrift.TFileTransportTest.");
+
+  // the callback runs on the sync thread, so it only records what it saw
+  std::atomic<uint64_t> acked(0);
+  std::atomic<bool> ackedInOrder(true);
+  {
+    TFileTransport transport(f.getPath());
+    transport.setWriteBatchSize(100);
+    transport.setDurableCallback([&acked, &ackedInOrder](uint64_t sequence) {
+      if (sequence < acked.load()) {
+        ackedInOrder = false;
+      }
+      acked = sequence;
+    });
+
+    uint8_t buf[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+    for (unsigned int n = 0; n < 1000; ++n) {
+      transport.write(buf, n % sizeof(buf) + 1);
+    }
+    BOOST_CHECK_EQUAL(transport.getEnqueuedSequence(), 1000u);
+
+    transport.flush();
+    BOOST_CHECK_GE(transport.getDurableSequence(), 1000u);
+    BOOST_CHECK_GE(acked.load(), 1000u);
+    BOOST_CHECK(transport.waitForDurable(1000, 1));
+
+    transport.write(buf, sizeof(buf));
+    BOOST_CHECK(transport.waitForDurable(1001));
+  }
+  BOOST_CHECK(ackedInOrder.load());
+  BOOST_CHECK_EQUAL(acked.load(), 1001u);
+
+  struct stat st;
+  BOOST_REQUIRE_EQUAL(stat(f.getPath(), &st), 0);
+  uint64_t expected = 0;
+  for (unsigned int n = 0; n < 1000; ++n) {
+    expected += n % 37 + 1 + 4;
+  }
+  expected += 37 + 4;
+  BOOST_CHECK_EQUAL(static_cast<uint64_t>(st.st_size), expected);
+}
+
+static const uint32_t MAPPED_CHUNK_SIZE = 4096;
+static const uint32_t MAPPED_NUM_EVENTS = 2000;
+
+static uint32_t mappedEventSize(uint32_t n) {
+  return n % 300 + 1;
+}
+
+static void writeMappedEvents(const char* path) {
+  TFileTransport transport(path);
+  transport.setChunkSize(MAPPED_CHUNK_SIZE);
+  uint8_t buf[300];
+  for (uint32_t n = 0; n < MAPPED_NUM_EVENTS; ++n) {
+    for (uint32_t i = 0; i < mappedEventSize(n); ++i) {
+      buf[i] = static_cast<uint8_t>(n + i);
+    }
+    transport.write(buf, mappedEventSize(n));
+  }
+}
+
+/**
+ * Reads the next event and returns its number, or -1 if it is not an
+ * event written by writeMappedEvents().
+ */
+static int readMappedEvent(TMappedFileReaderTransport& reader) {
+  uint8_t buf[301];
+  uint32_t size = reader.read(buf, sizeof(buf));
+  if (size == 0 || size > 300) {
+    return -1;
+  }
+  for (uint32_t n = buf[0]; n < MAPPED_NUM_EVENTS; n += 256) {
+    if (mappedEventSize(n) != size) {
+      continue;
+    }
+    bool match = true;
+    for (uint32_t i = 0; i < size && match; ++i) {
+      match = buf[i] == static_cast<uint8_t>(n + i);
+    }
+    if (match) {
+      return static_cast<int>(n);
+    }
+  }
+  return -1;
+}
+
+/**
+ * Make sure the mapped reader returns the events TFileTransport wrote, in
+ * order and across chunk boundaries.
+ */
+BOOST_AUTO_TEST_CASE(test_mapped_reader) {
+  TempFile f(tmp_dir, "thrift.TFileTransportTest.");
+  writeMappedEvents(f.getPath());
+
+  std::shared_ptr<TMappedLogFile> file(new TMappedLogFile(f.getPath(), MAPPED_CHUNK_SIZE));
+  TMappedFileReaderTransport reader(file);
+  BOOST_CHECK_GT(reader.getNumChunks(), 1u);
+  BOOST_CHECK_EQUAL(file->getNumEvents(), MAPPED_NUM_EVENTS);
+
+  for (uint32_t n = 0; n < MAPPED_NUM_EVENTS; ++n) {
+    BOOST_REQUIRE(reader.peek());
+    BOOST_REQUIRE_EQUAL(readMappedEvent(reader), static_cast<int>(n));
+  }
+  BOOST_CHECK(!reader.peek());
+
+  // borrow() hands out the rest of the current event
+  reader.seekToEvent(7);
+  uint8_t first;
+  reader.readAll(&first, 1);
+  uint32_t len = 1;
+  const uint8_t* rest = reader.borrow(nullptr, &len);
+  BOOST_REQUIRE(rest != nullptr);
+  BOOST_CHECK_EQUAL(len, mappedEventSize(7) - 1);
+  BOOST_CHECK_EQUAL(rest[0], 8);
+  reader.consume(len);
+  BOOST_CHECK_EQUAL(readMappedEvent(reader), 8);
+}
+
+/**
+ * Make sure the mapped reader can position itself on events and chunks.
+ */
+BOOST_AUTO_TEST_CASE(test_mapped_seek) {
+  TempFile f(tmp_dir, "thrift.TFileTransportTest.");
+  writeMappedEvents(f.getPath());
+
+  std::shared_ptr<TMappedLogFile> file(new TMappedLogFile(f.getPath(), MAPPED_CHUNK_SIZE));
+  TMappedFileReaderTransport reader(file);
+  for (uint32_t n : {1999u, 0u, 1234u, 17u}) {
+    reader.seekToEvent(n);
+    BOOST_CHECK_EQUAL(readMappedEvent(reader), static_cast<int>(n));
+  }
+  BOOST_CHECK_THROW(reader.seekToEvent(MAPPED_NUM_EVENTS), TEOFException);
+
+  // the first event of a chunk follows the last one of the chunk before
+  reader.seekToChunk(2);
+  BOOST_CHECK_EQUAL(reader.getCurChunk(), 2u);
+  int firstOfChunk = readMappedEvent(reader);
+  reader.seekToChunk(1);
+  uint32_t left = reader.getEventsLeftInChunk();
+  reader.seekToEvent(firstOfChunk - 1);
+  BOOST_CHECK_EQUAL(reader.getCurChunk(), 1u);
+  BOOST_CHECK_EQUAL(reader.getEventsLeftInChunk(), 1u);
+  reader.seekToChunk(1);
+  for (uint32_t i = 1; i < left; ++i) {
+    readMappedEvent(reader);
+  }
+  BOOST_CHECK_EQUAL(readMappedEvent(reader), firstOfChunk - 1);
+
+  reader.seekToEnd();
+  BOOST_CHECK(!reader.peek());
+  reader.seekToChunk(-1);
+  BOOST_CHECK_EQUAL(reader.getCurChunk(), reader.getNumChunks() - 1);
+}
+
+/**
+ * Make sure a saved index is used by later readers.
+ */
+BOOST_AUTO_TEST_CASE(test_mapped_index) {
+  TempFile f(tmp_dir, "thrift.TFileTransportTest.");
+  TempFile index(tmp_dir, "thrift.TFileTransportTest.");
+  writeMappedEvents(f.getPath());
+
+  {
+    TMappedLogFile file(f.getPath(), MAPPED_CHUNK_SIZE);
+    file.saveIndex(index.getPath());
+  }
+
+  std::shared_ptr<TMappedLogFile> file(new TMappedLogFile(f.getPath(), MAPPED_CHUNK_SIZE));
+  BOOST_CHECK(file->loadIndex(index.getPath()));
+  BOOST_CHECK_EQUAL(file->getNumEvents(), MAPPED_NUM_EVENTS);
+  TMappedFileReaderTransport reader(file);
+  reader.seekToEvent(1500);
+  BOOST_CHECK_EQUAL(readMappedEvent(reader), 1500);
+
+  // an index of another chunk size does not belong to this log
+  TMappedLogFile other(f.getPath(), MAPPED_CHUNK_SIZE * 2);
+  BOOST_CHECK(!other.loadIndex(index.getPath()));
+  BOOST_CHECK(!other.loadIndex(f.getPath()));
+}
+
+/**
+ * Make sure an event whose size header runs past its chunk is skipped when
+ * the index it was found through was loaded rather than built.
+ */
+BOOST_AUTO_TEST_CASE(test_mapped_index_corrupt_event) {
+  TempFile f(tmp_dir, "thrift.TFileTransportTest.");
+  TempFile index(tmp_dir, "thrift.TFileTransportTest.");
+  writeMappedEvents(f.getPath());
+
+  int firstOfChunk;
+  {
+    std::shared_ptr<TMappedLogFile> file(new TMappedLogFile(f.getPath(), MAPPED_CHUNK_SIZE));
+    file->saveIndex(index.getPath());
+    TMappedFileReaderTransport reader(file);
+    reader.seekToChunk(1);
+    firstOfChunk = readMappedEvent(reader);
+  }
+
+  // overwrite the size of the first event
+  uint32_t eventSize = MAPPED_CHUNK_SIZE;
+  FILE* log = fopen(f.getPath(), "r+b");
+  BOOST_REQUIRE(log != nullptr);
+  BOOST_REQUIRE_EQUAL(fwrite(&eventSize, sizeof(eventSize), 1, log), 1u);
+  fclose(log);
+
+  std::shared_ptr<TMappedLogFile> file(new TMappedLogFile(f.getPath(), MAPPED_CHUNK_SIZE));
+  BOOST_REQUIRE(file->loadIndex(index.getPath()));
+  TMappedFileReaderTransport reader(file);
+  BOOST_CHECK_EQUAL(readMappedEvent(reader), firstOfChunk);
+  BOOST_CHECK_EQUAL(reader.getCurChunk(), 1u);
+}
+
+/**
+ * Make sure cursors on different threads can read the chunks of one file.
+ */
+BOOST_AUTO_TEST_CASE(test_mapped_parallel) {
+  TempFile f(tmp_dir, "thrift.TFileTransportTest.");
+  writeMappedEvents(f.getPath());
+
+  std::shared_ptr<TMappedLogFile> file(new TMappedLogFile(f.getPath(), MAPPED_CHUNK_SIZE));
+  uint32_t numChunks = file->getNumChunks();
+  std::vector<uint32_t> seen(MAPPED_NUM_EVENTS, 0);
+  std::vector<std::thread> threads;
+  for (uint32_t chunk = 0; chunk < numChunks; ++chunk) {
+    threads.emplace_back([file, chunk, &seen]() {
+      TMappedFileReaderTransport reader(file);
+      reader.seekToChunk(chunk);
+      for (uint32_t left = reader.getEventsLeftInChunk(); left > 0; --left) {
+        int n = readMappedEvent(reader);
+        if (n >= 0) {
+          seen[n]++;
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  for (uint32_t n = 0; n < MAPPED_NUM_EVENTS; ++n) {
+    BOOST_CHECK_EQUAL(seen[n], 1u);
+  }
+}
+
+/**
+ * Processor for the events written by writeReplayEvents(), recording the
+ * event numbers in the order they were processed.
+ */
+class ReplayProcessor : public apache::thrift::TProcessor {
+public:
+  ReplayProcessor(std::mutex* mutex, std::vector<int32_t>* processed, int32_t failOn)
+    : mutex_(mutex), processed_(processed), failOn_(failOn) {}
+
+  bool process(std::shared_ptr<apache::thrift::protocol::TProtocol> in,
+               std::shared_ptr<apache::thrift::protocol::TProtocol> out,
+               void* connectionContext) override {
+    (void)out;
+    (void)connectionContext;
+    int32_t n;
+    std::string filler;
+    in->readI32(n);
+    if (n == failOn_) {
+      throw TTransportException("replay failure");
+    }
+    in->readString(filler);
+    std::lock_guard<std::mutex> lock(*mutex_);
+    processed_->push_back(n);
+    return true;
+  }
+
+private:
+  std::mutex* mutex_;
+  std::vector<int32_t>* processed_;
+  int32_t failOn_;
+};
+
+class ReplayProcessorFactory : public apache::thrift::TProcessorFactory {
+public:
+  ReplayProcessorFactory(int32_t failOn = -1) : failOn_(failOn), numProcessors_(0) {}
+
+  std::shared_ptr<apache::thrift::TProcessor> getProcessor(
+      const apache::thrift::TConnectionInfo& connInfo) override {
+    (void)connInfo;
+    numProcessors_++;
+    return std::make_shared<ReplayProcessor>(&mutex_, &processed_, failOn_);
+  }
+
+  std::vector<int32_t>& getProcessed() { return processed_; }
+  uint32_t getNumProcessors() { return numProcessors_; }
+
+private:
+  std::mutex mutex_;
+  std::vector<int32_t> processed_;
+  int32_t failOn_;
+  uint32_t numProcessors_;
+};
+
+static void writeReplayEvents(const char* path) {
+  TFileTransport transport(path);
+  transport.setChunkSize(MAPPED_CHUNK_SIZE);
+  std::shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  apache::thrift::protocol::TBinaryProtocol protocol(buffer);
+  for (int32_t n = 0; n < static_cast<int32_t>(MAPPED_NUM_EVENTS); ++n) {
+    protocol.writeI32(n);
+    protocol.writeString(std::string(n % 200, 'x'));
+    std::string event = buffer->getBufferAsString();
+    buffer->resetBuffer();
+    transport.write(reinterpret_cast<const uint8_t*>(event.data()),
+                    static_cast<uint32_t>(event.size()));
+  }
+}
+
+/**
+ * Make sure every ordering replays every event once, and STRICT in order.
+ */
+BOOST_AUTO_TEST_CASE(test_parallel_replay) {
+  TempFile f(tmp_dir, "thrift.TFileTransportTest.");
+  writeReplayEvents(f.getPath());
+  std::shared_ptr<TMappedLogFile> file(new TMappedLogFile(f.getPath(), MAPPED_CHUNK_SIZE));
+  std::shared_ptr<apache::thrift::protocol::TProtocolFactory> protocolFactory(
+      new apache::thrift::protocol::TBinaryProtocolFactory());
+
+  for (auto ordering : {TParallelFileProcessor::STRICT,
+                        TParallelFileProcessor::PER_CHUNK,
+                        TParallelFileProcessor::UNORDERED}) {
+    std::shared_ptr<ReplayProcessorFactory> processorFactory(new ReplayProcessorFactory());
+    TParallelFileProcessor processor(processorFactory, protocolFactory, file, 4, ordering);
+    processor.setBatchSize(10);
+    processor.process();
+
+    const TReplayStats& stats = processor.getStats();
+    BOOST_CHECK_EQUAL(processorFactory->getNumProcessors(), 4u);
+    BOOST_CHECK_EQUAL(stats.numEvents, MAPPED_NUM_EVENTS);
+    BOOST_CHECK_EQUAL(stats.numErrors, 0u);
+    BOOST_CHECK_EQUAL(stats.numChunks, file->getNumChunks());
+    BOOST_CHECK_EQUAL(stats.workerEvents.size(), 4u);
+    BOOST_CHECK_GT(stats.numBytes, MAPPED_NUM_EVENTS * 8);
+
+    std::vector<int32_t> processed = processorFactory->getProcessed();
+    BOOST_REQUIRE_EQUAL(processed.size(), MAPPED_NUM_EVENTS);
+    if (ordering == TParallelFileProcessor::STRICT) {
+      for (uint32_t n = 0; n < MAPPED_NUM_EVENTS; ++n) {
+        BOOST_CHECK_EQUAL(processed[n], static_cast<int32_t>(n));
+      }
+    }
+    std::sort(processed.begin(), processed.end());
+    for (uint32_t n = 0; n < MAPPED_NUM_EVENTS; ++n) {
+      BOOST_CHECK_EQUAL(processed[n], static_cast<int32_t>(n));
+    }
+  }
+}
+
+/**
+ * Make sure an event the processor fails on is skipped, or stops the replay.
+ */
+BOOST_AUTO_TEST_CASE(test_parallel_replay_errors) {
+  TempFile f(tmp_dir, "thrift.TFileTransportTest.");
+  writeReplayEvents(f.getPath());
+  std::shared_ptr<TMappedLogFile> file(new TMappedLogFile(f.getPath(), MAPPED_CHUNK_SIZE));
+  std::shared_ptr<apache::thrift::protocol::TProtocolFactory> protocolFactory(
+      new apache::thrift::protocol::TBinaryProtocolFactory());
+
+  std::shared_ptr<ReplayProcessorFactory> processorFactory(new ReplayProcessorFactory(777));
+  TParallelFileProcessor processor(processorFactory, protocolFactory, file, 3);
+  processor.process();
+  BOOST_CHECK_EQUAL(processor.getStats().numErrors, 1u);
+  BOOST_CHECK_EQUAL(processor.getStats().numEvents, MAPPED_NUM_EVENTS - 1);
+  BOOST_CHECK_EQUAL(processorFactory->getProcessed().size(), MAPPED_NUM_EVENTS - 1);
+
+  processorFactory.reset(new ReplayProcessorFactory(777));
+  TParallelFileProcessor strict(processorFactory, protocolFactory, file, 3,
+                                TParallelFileProcessor::STRICT);
+  strict.setStopOnError(true);
+  strict.process();
+  BOOST_CHECK_EQUAL(strict.getStats().numErrors, 1u);
+  BOOST_CHECK_EQUAL(processorFactory->getProcessed().size(), 777u);
+}
+
 /**************************************************************************
  * General Initialization
  **************************************************************************/
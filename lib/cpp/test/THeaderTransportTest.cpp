@@ -0,0 +1,152 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <memory>
+#include <string>
+
+#include <thrift/transport/TBufferTransports.h>
+#include <thrift/transport/THeaderTransport.h>
+
+#define BOOST_TEST_MODULE THeaderTransportTest
+#include <boost/test/unit_test.hpp>
+
+using apache::thrift::transport::THeaderTransport;
+using apache::thrift::transport::THeaderZstdDictionary;
+using apache::thrift::transport::TMemoryBuffer;
+using apache::thrift::transport::TTransportException;
+using std::shared_ptr;
+
+static const uint16_t transforms[] = {THeaderTransport::ZLIB_TRANSFORM,
+                                      THeaderTransport::SNAPPY_TRANSFORM,
+                                      THeaderTransport::ZSTD_TRANSFORM,
+                                      THeaderTransport::LZ4_TRANSFORM};
+
+static std::string makePayload(size_t size) {
+  std::string payload(size, '\0');
+  for (size_t i = 0; i < size; i++) {
+    payload[i] = "compressible"[i % 12];
+  }
+  return payload;
+}
+
+/**
+ * Sends payload through out and returns the size of the frame on the wire.
+ */
+static uint32_t send(THeaderTransport& out, TMemoryBuffer& wire, const std::string& payload) {
+  uint32_t before = wire.available_read();
+  out.write(reinterpret_cast<const uint8_t*>(payload.data()),
+            static_cast<uint32_t>(payload.size()));
+  out.flush();
+  return wire.available_read() - before;
+}
+
+static std::string receive(THeaderTransport& in, size_t size) {
+  std::string result(size, '\0');
+  in.readAll(reinterpret_cast<uint8_t*>(&result[0]), static_cast<uint32_t>(size));
+  in.readEnd();
+  return result;
+}
+
+BOOST_AUTO_TEST_CASE(test_round_trip) {
+  for (uint16_t transId : transforms) {
+    if (!THeaderTransport::isTransformSupported(transId)) {
+      continue;
+    }
+    BOOST_TEST_MESSAGE("transform " << transId);
+    for (size_t size : {size_t(1), size_t(100), size_t(1024 * 1024)}) {
+      shared_ptr<TMemoryBuffer> wire(new TMemoryBuffer());
+      THeaderTransport out(wire);
+      THeaderTransport in(wire);
+      out.setTransform(transId);
+
+      const std::string payload = makePayload(size);
+      uint32_t frameSize = send(out, *wire, payload);
+      if (size > 100) {
+        BOOST_CHECK_LT(frameSize, size / 4);
+      }
+      BOOST_CHECK(receive(in, size) == payload);
+
+      // the transport keeps working after the buffers were swapped
+      send(out, *wire, payload);
+      BOOST_CHECK(receive(in, size) == payload);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_unsupported_transform) {
+  shared_ptr<TMemoryBuffer> wire(new TMemoryBuffer());
+  THeaderTransport out(wire);
+  BOOST_CHECK(!THeaderTransport::isTransformSupported(0x02));
+  BOOST_CHECK_THROW(out.setTransform(0x02), TTransportException);
+  BOOST_CHECK_EQUAL(out.getNumTransforms(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(test_min_compress_bytes) {
+  shared_ptr<TMemoryBuffer> wire(new TMemoryBuffer());
+  THeaderTransport out(wire);
+  THeaderTransport in(wire);
+  out.setTransform(THeaderTransport::ZLIB_TRANSFORM);
+  out.setMinCompressBytes(1000);
+
+  // small frames go out as they are
+  const std::string small = makePayload(999);
+  BOOST_CHECK_GT(send(out, *wire, small), 999u);
+  BOOST_CHECK(receive(in, small.size()) == small);
+
+  const std::string large = makePayload(1000);
+  BOOST_CHECK_LT(send(out, *wire, large), 1000u);
+  BOOST_CHECK(receive(in, large.size()) == large);
+}
+
+BOOST_AUTO_TEST_CASE(test_mirror_transforms) {
+  shared_ptr<TMemoryBuffer> requests(new TMemoryBuffer());
+  shared_ptr<TMemoryBuffer> responses(new TMemoryBuffer());
+  THeaderTransport client(responses, requests);
+  THeaderTransport server(requests, responses);
+  client.setTransform(THeaderTransport::ZLIB_TRANSFORM);
+
+  const std::string payload = makePayload(10000);
+  send(client, *requests, payload);
+  BOOST_CHECK(receive(server, payload.size()) == payload);
+
+  // the server answers the way it was asked
+  BOOST_CHECK_LT(send(server, *responses, payload), payload.size() / 4);
+  BOOST_CHECK(receive(client, payload.size()) == payload);
+}
+
+#ifdef HAVE_ZSTD
+BOOST_AUTO_TEST_CASE(test_zstd_dictionary) {
+  shared_ptr<const THeaderZstdDictionary> dictionary(
+      new THeaderZstdDictionary(makePayload(4096)));
+  shared_ptr<TMemoryBuffer> wire(new TMemoryBuffer());
+  THeaderTransport out(wire);
+  THeaderTransport in(wire);
+  out.setTransform(THeaderTransport::ZSTD_TRANSFORM);
+  out.setZstdDictionary(dictionary);
+  in.setZstdDictionary(dictionary);
+
+  const std::string payload = makePayload(300);
+  send(out, *wire, payload);
+  BOOST_CHECK(receive(in, payload.size()) == payload);
+}
+#else
+BOOST_AUTO_TEST_CASE(test_zstd_dictionary) {
+  BOOST_CHECK_THROW(THeaderZstdDictionary("dictionary"), TTransportException);
+}
+#endif
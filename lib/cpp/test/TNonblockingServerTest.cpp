@@ -19,10 +19,17 @@
 
 #define BOOST_TEST_MODULE TNonblockingServerTest
 #include <boost/test/unit_test.hpp>
+#include <atomic>
+#include <chrono>
 #include <memory>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include "thrift/concurrency/Monitor.h"
 #include "thrift/concurrency/Thread.h"
+#include "thrift/concurrency/ThreadManager.h"
 #include "thrift/server/TNonblockingServer.h"
 #include "thrift/transport/TNonblockingServerSocket.h"
 
@@ -37,6 +44,7 @@ using apache::thrift::concurrency::ThreadFactory;
 using apache::thrift::concurrency::Runnable;
 using apache::thrift::concurrency::Thread;
 using apache::thrift::concurrency::ThreadFactory;
+using apache::thrift::concurrency::ThreadManager;
 using apache::thrift::server::TServerEventHandler;
 using std::make_shared;
 using std::shared_ptr;
@@ -48,15 +56,29 @@ struct Handler : public test::ParentServiceIf {
   void getStrings(std::vector<std::string>& _return) override { _return = strings_; }
   std::vector<std::string> strings_;
 
+  // keeps a worker thread busy for length milliseconds
+  void getDataWait(std::string&, const int32_t length) override {
+    std::this_thread::sleep_for(std::chrono::milliseconds(length));
+  }
+
   // dummy overrides not used in this test
   int32_t incrementGeneration() override { return 0; }
   int32_t getGeneration() override { return 0; }
-  void getDataWait(std::string&, const int32_t) override {}
   void onewayWait() override {}
   void exceptionWait(const std::string&) override {}
   void unexpectedExceptionWait(const std::string&) override {}
 };
 
+// A server socket whose siblings cannot bind
+struct FailingSiblingSocket : public transport::TNonblockingServerSocket {
+  FailingSiblingSocket(int port) : transport::TNonblockingServerSocket(port) {}
+
+protected:
+  shared_ptr<transport::TNonblockingServerSocket> newSibling(const std::string&, int port) override {
+    return make_shared<transport::TNonblockingServerSocket>("256.256.256.256", port);
+  }
+};
+
 class Fixture {
 private:
   struct ListenEventHandler : public TServerEventHandler {
@@ -80,10 +102,20 @@ private:
     shared_ptr<server::TNonblockingServer> server;
     shared_ptr<ListenEventHandler> listenHandler;
     shared_ptr<transport::TNonblockingServerSocket> socket;
+    size_t numIOThreads;
+    bool reusePort;
+    shared_ptr<ThreadManager> threadManager;
+    bool shedOnQueueDelay;
+    bool failingSiblings;
+    transport::TNonblockingServerSocket::socket_func_t acceptCallback;
     Mutex mutex_;
 
     Runner() {
       port = 0;
+      numIOThreads = 1;
+      reusePort = false;
+      shedOnQueueDelay = false;
+      failingSiblings = false;
       listenHandler.reset(new ListenEventHandler(&mutex_));
     }
 
@@ -103,9 +135,21 @@ private:
   private:
     void startServer(int retry_count) {
       try {
-        socket.reset(new transport::TNonblockingServerSocket(port));
+        if (failingSiblings) {
+          socket.reset(new FailingSiblingSocket(port));
+        } else {
+          socket.reset(new transport::TNonblockingServerSocket(port));
+        }
+        socket->setReusePort(reusePort);
+        socket->setAcceptCallback(acceptCallback);
         server.reset(new server::TNonblockingServer(processor, socket));
         server->setServerEventHandler(listenHandler);
+        server->setNumIOThreads(numIOThreads);
+        server->setUseReusePortAccept(reusePort);
+        if (threadManager) {
+          server->setThreadManager(threadManager);
+        }
+        server->setShedOnQueueDelay(shedOnQueueDelay);
         if (userEventBase) {
           server->registerEvents(userEventBase.get());
         }
@@ -126,7 +170,10 @@ private:
   };
 
 protected:
-  Fixture() : processor(new test::ParentServiceProcessor(make_shared<Handler>())) {}
+  Fixture()
+    : processor(new test::ParentServiceProcessor(make_shared<Handler>())),
+      shedOnQueueDelay(false),
+      failingSiblings(false) {}
 
   ~Fixture() {
     if (server) {
@@ -141,11 +188,20 @@ protected:
     userEventBase_.reset(user_event_base, EventDeleter());
   }
 
-  int startServer(int port) {
+  int startServer(int port, size_t numIOThreads = 1, bool reusePort = false) {
     shared_ptr<Runner> runner(new Runner);
     runner->port = port;
     runner->processor = processor;
     runner->userEventBase = userEventBase_;
+    runner->numIOThreads = numIOThreads;
+    runner->reusePort = reusePort;
+    runner->threadManager = threadManager;
+    runner->shedOnQueueDelay = shedOnQueueDelay;
+    runner->failingSiblings = failingSiblings;
+    runner->acceptCallback = [this](THRIFT_SOCKET) {
+      Guard g(acceptMutex);
+      acceptThreads.insert(std::this_thread::get_id());
+    };
 
     shared_ptr<ThreadFactory> threadFactory(
         new ThreadFactory(false));
@@ -168,13 +224,31 @@ protected:
     return strings.size() == 1 && !(strings[0].compare("foo"));
   }
 
+  bool canCall(int serverPort) {
+    shared_ptr<transport::TSocket> socket(new transport::TSocket("localhost", serverPort));
+    socket->open();
+    test::ParentServiceClient client(make_shared<protocol::TBinaryProtocol>(
+        make_shared<transport::TFramedTransport>(socket)));
+    return client.getGeneration() == 0;
+  }
+
+  size_t numAcceptThreads() {
+    Guard g(acceptMutex);
+    return acceptThreads.size();
+  }
+
 private:
   shared_ptr<event_base> userEventBase_;
   shared_ptr<test::ParentServiceProcessor> processor;
 protected:
   shared_ptr<server::TNonblockingServer> server;
+  shared_ptr<ThreadManager> threadManager;
+  bool shedOnQueueDelay;
+  bool failingSiblings;
 private:
   shared_ptr<apache::thrift::concurrency::Thread> thread;
+  Mutex acceptMutex;
+  std::set<std::thread::id> acceptThreads;
 
 };
 
@@ -212,4 +286,131 @@ BOOST_FIXTURE_TEST_CASE(provide_event_base, Fixture) {
 #endif
 }
 
+BOOST_FIXTURE_TEST_CASE(hand_off_connections, Fixture) {
+  startServer(0, 4);
+  int port = server->getListenPort();
+
+  // thread #0 accepts and queues most connections to the other IO threads
+  for (int i = 0; i < 16; i++) {
+    BOOST_CHECK(canCall(port));
+  }
+  BOOST_CHECK_EQUAL(numAcceptThreads(), 1u);
+
+  server->stop();
+}
+
+BOOST_FIXTURE_TEST_CASE(reuse_connections_per_io_thread, Fixture) {
+  startServer(0, 4);
+  int port = server->getListenPort();
+  const std::string large(64 * 1024, 'x');
+
+  for (int round = 0; round < 10; round++) {
+    // one connection for every IO thread, each growing its read buffer
+    std::vector<shared_ptr<test::ParentServiceClient> > clients;
+    for (int i = 0; i < 4; i++) {
+      shared_ptr<transport::TSocket> socket(new transport::TSocket("localhost", port));
+      socket->open();
+      clients.push_back(make_shared<test::ParentServiceClient>(
+          make_shared<protocol::TBinaryProtocol>(make_shared<transport::TFramedTransport>(socket))));
+    }
+    for (auto& client : clients) {
+      client->addString(large);
+      BOOST_CHECK_EQUAL(client->getGeneration(), 0);
+    }
+    clients.clear();
+
+    for (int wait = 0; wait < 500 && server->getNumIdleConnections() < 4; wait++) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    BOOST_REQUIRE_EQUAL(server->getNumIdleConnections(), 4u);
+  }
+  // every IO thread reused the connection object it got back
+  BOOST_CHECK_EQUAL(server->getNumConnections(), 4u);
+  BOOST_CHECK_EQUAL(server->getNumActiveConnections(), 0u);
+
+  server->stop();
+}
+
+BOOST_FIXTURE_TEST_CASE(shed_on_queue_delay, Fixture) {
+  threadManager = ThreadManager::newSimpleThreadManager(1);
+  threadManager->threadFactory(make_shared<ThreadFactory>());
+  threadManager->start();
+  shedOnQueueDelay = true;
+  startServer(0);
+  int port = server->getListenPort();
+  server::TCodel& codel = server->getQueueDelayController();
+  codel.setTargetDelay(std::chrono::milliseconds(1));
+  codel.setInterval(std::chrono::milliseconds(10));
+
+  // more clients than the single worker thread keeps up with
+  std::atomic<int> answered(0);
+  std::atomic<int> shed(0);
+  std::atomic<int> failed(0);
+  std::vector<std::thread> clients;
+  for (int i = 0; i < 8; i++) {
+    clients.emplace_back([&]() {
+      try {
+        shared_ptr<transport::TSocket> socket(new transport::TSocket("localhost", port));
+        socket->open();
+        test::ParentServiceClient client(make_shared<protocol::TBinaryProtocol>(
+            make_shared<transport::TFramedTransport>(socket)));
+        for (int j = 0; j < 10; j++) {
+          try {
+            std::string data;
+            client.getDataWait(data, 5);
+            ++answered;
+          } catch (const TApplicationException& x) {
+            ++(x.getType() == TApplicationException::LOADSHEDDING ? shed : failed);
+          }
+        }
+      } catch (const TException&) {
+        ++failed;
+      }
+    });
+  }
+  for (auto& client : clients) {
+    client.join();
+  }
+
+  // the requests that waited longest failed fast, the rest got answered
+  BOOST_CHECK_EQUAL(failed, 0);
+  BOOST_CHECK_EQUAL(answered + shed, 80);
+  BOOST_CHECK_GT(shed, 0);
+  BOOST_CHECK_GT(answered, 0);
+  BOOST_CHECK_EQUAL(codel.getNumShed(), static_cast<uint64_t>(shed));
+
+  server->stop();
+}
+
+#ifdef SO_REUSEPORT
+BOOST_FIXTURE_TEST_CASE(reuse_port_accept, Fixture) {
+  startServer(0, 4, true);
+  int port = server->getListenPort();
+  BOOST_REQUIRE_NE(port, 0);
+
+  for (int i = 0; i < 64; i++) {
+    BOOST_CHECK(canCall(port));
+  }
+  // the kernel spreads the connections over the IO threads' sockets
+  BOOST_CHECK_GT(numAcceptThreads(), 1u);
+
+  server->stop();
+}
+
+BOOST_FIXTURE_TEST_CASE(reuse_port_accept_falls_back, Fixture) {
+  failingSiblings = true;
+  startServer(0, 4, true);
+  int port = server->getListenPort();
+  BOOST_REQUIRE_NE(port, 0);
+
+  // the siblings failed to listen, so IO thread #0 accepts for all of them
+  for (int i = 0; i < 16; i++) {
+    BOOST_CHECK(canCall(port));
+  }
+  BOOST_CHECK_EQUAL(numAcceptThreads(), 1u);
+
+  server->stop();
+}
+#endif
+
 BOOST_AUTO_TEST_SUITE_END()
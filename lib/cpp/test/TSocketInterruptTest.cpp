@@ -69,6 +69,30 @@ BOOST_AUTO_TEST_CASE(test_interruptable_child_read) {
   sock1.close();
 }
 
+BOOST_AUTO_TEST_CASE(test_interruptable_child_read_pending) {
+  TServerSocket sock1("localhost", 0);
+  sock1.listen();
+  int port = sock1.getPort();
+  TSocket clientSock("localhost", port);
+  clientSock.open();
+  std::shared_ptr<TTransport> accepted = sock1.accept();
+  clientSock.write((const uint8_t*)"abcd", 4);
+  clientSock.flush();
+  boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+  sock1.interruptChildren();
+  // data that already arrived is still read, the interrupt takes effect
+  // once the child would block
+  boost::thread readThread(std::bind(readerWorker, accepted, 4));
+  BOOST_CHECK_MESSAGE(readThread.try_join_for(boost::chrono::milliseconds(200)),
+                      "child read of pending data did not complete");
+  boost::thread interruptedThread(std::bind(readerWorkerMustThrow, accepted));
+  BOOST_CHECK_MESSAGE(interruptedThread.try_join_for(boost::chrono::milliseconds(200)),
+                      "server socket interruptChildren did not interrupt child read");
+  clientSock.close();
+  accepted->close();
+  sock1.close();
+}
+
 BOOST_AUTO_TEST_CASE(test_non_interruptable_child_read) {
   TServerSocket sock1("localhost", 0);
   sock1.setInterruptableChildren(false); // returns to pre-THRIFT-2441 behavior
@@ -0,0 +1,242 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#define BOOST_TEST_MODULE TUringServerTest
+#include <boost/test/unit_test.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "thrift/concurrency/Monitor.h"
+#include "thrift/concurrency/Thread.h"
+#include "thrift/concurrency/ThreadFactory.h"
+#include "thrift/concurrency/ThreadManager.h"
+#include "thrift/protocol/TBinaryProtocol.h"
+#include "thrift/server/TUringServer.h"
+#include "thrift/transport/TBufferTransports.h"
+#include "thrift/transport/TServerSocket.h"
+#include "thrift/transport/TSocket.h"
+
+#include "gen-cpp/ParentService.h"
+
+using apache::thrift::concurrency::Guard;
+using apache::thrift::concurrency::Monitor;
+using apache::thrift::concurrency::Mutex;
+using apache::thrift::concurrency::Runnable;
+using apache::thrift::concurrency::Thread;
+using apache::thrift::concurrency::ThreadFactory;
+using apache::thrift::concurrency::ThreadManager;
+using apache::thrift::server::TServerEventHandler;
+using apache::thrift::server::TUringServer;
+using std::make_shared;
+using std::shared_ptr;
+
+using namespace apache::thrift;
+
+struct Handler : public test::ParentServiceIf {
+  Handler() : generation_(0) {}
+
+  void addString(const std::string& s) override {
+    Guard g(mutex_);
+    strings_.push_back(s);
+  }
+  void getStrings(std::vector<std::string>& _return) override {
+    Guard g(mutex_);
+    _return = strings_;
+  }
+  int32_t incrementGeneration() override {
+    Guard g(mutex_);
+    return ++generation_;
+  }
+  int32_t getGeneration() override {
+    Guard g(mutex_);
+    return generation_;
+  }
+
+  // dummy overrides not used in this test
+  void getDataWait(std::string&, const int32_t) override {}
+  void onewayWait() override {}
+  void exceptionWait(const std::string&) override {}
+  void unexpectedExceptionWait(const std::string&) override {}
+
+  Mutex mutex_;
+  std::vector<std::string> strings_;
+  int32_t generation_;
+};
+
+class Fixture {
+private:
+  struct ListenEventHandler : public TServerEventHandler {
+    ListenEventHandler() : ready_(false) {}
+
+    void preServe() override {
+      Guard g(monitor_.mutex());
+      ready_ = true;
+      monitor_.notify();
+    }
+
+    void waitForReady() {
+      Guard g(monitor_.mutex());
+      while (!ready_) {
+        monitor_.wait();
+      }
+    }
+
+    Monitor monitor_;
+    bool ready_;
+  };
+
+  struct Runner : public Runnable {
+    explicit Runner(shared_ptr<TUringServer> server) : server_(server) {}
+    void run() override { server_->serve(); }
+    shared_ptr<TUringServer> server_;
+  };
+
+protected:
+  Fixture() : handler(new Handler) {}
+
+  ~Fixture() {
+    if (server) {
+      server->stop();
+    }
+    if (thread) {
+      thread->join();
+    }
+  }
+
+  void startServer(size_t numIOThreads = 1, shared_ptr<ThreadManager> threadManager = nullptr) {
+    shared_ptr<transport::TServerSocket> socket(new transport::TServerSocket("localhost", 0));
+    server.reset(new TUringServer(make_shared<test::ParentServiceProcessor>(handler),
+                                  socket,
+                                  threadManager));
+    server->setNumIOThreads(numIOThreads);
+    // small buffers, so that requests span several of them
+    server->setBufferSize(512);
+    shared_ptr<ListenEventHandler> listenHandler(new ListenEventHandler);
+    server->setServerEventHandler(listenHandler);
+
+    thread = ThreadFactory(false).newThread(make_shared<Runner>(server));
+    thread->start();
+    listenHandler->waitForReady();
+  }
+
+  shared_ptr<test::ParentServiceClient> connect() {
+    shared_ptr<transport::TSocket> socket(
+        new transport::TSocket("localhost", server->getListenPort()));
+    socket->open();
+    return make_shared<test::ParentServiceClient>(make_shared<protocol::TBinaryProtocol>(
+        make_shared<transport::TFramedTransport>(socket)));
+  }
+
+  shared_ptr<Handler> handler;
+  shared_ptr<TUringServer> server;
+  shared_ptr<Thread> thread;
+};
+
+#define SKIP_IF_UNSUPPORTED()                                                                      \
+  if (!TUringServer::isSupported()) {                                                              \
+    BOOST_TEST_MESSAGE("io_uring is not supported, skipping");                                     \
+    return;                                                                                        \
+  }
+
+BOOST_AUTO_TEST_SUITE(TUringServerTest)
+
+BOOST_FIXTURE_TEST_CASE(test_communicate, Fixture) {
+  SKIP_IF_UNSUPPORTED();
+  startServer();
+  shared_ptr<test::ParentServiceClient> client = connect();
+  client->addString("foo");
+  std::vector<std::string> strings;
+  client->getStrings(strings);
+  BOOST_REQUIRE_EQUAL(strings.size(), 1u);
+  BOOST_CHECK_EQUAL(strings[0], "foo");
+
+  // a oneway call has no response, the next call still gets its own
+  client->onewayWait();
+  BOOST_CHECK_EQUAL(client->incrementGeneration(), 1);
+}
+
+BOOST_FIXTURE_TEST_CASE(test_large_request, Fixture) {
+  SKIP_IF_UNSUPPORTED();
+  startServer();
+  shared_ptr<test::ParentServiceClient> client = connect();
+  const std::string large(300 * 1000, 'x');
+  client->addString(large);
+  client->addString("small");
+  std::vector<std::string> strings;
+  client->getStrings(strings);
+  BOOST_REQUIRE_EQUAL(strings.size(), 2u);
+  BOOST_CHECK(strings[0] == large);
+}
+
+BOOST_FIXTURE_TEST_CASE(test_pipelined_requests, Fixture) {
+  SKIP_IF_UNSUPPORTED();
+  startServer();
+  shared_ptr<test::ParentServiceClient> client = connect();
+
+  // requests sent together are answered in order
+  for (int i = 0; i < 20; i++) {
+    client->send_incrementGeneration();
+  }
+  for (int i = 1; i <= 20; i++) {
+    BOOST_CHECK_EQUAL(client->recv_incrementGeneration(), i);
+  }
+}
+
+BOOST_FIXTURE_TEST_CASE(test_thread_manager, Fixture) {
+  SKIP_IF_UNSUPPORTED();
+  shared_ptr<ThreadManager> threadManager = ThreadManager::newSimpleThreadManager(4);
+  threadManager->threadFactory(make_shared<ThreadFactory>());
+  threadManager->start();
+  startServer(4, threadManager);
+
+  std::vector<shared_ptr<test::ParentServiceClient> > clients;
+  for (int i = 0; i < 16; i++) {
+    clients.push_back(connect());
+  }
+  for (int round = 0; round < 10; round++) {
+    for (auto& client : clients) {
+      client->send_incrementGeneration();
+    }
+    for (auto& client : clients) {
+      client->recv_incrementGeneration();
+    }
+  }
+  BOOST_CHECK_EQUAL(clients[0]->getGeneration(), 160);
+
+  server->stop();
+  thread->join();
+  thread.reset();
+  threadManager->stop();
+}
+
+BOOST_FIXTURE_TEST_CASE(test_stop_with_connected_clients, Fixture) {
+  SKIP_IF_UNSUPPORTED();
+  startServer(2);
+  shared_ptr<test::ParentServiceClient> client = connect();
+  BOOST_CHECK_EQUAL(client->getGeneration(), 0);
+
+  // idle connections do not keep the server from stopping
+  server->stop();
+  thread->join();
+  thread.reset();
+  BOOST_CHECK_THROW(client->getGeneration(), transport::TTransportException);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,271 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <memory>
+#include <string>
+
+#include <zlib.h>
+
+#include <thrift/transport/TBufferTransports.h>
+#include <thrift/transport/TVirtualTransport.h>
+#include <thrift/transport/TWebSocketDeflate.h>
+#include <thrift/transport/TWebSocketServer.h>
+
+#define BOOST_TEST_MODULE TWebSocketServerTest
+#include <boost/test/unit_test.hpp>
+
+using apache::thrift::transport::TMemoryBuffer;
+using apache::thrift::transport::TTransport;
+using apache::thrift::transport::TTransportException;
+using apache::thrift::transport::TVirtualTransport;
+using apache::thrift::transport::TWebSocketDeflate;
+using apache::thrift::transport::TWebSocketServer;
+using apache::thrift::transport::unmaskWebSocketPayload;
+using std::shared_ptr;
+using std::string;
+
+/**
+ * Hands the server what the client sent and collects the responses.
+ */
+class TLoopbackTransport : public TVirtualTransport<TLoopbackTransport> {
+public:
+  TLoopbackTransport() : in(new TMemoryBuffer()), out(new TMemoryBuffer()) {}
+
+  bool isOpen() const override { return true; }
+
+  uint32_t read(uint8_t* buf, uint32_t len) { return in->read(buf, len); }
+
+  void write(const uint8_t* buf, uint32_t len) { out->write(buf, len); }
+
+  shared_ptr<TMemoryBuffer> in;
+  shared_ptr<TMemoryBuffer> out;
+};
+
+static const uint8_t MASK[] = {0x37, 0xfa, 0x21, 0x3d};
+
+static string handshake(const string& extensions = "") {
+  string request = "GET / HTTP/1.1\r\n"
+                   "Host: localhost\r\n"
+                   "Upgrade: websocket\r\n"
+                   "Connection: Upgrade\r\n"
+                   "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+                   "Sec-WebSocket-Version: 13\r\n";
+  if (!extensions.empty()) {
+    request += "Sec-WebSocket-Extensions: " + extensions + "\r\n";
+  }
+  return request + "\r\n";
+}
+
+static string frame(uint8_t opcode, const string& payload, bool fin = true, bool rsv1 = false) {
+  string result;
+  result += static_cast<char>((fin ? 0x80 : 0) | (rsv1 ? 0x40 : 0) | opcode);
+  if (payload.size() < 126) {
+    result += static_cast<char>(0x80 | payload.size());
+  } else if (payload.size() < 65536) {
+    result += static_cast<char>(0x80 | 126);
+    result += static_cast<char>(payload.size() >> 8);
+    result += static_cast<char>(payload.size() & 0xff);
+  } else {
+    result += static_cast<char>(0x80 | 127);
+    for (int shift = 56; shift >= 0; shift -= 8) {
+      result += static_cast<char>((static_cast<uint64_t>(payload.size()) >> shift) & 0xff);
+    }
+  }
+  result.append(reinterpret_cast<const char*>(MASK), 4);
+  for (size_t i = 0; i < payload.size(); i++) {
+    result += static_cast<char>(payload[i] ^ MASK[i % 4]);
+  }
+  return result;
+}
+
+static string makePayload(size_t size) {
+  string payload(size, '\0');
+  for (size_t i = 0; i < size; i++) {
+    payload[i] = "websocket payload "[i % 18];
+  }
+  return payload;
+}
+
+static void send(TLoopbackTransport& client, const string& data) {
+  client.in->write(reinterpret_cast<const uint8_t*>(data.data()), static_cast<uint32_t>(data.size()));
+}
+
+// Goes through TTransport as the protocols do
+static string receive(TTransport& server, size_t size) {
+  string result(size, '\0');
+  uint32_t got = server.readAll(reinterpret_cast<uint8_t*>(&result[0]), static_cast<uint32_t>(size));
+  BOOST_CHECK_EQUAL(got, size);
+  return result;
+}
+
+// Splits the server output into the handshake response and the frames
+static string response(TLoopbackTransport& client, string* frames = nullptr) {
+  string all = client.out->getBufferAsString();
+  size_t end = all.find("\r\n\r\n") + 4;
+  if (frames != nullptr) {
+    *frames = all.substr(end);
+  }
+  return all.substr(0, end);
+}
+
+static string compressRaw(const string& data) {
+  z_stream stream = z_stream();
+  BOOST_REQUIRE_EQUAL(deflateInit2(&stream, 9, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY), Z_OK);
+  string result(deflateBound(&stream, static_cast<uLong>(data.size())) + 16, '\0');
+  stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+  stream.avail_in = static_cast<uInt>(data.size());
+  stream.next_out = reinterpret_cast<Bytef*>(&result[0]);
+  stream.avail_out = static_cast<uInt>(result.size());
+  BOOST_REQUIRE_EQUAL(deflate(&stream, Z_SYNC_FLUSH), Z_OK);
+  result.resize(result.size() - stream.avail_out);
+  deflateEnd(&stream);
+  BOOST_REQUIRE_EQUAL(result.substr(result.size() - 4), string("\x00\x00\xff\xff", 4));
+  return result.substr(0, result.size() - 4);
+}
+
+static string decompressRaw(string data) {
+  data.append("\x00\x00\xff\xff", 4);
+  z_stream stream = z_stream();
+  BOOST_REQUIRE_EQUAL(inflateInit2(&stream, -MAX_WBITS), Z_OK);
+  string result(1 << 20, '\0');
+  stream.next_in = reinterpret_cast<Bytef*>(&data[0]);
+  stream.avail_in = static_cast<uInt>(data.size());
+  stream.next_out = reinterpret_cast<Bytef*>(&result[0]);
+  stream.avail_out = static_cast<uInt>(result.size());
+  BOOST_REQUIRE_EQUAL(inflate(&stream, Z_SYNC_FLUSH), Z_OK);
+  result.resize(result.size() - stream.avail_out);
+  inflateEnd(&stream);
+  return result;
+}
+
+BOOST_AUTO_TEST_CASE(test_unmask) {
+  const string payload = makePayload(100);
+  for (size_t offset = 0; offset < 8; offset++) {
+    for (size_t size = 0; size + offset <= payload.size(); size++) {
+      string masked = frame(0x2, payload.substr(0, size)).substr(size < 126 ? 6 : 8);
+      string buffer = string(offset, 'x') + masked;
+      unmaskWebSocketPayload(reinterpret_cast<uint8_t*>(&buffer[offset]),
+                             static_cast<uint32_t>(size), MASK);
+      BOOST_CHECK(buffer.substr(offset) == payload.substr(0, size));
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_fragmented_message) {
+  shared_ptr<TLoopbackTransport> client(new TLoopbackTransport());
+  TWebSocketServer<true> server(client);
+
+  const string first = makePayload(300);
+  const string second = makePayload(70000);
+  send(*client, handshake() + frame(0x2, first.substr(0, 100), false)
+                + frame(0x9, "ping", true) + frame(0x0, first.substr(100, 150), false)
+                + frame(0x0, "", false) + frame(0x0, first.substr(250), true));
+  BOOST_CHECK(receive(server, first.size()) == first);
+
+  string frames;
+  BOOST_CHECK(response(*client, &frames).find("101 Switching Protocols") != string::npos);
+  BOOST_CHECK(frames == string("\x8a\x04ping", 6));
+
+  // A long frame, read in pieces
+  send(*client, frame(0x2, second) + frame(0x2, "tail"));
+  BOOST_CHECK(receive(server, 10) == second.substr(0, 10));
+  BOOST_CHECK(receive(server, second.size() - 10) == second.substr(10));
+  BOOST_CHECK(receive(server, 4) == "tail");
+}
+
+BOOST_AUTO_TEST_CASE(test_short_reads_end_at_message) {
+  shared_ptr<TLoopbackTransport> client(new TLoopbackTransport());
+  TWebSocketServer<true> server(client);
+  TTransport& transport = server;
+  uint8_t buf[512];
+
+  // Buffered transports ask for more than a request; the next message only
+  // comes after the response, so the read must not wait for it
+  send(*client, handshake() + frame(0x2, "request"));
+  BOOST_CHECK_EQUAL(transport.readAll(buf, sizeof(buf)), 7u);
+  BOOST_CHECK(string(reinterpret_cast<char*>(buf), 7) == "request");
+
+  send(*client, frame(0x2, "first") + frame(0x2, "second"));
+  BOOST_CHECK_EQUAL(transport.readAll(buf, 3), 3u);
+  BOOST_CHECK_EQUAL(transport.readAll(buf, sizeof(buf)), 2u);
+  BOOST_CHECK_EQUAL(transport.readAll(buf, sizeof(buf)), 6u);
+  BOOST_CHECK(string(reinterpret_cast<char*>(buf), 6) == "second");
+}
+
+BOOST_AUTO_TEST_CASE(test_protocol_errors) {
+  shared_ptr<TLoopbackTransport> client(new TLoopbackTransport());
+  TWebSocketServer<true> server(client);
+  send(*client, handshake() + frame(0x0, "orphan"));
+  uint8_t buf[6];
+  BOOST_CHECK_THROW(static_cast<TTransport&>(server).readAll(buf, 6), TTransportException);
+
+  // Compressed frames need a negotiated extension
+  client.reset(new TLoopbackTransport());
+  TWebSocketServer<true> plain(client);
+  send(*client, handshake("permessage-deflate") + frame(0x2, compressRaw("data"), true, true));
+  BOOST_CHECK_THROW(static_cast<TTransport&>(plain).readAll(buf, 4), TTransportException);
+  BOOST_CHECK(response(*client).find("Sec-WebSocket-Extensions") == string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(test_deflate_negotiation) {
+  TWebSocketDeflate extension;
+  BOOST_CHECK_EQUAL(extension.negotiate("x-webkit-deflate-frame"), "");
+  BOOST_CHECK_EQUAL(extension.negotiate("permessage-deflate; client_max_window_bits"),
+                    "permessage-deflate");
+  BOOST_CHECK_EQUAL(extension.negotiate("permessage-deflate; unknown_parameter"), "");
+  BOOST_CHECK_EQUAL(extension.negotiate("permessage-deflate; server_max_window_bits=8"), "");
+  BOOST_CHECK_EQUAL(extension.negotiate("permessage-deflate; client_max_window_bits=16"), "");
+  BOOST_CHECK_EQUAL(extension.negotiate("permessage-deflate; server_no_context_takeover;"
+                                      " server_no_context_takeover"),
+                    "");
+  // The first acceptable offer wins
+  BOOST_CHECK_EQUAL(extension.negotiate("permessage-deflate; server_max_window_bits=8, "
+                                      "permessage-deflate; server_max_window_bits=\"10\"; "
+                                      "server_no_context_takeover, permessage-deflate"),
+                    "permessage-deflate; server_no_context_takeover; server_max_window_bits=10");
+}
+
+BOOST_AUTO_TEST_CASE(test_deflate_messages) {
+  shared_ptr<TLoopbackTransport> client(new TLoopbackTransport());
+  TWebSocketServer<true> server(client, nullptr, std::make_shared<TWebSocketDeflate>());
+
+  const string request = makePayload(20000);
+  const string compressed = compressRaw(request);
+  send(*client, handshake("permessage-deflate; client_max_window_bits")
+                + frame(0x2, compressed.substr(0, 10), false, true)
+                + frame(0x0, compressed.substr(10), true) + frame(0x2, "plain"));
+  BOOST_CHECK(receive(server, request.size()) == request);
+  BOOST_CHECK(receive(server, 5) == "plain");
+  BOOST_CHECK(response(*client).find("Sec-WebSocket-Extensions: permessage-deflate\r\n")
+              != string::npos);
+
+  // The answer goes out compressed, RSV1 set
+  const string reply = makePayload(50000);
+  server.write(reinterpret_cast<const uint8_t*>(reply.data()), static_cast<uint32_t>(reply.size()));
+  server.flush();
+  string frames;
+  response(*client, &frames);
+  BOOST_REQUIRE_GT(frames.size(), 4u);
+  BOOST_CHECK_EQUAL(static_cast<uint8_t>(frames[0]), 0xc2);
+  BOOST_REQUIRE_EQUAL(static_cast<uint8_t>(frames[1]), 126);
+  size_t length = (static_cast<uint8_t>(frames[2]) << 8) | static_cast<uint8_t>(frames[3]);
+  BOOST_REQUIRE_EQUAL(frames.size(), 4 + length);
+  BOOST_CHECK_LT(length, reply.size() / 4);
+  BOOST_CHECK(decompressRaw(frames.substr(4)) == reply);
+}
@@ -0,0 +1,198 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <thrift/TConfiguration.h>
+#include <thrift/TSlice.h>
+#include <thrift/TToString.h>
+#include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/protocol/TCompactProtocol.h>
+#include <thrift/transport/PlatformSocket.h>
+#include <thrift/transport/TBufferTransports.h>
+#include <thrift/transport/TSocket.h>
+
+#include "gen-cpp/ZeroCopyTest_types.h"
+
+#define BOOST_TEST_MODULE ZeroCopyTest
+#include <boost/test/unit_test.hpp>
+
+using apache::thrift::TConfiguration;
+using apache::thrift::TSlice;
+using apache::thrift::protocol::TBinaryProtocol;
+using apache::thrift::protocol::TCompactProtocol;
+using apache::thrift::protocol::TProtocol;
+using apache::thrift::transport::TFramedTransport;
+using apache::thrift::transport::TIoVec;
+using apache::thrift::transport::TMemoryBuffer;
+using apache::thrift::transport::TSocket;
+using apache::thrift::transport::TTransportException;
+using std::shared_ptr;
+using namespace zerocopytest;
+
+static std::string makePayload(size_t size, char seed) {
+  std::string payload(size, '\0');
+  for (size_t i = 0; i < size; i++) {
+    payload[i] = static_cast<char>(seed + i * 7);
+  }
+  return payload;
+}
+
+static Envelope makeEnvelope(size_t payloadSize) {
+  Envelope env;
+  env.route = "upstream";
+  env.payload = makePayload(payloadSize, 'a');
+  env.chunks.push_back(makePayload(10, 'b'));
+  env.chunks.push_back(makePayload(TFramedTransport::MIN_DEFERRED_SLICE_SIZE, 'c'));
+  env.index[TSlice("key")] = 7;
+  return env;
+}
+
+BOOST_AUTO_TEST_CASE(test_slice) {
+  TSlice empty;
+  BOOST_CHECK(empty.empty());
+  BOOST_CHECK_EQUAL(empty.str(), "");
+
+  TSlice abc("abc");
+  TSlice abd(std::string("abd"));
+  BOOST_CHECK_EQUAL(abc.size(), 3u);
+  BOOST_CHECK(abc == TSlice("abc"));
+  BOOST_CHECK(abc != abd);
+  BOOST_CHECK(abc < abd);
+  BOOST_CHECK(TSlice("ab") < abc);
+  BOOST_CHECK(empty < abc);
+  BOOST_CHECK_EQUAL(apache::thrift::to_string(abc), "abc");
+}
+
+BOOST_AUTO_TEST_CASE(test_framed_read_slice) {
+  shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  shared_ptr<TFramedTransport> out(new TFramedTransport(buffer));
+  const std::string first = makePayload(1000, 'x');
+  out->write(reinterpret_cast<const uint8_t*>(first.data()), 1000);
+  out->flush();
+  const std::string second = makePayload(1000, 'y');
+  out->write(reinterpret_cast<const uint8_t*>(second.data()), 1000);
+  out->flush();
+
+  shared_ptr<TFramedTransport> in(new TFramedTransport(buffer));
+  TSlice a = in->readSlice(400);
+  TSlice b = in->readSlice(600);
+  // both point into the same frame buffer
+  BOOST_CHECK(b.data() == a.data() + 400);
+  BOOST_CHECK_EQUAL(a.str() + b.str(), first);
+
+  // the next frame must not overwrite the buffer the slices still share
+  TSlice c = in->readSlice(1000);
+  BOOST_CHECK(c.data() != a.data());
+  BOOST_CHECK_EQUAL(c.str(), second);
+  BOOST_CHECK_EQUAL(a.str() + b.str(), first);
+}
+
+template <typename TProto>
+void testRoundTrip(size_t payloadSize) {
+  const Envelope env = makeEnvelope(payloadSize);
+
+  Envelope partial;
+  partial.route = env.route;
+  partial.payload = env.payload;
+
+  // a plain memory buffer copies every slice it is given
+  shared_ptr<TMemoryBuffer> expected(new TMemoryBuffer());
+  shared_ptr<TProtocol> expectedProt(new TProto(expected));
+  uint32_t written = partial.write(expectedProt.get());
+
+  // deferred slices must put exactly the same bytes on the wire
+  shared_ptr<TMemoryBuffer> actual(new TMemoryBuffer());
+  shared_ptr<TFramedTransport> framed(new TFramedTransport(actual));
+  shared_ptr<TProtocol> prot(new TProto(framed));
+  BOOST_CHECK_EQUAL(partial.write(prot.get()), written);
+  BOOST_CHECK_EQUAL(framed->writeEnd(), written + 4);
+  framed->flush();
+  const std::string frame = actual->getBufferAsString();
+  BOOST_CHECK_EQUAL(frame.size(), written + 4);
+  BOOST_CHECK(frame.substr(4) == expected->getBufferAsString());
+
+  env.write(prot.get());
+  framed->flush();
+
+  Envelope result;
+  result.read(prot.get());
+  BOOST_CHECK(result == partial);
+  result.read(prot.get());
+  BOOST_CHECK(result == env);
+  BOOST_CHECK(result.__isset.trailer);
+  BOOST_CHECK_EQUAL(result.trailer.str(), "end");
+}
+
+BOOST_AUTO_TEST_CASE(test_binary_round_trip) {
+  testRoundTrip<TBinaryProtocol>(100);
+  testRoundTrip<TBinaryProtocol>(1024 * 1024);
+}
+
+BOOST_AUTO_TEST_CASE(test_compact_round_trip) {
+  testRoundTrip<TCompactProtocol>(100);
+  testRoundTrip<TCompactProtocol>(1024 * 1024);
+}
+
+BOOST_AUTO_TEST_CASE(test_compact_slice_message_size) {
+  TMemoryBuffer out;
+  TCompactProtocol(shared_ptr<TMemoryBuffer>(&out, [](TMemoryBuffer*) {}))
+      .writeBinary(makePayload(200, 'x'));
+  const std::string data = out.getBufferAsString();
+
+  // slices count against the message size limit like copied strings do
+  shared_ptr<TMemoryBuffer> in(
+      new TMemoryBuffer(reinterpret_cast<uint8_t*>(const_cast<char*>(data.data())),
+                        static_cast<uint32_t>(data.size()), TMemoryBuffer::OBSERVE,
+                        std::make_shared<TConfiguration>(100)));
+  TSlice slice;
+  BOOST_CHECK_THROW(TCompactProtocol(in).readBinarySlice(slice), TTransportException);
+}
+
+BOOST_AUTO_TEST_CASE(test_socket_writev) {
+  THRIFT_SOCKET sockets[2];
+  BOOST_REQUIRE_EQUAL(THRIFT_SOCKETPAIR(PF_UNIX, SOCK_STREAM, 0, sockets), 0);
+  TSocket in(sockets[0]);
+  TSocket out(sockets[1]);
+
+  // more buffers than one sendmsg() takes, more bytes than the socket
+  // buffers hold, and some empty buffers
+  std::vector<std::string> chunks;
+  for (size_t i = 0; i < 200; i++) {
+    chunks.push_back(makePayload(i % 3 == 0 ? 0 : i * 97, static_cast<char>('a' + i % 26)));
+  }
+  std::vector<TIoVec> iov;
+  std::string expected;
+  for (const std::string& chunk : chunks) {
+    iov.push_back({reinterpret_cast<const uint8_t*>(chunk.data()),
+                   static_cast<uint32_t>(chunk.size())});
+    expected += chunk;
+  }
+
+  std::string received(expected.size(), '\0');
+  std::thread reader([&] {
+    in.readAll(reinterpret_cast<uint8_t*>(&received[0]), static_cast<uint32_t>(received.size()));
+  });
+  out.writev(iov.data(), static_cast<uint32_t>(iov.size()));
+  reader.join();
+  BOOST_CHECK(received == expected);
+}
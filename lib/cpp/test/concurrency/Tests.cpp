@@ -152,6 +152,55 @@ int main(int argc, char** argv) {
     }
   }
 
+  if (runAll || args[0].compare("timing-wheel-timer-manager") == 0) {
+
+    std::cout << "TimingWheelTimerManager tests..." << '\n';
+
+    std::cout << "\t\tTimingWheelTimerManager test00" << '\n';
+
+    TimerManagerTests timerManagerTests;
+
+    if (!timerManagerTests.test00<TimingWheelTimerManager>()) {
+      std::cerr << "\t\tTimingWheelTimerManager tests FAILED" << '\n';
+      return 1;
+    }
+
+    std::cout << "\t\tTimingWheelTimerManager test01" << '\n';
+
+    if (!timerManagerTests.test01<TimingWheelTimerManager>()) {
+      std::cerr << "\t\tTimingWheelTimerManager tests FAILED" << '\n';
+      return 1;
+    }
+
+    std::cout << "\t\tTimingWheelTimerManager test02" << '\n';
+
+    if (!timerManagerTests.test02<TimingWheelTimerManager>()) {
+      std::cerr << "\t\tTimingWheelTimerManager tests FAILED" << '\n';
+      return 1;
+    }
+
+    std::cout << "\t\tTimingWheelTimerManager test03" << '\n';
+
+    if (!timerManagerTests.test03<TimingWheelTimerManager>()) {
+      std::cerr << "\t\tTimingWheelTimerManager tests FAILED" << '\n';
+      return 1;
+    }
+
+    std::cout << "\t\tTimingWheelTimerManager test04" << '\n';
+
+    if (!timerManagerTests.test04<TimingWheelTimerManager>()) {
+      std::cerr << "\t\tTimingWheelTimerManager tests FAILED" << '\n';
+      return 1;
+    }
+
+    std::cout << "\t\tTimingWheelTimerManager test05" << '\n';
+
+    if (!timerManagerTests.test05<TimingWheelTimerManager>(10000 * WEIGHT)) {
+      std::cerr << "\t\tTimingWheelTimerManager tests FAILED" << '\n';
+      return 1;
+    }
+  }
+
   if (runAll || args[0].compare("thread-manager") == 0) {
 
     std::cout << "ThreadManager tests..." << '\n';
@@ -188,6 +237,50 @@ int main(int argc, char** argv) {
     }
   }
 
+  if (runAll || args[0].compare("work-stealing-thread-manager") == 0) {
+
+    std::cout << "WorkStealingThreadManager tests..." << '\n';
+
+    {
+      size_t workerCount = 10 * WEIGHT;
+      size_t taskCount = 500 * WEIGHT;
+      int64_t delay = 10LL;
+
+      ThreadManagerTests threadManagerTests(&ThreadManager::newWorkStealingThreadManager);
+
+      std::cout << "\t\tWorkStealingThreadManager api test:" << '\n';
+
+      if (!threadManagerTests.apiTest()) {
+        std::cerr << "\t\tWorkStealingThreadManager apiTest FAILED" << '\n';
+        return 1;
+      }
+
+      std::cout << "\t\tWorkStealingThreadManager load test: worker count: " << workerCount
+                << " task count: " << taskCount << " delay: " << delay << '\n';
+
+      if (!threadManagerTests.loadTest(taskCount, delay, workerCount)) {
+        std::cerr << "\t\tWorkStealingThreadManager loadTest FAILED" << '\n';
+        return 1;
+      }
+
+      std::cout << "\t\tWorkStealingThreadManager block test: worker count: " << workerCount
+                << " delay: " << delay << '\n';
+
+      if (!threadManagerTests.blockTest(delay, workerCount)) {
+        std::cerr << "\t\tWorkStealingThreadManager blockTest FAILED" << '\n';
+        return 1;
+      }
+
+      std::cout << "\t\tWorkStealingThreadManager spawn test: worker count: " << workerCount
+                << " task count: " << taskCount << '\n';
+
+      if (!threadManagerTests.spawnTest(taskCount, workerCount)) {
+        std::cerr << "\t\tWorkStealingThreadManager spawnTest FAILED" << '\n';
+        return 1;
+      }
+    }
+  }
+
   if (runAll || args[0].compare("thread-manager-benchmark") == 0) {
 
     std::cout << "ThreadManager benchmark tests..." << '\n';
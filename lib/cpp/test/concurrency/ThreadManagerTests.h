@@ -24,6 +24,7 @@
 
 #include <assert.h>
 #include <deque>
+#include <functional>
 #include <set>
 #include <iostream>
 #include <stdint.h>
@@ -57,6 +58,11 @@ static void sleep_(int64_t millisec) {
 class ThreadManagerTests {
 
 public:
+  typedef std::function<shared_ptr<ThreadManager>(size_t, size_t)> Factory;
+
+  ThreadManagerTests(Factory factory = &ThreadManager::newSimpleThreadManager)
+    : _factory(factory) {}
+
   class Task : public Runnable {
 
   public:
@@ -105,7 +111,7 @@ public:
 
     size_t activeCount = count;
 
-    shared_ptr<ThreadManager> threadManager = ThreadManager::newSimpleThreadManager(workerCount);
+    shared_ptr<ThreadManager> threadManager = _factory(workerCount, 0);
 
     shared_ptr<ThreadFactory> threadFactory
         = shared_ptr<ThreadFactory>(new ThreadFactory(false));
@@ -251,7 +257,7 @@ public:
       size_t activeCounts[] = {workerCount, pendingTaskMaxCount, 1};
 
       shared_ptr<ThreadManager> threadManager
-          = ThreadManager::newSimpleThreadManager(workerCount, pendingTaskMaxCount);
+          = _factory(workerCount, pendingTaskMaxCount);
 
       shared_ptr<ThreadFactory> threadFactory
           = shared_ptr<ThreadFactory>(new ThreadFactory());
@@ -400,7 +406,7 @@ public:
 
   bool apiTestWithThreadFactory(shared_ptr<ThreadFactory> threadFactory)
   {
-    shared_ptr<ThreadManager> threadManager = ThreadManager::newSimpleThreadManager(1);
+    shared_ptr<ThreadManager> threadManager = _factory(1, 0);
     threadManager->threadFactory(threadFactory);
 
     std::cout << "\t\t\t\tstarting.. " << '\n';
@@ -629,6 +635,70 @@ public:
     threadManager.reset();
     return true;
   }
+
+  class SpawnTask : public Runnable {
+
+  public:
+    SpawnTask(ThreadManager& threadManager, Monitor& monitor, size_t& count, std::set<Thread::id_t>& threads, size_t children)
+      : _threadManager(threadManager), _monitor(monitor), _count(count), _threads(threads), _children(children) {}
+
+    void run() override {
+      for (size_t ix = 0; ix < _children; ix++) {
+        _threadManager.add(shared_ptr<SpawnTask>(new SpawnTask(_threadManager, _monitor, _count, _threads, 0)));
+      }
+
+      sleep_(1);
+
+      Synchronized s(_monitor);
+      _threads.insert(Thread::get_current());
+      if (--_count == 0) {
+        _monitor.notify();
+      }
+    }
+
+    ThreadManager& _threadManager;
+    Monitor& _monitor;
+    size_t& _count;
+    std::set<Thread::id_t>& _threads;
+    size_t _children;
+  };
+
+  /**
+   * Spawn test.  A single task adds count tasks from inside a worker thread.
+   * Verify that they all run, and that the other workers pick them up rather
+   * than leaving them all to the worker that added them.
+   */
+  bool spawnTest(size_t count = 100, size_t workerCount = 4) {
+
+    Monitor monitor;
+    size_t activeCount = count + 1;
+    std::set<Thread::id_t> threads;
+
+    shared_ptr<ThreadManager> threadManager = _factory(workerCount, 0);
+    threadManager->threadFactory(shared_ptr<ThreadFactory>(new ThreadFactory(false)));
+    threadManager->start();
+
+    threadManager->add(shared_ptr<SpawnTask>(new SpawnTask(*threadManager, monitor, activeCount, threads, count)));
+
+    {
+      Synchronized s(monitor);
+      while (activeCount > 0) {
+        monitor.wait();
+      }
+    }
+
+    threadManager->stop();
+
+    bool success = threads.size() > 1 && threadManager->totalTaskCount() == 0;
+
+    std::cout << "\t\t\t" << (success ? "Success" : "Failure") << "! " << count
+              << " tasks ran on " << threads.size() << " threads" << '\n';
+
+    return success;
+  }
+
+private:
+  Factory _factory;
 };
 
 }
@@ -22,9 +22,11 @@
 #include <thrift/concurrency/Monitor.h>
 
 #include <assert.h>
+#include <atomic>
 #include <chrono>
 #include <thread>
 #include <iostream>
+#include <vector>
 
 namespace apache {
 namespace thrift {
@@ -74,13 +76,14 @@ public:
    * properly clean up itself and the remaining orphaned timeout task when the
    * manager goes out of scope and its destructor is called.
    */
+  template <typename Manager = TimerManager>
   bool test00(uint64_t timeout = 1000LL) {
 
     shared_ptr<TimerManagerTests::Task> orphanTask
         = shared_ptr<TimerManagerTests::Task>(new TimerManagerTests::Task(_monitor, 10 * timeout));
 
     {
-      TimerManager timerManager;
+      Manager timerManager;
       timerManager.threadFactory(shared_ptr<ThreadFactory>(new ThreadFactory()));
       timerManager.start();
       if (timerManager.state() != TimerManager::STARTED) {
@@ -124,8 +127,9 @@ public:
    * verifies that the timer manager properly clean up itself and the remaining orphaned timeout
    * task when the manager goes out of scope and its destructor is called.
    */
+  template <typename Manager = TimerManager>
   bool test01(uint64_t timeout = 1000LL) {
-    TimerManager timerManager;
+    Manager timerManager;
     timerManager.threadFactory(shared_ptr<ThreadFactory>(new ThreadFactory()));
     timerManager.start();
     assert(timerManager.state() == TimerManager::STARTED);
@@ -157,8 +161,9 @@ public:
    * clean up itself and the remaining orphaned timeout task when the manager goes out of scope
    * and its destructor is called.
    */
+  template <typename Manager = TimerManager>
   bool test02(uint64_t timeout = 1000LL) {
-    TimerManager timerManager;
+    Manager timerManager;
     timerManager.threadFactory(shared_ptr<ThreadFactory>(new ThreadFactory()));
     timerManager.start();
     assert(timerManager.state() == TimerManager::STARTED);
@@ -190,8 +195,9 @@ public:
    * verifies that the timer manager properly clean up itself and the remaining orphaned timeout
    * task when the manager goes out of scope and its destructor is called.
    */
+  template <typename Manager = TimerManager>
   bool test03(uint64_t timeout = 1000LL) {
-    TimerManager timerManager;
+    Manager timerManager;
     timerManager.threadFactory(shared_ptr<ThreadFactory>(new ThreadFactory()));
     timerManager.start();
     assert(timerManager.state() == TimerManager::STARTED);
@@ -227,8 +233,9 @@ public:
   /**
    * This test creates one task, and tries to remove it after it has expired.
    */
+  template <typename Manager = TimerManager>
   bool test04(uint64_t timeout = 1000LL) {
-    TimerManager timerManager;
+    Manager timerManager;
     timerManager.threadFactory(shared_ptr<ThreadFactory>(new ThreadFactory()));
     timerManager.start();
     assert(timerManager.state() == TimerManager::STARTED);
@@ -262,6 +269,70 @@ public:
     return true;
   }
 
+  class CountTask : public Runnable {
+  public:
+    CountTask(std::atomic<size_t>& fired, std::chrono::steady_clock::time_point due)
+      : _fired(fired), _due(due), _early(false), _done(false) {}
+
+    void run() override {
+      _early = std::chrono::steady_clock::now() < _due;
+      _done = true;
+      _fired++;
+    }
+
+    std::atomic<size_t>& _fired;
+    std::chrono::steady_clock::time_point _due;
+    bool _early;
+    bool _done;
+  };
+
+  /**
+   * This test adds count timers spread over timeout milliseconds (after a head
+   * start of timeout / 2 milliseconds to add and cancel them), cancels every
+   * other one, and verifies that exactly the others fire and that none of them
+   * fires early.
+   */
+  template <typename Manager = TimerManager>
+  bool test05(size_t count = 100000, uint64_t timeout = 1000LL) {
+    Manager timerManager;
+    timerManager.threadFactory(shared_ptr<ThreadFactory>(new ThreadFactory()));
+    timerManager.start();
+    assert(timerManager.state() == TimerManager::STARTED);
+
+    std::atomic<size_t> fired(0);
+    std::vector<shared_ptr<CountTask> > tasks;
+    std::vector<TimerManager::Timer> timers;
+    tasks.reserve(count);
+    timers.reserve(count);
+
+    for (size_t ix = 0; ix < count; ix++) {
+      auto due = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout / 2 + (ix * 7919) % timeout);
+      tasks.push_back(shared_ptr<CountTask>(new CountTask(fired, due)));
+      timers.push_back(timerManager.add(tasks.back(), due));
+    }
+
+    for (size_t ix = 0; ix < count; ix += 2) {
+      timerManager.remove(timers[ix]);
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout * 5);
+    while (fired < count / 2 && std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    size_t early = 0;
+    size_t wrong = 0;
+    for (size_t ix = 0; ix < count; ix++) {
+      early += tasks[ix]->_early ? 1 : 0;
+      wrong += (tasks[ix]->_done == (ix % 2 == 0)) ? 1 : 0;
+    }
+
+    bool success = fired == count / 2 && early == 0 && wrong == 0 && timerManager.taskCount() == 0;
+    std::cout << "\t\t\t" << (success ? "Success" : "Failure") << "! " << fired << " of "
+              << count << " timers fired, " << early << " early, " << wrong << " wrong" << '\n';
+    return success;
+  }
+
   friend class TestTask;
 
   Monitor _monitor;